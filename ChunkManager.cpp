@@ -0,0 +1,242 @@
+// ChunkManager.cpp
+#include "ChunkManager.h"
+#include "MeshBuilder.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+ChunkManager::ChunkManager(const ChunkManagerParams& p, const HeightSampler& sampleHeights,
+                           ThreadPool& threadPool)
+    : params(p), sampler(sampleHeights), pool(threadPool),
+      ready((size_t)std::max(p.maxInFlight, 1)) {
+    if (params.terrain.chunkSize <= 0) params.terrain.chunkSize = 32;
+    if (params.maxInFlight < 1) params.maxInFlight = 1;
+    const float step = params.terrain.worldSize / params.terrain.resolution;
+    chunkWorldSize = step * params.terrain.chunkSize;
+    gridOrigin     = -params.terrain.worldSize * 0.5f;
+
+    // Offsets inside the view circle, sorted by distance so the chunks
+    // under the camera are requested first
+    struct Offset { int d2, dx, dz; };
+    std::vector<Offset> ring;
+    const int r = params.viewRadius;
+    for (int dx = -r; dx <= r; ++dx)
+        for (int dz = -r; dz <= r; ++dz)
+            if (dx * dx + dz * dz <= r * r) ring.push_back({dx * dx + dz * dz, dx, dz});
+    std::stable_sort(ring.begin(), ring.end(),
+                     [](const Offset& a, const Offset& b) { return a.d2 < b.d2; });
+    for (const Offset& o : ring) {
+        ringOffsets.push_back(o.dx);
+        ringOffsets.push_back(o.dz);
+    }
+}
+
+ChunkManager::~ChunkManager() {
+    // Queued jobs still run but skip the work; wait for all of them
+    // because they reference this object
+    cancelled.store(true);
+    while (running.load(std::memory_order_acquire) > 0) std::this_thread::yield();
+    // Ring slices nobody will copy out
+    releaseUploads(arrivedList);
+    ChunkPtr chunk;
+    while (ready.pop(chunk))
+        if (uploadRing && chunk->upload.bytes) uploadRing->release(chunk->upload);
+}
+
+void ChunkManager::releaseUploads(const std::vector<ChunkPtr>& chunks) {
+    if (!uploadRing) return;
+    for (const ChunkPtr& c : chunks)
+        if (c->upload.bytes) uploadRing->release(c->upload);
+}
+
+// Where a chunk's packed arrays go: a ring slice when there is one with
+// room, the chunk's own vectors otherwise
+static void reserveChunkArrays(StreamedChunk& out, size_t vertexCount, size_t indexCount,
+                               UploadRing* ring, PackedVoxelVertex*& vertices, uint16_t*& indices) {
+    out.vertexCount = vertexCount;
+    out.indexCount  = indexCount;
+    out.upload = UploadSlice();
+    if (ring && vertexCount &&
+        ring->allocate(out.vertexBytes() + out.indexBytes(), sizeof(PackedVoxelVertex), out.upload)) {
+        out.vertices.clear();
+        out.indices.clear();
+        vertices = reinterpret_cast<PackedVoxelVertex*>(out.upload.data);
+        indices  = reinterpret_cast<uint16_t*>(out.upload.data + out.vertexBytes());
+        return;
+    }
+    out.vertices.resize(vertexCount);
+    out.indices.resize(indexCount);
+    vertices = out.vertices.data();
+    indices  = out.indices.data();
+}
+
+// A chunk that draws nothing, for meshes the packed format cannot hold
+static bool failChunk(StreamedChunk& out, UploadRing* ring) {
+    if (ring && out.upload.bytes) ring->release(out.upload);
+    out.upload = UploadSlice();
+    out.vertices.clear();
+    out.indices.clear();
+    out.ranges.clear();
+    out.vertexCount = out.indexCount = 0;
+    out.ok = false;
+    return false;
+}
+
+bool ChunkManager::buildChunk(const ChunkManagerParams& params, const HeightSampler& sampleHeights,
+                              int cx, int cz, StreamedChunk& out, UploadRing* ring) {
+    const VoxelTerrainParams& t = params.terrain;
+    const int   C    = t.chunkSize;
+    const float step = t.worldSize / t.resolution;
+    const float half = t.worldSize * 0.5f;
+
+    // One extra column on every side so faces against the neighbors are
+    // culled exactly as in the static world. The grid and all meshing
+    // scratch are kept per thread, so a warm worker builds a chunk with
+    // no allocations besides the result's own arrays.
+    static thread_local VoxelColumns cols;
+    sampleVoxelColumns(t, sampleHeights, -half + (cx * C - 1) * step,
+                       -half + (cz * C - 1) * step, C + 2, cols);
+    MeshArenaScope scope(threadMeshArena());
+    MeshBuilder mesh(threadMeshArena(), VOXEL_VERTEX_FLOATS);
+    meshVoxelRegion(cols, 1, 1, C, C, t.greedyMerge, mesh, out.bounds, out.stats);
+
+    out.cx     = cx;
+    out.cz     = cz;
+    out.ok     = true;
+    // Same origin expression as the static world's columnMinX(), so shared
+    // chunk edges decode to identical positions
+    out.frame  = QuantFrame{{-half + cx * C * step, out.bounds.min.y, -half + cz * C * step},
+                            {cols.step, cols.voxelHeight, cols.step}};
+    const size_t vertexCount = mesh.vertexCount(), indexCount = mesh.indexCount();
+    if (vertexCount <= 65536) {
+        // One range: vertices keep their order and indices just narrow
+        PackedVoxelVertex* vertices;
+        uint16_t* indices;
+        reserveChunkArrays(out, vertexCount, indexCount, ring, vertices, indices);
+        if (!encodeVoxelVertices(mesh.vertices(), vertexCount, out.frame,
+                                 cols.palette, 3, vertices))
+            return failChunk(out, ring);
+        for (size_t i = 0; i < indexCount; ++i) indices[i] = (uint16_t)mesh.indices()[i];
+        out.ranges.clear();
+        if (indexCount) {
+            IndexRange16 range;
+            range.indexCount  = indexCount;
+            range.vertexCount = (unsigned)vertexCount;
+            out.ranges.push_back(range);
+        }
+        return true;
+    }
+    // Half-size indices; vertices follow the split's first-use order
+    std::vector<PackedVoxelVertex> packed(vertexCount);
+    if (!encodeVoxelVertices(mesh.vertices(), vertexCount, out.frame,
+                             cols.palette, 3, packed.data()))
+        return failChunk(out, ring);
+    std::vector<uint16_t> split;
+    std::vector<unsigned> remap;
+    splitIndices16(mesh.indices(), indexCount, vertexCount, split, remap, out.ranges);
+    PackedVoxelVertex* vertices;
+    uint16_t* indices;
+    reserveChunkArrays(out, remap.size(), split.size(), ring, vertices, indices);
+    remapVertices(packed.data(), remap, vertices);
+    std::copy(split.begin(), split.end(), indices);
+    return true;
+}
+
+const StreamedChunk* ChunkManager::find(ChunkKey key) const {
+    auto it = cache.find(key);
+    return it != cache.end() ? it->second.chunk.get() : nullptr;
+}
+
+void ChunkManager::request(int cx, int cz) {
+    ChunkKey key = chunkKey(cx, cz);
+    pending.insert(key);
+    ++counters.inFlight;
+    running.fetch_add(1);
+    auto job = [this, cx, cz] {
+        if (!cancelled.load(std::memory_order_relaxed)) {
+            std::shared_ptr<StreamedChunk> chunk = std::make_shared<StreamedChunk>();
+            buildChunk(params, sampler, cx, cz, *chunk, uploadRing);
+            // Never full: at most maxInFlight results wait in the queue
+            while (!ready.push(chunk)) std::this_thread::yield();
+        }
+        running.fetch_sub(1, std::memory_order_release);
+    };
+    // Without worker threads nothing would pick the job up
+    if (pool.concurrency() > 1) pool.submit(job);
+    else job();
+}
+
+void ChunkManager::drainReady() {
+    ChunkPtr chunk;
+    while (ready.pop(chunk)) {
+        ChunkKey key = chunkKey(chunk->cx, chunk->cz);
+        pending.erase(key);
+        --counters.inFlight;
+        ++counters.generated;
+        if (!chunk->ok) ++counters.failed;
+        lruOrder.push_front(key);
+        cache[key] = Entry{chunk, lruOrder.begin(), frame};
+        counters.residentBytes += chunk->bytes();
+        arrivedList.push_back(chunk);
+    }
+}
+
+void ChunkManager::evictOverBudget() {
+    counters.overBudget = false;
+    while (counters.residentBytes > params.memoryBudget && !lruOrder.empty()) {
+        ChunkKey key = lruOrder.back();
+        auto it = cache.find(key);
+        if (it->second.lastSeen == frame) {
+            // Everything left is in view
+            counters.overBudget = true;
+            break;
+        }
+        counters.residentBytes -= it->second.chunk->bytes();
+        lruOrder.pop_back();
+        cache.erase(it);
+        evictedList.push_back(key);
+        ++counters.evicted;
+    }
+    counters.resident = cache.size();
+}
+
+void ChunkManager::update(float camX, float camZ) {
+    ++frame;
+    // The renderer has issued its copies of the last arrivals
+    releaseUploads(arrivedList);
+    arrivedList.clear();
+    evictedList.clear();
+    visibleList.clear();
+
+    drainReady();
+
+    const int ccx = (int)std::floor((camX - gridOrigin) / chunkWorldSize);
+    const int ccz = (int)std::floor((camZ - gridOrigin) / chunkWorldSize);
+    for (size_t i = 0; i < ringOffsets.size(); i += 2) {
+        int cx = ccx + ringOffsets[i], cz = ccz + ringOffsets[i + 1];
+        ChunkKey key = chunkKey(cx, cz);
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            Entry& e = it->second;
+            e.lastSeen = frame;
+            lruOrder.splice(lruOrder.begin(), lruOrder, e.lru);
+            visibleList.push_back(key);
+        } else if (!pending.count(key) && counters.inFlight < params.maxInFlight) {
+            request(cx, cz);
+        }
+    }
+
+    // Jobs run inline on a pool without workers, so pick those up now
+    drainReady();
+    evictOverBudget();
+}
+
+void ChunkManager::flush() {
+    while (counters.inFlight > 0) {
+        drainReady();
+        if (counters.inFlight > 0) std::this_thread::yield();
+    }
+    counters.resident = cache.size();
+}
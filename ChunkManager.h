@@ -0,0 +1,143 @@
+// ChunkManager.h
+// Streams TerraVoxel chunks around the camera: missing chunks are built on
+// the thread pool, handed back through a lock-free queue, and kept in an
+// LRU cache until the memory budget forces them out.
+#pragma once
+
+#include "IndexOptimizer.h"
+#include "LockFreeQueue.h"
+#include "UploadRing.h"
+#include "VoxelTerrain.h"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct ChunkManagerParams {
+    VoxelTerrainParams terrain;           // chunkSize, resolution and worldSize set the grid
+    int    viewRadius   = 8;              // chunks kept visible around the camera
+    size_t memoryBudget = 64u << 20;      // bytes of packed chunk data kept resident
+    int    maxInFlight  = 16;             // generation jobs queued or running at once
+};
+
+// Chunk coordinates packed into one key
+typedef uint64_t ChunkKey;
+inline ChunkKey chunkKey(int cx, int cz) {
+    return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cz;
+}
+
+// One streamed chunk, packed and ready to upload. Chunk (0, 0) covers the
+// same columns as chunk (0, 0) of the static world; the grid is unbounded.
+//
+// With an upload ring the worker packs straight into a ring slice instead
+// of the two vectors: vertices at the start of `upload`, indices right
+// after them. The slice is only valid until the next update().
+struct StreamedChunk {
+    int cx = 0, cz = 0;
+    std::vector<PackedVoxelVertex> vertices;
+    std::vector<uint16_t>          indices;   // 16-bit, relative to each range's baseVertex
+    std::vector<IndexRange16>      ranges;    // one unless the chunk passes 65536 vertices
+    size_t      vertexCount = 0, indexCount = 0;
+    UploadSlice upload;                       // bytes == 0 when the vectors hold the data
+    QuantFrame frame = {};
+    AABB       bounds = {};
+    MeshStats  stats;
+    bool       ok = true;                     // false: the mesh did not pack; the chunk is empty
+
+    size_t vertexBytes() const { return vertexCount * sizeof(PackedVoxelVertex); }
+    size_t indexBytes() const  { return indexCount * sizeof(uint16_t); }
+    // Ring slices count like the vectors so the budget means the same
+    size_t bytes() const {
+        return sizeof(*this) + vertices.size() * sizeof(PackedVoxelVertex) +
+               indices.size() * sizeof(uint16_t) + ranges.size() * sizeof(IndexRange16) +
+               upload.bytes;
+    }
+};
+
+struct ChunkStreamStats {
+    size_t resident = 0, residentBytes = 0;
+    int    inFlight = 0;
+    size_t generated = 0, evicted = 0;
+    size_t failed = 0;           // generated chunks whose mesh did not pack
+    bool   overBudget = false;   // visible chunks alone exceed the budget
+};
+
+class ChunkManager {
+public:
+    // The sampler is called from pool threads and must be thread-safe.
+    // Both it and the pool must outlive the manager.
+    ChunkManager(const ChunkManagerParams& params, const HeightSampler& sampleHeights,
+                 ThreadPool& pool);
+    ~ChunkManager();
+
+    ChunkManager(const ChunkManager&) = delete;
+    ChunkManager& operator=(const ChunkManager&) = delete;
+
+    // Render thread, once per frame: collects finished chunks, requests
+    // missing ones nearest first, and evicts least recently seen chunks
+    // while over budget. Chunks visible this frame are never evicted.
+    void update(float camX, float camZ);
+
+    // Results of the last update(): chunks that became resident (upload
+    // them), chunks dropped from the cache (free their buffers), and the
+    // resident chunks inside the view radius, nearest first.
+    const std::vector<std::shared_ptr<const StreamedChunk>>& arrived() const { return arrivedList; }
+    const std::vector<ChunkKey>& evicted() const { return evictedList; }
+    const std::vector<ChunkKey>& visible() const { return visibleList; }
+
+    const StreamedChunk* find(ChunkKey key) const;
+    const ChunkStreamStats& stats() const { return counters; }
+
+    // Blocks until every in-flight chunk has arrived (tests, warm-up)
+    void flush();
+
+    // Workers pack new chunks into the ring when it has room, and fall
+    // back to the vectors when it does not. The slices of arrived() chunks
+    // are released by the next update(), so copy them out before that.
+    // Set before the first update(); the ring must outlive the manager.
+    void setUploadRing(UploadRing* ring) { uploadRing = ring; }
+
+    // Builds one chunk on the calling thread. Returns false, and leaves
+    // the chunk empty, if the mesh does not fit the packed format.
+    static bool buildChunk(const ChunkManagerParams& params, const HeightSampler& sampleHeights,
+                           int cx, int cz, StreamedChunk& out, UploadRing* ring = nullptr);
+
+private:
+    typedef std::shared_ptr<const StreamedChunk> ChunkPtr;
+
+    struct Entry {
+        ChunkPtr chunk;
+        std::list<ChunkKey>::iterator lru;
+        unsigned lastSeen;
+    };
+
+    void request(int cx, int cz);
+    void releaseUploads(const std::vector<ChunkPtr>& chunks);
+    void drainReady();
+    void evictOverBudget();
+
+    ChunkManagerParams params;
+    HeightSampler      sampler;
+    ThreadPool&        pool;
+    UploadRing*        uploadRing = nullptr;
+    float chunkWorldSize, gridOrigin;
+
+    std::vector<int> ringOffsets;          // (dx, dz) pairs inside viewRadius, nearest first
+
+    std::unordered_map<ChunkKey, Entry> cache;
+    std::list<ChunkKey>                 lruOrder;   // front = most recently seen
+    std::unordered_set<ChunkKey>        pending;
+    unsigned frame = 0;
+
+    LockFreeQueue<ChunkPtr> ready;
+    std::atomic<int>  running{0};          // jobs that have not pushed their result yet
+    std::atomic<bool> cancelled{false};
+
+    std::vector<ChunkPtr> arrivedList;
+    std::vector<ChunkKey> evictedList, visibleList;
+    ChunkStreamStats counters;
+};
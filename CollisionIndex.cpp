@@ -0,0 +1,450 @@
+// CollisionIndex.cpp
+#include "CollisionIndex.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#if defined(__SSE2__)
+#define COLLISION_SSE
+#include <emmintrin.h>
+#endif
+
+static const int SAH_BINS = 16;
+// Past this depth splits fall back to the median, which bounds the tree
+// depth (and the traversal stacks) for any input
+static const int SAH_MAX_DEPTH = 32;
+static const int STACK_SIZE    = 96;
+
+static inline int padToGroup(int n) { return (n + 3) & ~3; }
+
+static inline AABB emptyBox() {
+    return AABB{{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+}
+
+static inline AABB merge(const AABB& a, const AABB& b) {
+    return AABB{vmin(a.min, b.min), vmax(a.max, b.max)};
+}
+
+static inline float halfArea(const AABB& b) {
+    Vec3 e = b.max - b.min;
+    if (e.x < 0 || e.y < 0 || e.z < 0) return 0.0f;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+static inline float axisOf(const Vec3& v, int a) { return a == 0 ? v.x : (a == 1 ? v.y : v.z); }
+
+static inline bool sameBox(const AABB& a, const AABB& b) {
+    return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z &&
+           a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+}
+
+// Ray state shared by node and leaf tests. Axes with dir == 0 have no
+// slab interval; the origin must lie strictly inside the box on them.
+struct RayQuery {
+    float o[3], inv[3];
+    bool  flat[3];
+    Vec3  expand;      // half size of the swept box, zero for rays
+};
+
+static void setupRay(RayQuery& q, Vec3 origin, Vec3 dir, Vec3 expand) {
+    const float d[3] = {dir.x, dir.y, dir.z};
+    q.o[0] = origin.x; q.o[1] = origin.y; q.o[2] = origin.z;
+    for (int a = 0; a < 3; ++a) {
+        q.flat[a] = d[a] == 0.0f;
+        q.inv[a]  = q.flat[a] ? 0.0f : 1.0f / d[a];
+    }
+    q.expand = expand;
+}
+
+// Node bounds only need a conservative test
+static bool rayHitsNode(const RayQuery& q, const AABB& b, float best, float& tNear) {
+    const float lo[3] = {b.min.x - q.expand.x, b.min.y - q.expand.y, b.min.z - q.expand.z};
+    const float hi[3] = {b.max.x + q.expand.x, b.max.y + q.expand.y, b.max.z + q.expand.z};
+    float tn = 0.0f, tf = best;
+    for (int a = 0; a < 3; ++a) {
+        if (q.flat[a]) {
+            if (q.o[a] < lo[a] || q.o[a] > hi[a]) return false;
+            continue;
+        }
+        float t0 = (lo[a] - q.o[a]) * q.inv[a];
+        float t1 = (hi[a] - q.o[a]) * q.inv[a];
+        tn = std::max(tn, std::min(t0, t1));
+        tf = std::min(tf, std::max(t0, t1));
+    }
+    tNear = tn;
+    return tn <= tf;
+}
+
+void CollisionIndex::setSlot(int slot, const AABB& b) {
+    minX[slot] = b.min.x; minY[slot] = b.min.y; minZ[slot] = b.min.z;
+    maxX[slot] = b.max.x; maxY[slot] = b.max.y; maxZ[slot] = b.max.z;
+}
+
+AABB CollisionIndex::box(int id) const {
+    int s = boxSlot[id];
+    return AABB{{minX[s], minY[s], minZ[s]}, {maxX[s], maxY[s], maxZ[s]}};
+}
+
+AABB CollisionIndex::slotBounds(int first, int count) const {
+    AABB b = emptyBox();
+    for (int s = first; s < first + count; ++s)
+        b = merge(b, AABB{{minX[s], minY[s], minZ[s]}, {maxX[s], maxY[s], maxZ[s]}});
+    return b;
+}
+
+int CollisionIndex::buildNode(int node, int begin, int end, std::vector<int>& ids,
+                              const std::vector<AABB>& boxes, const std::vector<Vec3>& centers,
+                              int depth) {
+    maxDepth = std::max(maxDepth, depth);
+    const int count = end - begin;
+    AABB bounds = emptyBox(), centerBounds = emptyBox();
+    for (int i = begin; i < end; ++i) {
+        bounds = merge(bounds, boxes[ids[i]]);
+        centerBounds = merge(centerBounds, AABB{centers[ids[i]], centers[ids[i]]});
+    }
+    nodes[node].bounds = bounds;
+
+    if (count <= COLLISION_LEAF_BOXES) {
+        // Leaf: copy its boxes into the next SoA slots
+        int first = (int)slotBox.size();
+        int padded = padToGroup(count);
+        for (std::vector<float>* v : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ})
+            v->resize(first + padded);
+        slotBox.resize(first + padded, -1);
+        slotLeaf.resize(first + padded, node);
+        for (int s = 0; s < padded; ++s) {
+            if (s < count) {
+                int id = ids[begin + s];
+                setSlot(first + s, boxes[id]);
+                slotBox[first + s] = id;
+                boxSlot[id] = first + s;
+            } else {
+                setSlot(first + s, emptyBox());
+            }
+        }
+        nodes[node].first = first;
+        nodes[node].count = count;
+        nodes[node].child = -1;
+        return node;
+    }
+
+    // Binned SAH over box centers on all three axes
+    int   bestAxis = -1, bestSplit = 0;
+    float bestCost = FLT_MAX;
+    for (int a = 0; a < 3; ++a) {
+        float lo = axisOf(centerBounds.min, a), hi = axisOf(centerBounds.max, a);
+        if (!(hi > lo)) continue;
+        float binScale = SAH_BINS / (hi - lo);
+        int  binCount[SAH_BINS] = {};
+        AABB binBounds[SAH_BINS];
+        for (AABB& b : binBounds) b = emptyBox();
+        for (int i = begin; i < end; ++i) {
+            int b = std::min(SAH_BINS - 1, (int)((axisOf(centers[ids[i]], a) - lo) * binScale));
+            ++binCount[b];
+            binBounds[b] = merge(binBounds[b], boxes[ids[i]]);
+        }
+        // Right-to-left prefix areas, then sweep left to right
+        float rightArea[SAH_BINS];
+        int   rightCount[SAH_BINS];
+        AABB  acc = emptyBox();
+        int   n = 0;
+        for (int b = SAH_BINS - 1; b > 0; --b) {
+            acc = merge(acc, binBounds[b]);
+            n  += binCount[b];
+            rightArea[b]  = halfArea(acc);
+            rightCount[b] = n;
+        }
+        acc = emptyBox();
+        n = 0;
+        for (int b = 0; b < SAH_BINS - 1; ++b) {
+            acc = merge(acc, binBounds[b]);
+            n  += binCount[b];
+            if (n == 0 || rightCount[b + 1] == 0) continue;
+            float cost = halfArea(acc) * n + rightArea[b + 1] * rightCount[b + 1];
+            if (cost < bestCost) {
+                bestCost  = cost;
+                bestAxis  = a;
+                bestSplit = b + 1;
+            }
+        }
+    }
+
+    int mid;
+    if (bestAxis >= 0 && depth < SAH_MAX_DEPTH) {
+        float lo = axisOf(centerBounds.min, bestAxis);
+        float binScale = SAH_BINS / (axisOf(centerBounds.max, bestAxis) - lo);
+        int*  split = std::partition(ids.data() + begin, ids.data() + end, [&](int id) {
+            int b = std::min(SAH_BINS - 1, (int)((axisOf(centers[id], bestAxis) - lo) * binScale));
+            return b < bestSplit;
+        });
+        mid = (int)(split - ids.data());
+    } else {
+        // All centers coincide (or the tree is too deep): halve the range
+        mid = begin + count / 2;
+    }
+
+    int child = (int)nodes.size();
+    nodes.resize(nodes.size() + 2);
+    nodes[node].child = child;
+    nodes[node].count = 0;
+    nodes[child].parent = nodes[child + 1].parent = node;
+    buildNode(child,     begin, mid, ids, boxes, centers, depth + 1);
+    buildNode(child + 1, mid,   end, ids, boxes, centers, depth + 1);
+    return node;
+}
+
+void CollisionIndex::build(const std::vector<AABB>& boxes) {
+    boxCount = (int)boxes.size();
+    nodes.clear();
+    for (std::vector<float>* v : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ}) v->clear();
+    slotBox.clear();
+    slotLeaf.clear();
+    dirtyLeaves.clear();
+    boxSlot.assign(boxCount, -1);
+    maxDepth = 0;
+    if (boxCount == 0) return;
+
+    std::vector<int>  ids(boxCount);
+    std::vector<Vec3> centers(boxCount);
+    for (int i = 0; i < boxCount; ++i) {
+        ids[i] = i;
+        centers[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+    }
+    nodes.reserve((size_t)boxCount / 2 + 1);
+    nodes.resize(1);
+    nodes[0].parent = -1;
+    buildNode(0, 0, boxCount, ids, boxes, centers, 1);
+}
+
+CollisionIndexStats CollisionIndex::stats() const {
+    CollisionIndexStats s;
+    s.nodes = (int)nodes.size();
+    for (const Node& n : nodes) s.leaves += n.count > 0;
+    s.depth = maxDepth;
+    return s;
+}
+
+void CollisionIndex::updateBox(int id, const AABB& b) {
+    int slot = boxSlot[id];
+    setSlot(slot, b);
+    dirtyLeaves.push_back(slotLeaf[slot]);
+}
+
+void CollisionIndex::refit() {
+    std::sort(dirtyLeaves.begin(), dirtyLeaves.end());
+    dirtyLeaves.erase(std::unique(dirtyLeaves.begin(), dirtyLeaves.end()), dirtyLeaves.end());
+    for (int leaf : dirtyLeaves) {
+        Node& n = nodes[leaf];
+        n.bounds = slotBounds(n.first, padToGroup(n.count));
+        // Walk up until a parent's bounds stop changing
+        for (int p = n.parent; p >= 0; p = nodes[p].parent) {
+            AABB b = merge(nodes[nodes[p].child].bounds, nodes[nodes[p].child + 1].bounds);
+            if (sameBox(b, nodes[p].bounds)) break;
+            nodes[p].bounds = b;
+        }
+    }
+    dirtyLeaves.clear();
+}
+
+// Leaf tests, four slots at a time. Padding slots are empty boxes, which
+// never overlap anything; ray tests mask them by lane count instead.
+#ifdef COLLISION_SSE
+static inline int overlapGroup(const float* mnX, const float* mnY, const float* mnZ,
+                               const float* mxX, const float* mxY, const float* mxZ,
+                               const AABB& q) {
+    __m128 m = _mm_and_ps(_mm_cmplt_ps(_mm_set1_ps(q.min.x), _mm_loadu_ps(mxX)),
+                          _mm_cmplt_ps(_mm_loadu_ps(mnX), _mm_set1_ps(q.max.x)));
+    m = _mm_and_ps(m, _mm_and_ps(_mm_cmplt_ps(_mm_set1_ps(q.min.y), _mm_loadu_ps(mxY)),
+                                 _mm_cmplt_ps(_mm_loadu_ps(mnY), _mm_set1_ps(q.max.y))));
+    m = _mm_and_ps(m, _mm_and_ps(_mm_cmplt_ps(_mm_set1_ps(q.min.z), _mm_loadu_ps(mxZ)),
+                                 _mm_cmplt_ps(_mm_loadu_ps(mnZ), _mm_set1_ps(q.max.z))));
+    return _mm_movemask_ps(m);
+}
+
+static inline void rayAxis(__m128 lo, __m128 hi, const RayQuery& q, int a, float e,
+                           __m128& tn, __m128& tf, __m128& ok) {
+    lo = _mm_sub_ps(lo, _mm_set1_ps(e));
+    hi = _mm_add_ps(hi, _mm_set1_ps(e));
+    __m128 o = _mm_set1_ps(q.o[a]);
+    if (q.flat[a]) {
+        ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpgt_ps(o, lo), _mm_cmplt_ps(o, hi)));
+        return;
+    }
+    __m128 inv = _mm_set1_ps(q.inv[a]);
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(lo, o), inv);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(hi, o), inv);
+    tn = _mm_max_ps(tn, _mm_min_ps(t0, t1));
+    tf = _mm_min_ps(tf, _mm_max_ps(t0, t1));
+}
+
+// Lanes hit with entry time up to best; entry times (clamped to 0) in t
+static inline int rayGroup(const float* mnX, const float* mnY, const float* mnZ,
+                           const float* mxX, const float* mxY, const float* mxZ,
+                           const RayQuery& q, float best, float* t) {
+    __m128 tn = _mm_set1_ps(-FLT_MAX), tf = _mm_set1_ps(FLT_MAX);
+    __m128 ok = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    rayAxis(_mm_loadu_ps(mnX), _mm_loadu_ps(mxX), q, 0, q.expand.x, tn, tf, ok);
+    rayAxis(_mm_loadu_ps(mnY), _mm_loadu_ps(mxY), q, 1, q.expand.y, tn, tf, ok);
+    rayAxis(_mm_loadu_ps(mnZ), _mm_loadu_ps(mxZ), q, 2, q.expand.z, tn, tf, ok);
+    __m128 zero = _mm_setzero_ps();
+    ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmplt_ps(tn, tf), _mm_cmpgt_ps(tf, zero)));
+    __m128 entry = _mm_max_ps(tn, zero);
+    ok = _mm_and_ps(ok, _mm_cmple_ps(entry, _mm_set1_ps(best)));
+    _mm_storeu_ps(t, entry);
+    return _mm_movemask_ps(ok);
+}
+#else
+// Entry/exit of the ray through bounds grown by q.expand
+static bool rayInterval(const RayQuery& q, const AABB& b, float& tNear, float& tFar) {
+    const float lo[3] = {b.min.x - q.expand.x, b.min.y - q.expand.y, b.min.z - q.expand.z};
+    const float hi[3] = {b.max.x + q.expand.x, b.max.y + q.expand.y, b.max.z + q.expand.z};
+    tNear = -FLT_MAX;
+    tFar  = FLT_MAX;
+    for (int a = 0; a < 3; ++a) {
+        if (q.flat[a]) {
+            if (!(q.o[a] > lo[a] && q.o[a] < hi[a])) return false;
+            continue;
+        }
+        float t0 = (lo[a] - q.o[a]) * q.inv[a];
+        float t1 = (hi[a] - q.o[a]) * q.inv[a];
+        tNear = std::max(tNear, std::min(t0, t1));
+        tFar  = std::min(tFar,  std::max(t0, t1));
+    }
+    return tNear < tFar && tFar > 0.0f;
+}
+
+static inline int overlapGroup(const float* mnX, const float* mnY, const float* mnZ,
+                               const float* mxX, const float* mxY, const float* mxZ,
+                               const AABB& q) {
+    int mask = 0;
+    for (int l = 0; l < 4; ++l) {
+        if (q.min.x < mxX[l] && mnX[l] < q.max.x && q.min.y < mxY[l] && mnY[l] < q.max.y &&
+            q.min.z < mxZ[l] && mnZ[l] < q.max.z)
+            mask |= 1 << l;
+    }
+    return mask;
+}
+
+static inline int rayGroup(const float* mnX, const float* mnY, const float* mnZ,
+                           const float* mxX, const float* mxY, const float* mxZ,
+                           const RayQuery& q, float best, float* t) {
+    int mask = 0;
+    for (int l = 0; l < 4; ++l) {
+        AABB b = {{mnX[l], mnY[l], mnZ[l]}, {mxX[l], mxY[l], mxZ[l]}};
+        float tNear, tFar;
+        if (!rayInterval(q, b, tNear, tFar)) continue;
+        t[l] = tNear > 0.0f ? tNear : 0.0f;
+        if (t[l] <= best) mask |= 1 << l;
+    }
+    return mask;
+}
+#endif
+
+void CollisionIndex::overlap(const AABB& q, std::vector<int>& out) const {
+    if (nodes.empty()) return;
+    int stack[STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const Node& n = nodes[stack[--sp]];
+        const AABB& b = n.bounds;
+        if (!(q.min.x < b.max.x && b.min.x < q.max.x && q.min.y < b.max.y &&
+              b.min.y < q.max.y && q.min.z < b.max.z && b.min.z < q.max.z))
+            continue;
+        if (n.count == 0) {
+            stack[sp++] = n.child;
+            stack[sp++] = n.child + 1;
+            continue;
+        }
+        for (int s = n.first; s < n.first + n.count; s += 4) {
+            int mask = overlapGroup(&minX[s], &minY[s], &minZ[s], &maxX[s], &maxY[s], &maxZ[s], q);
+            for (int l = 0; l < 4; ++l)
+                if (mask & (1 << l)) out.push_back(slotBox[s + l]);
+        }
+    }
+}
+
+bool CollisionIndex::castRay(Vec3 origin, Vec3 dir, Vec3 expand, float maxT, RayHit& hit) const {
+    hit = RayHit();
+    if (nodes.empty()) return false;
+    RayQuery q;
+    setupRay(q, origin, dir, expand);
+
+    // Nearest-first traversal; entries whose node starts past the best
+    // hit are skipped when popped
+    struct Entry { int node; float t; };
+    Entry stack[STACK_SIZE];
+    int   sp = 0;
+    float best = maxT;
+    int   bestSlot = -1;
+    float t0;
+    if (!rayHitsNode(q, nodes[0].bounds, best, t0)) return false;
+    stack[sp++] = {0, t0};
+    while (sp > 0) {
+        Entry e = stack[--sp];
+        if (e.t >= best && bestSlot >= 0) continue;
+        const Node& n = nodes[e.node];
+        if (n.count == 0) {
+            float ta, tb;
+            bool ha = rayHitsNode(q, nodes[n.child].bounds, best, ta);
+            bool hb = rayHitsNode(q, nodes[n.child + 1].bounds, best, tb);
+            if (ha && hb) {
+                // Push the far child first so the near one is popped next
+                bool aFirst = ta <= tb;
+                stack[sp++] = aFirst ? Entry{n.child + 1, tb} : Entry{n.child, ta};
+                stack[sp++] = aFirst ? Entry{n.child, ta} : Entry{n.child + 1, tb};
+            } else if (ha) {
+                stack[sp++] = {n.child, ta};
+            } else if (hb) {
+                stack[sp++] = {n.child + 1, tb};
+            }
+            continue;
+        }
+        for (int s = n.first; s < n.first + n.count; s += 4) {
+            float t[4];
+            int mask = rayGroup(&minX[s], &minY[s], &minZ[s], &maxX[s], &maxY[s], &maxZ[s],
+                                q, best, t);
+            int lanes = std::min(4, n.first + n.count - s);
+            for (int l = 0; l < lanes; ++l) {
+                if ((mask & (1 << l)) && (bestSlot < 0 || t[l] < best)) {
+                    best = t[l];
+                    bestSlot = s + l;
+                }
+            }
+        }
+    }
+    if (bestSlot < 0) return false;
+
+    hit.box = slotBox[bestSlot];
+    hit.t   = best;
+    // The entered face is on the axis with the latest entry time
+    const float lo[3] = {minX[bestSlot] - expand.x, minY[bestSlot] - expand.y, minZ[bestSlot] - expand.z};
+    const float hi[3] = {maxX[bestSlot] + expand.x, maxY[bestSlot] + expand.y, maxZ[bestSlot] + expand.z};
+    const float d[3]  = {dir.x, dir.y, dir.z};
+    float latest = 0.0f;
+    int   axis = -1;
+    for (int a = 0; a < 3; ++a) {
+        if (q.flat[a]) continue;
+        float entry = ((d[a] > 0 ? lo[a] : hi[a]) - q.o[a]) * q.inv[a];
+        if (entry >= latest) {
+            latest = entry;
+            axis = a;
+        }
+    }
+    if (axis >= 0) {
+        float s = d[axis] > 0 ? -1.0f : 1.0f;
+        hit.normal = {axis == 0 ? s : 0.0f, axis == 1 ? s : 0.0f, axis == 2 ? s : 0.0f};
+    }
+    return true;
+}
+
+bool CollisionIndex::raycast(Vec3 origin, Vec3 dir, float maxT, RayHit& hit) const {
+    return castRay(origin, dir, {0, 0, 0}, maxT, hit);
+}
+
+bool CollisionIndex::sweep(const AABB& b, Vec3 delta, RayHit& hit) const {
+    // Moving box vs. box == moving center vs. box grown by the half size
+    Vec3 center = (b.min + b.max) * 0.5f;
+    Vec3 half   = (b.max - b.min) * 0.5f;
+    return castRay(center, delta, half, 1.0f, hit);
+}
@@ -0,0 +1,79 @@
+// CollisionIndex.h
+// Bounding volume hierarchy over collision boxes (binned SAH build).
+// Leaves keep their boxes in SoA blocks of 4 so one SSE test covers four
+// boxes. Queries: box overlap, nearest ray hit, swept box. Boxes can be
+// moved afterwards and the tree refit along the changed paths only.
+#pragma once
+
+#include "MathTypes.h"
+
+#include <vector>
+
+// Boxes per leaf, at most; leaves are padded to a multiple of 4 slots
+static const int COLLISION_LEAF_BOXES = 8;
+
+struct RayHit {
+    int   box = -1;            // index into the array passed to build(), -1 = miss
+    float t   = 0.0f;          // hit = origin + dir * t
+    Vec3  normal = {0, 0, 0};  // face that was entered; zero if the ray starts inside
+};
+
+struct CollisionIndexStats {
+    int nodes = 0, leaves = 0, depth = 0;
+};
+
+class CollisionIndex {
+public:
+    // Rebuilds the tree. Box ids in query results are indices into boxes.
+    void build(const std::vector<AABB>& boxes);
+
+    int  size() const { return boxCount; }
+    AABB box(int id) const;
+    CollisionIndexStats stats() const;
+
+    // Replaces one box; the tree is stale until refit()
+    void updateBox(int id, const AABB& box);
+    // Recomputes the bounds of every node above a changed box. The tree
+    // shape is kept, so refit after large moves makes queries slower;
+    // build() again then.
+    void refit();
+
+    // Appends the ids of boxes that overlap box with positive volume
+    // (touching faces do not count)
+    void overlap(const AABB& box, std::vector<int>& out) const;
+
+    // Nearest box hit by origin + dir * t for t in [0, maxT]. dir need
+    // not be normalized. Returns false on a miss.
+    bool raycast(Vec3 origin, Vec3 dir, float maxT, RayHit& hit) const;
+
+    // Moves box by delta and stops at the first box it would enter.
+    // hit.t is the allowed fraction of delta in [0, 1]. A touching box
+    // blocks at t = 0 only if delta moves into it; a box that already
+    // overlaps the start blocks at t = 0 with a zero normal.
+    bool sweep(const AABB& box, Vec3 delta, RayHit& hit) const;
+
+private:
+    struct Node {
+        AABB bounds;
+        int  child;     // internal: children at child and child + 1
+        int  first;     // leaf: first slot
+        int  count;     // leaf: boxes in the leaf; 0 = internal node
+        int  parent;
+    };
+
+    int  buildNode(int node, int begin, int end, std::vector<int>& ids,
+                   const std::vector<AABB>& boxes, const std::vector<Vec3>& centers, int depth);
+    void setSlot(int slot, const AABB& box);
+    AABB slotBounds(int first, int count) const;
+    bool castRay(Vec3 origin, Vec3 dir, Vec3 expand, float maxT, RayHit& hit) const;
+
+    std::vector<Node> nodes;
+    // SoA box slots in leaf order, padded per leaf to a multiple of 4
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    std::vector<int>   slotBox;    // slot -> box id, -1 for padding
+    std::vector<int>   boxSlot;    // box id -> slot
+    std::vector<int>   slotLeaf;   // slot -> leaf node
+    std::vector<int>   dirtyLeaves;
+    int boxCount = 0;
+    int maxDepth = 0;
+};
@@ -0,0 +1,122 @@
+// FramePacer.cpp
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+static const int     SLEEP_WINDOW        = 64;
+static const int64_t MARGIN_PAD_NS       = 200000;     // 0.2 ms on top of the worst oversleep
+static const int64_t MARGIN_INITIAL_NS   = 2000000;    // until the first measurements
+static const int64_t MARGIN_MAX_NS       = 4000000;
+static const int64_t HISTOGRAM_BUCKET_NS = 100000;     // 0.1 ms
+static const int     HISTOGRAM_BUCKETS   = 1000;       // up to 100 ms
+
+int64_t SteadyPacerClock::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SteadyPacerClock::sleepNs(int64_t ns) {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+}
+
+void SteadyPacerClock::relax() {
+    std::this_thread::yield();
+}
+
+FramePacer::FramePacer(double targetFps, PacerClock* c)
+    : clock(c), periodNs((int64_t)(1e9 / targetFps)),
+      oversleep(SLEEP_WINDOW, 0), marginNs(MARGIN_INITIAL_NS),
+      histogram(HISTOGRAM_BUCKETS, 0) {
+    if (!clock) clock = ownedClock = new SteadyPacerClock();
+}
+
+FramePacer::~FramePacer() {
+    delete ownedClock;
+}
+
+void FramePacer::setTargetFps(double fps) {
+    periodNs = (int64_t)(1e9 / fps);
+    deadline = 0;
+}
+
+void FramePacer::updateMargin(int64_t ns) {
+    oversleep[oversleepNext] = std::max<int64_t>(ns, 0);
+    oversleepNext = (oversleepNext + 1) % SLEEP_WINDOW;
+    int64_t worst = *std::max_element(oversleep.begin(), oversleep.end());
+    marginNs = std::min(worst + MARGIN_PAD_NS, MARGIN_MAX_NS);
+}
+
+void FramePacer::waitForNextFrame() {
+    int64_t now = clock->nowNs();
+    if (deadline == 0) {
+        // First frame (or new rate): start the schedule here
+        deadline = now + periodNs;
+        lastFrameEnd = now;
+        return;
+    }
+
+    if (now > deadline) {
+        ++missed;
+    } else {
+        // Coarse sleep, then spin the calibrated tail
+        int64_t wake = deadline - marginNs;
+        if (wake > now) {
+            clock->sleepNs(wake - now);
+            now = clock->nowNs();
+            updateMargin(now - wake);
+        }
+        while (now < deadline) {
+            clock->relax();
+            now = clock->nowNs();
+        }
+    }
+
+    record(now - lastFrameEnd);
+    lastFrameEnd = now;
+    deadline += periodNs;
+    // After a long stall start over instead of rushing to catch up
+    if (deadline <= now) deadline = now + periodNs;
+}
+
+void FramePacer::record(int64_t ns) {
+    int b = (int)std::min<int64_t>(ns / HISTOGRAM_BUCKET_NS, HISTOGRAM_BUCKETS - 1);
+    ++histogram[b];
+    ++frames;
+    totalNs += (double)ns;
+    maxNs = std::max(maxNs, ns);
+}
+
+double FramePacer::percentileMs(double p) const {
+    if (frames == 0) return 0.0;
+    int64_t rank = (int64_t)(p * (frames - 1)) + 1;
+    int64_t seen = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+        seen += histogram[b];
+        if (seen >= rank) {
+            // Bucket upper edge, but never above the real maximum
+            double edge = (b + 1) * HISTOGRAM_BUCKET_NS;
+            return std::min(edge, (double)maxNs) * 1e-6;
+        }
+    }
+    return maxNs * 1e-6;
+}
+
+FrameTimeStats FramePacer::stats() const {
+    FrameTimeStats s;
+    s.frames = frames;
+    s.missed = missed;
+    s.p50Ms  = percentileMs(0.50);
+    s.p99Ms  = percentileMs(0.99);
+    s.maxMs  = maxNs * 1e-6;
+    s.meanMs = frames ? totalNs / frames * 1e-6 : 0.0;
+    s.sleepMarginMs = marginNs * 1e-6;
+    return s;
+}
+
+void FramePacer::resetStats() {
+    std::fill(histogram.begin(), histogram.end(), 0);
+    frames = missed = maxNs = 0;
+    totalNs = 0;
+}
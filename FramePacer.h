@@ -0,0 +1,79 @@
+// FramePacer.h
+// Frame limiter with absolute deadlines: frame k ends at start + k * period
+// no matter how long each frame's work took, so frames do not drift.
+// It sleeps until shortly before the deadline and spins the rest; the
+// sleep margin follows the OS's measured oversleep. Frame times go into a
+// histogram for p50/p99/max queries.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Time source; the default is std::chrono::steady_clock. Tests pass a
+// fake clock to run the pacer headless and deterministically.
+class PacerClock {
+public:
+    virtual ~PacerClock() {}
+    virtual int64_t nowNs() = 0;
+    virtual void    sleepNs(int64_t ns) = 0;   // may oversleep
+    virtual void    relax() {}                 // one spin-wait step
+};
+
+class SteadyPacerClock : public PacerClock {
+public:
+    int64_t nowNs() override;
+    void    sleepNs(int64_t ns) override;
+    void    relax() override;
+};
+
+struct FrameTimeStats {
+    int64_t frames = 0;
+    int64_t missed = 0;            // frames that ended after their deadline
+    double  p50Ms = 0, p99Ms = 0, maxMs = 0, meanMs = 0;
+    double  sleepMarginMs = 0;     // current spin tail
+};
+
+class FramePacer {
+public:
+    // clock == nullptr uses a SteadyPacerClock owned by the pacer
+    explicit FramePacer(double targetFps, PacerClock* clock = nullptr);
+    ~FramePacer();
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // Changes the rate from the next frame on
+    void   setTargetFps(double fps);
+    double targetFps() const { return 1e9 / periodNs; }
+
+    // Call once per frame after present. Blocks until the frame's deadline
+    // and records the time since the previous call.
+    void waitForNextFrame();
+
+    FrameTimeStats stats() const;
+    // Frame time in ms below which a fraction p of frames fall (0..1),
+    // to histogram resolution
+    double percentileMs(double p) const;
+    void   resetStats();
+
+private:
+    void record(int64_t frameNs);
+    void updateMargin(int64_t oversleepNs);
+
+    PacerClock* clock;
+    PacerClock* ownedClock = nullptr;
+    int64_t periodNs;
+    int64_t deadline = 0;        // 0 = not started
+    int64_t lastFrameEnd = 0;
+
+    // Oversleep samples of the last SLEEP_WINDOW sleeps; the margin is
+    // their maximum plus a small pad
+    std::vector<int64_t> oversleep;
+    int     oversleepNext = 0;
+    int64_t marginNs;
+
+    // Frame times in HISTOGRAM_BUCKET_NS buckets, the last one open-ended
+    std::vector<int64_t> histogram;
+    int64_t frames = 0, missed = 0, maxNs = 0;
+    double  totalNs = 0;
+};
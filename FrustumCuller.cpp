@@ -0,0 +1,117 @@
+// FrustumCuller.cpp
+#include "FrustumCuller.h"
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#define FRUSTUM_SSE
+#include <emmintrin.h>
+#endif
+
+void extractFrustum(const float* m, Frustum& out) {
+    // Row i of the matrix is (m[i], m[4 + i], m[8 + i], m[12 + i])
+    for (int p = 0; p < 6; ++p) {
+        int   row  = p / 2;
+        float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+        float* pl = out.planes[p];
+        for (int c = 0; c < 4; ++c) pl[c] = m[c * 4 + 3] + sign * m[c * 4 + row];
+        float len = std::sqrt(pl[0] * pl[0] + pl[1] * pl[1] + pl[2] * pl[2]);
+        if (len > 0.0f)
+            for (int c = 0; c < 4; ++c) pl[c] /= len;
+    }
+}
+
+bool frustumTestBox(const Frustum& f, const AABB& box) {
+    Vec3 c = (box.min + box.max) * 0.5f;
+    Vec3 e = (box.max - box.min) * 0.5f;
+    for (const float* p : f.planes) {
+        float dist = p[0] * c.x + p[1] * c.y + p[2] * c.z + p[3];
+        float r    = std::fabs(p[0]) * e.x + std::fabs(p[1]) * e.y + std::fabs(p[2]) * e.z;
+        if (dist + r < 0.0f) return false;
+    }
+    return true;
+}
+
+void FrustumCuller::setBoxes(const AABB* boxes, int n) {
+    count = n;
+    size_t padded = (size_t)((n + 3) & ~3);
+    for (std::vector<float>* v : {&cx, &cy, &cz, &ex, &ey, &ez}) v->assign(padded, 0.0f);
+    for (int i = 0; i < n; ++i) updateBox(i, boxes[i]);
+}
+
+void FrustumCuller::updateBox(int i, const AABB& b) {
+    cx[i] = (b.min.x + b.max.x) * 0.5f;
+    cy[i] = (b.min.y + b.max.y) * 0.5f;
+    cz[i] = (b.min.z + b.max.z) * 0.5f;
+    ex[i] = (b.max.x - b.min.x) * 0.5f;
+    ey[i] = (b.max.y - b.min.y) * 0.5f;
+    ez[i] = (b.max.z - b.min.z) * 0.5f;
+}
+
+void FrustumCuller::cull(const Frustum& f, std::vector<int>& visible) const {
+#ifdef FRUSTUM_SSE
+    // Plane coefficients splatted once, |n| for the extent term
+    __m128 pa[6], pb[6], pc[6], pd[6], aa[6], ab[6], ac[6];
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (int p = 0; p < 6; ++p) {
+        pa[p] = _mm_set1_ps(f.planes[p][0]);
+        pb[p] = _mm_set1_ps(f.planes[p][1]);
+        pc[p] = _mm_set1_ps(f.planes[p][2]);
+        pd[p] = _mm_set1_ps(f.planes[p][3]);
+        aa[p] = _mm_and_ps(pa[p], absMask);
+        ab[p] = _mm_and_ps(pb[p], absMask);
+        ac[p] = _mm_and_ps(pc[p], absMask);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    for (int i = 0; i < count; i += 4) {
+        __m128 x = _mm_loadu_ps(&cx[i]), y = _mm_loadu_ps(&cy[i]), z = _mm_loadu_ps(&cz[i]);
+        __m128 hx = _mm_loadu_ps(&ex[i]), hy = _mm_loadu_ps(&ey[i]), hz = _mm_loadu_ps(&ez[i]);
+        __m128 outside = zero;
+        for (int p = 0; p < 6; ++p) {
+            // Summed in the scalar test's order, so both cull the same boxes
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(pa[p], x), _mm_mul_ps(pb[p], y)),
+                                                _mm_mul_ps(pc[p], z)), pd[p]);
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aa[p], hx), _mm_mul_ps(ab[p], hy)),
+                                  _mm_mul_ps(ac[p], hz));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, r), zero));
+        }
+        int in = ~_mm_movemask_ps(outside) & 15;
+        while (in) {
+            int lane = __builtin_ctz(in);
+            in &= in - 1;
+            if (i + lane < count) visible.push_back(i + lane);
+        }
+    }
+#else
+    for (int i = 0; i < count; ++i) {
+        bool inside = true;
+        for (const float* p : f.planes) {
+            float dist = p[0] * cx[i] + p[1] * cy[i] + p[2] * cz[i] + p[3];
+            float r = std::fabs(p[0]) * ex[i] + std::fabs(p[1]) * ey[i] + std::fabs(p[2]) * ez[i];
+            if (dist + r < 0.0f) {
+                inside = false;
+                break;
+            }
+        }
+        if (inside) visible.push_back(i);
+    }
+#endif
+}
+
+void appendDrawRange(DrawRanges& ranges, unsigned firstIndex, unsigned indexCount,
+                     int baseVertex, unsigned indexSize) {
+    if (indexCount == 0) return;
+    uintptr_t offset = (uintptr_t)firstIndex * indexSize;
+    if (!ranges.counts.empty() && ranges.baseVertices.back() == baseVertex) {
+        uintptr_t end = (uintptr_t)ranges.offsets.back() +
+                        (uintptr_t)ranges.counts.back() * indexSize;
+        if (end == offset) {
+            ranges.counts.back() += (int)indexCount;
+            return;
+        }
+    }
+    ranges.counts.push_back((int)indexCount);
+    ranges.offsets.push_back((const void*)offset);
+    ranges.baseVertices.push_back(baseVertex);
+}
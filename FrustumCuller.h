@@ -0,0 +1,54 @@
+// FrustumCuller.h
+// View frustum culling for chunk bounding boxes. Boxes are stored as SoA
+// centers and half extents and tested four at a time against the six
+// planes of a view-projection matrix.
+#pragma once
+
+#include "MathTypes.h"
+
+#include <vector>
+
+// Planes (a, b, c, d) with a*x + b*y + c*z + d >= 0 inside, unit normals.
+// Order: left, right, bottom, top, near, far.
+struct Frustum {
+    float planes[6][4];
+};
+
+// Gribb/Hartmann extraction from a column-major 4x4 matrix (the layout of
+// glm::mat4 and glUniformMatrix4fv), GL clip space (-w <= z <= w)
+void extractFrustum(const float* viewProj, Frustum& out);
+
+// Conservative: a box is culled only if it lies entirely outside one plane
+bool frustumTestBox(const Frustum& f, const AABB& box);
+
+class FrustumCuller {
+public:
+    void setBoxes(const AABB* boxes, int count);
+    void updateBox(int index, const AABB& box);
+    int  size() const { return count; }
+
+    // Appends the indices of boxes that may be visible, in increasing order
+    void cull(const Frustum& f, std::vector<int>& visible) const;
+
+private:
+    // Padded to a multiple of 4; padding lanes are never reported
+    std::vector<float> cx, cy, cz, ex, ey, ez;
+    int count = 0;
+};
+
+// Parameters for glMultiDrawElements(BaseVertex): element counts, byte
+// offsets into the bound index buffer and base vertices
+struct DrawRanges {
+    std::vector<int>         counts;
+    std::vector<const void*> offsets;
+    std::vector<int>         baseVertices;
+
+    void clear() { counts.clear(); offsets.clear(); baseVertices.clear(); }
+    int  size() const { return (int)counts.size(); }
+};
+
+// Adds [firstIndex, firstIndex + indexCount) of an index buffer with
+// indexSize-byte indices, merged into the previous range when the two are
+// contiguous and share a base vertex
+void appendDrawRange(DrawRanges& ranges, unsigned firstIndex, unsigned indexCount,
+                     int baseVertex = 0, unsigned indexSize = sizeof(unsigned));
@@ -0,0 +1,47 @@
+// HeightTexture.cpp
+#include "HeightTexture.h"
+#include "Heightfield.h"
+
+#include <algorithm>
+#include <cmath>
+
+uint16_t HeightTexture::encode(float h) const {
+    float q = std::round((h - heightOffset) / heightStep);
+    return (uint16_t)std::min(std::max(q, 0.0f), 65535.0f);
+}
+
+void HeightTexture::build(const Heightfield& hf, float headroom) {
+    texW = hf.width;
+    texD = hf.depth;
+    float lo = 0.0f, hi = 0.0f;
+    if (!hf.heights.empty()) {
+        auto range = std::minmax_element(hf.heights.begin(), hf.heights.end());
+        lo = *range.first;
+        hi = *range.second;
+    }
+    const float pad = (hi - lo) * headroom;
+    heightOffset = lo - pad;
+    heightStep = hi > lo ? (hi - lo + 2.0f * pad) / 65535.0f : 1.0f;
+    data.resize(hf.heights.size());
+    for (size_t i = 0; i < data.size(); ++i) data[i] = encode(hf.heights[i]);
+    clearDirty();
+}
+
+void HeightTexture::update(const Heightfield& hf, const HeightTexelRect& rect) {
+    const int x0 = std::max(rect.x0, 0), x1 = std::min(rect.x1, texW);
+    const int z0 = std::max(rect.z0, 0), z1 = std::min(rect.z1, texD);
+    if (x0 >= x1 || z0 >= z1) return;
+    for (int z = z0; z < z1; ++z)
+        for (int x = x0; x < x1; ++x) {
+            size_t i = (size_t)z * texW + x;
+            data[i] = encode(hf.heights[i]);
+        }
+    if (!dirty()) {
+        dirtyRect = HeightTexelRect{x0, z0, x1, z1};
+    } else {
+        dirtyRect.x0 = std::min(dirtyRect.x0, x0);
+        dirtyRect.z0 = std::min(dirtyRect.z0, z0);
+        dirtyRect.x1 = std::max(dirtyRect.x1, x1);
+        dirtyRect.z1 = std::max(dirtyRect.z1, z1);
+    }
+}
@@ -0,0 +1,53 @@
+// HeightTexture.h
+// The Perlin terrain as one 16-bit texel per grid point, for the GPU
+// displacement mode. The vertex shader fetches a point's height, its four
+// neighbors for the normal and the coarser level's points for the LOD
+// morph, so the GPU holds 2 bytes per grid point and one shared patch
+// index buffer instead of per-vertex positions, normals and morph
+// targets. Height edits re-encode a rectangle of texels and mark it
+// dirty; the renderer then uploads only that rectangle.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Heightfield;
+
+// Grid points [x0, x1) x [z0, z1)
+struct HeightTexelRect {
+    int x0, z0, x1, z1;
+};
+
+class HeightTexture {
+public:
+    // headroom is the fraction of the height range kept free above and
+    // below it for later edits; heights beyond that are clamped
+    void build(const Heightfield& hf, float headroom = 0.25f);
+
+    int width() const { return texW; }
+    int depth() const { return texD; }
+    // height = offset + texel * step, with texel in 0..65535
+    float offset() const { return heightOffset; }
+    float step() const { return heightStep; }
+    float height(uint16_t texel) const { return heightOffset + texel * heightStep; }
+    // Row-major, width() texels per row
+    const uint16_t* texels() const { return data.data(); }
+    size_t bytes() const { return data.size() * sizeof(uint16_t); }
+
+    // Encodes the heights of rect from hf again (clipped to the grid) and
+    // grows the dirty rectangle to cover it
+    void update(const Heightfield& hf, const HeightTexelRect& rect);
+    bool dirty() const { return dirtyRect.x0 < dirtyRect.x1; }
+    // Bounding rectangle of the updates since clearDirty()
+    const HeightTexelRect& dirtyRegion() const { return dirtyRect; }
+    void clearDirty() { dirtyRect = HeightTexelRect{0, 0, 0, 0}; }
+
+private:
+    uint16_t encode(float h) const;
+
+    int   texW = 0, texD = 0;
+    float heightOffset = 0.0f, heightStep = 1.0f;
+    std::vector<uint16_t> data;
+    HeightTexelRect dirtyRect = {0, 0, 0, 0};
+};
@@ -0,0 +1,94 @@
+// HeightTextureGL.h
+// GL_R16 texture for a HeightTexture. Include after the GL loader (glew or
+// glad); header-only like VertexFormatGL.h. Sample it with texelFetch and
+// turn the normalized value back into a height with
+//   height = offset() + value * step() * 65535
+#pragma once
+
+#include "HeightTexture.h"
+
+// Creates the texture with every texel; leaves it bound to GL_TEXTURE_2D
+inline GLuint createHeightTexture(HeightTexture& ht) {
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Rows are 2 * width bytes, which need not be a multiple of 4
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, ht.width(), ht.depth(), 0,
+                 GL_RED, GL_UNSIGNED_SHORT, ht.texels());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    ht.clearDirty();
+    return tex;
+}
+
+// Uploads the dirty rectangle, straight out of the texel array, and
+// clears it. Returns the bytes uploaded.
+inline size_t uploadHeightTexture(GLuint tex, HeightTexture& ht) {
+    if (!ht.dirty()) return 0;
+    const HeightTexelRect& r = ht.dirtyRegion();
+    const int w = r.x1 - r.x0, d = r.z1 - r.z0;
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, ht.width());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, r.x0, r.z0, w, d, GL_RED, GL_UNSIGNED_SHORT,
+                    ht.texels() + (size_t)r.z0 * ht.width() + r.x0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    ht.clearDirty();
+    return (size_t)w * d * sizeof(uint16_t);
+}
+
+// Vertex shader that draws one LOD patch straight from the texture, with
+// no vertex attributes: the same surface, morph and normals as the packed
+// vertex path (TerrainLod::buildMorphHeights, NORMALS_CENTRAL_DIFF). Draw
+// TerrainLod::buildSharedPatchIndices() with uPatchOrigin and uLevel set
+// per node; FragPos and Normal go to the fragment shader.
+static const char* const HEIGHT_DISPLACE_VERT_SRC = R"glsl(
+#version 330 core
+out vec3 FragPos;
+out vec3 Normal;
+uniform mat4 model, view, projection;
+uniform vec3 viewPos;
+uniform sampler2D uHeights;           // R16, one texel per grid point
+uniform vec2 uHeightFrame;            // height = x + texel * y
+uniform float uGridSpacing;
+uniform int uPatchWidth;              // points per side of the shared patch
+uniform ivec2 uPatchOrigin;           // first grid point of the node
+uniform int uLevel;                   // LOD level of the patch being drawn
+uniform vec2 uMorphRange;             // camera distances where the morph runs 0 -> 1
+float heightAt(ivec2 g){
+    return uHeightFrame.x + texelFetch(uHeights, g, 0).r * uHeightFrame.y;
+}
+void main(){
+    // The index is the point of the shared patch
+    int s = 1 << uLevel;
+    ivec2 g = uPatchOrigin + ivec2(gl_VertexID % uPatchWidth, gl_VertexID / uPatchWidth) * s;
+    vec3 pos = vec3(float(g.x) * uGridSpacing, heightAt(g), float(g.y) * uGridSpacing);
+    // Points that the next level drops slide onto its surface with
+    // distance: edge midpoints onto their edge, cell centers onto the
+    // diagonal (as TerrainLod::buildMorphHeights)
+    if ((((g.x | g.y) >> uLevel) & 1) != 0) {
+        bool oddX = ((g.x >> uLevel) & 1) != 0, oddZ = ((g.y >> uLevel) & 1) != 0;
+        float coarse = oddX && oddZ ? heightAt(g + ivec2(s, -s)) + heightAt(g + ivec2(-s, s))
+                     : oddX         ? heightAt(g - ivec2(s, 0)) + heightAt(g + ivec2(s, 0))
+                                    : heightAt(g - ivec2(0, s)) + heightAt(g + ivec2(0, s));
+        float k = clamp((distance(pos, viewPos) - uMorphRange.x) /
+                        (uMorphRange.y - uMorphRange.x), 0.0, 1.0);
+        pos.y = mix(pos.y, 0.5 * coarse, k);
+    }
+    // Central differences of the full grid, one-sided at its edges
+    // (NORMALS_CENTRAL_DIFF)
+    ivec2 lo = max(g - 1, ivec2(0)), hi = min(g + 1, textureSize(uHeights, 0) - 1);
+    float gx = (heightAt(ivec2(hi.x, g.y)) - heightAt(ivec2(lo.x, g.y))) /
+               (float(hi.x - lo.x) * uGridSpacing);
+    float gz = (heightAt(ivec2(g.x, hi.y)) - heightAt(ivec2(g.x, lo.y))) /
+               (float(hi.y - lo.y) * uGridSpacing);
+    FragPos = vec3(model * vec4(pos,1.0));
+    Normal  = mat3(transpose(inverse(model))) * normalize(vec3(-gx, 1.0, -gz));
+    gl_Position = projection * view * vec4(FragPos,1.0);
+}
+)glsl";
@@ -0,0 +1,164 @@
+// Heightfield.cpp
+#include "Heightfield.h"
+#include "MathTypes.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+
+// Rows of normals handed to one task
+static const int NORMAL_ROWS_PER_TASK = 16;
+
+void generateHeightfield(const HeightfieldParams& params, ThreadPool& pool,
+                         Heightfield& out) {
+    out.width   = params.width;
+    out.depth   = params.depth;
+    out.spacing = params.scale;
+    out.heights.assign((size_t)params.width * params.depth, 0.0f);
+
+    float* heights = out.heights.data();
+    int width = params.width;
+    parallelForTiles(pool, params.width, params.depth, params.tileSize,
+                     [&](int x0, int z0, int w, int h) {
+        // Sample row by row straight into the tile's part of the grid
+        for (int z = 0; z < h; ++z) {
+            float* row = heights + (size_t)(z0 + z) * width + x0;
+            perlinFbmGrid(x0, z0 + z, w, 1, params.scale, params.fbm, row);
+            for (int x = 0; x < w; ++x) row[x] *= params.heightScale;
+        }
+    });
+}
+
+void buildGridPositions(const Heightfield& hf, ThreadPool& pool, float* xyz) {
+    parallelForTiles(pool, hf.width, hf.depth, 64, [&](int x0, int z0, int w, int h) {
+        for (int z = z0; z < z0 + h; ++z) {
+            for (int x = x0; x < x0 + w; ++x) {
+                float* p = xyz + ((size_t)z * hf.width + x) * 3;
+                p[0] = x * hf.spacing;
+                p[1] = hf.at(x, z);
+                p[2] = z * hf.spacing;
+            }
+        }
+    });
+}
+
+static inline void storeNormal(float* dst, float nx, float ny, float nz) {
+    float inv = 1.0f / std::sqrt(nx * nx + ny * ny + nz * nz);
+    dst[0] = nx * inv;
+    dst[1] = ny * inv;
+    dst[2] = nz * inv;
+}
+
+// Face normals of the two triangles of cell (cx, cz), unnormalized and
+// divided by the spacing, so their length is proportional to the area.
+// Triangle A is (i0,i2,i1), triangle B is (i1,i2,i3), as in buildGridIndices().
+static inline Vec3 cellTriA(const Heightfield& hf, int cx, int cz) {
+    float h0 = hf.at(cx, cz), h1 = hf.at(cx + 1, cz), h2 = hf.at(cx, cz + 1);
+    return {h0 - h1, hf.spacing, h0 - h2};
+}
+static inline Vec3 cellTriB(const Heightfield& hf, int cx, int cz) {
+    float h1 = hf.at(cx + 1, cz), h2 = hf.at(cx, cz + 1), h3 = hf.at(cx + 1, cz + 1);
+    return {h2 - h3, hf.spacing, h1 - h3};
+}
+
+// Gathers whichever of the 6 incident triangles exist; used on the border
+static Vec3 areaWeightedAt(const Heightfield& hf, int x, int z) {
+    bool l = x > 0, r = x < hf.width - 1, dn = z > 0, up = z < hf.depth - 1;
+    Vec3 n = {0.0f, 0.0f, 0.0f};
+    if (r && up) n = n + cellTriA(hf, x, z);
+    if (l && up) n = n + cellTriA(hf, x - 1, z) + cellTriB(hf, x - 1, z);
+    if (r && dn) n = n + cellTriA(hf, x, z - 1) + cellTriB(hf, x, z - 1);
+    if (l && dn) n = n + cellTriB(hf, x - 1, z - 1);
+    return n;
+}
+
+static void centralDiffRow(const Heightfield& hf, int z, float* dst) {
+    const int w = hf.width, d = hf.depth;
+    const float* row = hf.heights.data() + (size_t)z * w;
+    // Clamped neighbor rows turn the z difference one-sided at the edges
+    const float* up = z + 1 < d ? row + w : row;
+    const float* dn = z > 0     ? row - w : row;
+    const float invS  = 1.0f / hf.spacing;
+    const float inv2S = 0.5f * invS;
+    const float gzScale = (z > 0 && z + 1 < d) ? inv2S : invS;
+
+    // Interior columns: straight-line code the compiler can vectorize
+    for (int x = 1; x < w - 1; ++x) {
+        float gx = (row[x + 1] - row[x - 1]) * inv2S;
+        float gz = (up[x] - dn[x]) * gzScale;
+        storeNormal(dst + 3 * x, -gx, 1.0f, -gz);
+    }
+    float gx0 = (row[1] - row[0]) * invS;
+    float gxN = (row[w - 1] - row[w - 2]) * invS;
+    storeNormal(dst, -gx0, 1.0f, -(up[0] - dn[0]) * gzScale);
+    storeNormal(dst + 3 * (w - 1), -gxN, 1.0f, -(up[w - 1] - dn[w - 1]) * gzScale);
+}
+
+static void areaWeightedRow(const Heightfield& hf, int z, float* dst) {
+    const int w = hf.width, d = hf.depth;
+    if (z == 0 || z == d - 1) {
+        for (int x = 0; x < w; ++x) {
+            Vec3 n = areaWeightedAt(hf, x, z);
+            storeNormal(dst + 3 * x, n.x, n.y, n.z);
+        }
+        return;
+    }
+    const float* row = hf.heights.data() + (size_t)z * w;
+    const float* up  = row + w;
+    const float* dn  = row - w;
+    const float ny = 6.0f * hf.spacing;
+    // Closed form of the six triangle normals summed around an interior vertex
+    for (int x = 1; x < w - 1; ++x) {
+        float l = row[x - 1], r = row[x + 1];
+        float u = up[x], ul = up[x - 1];
+        float b = dn[x], br = dn[x + 1];
+        float nx = 2.0f * (l - r) + (ul - u) + (b - br);
+        float nz = 2.0f * (b - u) + (l - ul) + (br - r);
+        storeNormal(dst + 3 * x, nx, ny, nz);
+    }
+    Vec3 n0 = areaWeightedAt(hf, 0, z), nN = areaWeightedAt(hf, w - 1, z);
+    storeNormal(dst, n0.x, n0.y, n0.z);
+    storeNormal(dst + 3 * (w - 1), nN.x, nN.y, nN.z);
+}
+
+void computeGridNormals(const Heightfield& hf, NormalMode mode, ThreadPool& pool,
+                        float* xyz) {
+    const int w = hf.width, d = hf.depth;
+    if (w < 2 || d < 2) {
+        // No triangles; a flat up vector is the only sensible answer
+        for (size_t i = 0; i < (size_t)w * d; ++i) {
+            xyz[3 * i] = 0.0f; xyz[3 * i + 1] = 1.0f; xyz[3 * i + 2] = 0.0f;
+        }
+        return;
+    }
+    int tasks = (d + NORMAL_ROWS_PER_TASK - 1) / NORMAL_ROWS_PER_TASK;
+    pool.parallelFor(tasks, [&](int t) {
+        int z1 = (t + 1) * NORMAL_ROWS_PER_TASK < d ? (t + 1) * NORMAL_ROWS_PER_TASK : d;
+        for (int z = t * NORMAL_ROWS_PER_TASK; z < z1; ++z) {
+            float* dst = xyz + (size_t)z * w * 3;
+            if (mode == NORMALS_AREA_WEIGHTED) areaWeightedRow(hf, z, dst);
+            else                               centralDiffRow(hf, z, dst);
+        }
+    });
+}
+
+size_t gridIndexCount(int width, int depth) {
+    if (width < 2 || depth < 2) return 0;
+    return (size_t)(width - 1) * (depth - 1) * 6;
+}
+
+void buildGridIndices(int width, int depth, ThreadPool& pool, unsigned* out) {
+    int cellsX = width - 1, cellsZ = depth - 1;
+    parallelForTiles(pool, cellsX, cellsZ, 64, [&](int x0, int z0, int w, int h) {
+        for (int z = z0; z < z0 + h; ++z) {
+            unsigned* dst = out + ((size_t)z * cellsX + x0) * 6;
+            for (int x = x0; x < x0 + w; ++x) {
+                unsigned i0 = z * width + x;
+                unsigned i1 = i0 + 1;
+                unsigned i2 = i0 + width;
+                unsigned i3 = i2 + 1;
+                *dst++ = i0; *dst++ = i2; *dst++ = i1;
+                *dst++ = i1; *dst++ = i2; *dst++ = i3;
+            }
+        }
+    });
+}
@@ -0,0 +1,52 @@
+// Heightfield.h
+// Regular height grid for the Perlin terrain, generated tile by tile.
+#pragma once
+
+#include "PerlinNoise.h"
+
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+// heights[z * width + x] is the height at world (x * spacing, z * spacing)
+struct Heightfield {
+    int   width = 0, depth = 0;
+    float spacing = 1.0f;
+    std::vector<float> heights;
+
+    float at(int x, int z) const { return heights[(size_t)z * width + x]; }
+};
+
+struct HeightfieldParams {
+    int   width = 200, depth = 200;
+    float scale = 0.1f;          // grid spacing, also the noise step
+    float heightScale = 10.0f;
+    FbmParams fbm;
+    int   tileSize = 64;
+};
+
+// Every tile writes only its own rectangle of the preallocated output,
+// so the result is byte-identical for any number of threads.
+void generateHeightfield(const HeightfieldParams& params, ThreadPool& pool,
+                         Heightfield& out);
+
+// One xyz triple per grid point, row-major (same layout as std::vector<glm::vec3>)
+void buildGridPositions(const Heightfield& hf, ThreadPool& pool, float* xyz);
+
+// How computeGridNormals() derives a vertex normal from the heights
+enum NormalMode {
+    NORMALS_CENTRAL_DIFF,     // gradient from the 4 neighbors (one-sided at edges)
+    NORMALS_AREA_WEIGHTED     // sum of the 6 incident triangles, weighted by area
+};
+
+// One xyz normal per grid point, same layout as buildGridPositions().
+// Each output row only reads heights, so rows run in parallel with no
+// scatter writes; it replaces accumulating face normals over the mesh.
+void computeGridNormals(const Heightfield& hf, NormalMode mode, ThreadPool& pool,
+                        float* xyz);
+
+// Two triangles per cell, (i0,i2,i1) and (i1,i2,i3), in row order.
+// out must hold gridIndexCount(width, depth) entries.
+size_t gridIndexCount(int width, int depth);
+void buildGridIndices(int width, int depth, ThreadPool& pool, unsigned* out);
@@ -0,0 +1,337 @@
+// HeightfieldQuery.cpp
+#include "HeightfieldQuery.h"
+#include "Heightfield.h"
+#include "ThreadPool.h"
+#include "VoxelTerrain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Rays per parallelFor task
+static const int RAY_BLOCK = 256;
+
+// A point this close to a cell border (in cells) belongs to the cell the
+// ray is heading into, so rounding never sends the walk back a cell
+static const double BORDER_BIAS = 1e-7;
+
+// Smallest step along the ray, in cells
+static const double PROGRESS = 1e-9;
+
+static const double INF = std::numeric_limits<double>::infinity();
+
+void HeightfieldQuery::init(int samplesW, int samplesD, float minHeight, float maxHeight) {
+    sampleW = samplesW;
+    sampleD = samplesD;
+    cellsW = columns ? samplesW : samplesW - 1;
+    cellsD = columns ? samplesD : samplesD - 1;
+    samples.assign((size_t)sampleW * sampleD, 0);
+    levels.clear();
+    levelW.clear();
+    levelD.clear();
+    changed.clear();
+    if (!columns) {
+        heightOffset = minHeight;
+        heightScale = maxHeight > minHeight ? (maxHeight - minHeight) / 65535.0 : 1.0;
+    }
+}
+
+void HeightfieldQuery::build(const Heightfield& hf, float headroom) {
+    columns = false;
+    originX = originZ = 0.0;
+    spacing = hf.spacing;
+    float lo = 0.0f, hi = 0.0f;
+    if (!hf.heights.empty()) {
+        auto range = std::minmax_element(hf.heights.begin(), hf.heights.end());
+        lo = *range.first;
+        hi = *range.second;
+    }
+    const float pad = (hi - lo) * headroom;
+    init(hf.width, hf.depth, lo - pad, hi + pad);
+    if (cellsW < 1 || cellsD < 1) return;
+    for (size_t i = 0; i < samples.size(); ++i)
+        samples[i] = (uint16_t)std::lround((hf.heights[i] - heightOffset) / heightScale);
+    buildLevels();
+}
+
+void HeightfieldQuery::build(const VoxelColumns& cols) {
+    columns = true;
+    originX = cols.originX;
+    originZ = cols.originZ;
+    spacing = cols.step;
+    // Whole layers, so the 16-bit steps are exact
+    heightOffset = cols.floorY;
+    heightScale = cols.voxelHeight;
+    init(cols.resolution, cols.resolution, 0.0f, 0.0f);
+    if (cellsW < 1) return;
+    for (int x = 0; x < cols.resolution; ++x)
+        for (int z = 0; z < cols.resolution; ++z) updateColumn(cols, x, z);
+    changed.clear();
+    buildLevels();
+}
+
+void HeightfieldQuery::updateColumn(const VoxelColumns& cols, int x, int z) {
+    if (!columns || x < 0 || z < 0 || x >= sampleW || z >= sampleD) return;
+    int top = std::min(std::max(cols.top[cols.index(x, z)], 0), 65535);
+    samples[(size_t)z * sampleW + x] = (uint16_t)top;
+    changed.push_back(z * sampleW + x);
+}
+
+void HeightfieldQuery::updateHeight(const Heightfield& hf, int x, int z) {
+    if (columns || x < 0 || z < 0 || x >= sampleW || z >= sampleD) return;
+    double q = std::round((hf.at(x, z) - heightOffset) / heightScale);
+    samples[(size_t)z * sampleW + x] = (uint16_t)std::min(std::max(q, 0.0), 65535.0);
+    changed.push_back(z * sampleW + x);
+}
+
+HeightfieldQuery::Range HeightfieldQuery::cellRange(int x, int z) const {
+    const uint16_t* row = &samples[(size_t)z * sampleW + x];
+    if (columns) return Range{row[0], row[0]};
+    uint16_t a = row[0], b = row[1], c = row[sampleW], d = row[sampleW + 1];
+    return Range{std::min(std::min(a, b), std::min(c, d)), std::max(std::max(a, b), std::max(c, d))};
+}
+
+// Node (x, z) of level l from its up to four children
+HeightfieldQuery::Range HeightfieldQuery::mergeChildren(int l, int x, int z) const {
+    const std::vector<Range>& below = levels[l - 1];
+    const int bw = levelW[l - 1], bd = levelD[l - 1];
+    Range r = below[(size_t)(2 * z) * bw + 2 * x];
+    for (int dz = 0; dz < 2; ++dz)
+        for (int dx = 0; dx < 2; ++dx) {
+            int cx = 2 * x + dx, cz = 2 * z + dz;
+            if (cx >= bw || cz >= bd) continue;
+            const Range& c = below[(size_t)cz * bw + cx];
+            r.lo = std::min(r.lo, c.lo);
+            r.hi = std::max(r.hi, c.hi);
+        }
+    return r;
+}
+
+void HeightfieldQuery::buildLevels() {
+    int w = cellsW, d = cellsD;
+    for (;;) {
+        levelW.push_back(w);
+        levelD.push_back(d);
+        levels.emplace_back((size_t)w * d);
+        if (w == 1 && d == 1) break;
+        w = (w + 1) / 2;
+        d = (d + 1) / 2;
+    }
+    for (int z = 0; z < cellsD; ++z)
+        for (int x = 0; x < cellsW; ++x) levels[0][(size_t)z * cellsW + x] = cellRange(x, z);
+    for (size_t l = 1; l < levels.size(); ++l)
+        for (int z = 0; z < levelD[l]; ++z)
+            for (int x = 0; x < levelW[l]; ++x)
+                levels[l][(size_t)z * levelW[l] + x] = mergeChildren((int)l, x, z);
+}
+
+void HeightfieldQuery::refitCell(int x, int z) {
+    levels[0][(size_t)z * cellsW + x] = cellRange(x, z);
+    for (size_t l = 1; l < levels.size(); ++l) {
+        x >>= 1;
+        z >>= 1;
+        levels[l][(size_t)z * levelW[l] + x] = mergeChildren((int)l, x, z);
+    }
+}
+
+void HeightfieldQuery::refit() {
+    if (!valid()) return;
+    // A grid point is a corner of up to four patches
+    const int reach = columns ? 0 : 1;
+    for (int i : changed) {
+        int x = i % sampleW, z = i / sampleW;
+        for (int cz = std::max(z - reach, 0); cz <= std::min(z, cellsD - 1); ++cz)
+            for (int cx = std::max(x - reach, 0); cx <= std::min(x, cellsW - 1); ++cx)
+                refitCell(cx, cz);
+    }
+    changed.clear();
+}
+
+// Cell holding the point, nudged the way the ray is going
+static int cellOf(double p, double d, int cells) {
+    double biased = p + (d > 0 ? BORDER_BIAS : d < 0 ? -BORDER_BIAS : 0.0);
+    int c = (int)std::floor(biased);
+    return std::min(std::max(c, 0), cells - 1);
+}
+
+bool HeightfieldQuery::hitCell(int x, int z, const double* o, const double* d, double s0,
+                               double s1, int entryAxis, double& s, Vec3& normal) const {
+    const double y0 = o[1] + d[1] * s0;
+    if (columns) {
+        const double h = sampleHeight(x, z);
+        if (y0 <= h) {
+            // Through the side of the column, or starting inside it
+            s = s0;
+            if (entryAxis == 0)      normal = {d[0] > 0 ? -1.0f : 1.0f, 0, 0};
+            else if (entryAxis == 2) normal = {0, 0, d[2] > 0 ? -1.0f : 1.0f};
+            else if (entryAxis == 1) normal = {0, 1, 0};
+            else                     normal = {0, 0, 0};
+            return true;
+        }
+        if (d[1] >= 0) return false;
+        double top = (h - o[1]) / d[1];
+        if (top > s1) return false;
+        s = top;
+        normal = {0, 1, 0};
+        return true;
+    }
+
+    // Bilinear patch H(u, v) = A + B u + C v + D u v over the cell, with
+    // the ray as u = u0 + du t, v = v0 + dv t, y = y0 + dy t from s0.
+    // y - H along the ray is a quadratic in t.
+    const double h00 = sampleHeight(x, z), h10 = sampleHeight(x + 1, z);
+    const double h01 = sampleHeight(x, z + 1), h11 = sampleHeight(x + 1, z + 1);
+    const double A = h00, B = h10 - h00, C = h01 - h00, D = h00 - h10 - h01 + h11;
+    const double u0 = o[0] + d[0] * s0 - x, v0 = o[2] + d[2] * s0 - z;
+    const double du = d[0], dv = d[2], dy = d[1];
+    const double c = y0 - (A + B * u0 + C * v0 + D * u0 * v0);
+    const double b = dy - B * du - C * dv - D * (u0 * dv + v0 * du);
+    const double a = -D * du * dv;
+    const double len = s1 - s0;
+
+    double t = -1.0;
+    if (c <= 0.0) {
+        t = 0.0;
+    } else if (std::fabs(a) < 1e-12 * (std::fabs(b) + 1e-12)) {
+        if (b < 0.0) t = -c / b;
+    } else {
+        double disc = b * b - 4.0 * a * c;
+        if (disc >= 0.0) {
+            // Stable form: q and c / q are the two roots times a
+            double q = -0.5 * (b + (b < 0.0 ? -std::sqrt(disc) : std::sqrt(disc)));
+            double r0 = q / a, r1 = q != 0.0 ? c / q : r0;
+            if (r0 > r1) std::swap(r0, r1);
+            t = r0 >= 0.0 ? r0 : r1;
+        }
+    }
+    if (t < 0.0 || t > len) return false;
+    s = s0 + t;
+    if (c <= 0.0 && entryAxis < 0) {
+        normal = {0, 0, 0};
+        return true;
+    }
+    double u = std::min(std::max(u0 + du * t, 0.0), 1.0);
+    double v = std::min(std::max(v0 + dv * t, 0.0), 1.0);
+    double hx = (B + D * v) / spacing, hz = (C + D * u) / spacing;
+    normal = normalize(Vec3{(float)-hx, 1.0f, (float)-hz});
+    return true;
+}
+
+bool HeightfieldQuery::raycast(Vec3 origin, Vec3 dir, float maxT, HeightfieldHit& hit) const {
+    hit = HeightfieldHit();
+    if (!valid()) return false;
+
+    // Cell units across, world units up; s runs along the unit direction
+    double o[3] = {(origin.x - originX) / spacing, origin.y, (origin.z - originZ) / spacing};
+    double d[3] = {dir.x / spacing, dir.y, dir.z / spacing};
+    const double len = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    if (len == 0.0 || maxT < 0.0f) return false;
+    for (double& c : d) c /= len;
+
+    // Clip to the grid, and to below the highest point
+    const int top = (int)levels.size() - 1;
+    const double maxH = height(levels[top][0].hi);
+    double s0 = 0.0, s1 = maxT * len;
+    int entryAxis = -1;
+    const double lo[3] = {0.0, -INF, 0.0}, hi[3] = {(double)cellsW, maxH, (double)cellsD};
+    for (int a = 0; a < 3; ++a) {
+        if (d[a] == 0.0) {
+            if (o[a] < lo[a] || o[a] > hi[a]) return false;
+            continue;
+        }
+        double ta = (lo[a] - o[a]) / d[a], tb = (hi[a] - o[a]) / d[a];
+        if (ta > tb) std::swap(ta, tb);
+        if (ta > s0) {
+            s0 = ta;
+            entryAxis = a;
+        }
+        s1 = std::min(s1, tb);
+    }
+    if (s0 > s1) return false;
+
+    int level = top;
+    double s = s0;
+    int axis = entryAxis;
+    for (;;) {
+        const int cx = cellOf(o[0] + d[0] * s, d[0], cellsW);
+        const int cz = cellOf(o[2] + d[2] * s, d[2], cellsD);
+        const int nx = cx >> level, nz = cz >> level;
+
+        // Where the ray leaves the node
+        double exitX = INF, exitZ = INF;
+        if (d[0] > 0)      exitX = (std::min((nx + 1) << level, cellsW) - o[0]) / d[0];
+        else if (d[0] < 0) exitX = ((double)(nx << level) - o[0]) / d[0];
+        if (d[2] > 0)      exitZ = (std::min((nz + 1) << level, cellsD) - o[2]) / d[2];
+        else if (d[2] < 0) exitZ = ((double)(nz << level) - o[2]) / d[2];
+        const int exitAxis = exitX < exitZ ? 0 : 2;
+        const double sExit = std::max(std::min(std::min(exitX, exitZ), s1), s);
+
+        const Range& r = levels[level][(size_t)nz * levelW[level] + nx];
+        const double yLow = o[1] + d[1] * (d[1] < 0 ? sExit : s);
+        if (yLow <= height(r.hi)) {
+            if (level > 0) {
+                --level;
+                continue;
+            }
+            double sHit;
+            Vec3 normal;
+            if (hitCell(cx, cz, o, d, s, sExit, axis, sHit, normal)) {
+                hit.t = (float)(sHit / len);
+                hit.normal = normal;
+                hit.x = cx;
+                hit.z = cz;
+                return true;
+            }
+        }
+        // Passed over the node; try the coarser level next
+        if (sExit >= s1) return false;
+        // Never stall on a border that rounding put on both sides
+        s = std::max(sExit, s + PROGRESS);
+        axis = exitAxis;
+        if (level < top) ++level;
+    }
+}
+
+bool HeightfieldQuery::heightAt(float x, float z, float& h) const {
+    if (!valid()) return false;
+    double u = (x - originX) / spacing, v = (z - originZ) / spacing;
+    if (u < 0.0 || v < 0.0 || u > cellsW || v > cellsD) return false;
+    int cx = std::min((int)u, cellsW - 1), cz = std::min((int)v, cellsD - 1);
+    if (columns) {
+        h = (float)sampleHeight(cx, cz);
+        return true;
+    }
+    u -= cx;
+    v -= cz;
+    double h0 = sampleHeight(cx, cz) + (sampleHeight(cx + 1, cz) - sampleHeight(cx, cz)) * u;
+    double h1 = sampleHeight(cx, cz + 1) + (sampleHeight(cx + 1, cz + 1) - sampleHeight(cx, cz + 1)) * u;
+    h = (float)(h0 + (h1 - h0) * v);
+    return true;
+}
+
+void HeightfieldQuery::raycastBatch(const HeightfieldRay* rays, int count, ThreadPool& pool,
+                                    HeightfieldHit* hits) const {
+    pool.parallelFor((count + RAY_BLOCK - 1) / RAY_BLOCK, [&](int block) {
+        int end = std::min(count, (block + 1) * RAY_BLOCK);
+        for (int i = block * RAY_BLOCK; i < end; ++i)
+            raycast(rays[i].origin, rays[i].dir, rays[i].maxT, hits[i]);
+    });
+}
+
+void HeightfieldQuery::lineOfSight(const Vec3* from, const Vec3* to, int count, ThreadPool& pool,
+                                   uint8_t* visible) const {
+    pool.parallelFor((count + RAY_BLOCK - 1) / RAY_BLOCK, [&](int block) {
+        int end = std::min(count, (block + 1) * RAY_BLOCK);
+        HeightfieldHit hit;
+        for (int i = block * RAY_BLOCK; i < end; ++i)
+            visible[i] = raycast(from[i], to[i] - from[i], 1.0f, hit) ? 0 : 1;
+    });
+}
+
+HeightfieldQueryStats HeightfieldQuery::stats() const {
+    HeightfieldQueryStats s;
+    s.levels = (int)levels.size();
+    s.bytes = samples.capacity() * sizeof(uint16_t);
+    for (const std::vector<Range>& level : levels) s.bytes += level.capacity() * sizeof(Range);
+    return s;
+}
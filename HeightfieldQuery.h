@@ -0,0 +1,103 @@
+// HeightfieldQuery.h
+// Ray casts, picking and line of sight straight against a height grid, no
+// triangles or boxes involved. Heights are kept as 16-bit steps over the
+// grid's range (exact for voxel columns, under 1/65535 of the range and
+// its headroom for float heights), with a min/max mipmap over the cells. A ray walks the
+// grid with a 2D DDA from the coarsest level down, stepping over every
+// node it passes above, so a query touches O(log n) nodes on open ground
+// instead of every cell on its path.
+//
+// The surface is either bilinear patches between grid points (the Perlin
+// terrain) or flat-topped columns (TerraVoxel); both are intersected
+// exactly. Everything below the surface counts as solid. Queries are
+// const and safe from several threads; the batch calls split their rays
+// over a ThreadPool.
+#pragma once
+
+#include "MathTypes.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Heightfield;
+struct VoxelColumns;
+class ThreadPool;
+
+struct HeightfieldRay {
+    Vec3  origin, dir;         // dir need not be normalized
+    float maxT;                // the ray covers origin + dir * [0, maxT]
+};
+
+struct HeightfieldHit {
+    float t = 0.0f;            // hit = origin + dir * t
+    Vec3  normal = {0, 0, 0};  // zero if the ray starts below the surface
+    int   x = -1, z = -1;      // column or patch that was hit; -1 = miss
+};
+
+struct HeightfieldQueryStats {
+    int    levels = 0;         // mip levels, the cell level included
+    size_t bytes = 0;
+};
+
+class HeightfieldQuery {
+public:
+    // Bilinear patches between the grid points of hf; point (x, z) is at
+    // world (x * spacing, z * spacing) like buildGridPositions(). headroom
+    // is the fraction of the height range kept free above and below it for
+    // later edits, as in HeightTexture::build().
+    void build(const Heightfield& hf, float headroom = 0.25f);
+    // One flat-topped column per grid entry, from -infinity up to its top
+    // layer, placed like the collision boxes
+    void build(const VoxelColumns& cols);
+
+    bool valid() const { return !levels.empty(); }
+
+    // Column (x, z) has a new top; the mipmap is stale until refit()
+    void updateColumn(const VoxelColumns& cols, int x, int z);
+    // Grid point (x, z) of hf has a new height, clamped to the range and
+    // headroom of the build; the mipmap is stale until refit()
+    void updateHeight(const Heightfield& hf, int x, int z);
+    // Recomputes the mip nodes above every changed column
+    void refit();
+
+    // Nearest hit with the surface for t in [0, maxT]; false on a miss
+    bool raycast(Vec3 origin, Vec3 dir, float maxT, HeightfieldHit& hit) const;
+    // Surface height at world (x, z); false outside the grid
+    bool heightAt(float x, float z, float& height) const;
+
+    // raycast() for every ray, in parallel; hits[i].x < 0 marks a miss
+    void raycastBatch(const HeightfieldRay* rays, int count, ThreadPool& pool,
+                      HeightfieldHit* hits) const;
+    // visible[i] = 1 if nothing lies between from[i] and to[i]
+    void lineOfSight(const Vec3* from, const Vec3* to, int count, ThreadPool& pool,
+                     uint8_t* visible) const;
+
+    HeightfieldQueryStats stats() const;
+
+private:
+    struct Range {
+        uint16_t lo, hi;
+    };
+
+    void   init(int samplesW, int samplesD, float minHeight, float maxHeight);
+    void   buildLevels();
+    Range  cellRange(int x, int z) const;
+    Range  mergeChildren(int level, int x, int z) const;
+    void   refitCell(int x, int z);
+    double height(uint16_t q) const { return heightOffset + (double)q * heightScale; }
+    double sampleHeight(int x, int z) const { return height(samples[(size_t)z * sampleW + x]); }
+    bool   hitCell(int x, int z, const double* o, const double* d, double s0, double s1,
+                   int entryAxis, double& s, Vec3& normal) const;
+
+    bool   columns = false;     // flat-topped columns, or bilinear patches
+    int    sampleW = 0, sampleD = 0;
+    int    cellsW = 0, cellsD = 0;
+    double originX = 0.0, originZ = 0.0, spacing = 1.0;
+    double heightOffset = 0.0, heightScale = 1.0;
+
+    std::vector<uint16_t>           samples;   // [z * sampleW + x]
+    std::vector<std::vector<Range>> levels;    // levels[0] per cell, then 2x2 blocks
+    std::vector<int>                levelW, levelD;
+    std::vector<int>                changed;   // sample indices waiting for refit()
+};
@@ -0,0 +1,232 @@
+// IndexOptimizer.cpp
+#include "IndexOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <unordered_map>
+
+VertexCacheStats analyzeVertexCache(const unsigned* indices, size_t indexCount,
+                                    size_t vertexCount, int cacheSize, VertexCacheModel model) {
+    VertexCacheStats s;
+    s.triangles = indexCount / 3;
+    std::vector<char> seen(vertexCount, 0);
+
+    if (model == VERTEX_CACHE_FIFO) {
+        // A vertex is cached while fewer than cacheSize misses followed its own
+        std::vector<size_t> insertedAt(vertexCount, 0);
+        for (size_t i = 0; i < indexCount; ++i) {
+            unsigned v = indices[i];
+            if (!seen[v]) {
+                seen[v] = 1;
+                ++s.vertices;
+            } else if (s.misses - insertedAt[v] < (size_t)cacheSize) {
+                continue;
+            }
+            ++s.misses;
+            insertedAt[v] = s.misses;
+        }
+    } else {
+        std::list<unsigned> lru;
+        for (size_t i = 0; i < indexCount; ++i) {
+            unsigned v = indices[i];
+            if (!seen[v]) {
+                seen[v] = 1;
+                ++s.vertices;
+            }
+            auto it = std::find(lru.begin(), lru.end(), v);
+            if (it != lru.end()) {
+                lru.splice(lru.begin(), lru, it);
+                continue;
+            }
+            ++s.misses;
+            lru.push_front(v);
+            if ((int)lru.size() > cacheSize) lru.pop_back();
+        }
+    }
+    s.acmr = s.triangles ? (double)s.misses / s.triangles : 0.0;
+    s.atvr = s.vertices  ? (double)s.misses / s.vertices  : 0.0;
+    return s;
+}
+
+// --- Forsyth ---
+
+static const float LAST_TRI_SCORE   = 0.75f;
+static const float CACHE_DECAY      = 1.5f;
+static const float VALENCE_BOOST    = 2.0f;
+static const float VALENCE_POWER    = 0.5f;
+static const int   MAX_VALENCE_TABLE = 64;
+
+struct ForsythTables {
+    float cache[VERTEX_CACHE_SIZE];
+    float valence[MAX_VALENCE_TABLE];
+
+    ForsythTables() {
+        for (int i = 0; i < VERTEX_CACHE_SIZE; ++i) {
+            // The last triangle's vertices get a fixed score so the next
+            // triangle does not simply reuse the same edge
+            if (i < 3) {
+                cache[i] = LAST_TRI_SCORE;
+            } else {
+                float t = 1.0f - (float)(i - 3) / (VERTEX_CACHE_SIZE - 3);
+                cache[i] = std::pow(t, CACHE_DECAY);
+            }
+        }
+        valence[0] = 0.0f;
+        for (int i = 1; i < MAX_VALENCE_TABLE; ++i)
+            valence[i] = VALENCE_BOOST * std::pow((float)i, -VALENCE_POWER);
+    }
+};
+
+static float vertexScore(const ForsythTables& t, int cachePos, unsigned remaining) {
+    // Vertices with no triangles left do not matter any more
+    if (remaining == 0) return -1.0f;
+    float score = cachePos >= 0 ? t.cache[cachePos] : 0.0f;
+    score += remaining < (unsigned)MAX_VALENCE_TABLE
+                 ? t.valence[remaining]
+                 : VALENCE_BOOST * std::pow((float)remaining, -VALENCE_POWER);
+    return score;
+}
+
+void optimizeVertexCache(const unsigned* in, size_t indexCount, size_t vertexCount,
+                         unsigned* out) {
+    static const ForsythTables tables;
+    const size_t triCount = indexCount / 3;
+    if (triCount == 0) return;
+    std::vector<unsigned> src(in, in + triCount * 3);
+
+    // Small pieces of a large mesh (LOD patches) get compact vertex ids so
+    // the per-vertex arrays below scale with the piece, not the mesh
+    std::vector<unsigned> original;
+    if (vertexCount > src.size()) {
+        std::unordered_map<unsigned, unsigned> compact;
+        for (unsigned& v : src) {
+            auto it = compact.emplace(v, (unsigned)original.size());
+            if (it.second) original.push_back(v);
+            v = it.first->second;
+        }
+        vertexCount = original.size();
+    }
+
+    // Triangles of every vertex (CSR); the first `remaining` entries of a
+    // vertex's slice are the ones not emitted yet
+    std::vector<unsigned> remaining(vertexCount, 0), offset(vertexCount + 1, 0);
+    for (unsigned v : src) ++remaining[v];
+    for (size_t v = 0; v < vertexCount; ++v) offset[v + 1] = offset[v] + remaining[v];
+    std::vector<unsigned> adjacency(offset[vertexCount]);
+    {
+        std::vector<unsigned> fill(offset.begin(), offset.end() - 1);
+        for (size_t t = 0; t < triCount; ++t)
+            for (int k = 0; k < 3; ++k) adjacency[fill[src[t * 3 + k]]++] = (unsigned)t;
+    }
+
+    std::vector<int>   cachePos(vertexCount, -1);
+    std::vector<float> vScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) vScore[v] = vertexScore(tables, -1, remaining[v]);
+    std::vector<char>  emitted(triCount, 0);
+
+    int cache[VERTEX_CACHE_SIZE + 3], cacheSize = 0;
+    int newCache[VERTEX_CACHE_SIZE + 3];
+    size_t scan = 0;        // everything before it has been emitted
+    long   best = -1;
+
+    for (size_t e = 0; e < triCount; ++e) {
+        if (best < 0) {
+            // Nothing in the cache has triangles left: take the next one in order
+            while (emitted[scan]) ++scan;
+            best = (long)scan;
+        }
+        const unsigned* tri = &src[(size_t)best * 3];
+        for (int k = 0; k < 3; ++k) out[e * 3 + k] = original.empty() ? tri[k] : original[tri[k]];
+        emitted[best] = 1;
+
+        // Drop the triangle from its vertices' live lists
+        for (int k = 0; k < 3; ++k) {
+            unsigned v = tri[k];
+            unsigned* list = &adjacency[offset[v]];
+            unsigned n = remaining[v];
+            for (unsigned i = 0; i < n; ++i) {
+                if (list[i] == (unsigned)best) {
+                    list[i] = list[n - 1];
+                    break;
+                }
+            }
+            --remaining[v];
+        }
+
+        // The triangle's vertices move to the front of the cache
+        int newSize = 0;
+        for (int k = 0; k < 3; ++k) newCache[newSize++] = (int)tri[k];
+        for (int i = 0; i < cacheSize; ++i) {
+            int v = cache[i];
+            if (v != (int)tri[0] && v != (int)tri[1] && v != (int)tri[2]) newCache[newSize++] = v;
+        }
+        for (int i = 0; i < newSize; ++i) {
+            int v = newCache[i];
+            cachePos[v] = i < VERTEX_CACHE_SIZE ? i : -1;
+            vScore[v] = vertexScore(tables, cachePos[v], remaining[v]);
+        }
+
+        // Rescore the triangles touching the cache and pick the best one
+        best = -1;
+        float bestScore = -1.0f;
+        for (int i = 0; i < newSize; ++i) {
+            int v = newCache[i];
+            const unsigned* list = &adjacency[offset[v]];
+            for (unsigned j = 0; j < remaining[v]; ++j) {
+                unsigned t = list[j];
+                const unsigned* tv = &src[(size_t)t * 3];
+                float score = vScore[tv[0]] + vScore[tv[1]] + vScore[tv[2]];
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = (long)t;
+                }
+            }
+        }
+        cacheSize = std::min(newSize, VERTEX_CACHE_SIZE);
+        std::copy(newCache, newCache + cacheSize, cache);
+    }
+}
+
+// --- 16-bit splitting ---
+
+void splitIndices16(const unsigned* indices, size_t indexCount, size_t vertexCount,
+                    std::vector<uint16_t>& out, std::vector<unsigned>& remap,
+                    std::vector<IndexRange16>& ranges, unsigned maxVertices) {
+    out.resize(indexCount - indexCount % 3);
+    remap.clear();
+    ranges.clear();
+    if (maxVertices > 65536) maxVertices = 65536;
+
+    // local[v] is valid while stamp[v] == the current range number
+    std::vector<unsigned> local(vertexCount), stamp(vertexCount, 0);
+    unsigned rangeId = 1;
+    IndexRange16 range;
+    for (size_t i = 0; i + 3 <= indexCount; i += 3) {
+        unsigned fresh = 0;
+        for (int k = 0; k < 3; ++k) {
+            unsigned v = indices[i + k];
+            bool dup = (k > 0 && indices[i] == v) || (k > 1 && indices[i + 1] == v);
+            if (stamp[v] != rangeId && !dup) ++fresh;
+        }
+        if (range.vertexCount + fresh > maxVertices) {
+            ranges.push_back(range);
+            range.firstIndex = i;
+            range.indexCount = 0;
+            range.baseVertex = (unsigned)remap.size();
+            range.vertexCount = 0;
+            ++rangeId;
+        }
+        for (int k = 0; k < 3; ++k) {
+            unsigned v = indices[i + k];
+            if (stamp[v] != rangeId) {
+                stamp[v] = rangeId;
+                local[v] = range.vertexCount++;
+                remap.push_back(v);
+            }
+            out[i + k] = (uint16_t)local[v];
+        }
+        range.indexCount += 3;
+    }
+    if (range.indexCount) ranges.push_back(range);
+}
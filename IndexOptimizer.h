@@ -0,0 +1,59 @@
+// IndexOptimizer.h
+// Index buffer post-processing for the generators: triangle reordering for
+// the post-transform vertex cache (Forsyth's linear-speed algorithm),
+// splitting into ranges that fit 16-bit indices, and an ACMR/ATVR analyzer
+// with FIFO and LRU cache models to measure both.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Cache size the reordering optimizes for; it does well on any real cache
+// of about this size or larger
+static const int VERTEX_CACHE_SIZE = 32;
+
+enum VertexCacheModel {
+    VERTEX_CACHE_FIFO,    // most desktop GPUs: hits do not refresh an entry
+    VERTEX_CACHE_LRU
+};
+
+struct VertexCacheStats {
+    size_t triangles = 0;
+    size_t vertices  = 0;     // distinct vertices referenced
+    size_t misses    = 0;     // vertex shader invocations
+    double acmr = 0.0;        // misses per triangle; 0.5 is ideal for a large grid
+    double atvr = 0.0;        // misses per distinct vertex; 1.0 is ideal
+};
+
+// Simulates a cacheSize-entry cache over the triangle list
+VertexCacheStats analyzeVertexCache(const unsigned* indices, size_t indexCount,
+                                    size_t vertexCount, int cacheSize = VERTEX_CACHE_SIZE,
+                                    VertexCacheModel model = VERTEX_CACHE_FIFO);
+
+// Reorders the triangles of indices for vertex cache reuse. Triangles keep
+// their winding; in and out may be the same buffer.
+void optimizeVertexCache(const unsigned* in, size_t indexCount, size_t vertexCount,
+                         unsigned* out);
+
+// One range of a split index buffer: draw indexCount 16-bit indices from
+// firstIndex with baseVertex added
+struct IndexRange16 {
+    size_t   firstIndex = 0, indexCount = 0;
+    unsigned baseVertex = 0, vertexCount = 0;
+};
+
+// Splits a 32-bit triangle list into ranges of at most maxVertices
+// distinct vertices each, in triangle order. Every range's vertices are
+// renumbered in first-use order and laid out one range after another:
+// remap[newVertex] = oldVertex, with vertices shared between ranges
+// duplicated. Reorder the vertex arrays with remapVertices().
+void splitIndices16(const unsigned* indices, size_t indexCount, size_t vertexCount,
+                    std::vector<uint16_t>& out, std::vector<unsigned>& remap,
+                    std::vector<IndexRange16>& ranges, unsigned maxVertices = 65536);
+
+// out[i] = in[remap[i]], for vertex arrays of any element type
+template <class T>
+void remapVertices(const T* in, const std::vector<unsigned>& remap, T* out) {
+    for (size_t i = 0; i < remap.size(); ++i) out[i] = in[remap[i]];
+}
@@ -0,0 +1,92 @@
+// LockFreeQueue.h
+// Bounded multi-producer/multi-consumer queue (Dmitry Vyukov's design):
+// one atomic sequence number per slot, no locks, no allocation after
+// construction. Used to hand finished work from pool threads to the
+// render thread.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+template <class T>
+class LockFreeQueue {
+public:
+    // capacity is rounded up to a power of two
+    explicit LockFreeQueue(size_t capacity) {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        mask  = n - 1;
+        slots = std::vector<Slot>(n);
+        for (size_t i = 0; i < n; ++i)
+            slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    LockFreeQueue(const LockFreeQueue&) = delete;
+    LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    // Returns false when the queue is full
+    bool push(T value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& s = slots[pos & mask];
+            size_t seq = s.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    s.value = std::move(value);
+                    s.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false when the queue is empty
+    bool pop(T& out) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& s = slots[pos & mask];
+            size_t seq = s.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(s.value);
+                    s.seq.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq{0};
+        T value{};
+
+        Slot() = default;
+        Slot(Slot&& o) noexcept : seq(o.seq.load()), value(std::move(o.value)) {}
+        Slot& operator=(Slot&& o) noexcept {
+            seq.store(o.seq.load());
+            value = std::move(o.value);
+            return *this;
+        }
+    };
+
+    std::vector<Slot> slots;
+    size_t mask = 0;
+    // Producers and consumers on separate cache lines
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) std::atomic<size_t> head{0};
+};
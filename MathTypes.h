@@ -0,0 +1,35 @@
+// MathTypes.h
+// Minimal vector/box types for the CPU-side modules so they build without
+// glm. Vec3 has the same layout as glm::vec3 (three packed floats).
+#pragma once
+
+#include <cmath>
+
+struct Vec3 {
+    float x, y, z;
+};
+
+inline Vec3 operator+(Vec3 a, Vec3 b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+inline Vec3 operator-(Vec3 a, Vec3 b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline Vec3 operator*(Vec3 a, Vec3 b) { return {a.x * b.x, a.y * b.y, a.z * b.z}; }
+inline Vec3 operator*(Vec3 a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+
+inline float dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 cross(Vec3 a, Vec3 b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+inline Vec3 normalize(Vec3 a) {
+    float len = std::sqrt(dot(a, a));
+    return len > 0.0f ? a * (1.0f / len) : a;
+}
+inline Vec3 vmin(Vec3 a, Vec3 b) {
+    return {a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z};
+}
+inline Vec3 vmax(Vec3 a, Vec3 b) {
+    return {a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z};
+}
+
+// Simple AABB for collisions
+struct AABB {
+    Vec3 min, max;
+};
@@ -0,0 +1,109 @@
+// MeshBuilder.cpp
+#include "MeshBuilder.h"
+
+#include <atomic>
+#include <new>
+
+static const size_t MIN_BLOCK_BYTES = 64 * 1024;
+
+static std::atomic<size_t> heapAllocationsTotal{0};
+static std::atomic<size_t> heapBytesTotal{0};
+
+struct MeshArena::Block {
+    Block* next;
+    size_t size;
+    char*  data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+MeshArena::MeshArena(size_t initialBytes) {
+    if (initialBytes) current = first = addBlock(initialBytes);
+}
+
+MeshArena::~MeshArena() {
+    while (first) {
+        Block* next = first->next;
+        ::operator delete(first);
+        first = next;
+    }
+}
+
+MeshArena::Block* MeshArena::addBlock(size_t minBytes) {
+    Block* last = first;
+    while (last && last->next) last = last->next;
+    size_t size = MIN_BLOCK_BYTES;
+    if (last && last->size * 2 > size) size = last->size * 2;
+    if (minBytes > size) size = minBytes;
+
+    Block* b = static_cast<Block*>(::operator new(sizeof(Block) + size));
+    b->next = nullptr;
+    b->size = size;
+    if (last) last->next = b;
+    else first = b;
+    ++blockCount;
+    totalCapacity += size;
+    ++counters.heapAllocations;
+    counters.heapBytes += size;
+    heapAllocationsTotal.fetch_add(1, std::memory_order_relaxed);
+    heapBytesTotal.fetch_add(size, std::memory_order_relaxed);
+    return b;
+}
+
+void* MeshArena::allocate(size_t bytes, size_t align) {
+    ++counters.arenaAllocations;
+    counters.arenaBytes += bytes;
+    if (!current) {
+        current = first ? first : addBlock(bytes + align);
+        offset = 0;
+    }
+    for (;;) {
+        uintptr_t base  = reinterpret_cast<uintptr_t>(current->data());
+        uintptr_t start = (base + offset + align - 1) & ~(uintptr_t)(align - 1);
+        size_t    end   = (size_t)(start - base) + bytes;
+        if (end <= current->size) {
+            used += end - offset;
+            offset = end;
+            if (used > counters.peakBytes) counters.peakBytes = used;
+            return reinterpret_cast<void*>(start);
+        }
+        // The rest of this block is skipped until the next rewind
+        used += current->size - offset;
+        current = current->next ? current->next : addBlock(bytes + align);
+        offset = 0;
+    }
+}
+
+void MeshArena::rewind(const Marker& m) {
+    current = static_cast<Block*>(m.block);
+    offset = m.offset;
+    used = m.used;
+}
+
+void MeshArena::reset() {
+    if (blockCount > 1) {
+        // One block that fits the whole last build
+        size_t total = totalCapacity;
+        while (first) {
+            Block* next = first->next;
+            ::operator delete(first);
+            first = next;
+        }
+        blockCount = 0;
+        totalCapacity = 0;
+        addBlock(total);
+    }
+    current = first;
+    offset = 0;
+    used = 0;
+}
+
+MeshArena& threadMeshArena() {
+    static thread_local MeshArena arena;
+    return arena;
+}
+
+MeshAllocStats meshArenaHeapTotals() {
+    MeshAllocStats s;
+    s.heapAllocations = heapAllocationsTotal.load(std::memory_order_relaxed);
+    s.heapBytes = heapBytesTotal.load(std::memory_order_relaxed);
+    return s;
+}
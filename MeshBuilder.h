@@ -0,0 +1,183 @@
+// MeshBuilder.h
+// Scratch memory for mesh generation. A MeshArena hands out memory by
+// bumping a pointer through blocks it keeps between builds, so rebuilding
+// a chunk of the same size again takes nothing from the heap. Every arena
+// counts the heap blocks it takes and the bytes it hands out.
+// MeshBuilder collects vertices and indices in arena memory.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+struct MeshAllocStats {
+    size_t heapAllocations = 0, heapBytes = 0;     // blocks taken from the heap
+    size_t arenaAllocations = 0, arenaBytes = 0;   // requests served from blocks
+    size_t peakBytes = 0;                          // most bytes in use at once
+};
+
+class MeshArena {
+public:
+    // initialBytes == 0 takes the first block on the first allocation
+    explicit MeshArena(size_t initialBytes = 0);
+    ~MeshArena();
+
+    MeshArena(const MeshArena&) = delete;
+    MeshArena& operator=(const MeshArena&) = delete;
+
+    void* allocate(size_t bytes, size_t align = 16);
+    template <class T>
+    T* allocate(size_t count) {
+        static_assert(std::is_trivially_copyable<T>::value, "arena memory is never destructed");
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16));
+    }
+
+    // Position to rewind to; MeshArenaScope is the usual way to use it
+    struct Marker {
+        void*  block;
+        size_t offset, used;
+    };
+    Marker mark() const { return Marker{current, offset, used}; }
+    void   rewind(const Marker& m);
+
+    // Frees everything. When the last build needed more than one block
+    // they are replaced by a single block of their combined size.
+    void reset();
+
+    size_t bytesUsed() const { return used; }
+    size_t capacity() const { return totalCapacity; }
+    const MeshAllocStats& stats() const { return counters; }
+    void   resetStats() { counters = MeshAllocStats(); }
+
+private:
+    struct Block;
+    Block* addBlock(size_t minBytes);
+
+    Block* first = nullptr;
+    Block* current = nullptr;
+    size_t offset = 0;           // into current
+    size_t used = 0;             // over all blocks, including alignment padding
+    size_t totalCapacity = 0;
+    int    blockCount = 0;
+    MeshAllocStats counters;
+};
+
+// Rewinds the arena to where it was on construction. Scopes nest, so code
+// on a pool thread can use the thread's arena even if the task it
+// interrupted had a scope open.
+class MeshArenaScope {
+public:
+    explicit MeshArenaScope(MeshArena& a) : arena(a), marker(a.mark()) {}
+    ~MeshArenaScope() {
+        if (marker.used == 0) arena.reset();
+        else arena.rewind(marker);
+    }
+
+    MeshArenaScope(const MeshArenaScope&) = delete;
+    MeshArenaScope& operator=(const MeshArenaScope&) = delete;
+
+private:
+    MeshArena& arena;
+    MeshArena::Marker marker;
+};
+
+// Arena of the calling thread
+MeshArena& threadMeshArena();
+
+// Heap blocks taken by all arenas of the process since start-up
+MeshAllocStats meshArenaHeapTotals();
+
+// Growable array in arena memory for trivially copyable T. Growing
+// abandons the old storage until the arena rewinds, so reserve() the exact
+// size when it is known.
+template <class T>
+class ArenaArray {
+    static_assert(std::is_trivially_copyable<T>::value, "ArenaArray copies with memcpy");
+
+public:
+    explicit ArenaArray(MeshArena& a) : arena(&a) {}
+
+    void reserve(size_t n) {
+        if (n <= cap) return;
+        T* grown = arena->allocate<T>(n);
+        if (count) std::memcpy(grown, items, count * sizeof(T));
+        items = grown;
+        cap = n;
+    }
+    void resize(size_t n) {
+        reserve(n);
+        count = n;
+    }
+    // Uninitialized room for n more elements
+    T* append(size_t n) {
+        if (count + n > cap) reserve(count + n > cap * 2 ? count + n : cap * 2);
+        T* p = items + count;
+        count += n;
+        return p;
+    }
+    void push_back(const T& v) { *append(1) = v; }
+    void assign(size_t n, const T& v) {
+        resize(n);
+        for (size_t i = 0; i < n; ++i) items[i] = v;
+    }
+    void clear() { count = 0; }
+
+    T*       data()       { return items; }
+    const T* data() const { return items; }
+    size_t   size() const { return count; }
+    bool     empty() const { return count == 0; }
+    T&       operator[](size_t i)       { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+    T*       begin()       { return items; }
+    T*       end()         { return items + count; }
+    const T* begin() const { return items; }
+    const T* end() const   { return items + count; }
+
+private:
+    MeshArena* arena;
+    T*     items = nullptr;
+    size_t count = 0, cap = 0;
+};
+
+// Vertices of vertexFloats floats each plus a 32-bit triangle list
+class MeshBuilder {
+public:
+    MeshBuilder(MeshArena& arena, int vertexFloats)
+        : floats(arena), idx(arena), stride(vertexFloats) {}
+
+    void reserve(size_t vertices, size_t indices) {
+        floats.reserve(vertices * stride);
+        idx.reserve(indices);
+    }
+    void clear() {
+        floats.clear();
+        idx.clear();
+    }
+
+    // Room for n vertices; returns their first float
+    float* addVertices(size_t n) { return floats.append(n * stride); }
+    void   addTriangle(unsigned a, unsigned b, unsigned c) {
+        unsigned* p = idx.append(3);
+        p[0] = a;
+        p[1] = b;
+        p[2] = c;
+    }
+    // Two triangles over base..base + 3, corners in order around the quad
+    void   addQuad(unsigned base) {
+        unsigned* p = idx.append(6);
+        p[0] = base; p[1] = base + 1; p[2] = base + 2;
+        p[3] = base; p[4] = base + 2; p[5] = base + 3;
+    }
+
+    int             vertexFloats() const { return stride; }
+    size_t          vertexCount() const { return floats.size() / stride; }
+    size_t          indexCount() const { return idx.size(); }
+    const float*    vertices() const { return floats.data(); }
+    const unsigned* indices() const { return idx.data(); }
+
+private:
+    ArenaArray<float>    floats;
+    ArenaArray<unsigned> idx;
+    int stride;
+};
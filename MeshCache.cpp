@@ -0,0 +1,222 @@
+// MeshCache.cpp
+#include "MeshCache.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(MeshCacheHeader) == MESH_CACHE_ALIGN, "header must fill one aligned block");
+static_assert(sizeof(MeshCacheSection) == 32, "section table entries are 32 bytes");
+
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+
+static inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t mixLane(uint64_t lane, uint64_t word) {
+    return rotl64(lane + word * PRIME2, 31) * PRIME1;
+}
+
+uint64_t meshCacheChecksum(const void* data, size_t bytes) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint64_t lane[4] = {PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1};
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        for (int l = 0; l < 4; ++l) {
+            uint64_t w;
+            std::memcpy(&w, p + i + l * 8, 8);
+            lane[l] = mixLane(lane[l], w);
+        }
+    }
+    uint64_t h = rotl64(lane[0], 1) + rotl64(lane[1], 7) + rotl64(lane[2], 12) + rotl64(lane[3], 18);
+    h += (uint64_t)bytes;
+    for (; i < bytes; ++i) h = rotl64(h ^ (p[i] * PRIME1), 11) * PRIME2;
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    return h;
+}
+
+MeshCacheKey& MeshCacheKey::add(const void* data, size_t bytes) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < bytes; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return *this;
+}
+
+MeshCacheKey& MeshCacheKey::add(const char* s) {
+    // Length included so ("ab", "c") and ("a", "bc") differ
+    return add(s, std::strlen(s) + 1);
+}
+
+std::string meshCachePath(const char* dir, const char* name, uint64_t key) {
+    char file[64];
+    std::snprintf(file, sizeof(file), "%s-%016llx.meshcache", name, (unsigned long long)key);
+    std::string path = dir ? dir : "";
+    if (!path.empty() && path.back() != '/') path += '/';
+    return path + file;
+}
+
+static size_t alignUp(size_t v) {
+    return (v + MESH_CACHE_ALIGN - 1) & ~(MESH_CACHE_ALIGN - 1);
+}
+
+void MeshCacheWriter::add(uint32_t tag, const void* data, size_t count, size_t elementSize) {
+    Pending p;
+    p.tag = tag;
+    p.elementSize = (uint32_t)elementSize;
+    p.data = data;
+    p.bytes = count * elementSize;
+    sections.push_back(p);
+}
+
+bool MeshCacheWriter::write(const std::string& path, uint64_t key) const {
+    std::vector<MeshCacheSection> table(sections.size());
+    size_t offset = alignUp(sizeof(MeshCacheHeader) + table.size() * sizeof(MeshCacheSection));
+    for (size_t i = 0; i < sections.size(); ++i) {
+        MeshCacheSection& s = table[i];
+        s.tag = sections[i].tag;
+        s.elementSize = sections[i].elementSize;
+        s.offset = offset;
+        s.bytes = sections[i].bytes;
+        s.checksum = meshCacheChecksum(sections[i].data, sections[i].bytes);
+        offset = alignUp(offset + s.bytes);
+    }
+
+    MeshCacheHeader h;
+    std::memset(&h, 0, sizeof(h));
+    h.magic = MESH_CACHE_MAGIC;
+    h.version = MESH_CACHE_VERSION;
+    h.key = key;
+    h.fileSize = offset;
+    h.sectionCount = (uint32_t)table.size();
+    h.tableChecksum = meshCacheChecksum(table.data(), table.size() * sizeof(MeshCacheSection));
+
+    std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    static const uint8_t zeros[MESH_CACHE_ALIGN] = {};
+    bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1;
+    if (!table.empty())
+        ok = ok && std::fwrite(table.data(), sizeof(MeshCacheSection), table.size(), f) == table.size();
+    size_t written = sizeof(h) + table.size() * sizeof(MeshCacheSection);
+    for (size_t i = 0; ok && i < sections.size(); ++i) {
+        size_t gap = table[i].offset - written;
+        if (gap) ok = std::fwrite(zeros, 1, gap, f) == gap;
+        if (ok && table[i].bytes)
+            ok = std::fwrite(sections[i].data, 1, table[i].bytes, f) == table[i].bytes;
+        written = table[i].offset + table[i].bytes;
+    }
+    if (ok && written < offset) ok = std::fwrite(zeros, 1, offset - written, f) == offset - written;
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows
+    if (!MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+#else
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+#endif
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool MeshCacheFile::open(const std::string& path, uint64_t key) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(MeshCacheHeader)) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mapHandle = mapping;
+    base = static_cast<const uint8_t*>(view);
+    size = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(MeshCacheHeader)) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);   // the mapping keeps the file alive
+    if (view == MAP_FAILED) return false;
+    // Everything is read once for the checksums, then again by the upload
+    madvise(view, (size_t)st.st_size, MADV_WILLNEED);
+    base = static_cast<const uint8_t*>(view);
+    size = (size_t)st.st_size;
+#endif
+
+    const MeshCacheHeader* h = reinterpret_cast<const MeshCacheHeader*>(base);
+    size_t tableEnd = sizeof(MeshCacheHeader) + (size_t)h->sectionCount * sizeof(MeshCacheSection);
+    bool ok = h->magic == MESH_CACHE_MAGIC && h->version == MESH_CACHE_VERSION &&
+              h->key == key && h->fileSize == size && tableEnd <= size;
+    if (ok) {
+        table = reinterpret_cast<const MeshCacheSection*>(base + sizeof(MeshCacheHeader));
+        sectionCount = h->sectionCount;
+        ok = meshCacheChecksum(table, sectionCount * sizeof(MeshCacheSection)) == h->tableChecksum;
+    }
+    for (uint32_t i = 0; ok && i < sectionCount; ++i) {
+        const MeshCacheSection& s = table[i];
+        ok = s.offset % MESH_CACHE_ALIGN == 0 && s.offset >= tableEnd && s.offset <= size &&
+             s.bytes <= size - s.offset && s.elementSize > 0 && s.bytes % s.elementSize == 0 &&
+             meshCacheChecksum(base + s.offset, (size_t)s.bytes) == s.checksum;
+    }
+    if (!ok) close();
+    return ok;
+}
+
+void MeshCacheFile::close() {
+    if (!base) return;
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+    CloseHandle((HANDLE)mapHandle);
+    CloseHandle((HANDLE)fileHandle);
+    fileHandle = mapHandle = nullptr;
+#else
+    munmap(const_cast<uint8_t*>(base), size);
+#endif
+    base = nullptr;
+    size = 0;
+    table = nullptr;
+    sectionCount = 0;
+}
+
+const void* MeshCacheFile::section(uint32_t tag, size_t elementSize, size_t& count) const {
+    count = 0;
+    for (uint32_t i = 0; i < sectionCount; ++i) {
+        if (table[i].tag != tag) continue;
+        if (table[i].elementSize != elementSize) return nullptr;
+        count = (size_t)(table[i].bytes / elementSize);
+        return base + table[i].offset;
+    }
+    return nullptr;
+}
@@ -0,0 +1,134 @@
+// MeshCache.h
+// On-disk cache for generated mesh arrays. A file holds tagged sections
+// (vertices, indices, collision boxes, ...) at 64-byte aligned offsets and
+// is read back through mmap, so section pointers can go straight to
+// glBufferData with no copy. Files are keyed by a hash of the generation
+// parameters and validated with a version header and per-section
+// checksums; any mismatch reads as a miss and the caller regenerates.
+//
+// Layout (native little-endian):
+//   MeshCacheHeader | MeshCacheSection[sectionCount] | pad | section data...
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static const uint32_t MESH_CACHE_MAGIC   = 0x4843534D;   // "MSCH"
+static const uint32_t MESH_CACHE_VERSION = 1;
+static const size_t   MESH_CACHE_ALIGN   = 64;
+
+// Four-character section tag, e.g. meshCacheTag("VERT")
+inline uint32_t meshCacheTag(const char* s) {
+    return (uint32_t)(uint8_t)s[0] | (uint32_t)(uint8_t)s[1] << 8 |
+           (uint32_t)(uint8_t)s[2] << 16 | (uint32_t)(uint8_t)s[3] << 24;
+}
+
+// Fast 64-bit checksum (four 64-bit lanes, 32 bytes per step)
+uint64_t meshCacheChecksum(const void* data, size_t bytes);
+
+// FNV-1a over the inputs that determine the mesh. Add a name for the
+// generator first so different programs never share a key, then a version
+// of its output that is bumped whenever the generating code changes; the
+// parameters alone cannot tell an old file from a new one.
+class MeshCacheKey {
+public:
+    MeshCacheKey& add(const void* data, size_t bytes);
+    MeshCacheKey& add(const char* s);
+    MeshCacheKey& add(int v)      { return add(&v, sizeof(v)); }
+    MeshCacheKey& add(uint32_t v) { return add(&v, sizeof(v)); }
+    MeshCacheKey& add(uint64_t v) { return add(&v, sizeof(v)); }
+    MeshCacheKey& add(float v)    { return add(&v, sizeof(v)); }
+    MeshCacheKey& add(bool v)     { return add(v ? 1 : 0); }
+    uint64_t value() const { return hash; }
+
+private:
+    uint64_t hash = 14695981039346656037ull;
+};
+
+// "<dir>/<name>-<key as hex>.meshcache"
+std::string meshCachePath(const char* dir, const char* name, uint64_t key);
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t fileSize;
+    uint32_t sectionCount;
+    uint32_t reserved;
+    uint64_t tableChecksum;      // of the section table
+    uint8_t  pad[24];
+};
+
+struct MeshCacheSection {
+    uint32_t tag;
+    uint32_t elementSize;
+    uint64_t offset;             // from the start of the file, MESH_CACHE_ALIGN aligned
+    uint64_t bytes;
+    uint64_t checksum;
+};
+
+// Collects borrowed arrays and writes them in one go. The arrays must stay
+// alive until write() returns.
+class MeshCacheWriter {
+public:
+    void add(uint32_t tag, const void* data, size_t count, size_t elementSize);
+    template <class T>
+    void add(uint32_t tag, const std::vector<T>& v) { add(tag, v.data(), v.size(), sizeof(T)); }
+
+    // Writes to a temporary file and renames it over path, so a crash or a
+    // concurrent reader never sees a half-written cache
+    bool write(const std::string& path, uint64_t key) const;
+
+private:
+    struct Pending {
+        uint32_t    tag, elementSize;
+        const void* data;
+        size_t      bytes;
+    };
+    std::vector<Pending> sections;
+};
+
+// Read-only mapping of a cache file
+class MeshCacheFile {
+public:
+    MeshCacheFile() {}
+    ~MeshCacheFile() { close(); }
+
+    MeshCacheFile(const MeshCacheFile&) = delete;
+    MeshCacheFile& operator=(const MeshCacheFile&) = delete;
+
+    // Maps path and checks magic, version, key, size and every checksum.
+    // Returns false (and stays closed) on a missing or stale file.
+    bool open(const std::string& path, uint64_t key);
+    void close();
+    bool isOpen() const { return base != nullptr; }
+
+    // Section data inside the mapping, valid until close(); nullptr if the
+    // tag is missing or its element size differs
+    const void* section(uint32_t tag, size_t elementSize, size_t& count) const;
+    template <class T>
+    const T* array(uint32_t tag, size_t& count) const {
+        return static_cast<const T*>(section(tag, sizeof(T), count));
+    }
+    // Copies a section into a vector; false if it is missing
+    template <class T>
+    bool copy(uint32_t tag, std::vector<T>& out) const {
+        size_t count = 0;
+        const T* p = array<T>(tag, count);
+        if (!p) return false;
+        out.assign(p, p + count);
+        return true;
+    }
+
+private:
+    const uint8_t* base = nullptr;
+    size_t         size = 0;
+    const MeshCacheSection* table = nullptr;
+    uint32_t       sectionCount = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mapHandle  = nullptr;
+#endif
+};
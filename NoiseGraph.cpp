@@ -0,0 +1,26 @@
+// NoiseGraph.cpp
+#include "NoiseGraph.h"
+
+// splitmix64: fixed arithmetic, so tables do not depend on the standard
+// library's engines or distributions
+static uint64_t nextSplitMix(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+NoisePerm makeNoisePerm(uint32_t seed) {
+    NoisePerm perm;
+    for (int i = 0; i < 256; ++i) perm.p[i] = (uint8_t)i;
+    // Fisher-Yates
+    uint64_t state = seed;
+    for (int i = 255; i > 0; --i) {
+        int j = (int)(nextSplitMix(state) % (uint64_t)(i + 1));
+        uint8_t t = perm.p[i];
+        perm.p[i] = perm.p[j];
+        perm.p[j] = t;
+    }
+    for (int i = 0; i < 256; ++i) perm.p[256 + i] = perm.p[i];
+    return perm;
+}
@@ -0,0 +1,499 @@
+// NoiseGraph.h
+// Seeded noise sources and combinators that compose into one type, e.g.
+//
+//   typedef Shared<0, Fbm<3, SimplexNoise>>        Continents;
+//   typedef DomainWarp<Continents, Fbm<5, GradientNoise>> Hills;
+//   typedef Blend<Hills, Ridged<4, SimplexNoise>, Continents> Terrain;
+//
+// The whole graph is a template, so octave counts are loop bounds known
+// at compile time and every node call inlines; nothing is interpreted
+// per sample. Runtime settings (seeds, frequencies, gains) live in the
+// node members.
+//
+// Nodes evaluate one sample with sample(x, y) (sources and the fractal
+// nodes also take z), or a batch of points with batch(), which is what
+// sampleNoise() runs. A batch is one tile: scratch arrays come from the
+// thread's MeshArena, and a Shared<Id, ...> node asked twice for the same
+// points in one tile computes them once. Sources return about [-1, 1];
+// Fbm, Ridged, DomainWarp and Blend keep that range.
+#pragma once
+
+#include "MeshBuilder.h"
+
+#include <cmath>
+#include <cstdint>
+
+// Permutation doubled so lookups like p[p[x] + y + 1] never wrap
+struct NoisePerm {
+    uint8_t p[512];
+};
+
+// Same table for the same seed on every platform
+NoisePerm makeNoisePerm(uint32_t seed);
+
+// Per-tile scratch and the results of shared nodes
+class NoiseContext {
+public:
+    explicit NoiseContext(MeshArena& a) : arena(a), scope(a) {}
+
+    NoiseContext(const NoiseContext&) = delete;
+    NoiseContext& operator=(const NoiseContext&) = delete;
+
+    // Lives until the context is destroyed, so arrays handed to children
+    // are never reused within the tile
+    float* scratch(int n) { return arena.allocate<float>((size_t)n); }
+
+    // Values a shared node computed for exactly these point arrays
+    const float* find(int id, const float* x, const float* y, int n) const {
+        for (int i = 0; i < count; ++i) {
+            const Entry& e = entries[i];
+            if (e.id == id && e.x == x && e.y == y && e.n == n) return e.values;
+        }
+        return nullptr;
+    }
+    void store(int id, const float* x, const float* y, int n, const float* values) {
+        if (count < MAX_ENTRIES) entries[count++] = Entry{id, x, y, n, values};
+    }
+
+    int hits = 0, misses = 0;
+
+private:
+    struct Entry {
+        int id;
+        const float *x, *y;
+        int n;
+        const float* values;
+    };
+    static const int MAX_ENTRIES = 16;
+
+    MeshArena&     arena;
+    MeshArenaScope scope;
+    Entry entries[MAX_ENTRIES];
+    int   count = 0;
+};
+
+// Evaluates a graph at count points
+template <class Node>
+void sampleNoise(const Node& node, const float* xs, const float* ys, int count, float* out) {
+    NoiseContext ctx(threadMeshArena());
+    node.batch(xs, ys, count, out, ctx);
+}
+
+inline int   noiseFloor(float x) { int i = (int)x; return x < (float)i ? i - 1 : i; }
+inline float noiseFade(float t) { return t * t * t * (t * (t * 6 - 15) + 10); }
+inline float noiseLerp(float a, float b, float t) { return a + t * (b - a); }
+inline float noiseClamp01(float t) { return t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t); }
+
+// Ken Perlin's gradients: four diagonals in 2D, twelve cube edges in 3D
+inline float noiseGrad2(int hash, float x, float y) {
+    return ((hash & 1) ? -x : x) + ((hash & 2) ? -y : y);
+}
+inline float noiseGrad3(int hash, float x, float y, float z) {
+    int h = hash & 15;
+    float u = h < 8 ? x : y;
+    float v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+    return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+// Simplex corner gradients (cube edge midpoints)
+static const float NOISE_SIMPLEX_GRAD[12][3] = {
+    {1, 1, 0}, {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0},
+    {1, 0, 1}, {-1, 0, 1}, {1, 0, -1}, {-1, 0, -1},
+    {0, 1, 1}, {0, -1, 1}, {0, 1, -1}, {0, -1, -1}
+};
+
+// batch() for nodes that have nothing better than a loop over sample()
+template <class Node>
+inline void noiseBatchBySample(const Node& node, const float* x, const float* y, int n, float* out) {
+    for (int i = 0; i < n; ++i) out[i] = node.sample(x[i], y[i]);
+}
+
+// ---------------------------------------------------------------------------
+// Sources
+// ---------------------------------------------------------------------------
+
+// Improved Perlin gradient noise
+struct GradientNoise {
+    NoisePerm perm;
+
+    explicit GradientNoise(uint32_t seed = 0) : perm(makeNoisePerm(seed)) {}
+
+    float sample(float x, float y) const {
+        const uint8_t* p = perm.p;
+        int fx = noiseFloor(x), fy = noiseFloor(y);
+        int xi = fx & 255, yi = fy & 255;
+        float xf = x - fx, yf = y - fy;
+        float u = noiseFade(xf), v = noiseFade(yf);
+        int a = p[xi] + yi, b = p[xi + 1] + yi;
+        float x1 = noiseLerp(noiseGrad2(p[a], xf, yf), noiseGrad2(p[b], xf - 1, yf), u);
+        float x2 = noiseLerp(noiseGrad2(p[a + 1], xf, yf - 1),
+                             noiseGrad2(p[b + 1], xf - 1, yf - 1), u);
+        return noiseLerp(x1, x2, v);
+    }
+
+    float sample(float x, float y, float z) const {
+        const uint8_t* p = perm.p;
+        int fx = noiseFloor(x), fy = noiseFloor(y), fz = noiseFloor(z);
+        int X = fx & 255, Y = fy & 255, Z = fz & 255;
+        x -= fx;
+        y -= fy;
+        z -= fz;
+        float u = noiseFade(x), v = noiseFade(y), w = noiseFade(z);
+        int A = p[X] + Y, AA = p[A] + Z, AB = p[A + 1] + Z;
+        int B = p[X + 1] + Y, BA = p[B] + Z, BB = p[B + 1] + Z;
+        float x00 = noiseLerp(noiseGrad3(p[AA], x, y, z), noiseGrad3(p[BA], x - 1, y, z), u);
+        float x10 = noiseLerp(noiseGrad3(p[AB], x, y - 1, z), noiseGrad3(p[BB], x - 1, y - 1, z), u);
+        float x01 = noiseLerp(noiseGrad3(p[AA + 1], x, y, z - 1),
+                              noiseGrad3(p[BA + 1], x - 1, y, z - 1), u);
+        float x11 = noiseLerp(noiseGrad3(p[AB + 1], x, y - 1, z - 1),
+                              noiseGrad3(p[BB + 1], x - 1, y - 1, z - 1), u);
+        return noiseLerp(noiseLerp(x00, x10, v), noiseLerp(x01, x11, v), w);
+    }
+
+    void batch(const float* x, const float* y, int n, float* out, NoiseContext&) const {
+        noiseBatchBySample(*this, x, y, n, out);
+    }
+};
+
+// Simplex noise (Gustavson's formulation); cheaper than gradient noise in
+// 3D and free of its axis-aligned look
+struct SimplexNoise {
+    NoisePerm perm;
+
+    explicit SimplexNoise(uint32_t seed = 0) : perm(makeNoisePerm(seed)) {}
+
+    float sample(float x, float y) const {
+        const float F2 = 0.36602540378f;   // (sqrt(3) - 1) / 2
+        const float G2 = 0.21132486540f;   // (3 - sqrt(3)) / 6
+        const uint8_t* p = perm.p;
+        float s = (x + y) * F2;
+        int i = noiseFloor(x + s), j = noiseFloor(y + s);
+        float t = (i + j) * G2;
+        float x0 = x - (i - t), y0 = y - (j - t);
+        int i1 = x0 > y0 ? 1 : 0, j1 = 1 - i1;
+        float x1 = x0 - i1 + G2, y1 = y0 - j1 + G2;
+        float x2 = x0 - 1 + 2 * G2, y2 = y0 - 1 + 2 * G2;
+        int ii = i & 255, jj = j & 255;
+        float xs[3] = {x0, x1, x2}, ys[3] = {y0, y1, y2};
+        int g[3] = {p[ii + p[jj]] % 12, p[ii + i1 + p[jj + j1]] % 12, p[ii + 1 + p[jj + 1]] % 12};
+        float sum = 0.0f;
+        for (int c = 0; c < 3; ++c) {
+            float r = 0.5f - xs[c] * xs[c] - ys[c] * ys[c];
+            if (r <= 0.0f) continue;
+            r *= r;
+            const float* gr = NOISE_SIMPLEX_GRAD[g[c]];
+            sum += r * r * (gr[0] * xs[c] + gr[1] * ys[c]);
+        }
+        return 70.0f * sum;
+    }
+
+    float sample(float x, float y, float z) const {
+        const float F3 = 1.0f / 3.0f, G3 = 1.0f / 6.0f;
+        const uint8_t* p = perm.p;
+        float s = (x + y + z) * F3;
+        int i = noiseFloor(x + s), j = noiseFloor(y + s), k = noiseFloor(z + s);
+        float t = (i + j + k) * G3;
+        float x0 = x - (i - t), y0 = y - (j - t), z0 = z - (k - t);
+        // Which of the six tetrahedra of the skewed cube holds the point
+        int i1, j1, k1, i2, j2, k2;
+        if (x0 >= y0) {
+            if (y0 >= z0)      { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+            else if (x0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1; }
+            else               { i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1; }
+        } else {
+            if (y0 < z0)       { i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1; }
+            else if (x0 < z0)  { i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1; }
+            else               { i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+        }
+        float xs[4] = {x0, x0 - i1 + G3, x0 - i2 + 2 * G3, x0 - 1 + 3 * G3};
+        float ys[4] = {y0, y0 - j1 + G3, y0 - j2 + 2 * G3, y0 - 1 + 3 * G3};
+        float zs[4] = {z0, z0 - k1 + G3, z0 - k2 + 2 * G3, z0 - 1 + 3 * G3};
+        int ii = i & 255, jj = j & 255, kk = k & 255;
+        int g[4] = {p[ii + p[jj + p[kk]]] % 12,
+                    p[ii + i1 + p[jj + j1 + p[kk + k1]]] % 12,
+                    p[ii + i2 + p[jj + j2 + p[kk + k2]]] % 12,
+                    p[ii + 1 + p[jj + 1 + p[kk + 1]]] % 12};
+        float sum = 0.0f;
+        for (int c = 0; c < 4; ++c) {
+            float r = 0.6f - xs[c] * xs[c] - ys[c] * ys[c] - zs[c] * zs[c];
+            if (r <= 0.0f) continue;
+            r *= r;
+            const float* gr = NOISE_SIMPLEX_GRAD[g[c]];
+            sum += r * r * (gr[0] * xs[c] + gr[1] * ys[c] + gr[2] * zs[c]);
+        }
+        return 32.0f * sum;
+    }
+
+    void batch(const float* x, const float* y, int n, float* out, NoiseContext&) const {
+        noiseBatchBySample(*this, x, y, n, out);
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Combinators
+// ---------------------------------------------------------------------------
+
+// Fractal sum of Octaves copies of the source, divided by the total
+// amplitude
+template <int Octaves, class Source>
+struct Fbm {
+    static_assert(Octaves >= 1, "Fbm needs at least one octave");
+
+    Source source;
+    float  lacunarity = 2.0f;   // frequency multiplier per octave
+    float  gain = 0.5f;         // amplitude multiplier per octave
+
+    Fbm() {}
+    explicit Fbm(const Source& s) : source(s) {}
+
+    float sample(float x, float y) const {
+        float sum = 0.0f, norm = 0.0f, amp = 1.0f, freq = 1.0f;
+        for (int o = 0; o < Octaves; ++o) {
+            sum  += amp * source.sample(x * freq, y * freq);
+            norm += amp;
+            amp  *= gain;
+            freq *= lacunarity;
+        }
+        return sum / norm;
+    }
+
+    float sample(float x, float y, float z) const {
+        float sum = 0.0f, norm = 0.0f, amp = 1.0f, freq = 1.0f;
+        for (int o = 0; o < Octaves; ++o) {
+            sum  += amp * source.sample(x * freq, y * freq, z * freq);
+            norm += amp;
+            amp  *= gain;
+            freq *= lacunarity;
+        }
+        return sum / norm;
+    }
+
+    void batch(const float* x, const float* y, int n, float* out, NoiseContext& ctx) const {
+        float* octave = ctx.scratch(n);
+        for (int i = 0; i < n; ++i) out[i] = 0.0f;
+        float norm = 0.0f, amp = 1.0f, freq = 1.0f;
+        for (int o = 0; o < Octaves; ++o) {
+            const float *ox = x, *oy = y;
+            if (o > 0) {
+                float* sx = ctx.scratch(n);
+                float* sy = ctx.scratch(n);
+                for (int i = 0; i < n; ++i) {
+                    sx[i] = x[i] * freq;
+                    sy[i] = y[i] * freq;
+                }
+                ox = sx;
+                oy = sy;
+            }
+            source.batch(ox, oy, n, octave, ctx);
+            for (int i = 0; i < n; ++i) out[i] += amp * octave[i];
+            norm += amp;
+            amp  *= gain;
+            freq *= lacunarity;
+        }
+        // Divide like sample() does, so both paths give the same floats
+        for (int i = 0; i < n; ++i) out[i] /= norm;
+    }
+};
+
+// Ridged multifractal: octaves of (1 - |n|)^2, each weighted by the one
+// before so ridges stay sharp and valleys smooth
+template <int Octaves, class Source>
+struct Ridged {
+    static_assert(Octaves >= 1, "Ridged needs at least one octave");
+
+    Source source;
+    float  lacunarity = 2.0f;
+    float  gain = 0.5f;
+    float  weighting = 2.0f;    // how strongly a ridge feeds the next octave
+
+    Ridged() {}
+    explicit Ridged(const Source& s) : source(s) {}
+
+    float sample(float x, float y) const {
+        float r[Octaves];
+        float freq = 1.0f;
+        for (int o = 0; o < Octaves; ++o, freq *= lacunarity)
+            r[o] = source.sample(x * freq, y * freq);
+        return combine(r);
+    }
+
+    float sample(float x, float y, float z) const {
+        float r[Octaves];
+        float freq = 1.0f;
+        for (int o = 0; o < Octaves; ++o, freq *= lacunarity)
+            r[o] = source.sample(x * freq, y * freq, z * freq);
+        return combine(r);
+    }
+
+    void batch(const float* x, const float* y, int n, float* out, NoiseContext& ctx) const {
+        float* octaves[Octaves];
+        float freq = 1.0f;
+        for (int o = 0; o < Octaves; ++o, freq *= lacunarity) {
+            octaves[o] = ctx.scratch(n);
+            const float *ox = x, *oy = y;
+            if (o > 0) {
+                float* sx = ctx.scratch(n);
+                float* sy = ctx.scratch(n);
+                for (int i = 0; i < n; ++i) {
+                    sx[i] = x[i] * freq;
+                    sy[i] = y[i] * freq;
+                }
+                ox = sx;
+                oy = sy;
+            }
+            source.batch(ox, oy, n, octaves[o], ctx);
+        }
+        for (int i = 0; i < n; ++i) {
+            float r[Octaves];
+            for (int o = 0; o < Octaves; ++o) r[o] = octaves[o][i];
+            out[i] = combine(r);
+        }
+    }
+
+private:
+    float combine(const float* r) const {
+        float sum = 0.0f, norm = 0.0f, amp = 1.0f, weight = 1.0f;
+        for (int o = 0; o < Octaves; ++o) {
+            float s = 1.0f - std::fabs(r[o]);
+            s *= s * weight;
+            weight = noiseClamp01(s * weighting);
+            sum  += s * amp;
+            norm += amp;
+            amp  *= gain;
+        }
+        return 2.0f * sum / norm - 1.0f;   // [0, 1] ridges back to [-1, 1]
+    }
+};
+
+// Samples the source at points pushed around by the warp node
+template <class Warp, class Source>
+struct DomainWarp {
+    Warp   warp;
+    Source source;
+    float  strength = 1.0f;     // displacement in source units per warp unit
+
+    DomainWarp() {}
+    DomainWarp(const Warp& w, const Source& s, float k = 1.0f) : warp(w), source(s), strength(k) {}
+
+    // The y displacement reads the warp at an offset so it is not just
+    // the x displacement again
+    static constexpr float OFFSET_X = 5.2f, OFFSET_Y = 1.3f;
+
+    float sample(float x, float y) const {
+        float dx = warp.sample(x, y);
+        float dy = warp.sample(x + OFFSET_X, y + OFFSET_Y);
+        return source.sample(x + strength * dx, y + strength * dy);
+    }
+
+    void batch(const float* x, const float* y, int n, float* out, NoiseContext& ctx) const {
+        float* dx = ctx.scratch(n);
+        float* dy = ctx.scratch(n);
+        float* ox = ctx.scratch(n);
+        float* oy = ctx.scratch(n);
+        warp.batch(x, y, n, dx, ctx);
+        for (int i = 0; i < n; ++i) {
+            ox[i] = x[i] + OFFSET_X;
+            oy[i] = y[i] + OFFSET_Y;
+        }
+        warp.batch(ox, oy, n, dy, ctx);
+        // The offset points are done with; the warped ones go in new arrays
+        float* wx = ctx.scratch(n);
+        float* wy = ctx.scratch(n);
+        for (int i = 0; i < n; ++i) {
+            wx[i] = x[i] + strength * dx[i];
+            wy[i] = y[i] + strength * dy[i];
+        }
+        source.batch(wx, wy, n, out, ctx);
+    }
+};
+
+// offset + amplitude * source(x * frequency, y * frequency)
+template <class Source>
+struct ScaleBias {
+    Source source;
+    float  frequency = 1.0f;
+    float  amplitude = 1.0f;
+    float  offset = 0.0f;
+
+    ScaleBias() {}
+    ScaleBias(const Source& s, float f, float a, float b)
+        : source(s), frequency(f), amplitude(a), offset(b) {}
+
+    float sample(float x, float y) const {
+        return offset + amplitude * source.sample(x * frequency, y * frequency);
+    }
+    float sample(float x, float y, float z) const {
+        return offset + amplitude * source.sample(x * frequency, y * frequency, z * frequency);
+    }
+
+    void batch(const float* x, const float* y, int n, float* out, NoiseContext& ctx) const {
+        float* sx = ctx.scratch(n);
+        float* sy = ctx.scratch(n);
+        for (int i = 0; i < n; ++i) {
+            sx[i] = x[i] * frequency;
+            sy[i] = y[i] * frequency;
+        }
+        source.batch(sx, sy, n, out, ctx);
+        for (int i = 0; i < n; ++i) out[i] = offset + amplitude * out[i];
+    }
+};
+
+// Mixes a and b by the mask: -1 gives a, 1 gives b, with a smooth step
+// across `width` around `center`
+template <class A, class B, class Mask>
+struct Blend {
+    A     a;
+    B     b;
+    Mask  mask;
+    float center = 0.0f;
+    float width = 1.0f;
+
+    Blend() {}
+    Blend(const A& a_, const B& b_, const Mask& m) : a(a_), b(b_), mask(m) {}
+
+    float weight(float m) const {
+        float t = noiseClamp01((m - center) / width + 0.5f);
+        return t * t * (3.0f - 2.0f * t);
+    }
+
+    float sample(float x, float y) const {
+        return noiseLerp(a.sample(x, y), b.sample(x, y), weight(mask.sample(x, y)));
+    }
+
+    void batch(const float* x, const float* y, int n, float* out, NoiseContext& ctx) const {
+        float* vb = ctx.scratch(n);
+        float* vm = ctx.scratch(n);
+        a.batch(x, y, n, out, ctx);
+        b.batch(x, y, n, vb, ctx);
+        mask.batch(x, y, n, vm, ctx);
+        for (int i = 0; i < n; ++i) out[i] = noiseLerp(out[i], vb[i], weight(vm[i]));
+    }
+};
+
+// Marks a node used in several places of a graph. Within one tile, later
+// requests for the same points reuse the first result. Ids only need to
+// be unique within a graph.
+template <int Id, class Source>
+struct Shared {
+    Source source;
+
+    Shared() {}
+    explicit Shared(const Source& s) : source(s) {}
+
+    float sample(float x, float y) const { return source.sample(x, y); }
+    float sample(float x, float y, float z) const { return source.sample(x, y, z); }
+
+    void batch(const float* x, const float* y, int n, float* out, NoiseContext& ctx) const {
+        const float* cached = ctx.find(Id, x, y, n);
+        if (cached) {
+            ++ctx.hits;
+        } else {
+            ++ctx.misses;
+            float* values = ctx.scratch(n);
+            source.batch(x, y, n, values, ctx);
+            ctx.store(Id, x, y, n, values);
+            cached = values;
+        }
+        for (int i = 0; i < n; ++i) out[i] = cached[i];
+    }
+};
@@ -0,0 +1,320 @@
+// PerlinNoise.cpp
+#include "PerlinNoise.h"
+
+#include <atomic>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PERLIN_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// Ken Perlin's reference permutation
+static constexpr int PERMUTATION[256] = {
+    151,160,137,91,90,15,131,13,201,95,96,53,194,233,7,225,
+    140,36,103,30,69,142,8,99,37,240,21,10,23,190,6,148,
+    247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,
+    57,177,33,88,237,149,56,87,174,20,125,136,171,168,68,175,
+    74,165,71,134,139,48,27,166,77,146,158,231,83,111,229,122,
+    60,211,133,230,220,105,92,41,55,46,245,40,244,102,143,54,
+    65,25,63,161,1,216,80,73,209,76,132,187,208,89,18,169,
+    200,196,135,130,116,188,159,86,164,100,109,198,173,186,3,64,
+    52,217,226,250,124,123,5,202,38,147,118,126,255,82,85,212,
+    207,206,59,227,47,16,58,17,182,189,28,42,223,183,170,213,
+    119,248,152,2,44,154,163,70,221,153,101,155,167,43,172,9,
+    129,22,39,253,19,98,108,110,79,113,224,232,178,185,112,104,
+    218,246,97,228,251,34,242,193,238,210,144,12,191,179,162,241,
+    81,51,145,235,249,14,239,107,49,192,214,31,181,199,106,157,
+    184,84,204,176,115,121,50,45,127,4,150,254,138,236,205,93,
+    222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180
+};
+
+// Permutation doubled so p[p[xi] + yi + 1] never wraps. Built at compile
+// time, so there is no per-call "initialized" check.
+struct PermTable {
+    int p[512] = {};
+    constexpr PermTable() {
+        for (int i = 0; i < 256; ++i)
+            p[256 + i] = p[i] = PERMUTATION[i];
+    }
+};
+static constexpr PermTable PERM;
+
+// Longest run handed to a kernel at once; keeps scratch buffers on the stack
+static const int CHUNK = 256;
+
+// ---------------------------------------------------------------------------
+// Scalar reference
+// ---------------------------------------------------------------------------
+
+static inline float fade(float t) { return t * t * t * (t * (t * 6 - 15) + 10); }
+static inline float lerp(float a, float b, float t) { return a + t * (b - a); }
+static inline float grad(int hash, float x, float y) {
+    switch (hash & 3) {
+        case 0: return  x + y;
+        case 1: return -x + y;
+        case 2: return  x - y;
+        case 3: return -x - y;
+    }
+    return 0.0f; // never happens
+}
+
+float perlinNoise(float x, float y) {
+    const int* p = PERM.p;
+    int xi = (int)std::floor(x) & 255;
+    int yi = (int)std::floor(y) & 255;
+    float xf = x - std::floor(x), yf = y - std::floor(y);
+    float u = fade(xf), v = fade(yf);
+
+    int aa = p[p[xi] + yi], ab = p[p[xi] + yi + 1];
+    int ba = p[p[xi + 1] + yi], bb = p[p[xi + 1] + yi + 1];
+
+    float x1 = lerp(grad(aa, xf,    yf),
+                    grad(ba, xf-1,  yf),    u);
+    float x2 = lerp(grad(ab, xf,    yf-1),
+                    grad(bb, xf-1,  yf-1),  u);
+    return (lerp(x1, x2, v) + 1.0f) * 0.5f; // normalize to [0,1]
+}
+
+float perlinFbm(float x, float y, const FbmParams& fbm) {
+    int octaves = fbm.octaves < 1 ? 1 : fbm.octaves;
+    float sum = 0.0f, norm = 0.0f, amp = 1.0f, freq = 1.0f;
+    for (int o = 0; o < octaves; ++o) {
+        sum  += amp * perlinNoise(x * freq, y * freq);
+        norm += amp;
+        amp  *= fbm.gain;
+        freq *= fbm.lacunarity;
+    }
+    return sum / norm;
+}
+
+static void noiseScalar(const float* xs, const float* ys, int count, float* out) {
+    for (int i = 0; i < count; ++i)
+        out[i] = perlinNoise(xs[i], ys[i]);
+}
+
+// ---------------------------------------------------------------------------
+// SIMD kernels. Gradients use sign flips instead of a switch:
+// bit 0 of the hash negates x, bit 1 negates y, which is exactly
+// the four cases of grad() above.
+// ---------------------------------------------------------------------------
+
+#ifdef PERLIN_X86_KERNELS
+
+__attribute__((target("sse4.1")))
+static inline __m128 fade4(__m128 t) {
+    __m128 inner = _mm_add_ps(
+        _mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))),
+        _mm_set1_ps(10.0f));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t) {
+    return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 grad4(__m128i hash, __m128 x, __m128 y) {
+    __m128 sx = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(hash, _mm_set1_epi32(1)), 31));
+    __m128 sy = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(hash, _mm_set1_epi32(2)), 30));
+    return _mm_add_ps(_mm_xor_ps(x, sx), _mm_xor_ps(y, sy));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 noise4(__m128 x, __m128 y) {
+    const int* p = PERM.p;
+    __m128 fx = _mm_floor_ps(x), fy = _mm_floor_ps(y);
+    __m128i mask = _mm_set1_epi32(255);
+    alignas(16) int xi[4], yi[4];
+    _mm_store_si128((__m128i*)xi, _mm_and_si128(_mm_cvttps_epi32(fx), mask));
+    _mm_store_si128((__m128i*)yi, _mm_and_si128(_mm_cvttps_epi32(fy), mask));
+    __m128 xf = _mm_sub_ps(x, fx), yf = _mm_sub_ps(y, fy);
+    __m128 u = fade4(xf), v = fade4(yf);
+
+    // No gather before AVX2; the four lanes are looked up one by one
+    alignas(16) int aa[4], ab[4], ba[4], bb[4];
+    for (int l = 0; l < 4; ++l) {
+        int a = p[xi[l]] + yi[l], b = p[xi[l] + 1] + yi[l];
+        aa[l] = p[a]; ab[l] = p[a + 1];
+        ba[l] = p[b]; bb[l] = p[b + 1];
+    }
+
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 xf1 = _mm_sub_ps(xf, one), yf1 = _mm_sub_ps(yf, one);
+    __m128 x1 = lerp4(grad4(_mm_load_si128((const __m128i*)aa), xf,  yf),
+                      grad4(_mm_load_si128((const __m128i*)ba), xf1, yf), u);
+    __m128 x2 = lerp4(grad4(_mm_load_si128((const __m128i*)ab), xf,  yf1),
+                      grad4(_mm_load_si128((const __m128i*)bb), xf1, yf1), u);
+    return _mm_mul_ps(_mm_add_ps(lerp4(x1, x2, v), one), _mm_set1_ps(0.5f));
+}
+
+__attribute__((target("sse4.1")))
+static void noiseSse41(const float* xs, const float* ys, int count, float* out) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(out + i, noise4(_mm_loadu_ps(xs + i), _mm_loadu_ps(ys + i)));
+    for (; i < count; ++i)
+        out[i] = perlinNoise(xs[i], ys[i]);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 fade8(__m256 t) {
+    __m256 inner = _mm256_add_ps(
+        _mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f))),
+        _mm256_set1_ps(10.0f));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 lerp8(__m256 a, __m256 b, __m256 t) {
+    return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 grad8(__m256i hash, __m256 x, __m256 y) {
+    __m256 sx = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(hash, _mm256_set1_epi32(1)), 31));
+    __m256 sy = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(hash, _mm256_set1_epi32(2)), 30));
+    return _mm256_add_ps(_mm256_xor_ps(x, sx), _mm256_xor_ps(y, sy));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 noise8(__m256 x, __m256 y) {
+    const int* p = PERM.p;
+    __m256 fx = _mm256_floor_ps(x), fy = _mm256_floor_ps(y);
+    __m256i mask = _mm256_set1_epi32(255), oneI = _mm256_set1_epi32(1);
+    __m256i xi = _mm256_and_si256(_mm256_cvttps_epi32(fx), mask);
+    __m256i yi = _mm256_and_si256(_mm256_cvttps_epi32(fy), mask);
+    __m256 xf = _mm256_sub_ps(x, fx), yf = _mm256_sub_ps(y, fy);
+    __m256 u = fade8(xf), v = fade8(yf);
+
+    __m256i a = _mm256_add_epi32(_mm256_i32gather_epi32(p, xi, 4), yi);
+    __m256i b = _mm256_add_epi32(_mm256_i32gather_epi32(p, _mm256_add_epi32(xi, oneI), 4), yi);
+    __m256i aa = _mm256_i32gather_epi32(p, a, 4);
+    __m256i ab = _mm256_i32gather_epi32(p, _mm256_add_epi32(a, oneI), 4);
+    __m256i ba = _mm256_i32gather_epi32(p, b, 4);
+    __m256i bb = _mm256_i32gather_epi32(p, _mm256_add_epi32(b, oneI), 4);
+
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 xf1 = _mm256_sub_ps(xf, one), yf1 = _mm256_sub_ps(yf, one);
+    __m256 x1 = lerp8(grad8(aa, xf, yf),  grad8(ba, xf1, yf),  u);
+    __m256 x2 = lerp8(grad8(ab, xf, yf1), grad8(bb, xf1, yf1), u);
+    return _mm256_mul_ps(_mm256_add_ps(lerp8(x1, x2, v), one), _mm256_set1_ps(0.5f));
+}
+
+__attribute__((target("avx2")))
+static void noiseAvx2(const float* xs, const float* ys, int count, float* out) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(out + i, noise8(_mm256_loadu_ps(xs + i), _mm256_loadu_ps(ys + i)));
+    for (; i < count; ++i)
+        out[i] = perlinNoise(xs[i], ys[i]);
+}
+
+#endif // PERLIN_X86_KERNELS
+
+// ---------------------------------------------------------------------------
+// Runtime dispatch
+// ---------------------------------------------------------------------------
+
+typedef void (*NoiseKernel)(const float*, const float*, int, float*);
+
+static NoiseIsa bestIsa() {
+#ifdef PERLIN_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))   return NOISE_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return NOISE_SSE41;
+#endif
+    return NOISE_SCALAR;
+}
+
+static NoiseKernel kernelFor(NoiseIsa isa) {
+#ifdef PERLIN_X86_KERNELS
+    if (isa == NOISE_AVX2)  return noiseAvx2;
+    if (isa == NOISE_SSE41) return noiseSse41;
+#endif
+    (void)isa;
+    return noiseScalar;
+}
+
+// Constant-initialized to the scalar path so callers from other static
+// initializers are safe; upgraded to the best kernel during startup.
+// Atomic because setPerlinNoiseIsa() may run while pool workers sample;
+// relaxed is enough since every kernel gives the same bits.
+static std::atomic<NoiseIsa>    activeIsa{NOISE_SCALAR};
+static std::atomic<NoiseKernel> activeKernel{noiseScalar};
+static const NoiseIsa startupIsa = setPerlinNoiseIsa(NOISE_AVX2);
+
+NoiseIsa perlinNoiseIsa() { return activeIsa.load(std::memory_order_relaxed); }
+
+NoiseIsa setPerlinNoiseIsa(NoiseIsa isa) {
+    NoiseIsa best = bestIsa();
+    if (isa > best) isa = best;
+    activeIsa.store(isa, std::memory_order_relaxed);
+    activeKernel.store(kernelFor(isa), std::memory_order_relaxed);
+    return isa;
+}
+
+const char* noiseIsaName(NoiseIsa isa) {
+    switch (isa) {
+        case NOISE_SCALAR: return "scalar";
+        case NOISE_SSE41:  return "sse4.1";
+        case NOISE_AVX2:   return "avx2";
+    }
+    return "unknown";
+}
+
+// ---------------------------------------------------------------------------
+// Batch entry points
+// ---------------------------------------------------------------------------
+
+void perlinNoiseBatch(const float* xs, const float* ys, int count, float* out) {
+    activeKernel.load(std::memory_order_relaxed)(xs, ys, count, out);
+}
+
+void perlinFbmBatch(const float* xs, const float* ys, int count,
+                    const FbmParams& fbm, float* out) {
+    int octaves = fbm.octaves < 1 ? 1 : fbm.octaves;
+    const NoiseKernel kernel = activeKernel.load(std::memory_order_relaxed);
+    float ox[CHUNK], oy[CHUNK], n[CHUNK], sum[CHUNK];
+    for (int base = 0; base < count; base += CHUNK) {
+        int len = count - base < CHUNK ? count - base : CHUNK;
+        for (int i = 0; i < len; ++i) sum[i] = 0.0f;
+        float norm = 0.0f, amp = 1.0f, freq = 1.0f;
+        for (int o = 0; o < octaves; ++o) {
+            for (int i = 0; i < len; ++i) {
+                ox[i] = xs[base + i] * freq;
+                oy[i] = ys[base + i] * freq;
+            }
+            kernel(ox, oy, len, n);
+            for (int i = 0; i < len; ++i) sum[i] += amp * n[i];
+            norm += amp;
+            amp  *= fbm.gain;
+            freq *= fbm.lacunarity;
+        }
+        for (int i = 0; i < len; ++i) out[base + i] = sum[i] / norm;
+    }
+}
+
+void perlinNoiseGrid(int x0, int z0, int w, int h, float scale, float* out) {
+    FbmParams single;
+    perlinFbmGrid(x0, z0, w, h, scale, single, out);
+}
+
+void perlinFbmGrid(int x0, int z0, int w, int h, float scale,
+                   const FbmParams& fbm, float* out) {
+    float xs[CHUNK], ys[CHUNK];
+    for (int z = 0; z < h; ++z) {
+        float fz = (z0 + z) * scale;
+        for (int base = 0; base < w; base += CHUNK) {
+            int len = w - base < CHUNK ? w - base : CHUNK;
+            for (int i = 0; i < len; ++i) {
+                xs[i] = (x0 + base + i) * scale;
+                ys[i] = fz;
+            }
+            float* row = out + (long)z * w + base;
+            if (fbm.octaves <= 1) activeKernel.load(std::memory_order_relaxed)(xs, ys, len, row);
+            else                  perlinFbmBatch(xs, ys, len, fbm, row);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+// PerlinNoise.h
+// Ken Perlin's improved 2D noise, scalar and batched (SSE4.1 / AVX2).
+#pragma once
+
+// Instruction set used by the batch kernels, picked at startup
+enum NoiseIsa { NOISE_SCALAR, NOISE_SSE41, NOISE_AVX2 };
+
+// Octave settings for fractal (fBm) noise
+struct FbmParams {
+    int   octaves    = 1;
+    float lacunarity = 2.0f;   // frequency multiplier per octave
+    float gain       = 0.5f;   // amplitude multiplier per octave
+};
+
+// Single sample in [0,1]
+float perlinNoise(float x, float y);
+
+// Sum of octaves, divided by the total amplitude so the result stays in [0,1].
+// One octave returns exactly perlinNoise(x, y).
+float perlinFbm(float x, float y, const FbmParams& fbm);
+
+// Batched sampling. Every lane runs the same float operations in the same
+// order as perlinNoise()/perlinFbm(), so results match the scalar path
+// bit-for-bit (0 ulp) as long as the build does not contract a*b+c into FMA.
+void perlinNoiseBatch(const float* xs, const float* ys, int count, float* out);
+void perlinFbmBatch(const float* xs, const float* ys, int count,
+                    const FbmParams& fbm, float* out);
+
+// Fills a w x h tile, row-major, out[z*w + x] for grid point (x0+x, z0+z).
+// Sample coordinates are float(x) * scale, as in the terrain grid loop.
+void perlinNoiseGrid(int x0, int z0, int w, int h, float scale, float* out);
+void perlinFbmGrid(int x0, int z0, int w, int h, float scale,
+                   const FbmParams& fbm, float* out);
+
+// Kernel selection. setPerlinNoiseIsa() clamps to what the CPU supports and
+// returns the ISA actually in use; it is safe to call while other threads
+// sample.
+NoiseIsa perlinNoiseIsa();
+NoiseIsa setPerlinNoiseIsa(NoiseIsa isa);
+const char* noiseIsaName(NoiseIsa isa);
@@ -0,0 +1,285 @@
+// PostProcessCpu.cpp
+#include "PostProcessCpu.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#define POSTFX_SSE
+#include <emmintrin.h>
+#endif
+
+// One RGBA pixel; the kernels are written once against these helpers
+#ifdef POSTFX_SSE
+typedef __m128 Px;
+static inline Px pxLoad(const float* p)        { return _mm_loadu_ps(p); }
+static inline void pxStore(float* p, Px v)     { _mm_storeu_ps(p, v); }
+static inline Px pxSplat(float s)              { return _mm_set1_ps(s); }
+static inline Px pxAdd(Px a, Px b)             { return _mm_add_ps(a, b); }
+static inline Px pxSub(Px a, Px b)             { return _mm_sub_ps(a, b); }
+static inline Px pxMul(Px a, Px b)             { return _mm_mul_ps(a, b); }
+static inline Px pxMax(Px a, Px b)             { return _mm_max_ps(a, b); }
+static inline Px pxSet(float r, float g, float b, float a) { return _mm_setr_ps(r, g, b, a); }
+#else
+struct Px { float v[4]; };
+static inline Px pxLoad(const float* p)        { return {{p[0], p[1], p[2], p[3]}}; }
+static inline void pxStore(float* p, Px v)     { for (int c = 0; c < 4; ++c) p[c] = v.v[c]; }
+static inline Px pxSplat(float s)              { return {{s, s, s, s}}; }
+static inline Px pxAdd(Px a, Px b)             { for (int c = 0; c < 4; ++c) a.v[c] += b.v[c]; return a; }
+static inline Px pxSub(Px a, Px b)             { for (int c = 0; c < 4; ++c) a.v[c] -= b.v[c]; return a; }
+static inline Px pxMul(Px a, Px b)             { for (int c = 0; c < 4; ++c) a.v[c] *= b.v[c]; return a; }
+static inline Px pxMax(Px a, Px b)             { for (int c = 0; c < 4; ++c) a.v[c] = std::max(a.v[c], b.v[c]); return a; }
+static inline Px pxSet(float r, float g, float b, float a) { return {{r, g, b, a}}; }
+#endif
+
+static void matchSize(CpuImage& dst, const CpuImage& src) {
+    if (dst.width != src.width || dst.height != src.height) dst.resize(src.width, src.height);
+}
+
+void fillImage(CpuImage& img, const float rgba[4]) {
+    for (size_t i = 0; i < img.pixels.size(); i += 4)
+        for (int c = 0; c < 4; ++c) img.pixels[i + c] = rgba[c];
+}
+
+void imageToRGBA8(const CpuImage& img, std::vector<uint8_t>& out) {
+    out.resize(img.pixels.size());
+    for (size_t i = 0; i < img.pixels.size(); ++i) {
+        float v = std::min(std::max(img.pixels[i], 0.0f), 1.0f);
+        out[i] = (uint8_t)(v * 255.0f + 0.5f);
+    }
+}
+
+// Runs fn(x0, y0, w, h) over the image in tiles
+static void forTiles(const CpuImage& img, ThreadPool& pool,
+                     const std::function<void(int, int, int, int)>& fn) {
+    parallelForTiles(pool, img.width, img.height, POSTFX_TILE, fn);
+}
+
+// --- Blur ---
+
+static std::vector<float> gaussianWeights(int radius) {
+    const float sigma = radius / 3.0f;
+    std::vector<float> w(radius + 1);
+    float sum = 0.0f;
+    for (int i = 0; i <= radius; ++i) {
+        w[i] = std::exp(-0.5f * i * i / (sigma * sigma));
+        sum += i == 0 ? w[i] : 2.0f * w[i];
+    }
+    for (float& v : w) v /= sum;
+    return w;
+}
+
+void postBlur(const CpuImage& src, CpuImage& dst, const PostFxParams& params, ThreadPool& pool) {
+    matchSize(dst, src);
+    const int radius = params.blurRadius;
+    if (radius <= 0) {
+        dst.pixels = src.pixels;
+        return;
+    }
+    const std::vector<float> w = gaussianWeights(radius);
+    const int width = src.width, height = src.height;
+    CpuImage tmp;
+    tmp.resize(width, height);
+
+    // Horizontal; the clamp only matters within radius of the edges
+    forTiles(src, pool, [&](int x0, int y0, int tw, int th) {
+        for (int y = y0; y < y0 + th; ++y) {
+            const float* in = src.row(y);
+            float* out = tmp.row(y);
+            for (int x = x0; x < x0 + tw; ++x) {
+                Px acc = pxMul(pxLoad(in + x * 4), pxSplat(w[0]));
+                if (x >= radius && x + radius < width) {
+                    for (int k = 1; k <= radius; ++k)
+                        acc = pxAdd(acc, pxMul(pxAdd(pxLoad(in + (x - k) * 4),
+                                                     pxLoad(in + (x + k) * 4)), pxSplat(w[k])));
+                } else {
+                    for (int k = 1; k <= radius; ++k) {
+                        int l = std::max(x - k, 0), r = std::min(x + k, width - 1);
+                        acc = pxAdd(acc, pxMul(pxAdd(pxLoad(in + l * 4), pxLoad(in + r * 4)),
+                                               pxSplat(w[k])));
+                    }
+                }
+                pxStore(out + x * 4, acc);
+            }
+        }
+    });
+
+    // Vertical; rows are walked in order so every load is sequential
+    forTiles(src, pool, [&](int x0, int y0, int tw, int th) {
+        for (int y = y0; y < y0 + th; ++y) {
+            float* out = dst.row(y);
+            for (int x = x0; x < x0 + tw; ++x)
+                pxStore(out + x * 4, pxMul(pxLoad(tmp.row(y) + x * 4), pxSplat(w[0])));
+            for (int k = 1; k <= radius; ++k) {
+                const float* up = tmp.row(std::max(y - k, 0));
+                const float* dn = tmp.row(std::min(y + k, height - 1));
+                Px wk = pxSplat(w[k]);
+                for (int x = x0; x < x0 + tw; ++x) {
+                    Px sum = pxAdd(pxLoad(up + x * 4), pxLoad(dn + x * 4));
+                    pxStore(out + x * 4, pxAdd(pxLoad(out + x * 4), pxMul(sum, wk)));
+                }
+            }
+        }
+    });
+}
+
+// --- SSAO ---
+
+void postSSAO(const CpuImage& normalDepth, CpuImage& dst, const PostFxParams& params,
+              ThreadPool& pool) {
+    matchSize(dst, normalDepth);
+    const int width = normalDepth.width, height = normalDepth.height;
+    const int samples = std::max(1, params.ssaoSamples);
+
+    // Spiral of sample offsets (golden angle), rounded to whole pixels
+    std::vector<int> ox(samples), oy(samples);
+    int pad = 0;
+    for (int i = 0; i < samples; ++i) {
+        float r = params.ssaoRadius * std::sqrt((i + 0.5f) / samples);
+        float a = 2.39996323f * i;
+        ox[i] = (int)std::lround(r * std::cos(a));
+        oy[i] = (int)std::lround(r * std::sin(a));
+        pad = std::max(pad, std::max(std::abs(ox[i]), std::abs(oy[i])));
+    }
+
+    // Depth as its own plane with a clamped border, so four neighbouring
+    // pixels read four consecutive floats for any offset
+    const int pw = width + 2 * pad, ph = height + 2 * pad;
+    std::vector<float> depth((size_t)pw * ph);
+    pool.parallelFor(ph, [&](int py) {
+        const float* in = normalDepth.row(std::min(std::max(py - pad, 0), height - 1));
+        float* out = &depth[(size_t)py * pw];
+        for (int px = 0; px < pw; ++px) out[px] = in[std::min(std::max(px - pad, 0), width - 1) * 4 + 3];
+    });
+
+    const float scale = params.ssaoStrength / samples;
+    forTiles(normalDepth, pool, [&](int x0, int y0, int tw, int th) {
+        for (int y = y0; y < y0 + th; ++y) {
+            const float* center = &depth[(size_t)(y + pad) * pw + pad];
+            float* out = dst.row(y);
+            int x = x0;
+#ifdef POSTFX_SSE
+            const __m128 bias = _mm_set1_ps(params.ssaoBias), range = _mm_set1_ps(params.ssaoRange);
+            const __m128 one = _mm_set1_ps(1.0f);
+            for (; x + 4 <= x0 + tw; x += 4) {
+                __m128 c = _mm_loadu_ps(center + x);
+                __m128 count = _mm_setzero_ps();
+                for (int i = 0; i < samples; ++i) {
+                    __m128 d = _mm_sub_ps(c, _mm_loadu_ps(center + oy[i] * pw + ox[i] + x));
+                    __m128 hit = _mm_and_ps(_mm_cmpgt_ps(d, bias), _mm_cmplt_ps(d, range));
+                    count = _mm_add_ps(count, _mm_and_ps(hit, one));
+                }
+                float vis[4];
+                _mm_storeu_ps(vis, _mm_sub_ps(one, _mm_mul_ps(count, _mm_set1_ps(scale))));
+                for (int l = 0; l < 4; ++l) pxStore(out + (x + l) * 4, pxSet(vis[l], vis[l], vis[l], 1.0f));
+            }
+#endif
+            for (; x < x0 + tw; ++x) {
+                int count = 0;
+                for (int i = 0; i < samples; ++i) {
+                    float d = center[x] - center[oy[i] * pw + ox[i] + x];
+                    if (d > params.ssaoBias && d < params.ssaoRange) ++count;
+                }
+                float vis = 1.0f - count * scale;
+                pxStore(out + x * 4, pxSet(vis, vis, vis, 1.0f));
+            }
+        }
+    });
+}
+
+// --- Per-pixel passes ---
+
+void postScatter(const CpuImage& base, CpuImage& dst, const PostFxParams& params,
+                 ThreadPool& pool) {
+    matchSize(dst, base);
+    const float a = params.scatterAmount;
+    const Px keep = pxSet(1.0f - a, 1.0f - a, 1.0f - a, 1.0f);
+    const Px tint = pxSet(a * params.scatterTint[0], a * params.scatterTint[1],
+                          a * params.scatterTint[2], 0.0f);
+    forTiles(base, pool, [&](int x0, int y0, int tw, int th) {
+        for (int y = y0; y < y0 + th; ++y) {
+            const float* in = base.row(y);
+            float* out = dst.row(y);
+            for (int x = x0; x < x0 + tw; ++x) {
+                const float* p = in + x * 4;
+                float luma = 0.2126f * p[0] + 0.7152f * p[1] + 0.0722f * p[2];
+                pxStore(out + x * 4, pxAdd(pxMul(pxLoad(p), keep), pxMul(tint, pxSplat(luma))));
+            }
+        }
+    });
+}
+
+void postSheen(const CpuImage& occl, CpuImage& dst, const PostFxParams& params, ThreadPool& pool) {
+    matchSize(dst, occl);
+    forTiles(occl, pool, [&](int x0, int y0, int tw, int th) {
+        for (int y = y0; y < y0 + th; ++y) {
+            const float* in = occl.row(y);
+            float* out = dst.row(y);
+            for (int x = x0; x < x0 + tw; ++x) {
+                // Visibility is grey, so one pow per pixel
+                float s = std::pow(std::max(in[x * 4], 0.0f), params.sheenPower);
+                pxStore(out + x * 4, pxSet(s, s, s, 1.0f));
+            }
+        }
+    });
+}
+
+void postShadowComposite(const CpuImage& color, const CpuImage& sheenBlur, CpuImage& dst,
+                         const PostFxParams& params, ThreadPool& pool) {
+    matchSize(dst, color);
+    const float k = params.shadowStrength;
+    forTiles(color, pool, [&](int x0, int y0, int tw, int th) {
+        for (int y = y0; y < y0 + th; ++y) {
+            const float* c = color.row(y);
+            const float* s = sheenBlur.row(y);
+            float* out = dst.row(y);
+            for (int x = x0; x < x0 + tw; ++x) {
+                float shade = 1.0f - k + k * s[x * 4];
+                pxStore(out + x * 4, pxMul(pxLoad(c + x * 4), pxSet(shade, shade, shade, 1.0f)));
+            }
+        }
+    });
+}
+
+void postGlossSpread(const CpuImage& base, CpuImage& dst, const PostFxParams& params,
+                     ThreadPool& pool) {
+    matchSize(dst, base);
+    const int width = base.width, height = base.height;
+    const float t = std::min(std::max(params.glossSpread * 0.5f, 0.0f), 1.0f);
+    const Px tv = pxSplat(t);
+    forTiles(base, pool, [&](int x0, int y0, int tw, int th) {
+        for (int y = y0; y < y0 + th; ++y) {
+            const float* rows[3] = {base.row(std::max(y - 1, 0)), base.row(y),
+                                    base.row(std::min(y + 1, height - 1))};
+            float* out = dst.row(y);
+            for (int x = x0; x < x0 + tw; ++x) {
+                int l = std::max(x - 1, 0) * 4, m = x * 4, r = std::min(x + 1, width - 1) * 4;
+                Px hi = pxLoad(rows[0] + m);
+                for (const float* row : rows)
+                    hi = pxMax(hi, pxMax(pxLoad(row + l), pxMax(pxLoad(row + m), pxLoad(row + r))));
+                Px p = pxLoad(rows[1] + m);
+                pxStore(out + m, pxAdd(p, pxMul(pxSub(hi, p), tv)));
+            }
+        }
+    });
+}
+
+// --- Chain ---
+
+void runPostChain(const CpuImage& normalDepth, const PostFxParams& params, ThreadPool& pool,
+                  PostChainScratch& scratch, CpuImage& out) {
+    // canvas and blur fold to white, exactly as the render graph folds them
+    const float white[4] = {1, 1, 1, 1};
+    CpuImage& a = scratch.a;
+    CpuImage& b = scratch.b;
+    CpuImage& c = scratch.c;
+    matchSize(b, normalDepth);
+    fillImage(b, white);
+
+    postSSAO(normalDepth, a, params, pool);       // ssao
+    postScatter(b, b, params, pool);              // scatter of the white blur
+    postSheen(a, c, params, pool);                // sheen
+    postBlur(c, a, params, pool);                 // sheenBlur
+    postShadowComposite(b, a, c, params, pool);   // shadows
+    postGlossSpread(c, out, params, pool);        // gloss
+}
@@ -0,0 +1,86 @@
+// PostProcessCpu.h
+// CPU reference versions of the SSAO pipeline's post passes, for headless
+// batch rendering and golden-image tests. Images are float RGBA, one pixel
+// per SSE register; every pass is split into tiles on a ThreadPool. Each
+// function takes the same input textures as its shader, and PostFxParams
+// carries the uniforms the GL passes set.
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <vector>
+
+struct CpuImage {
+    int width = 0, height = 0;
+    std::vector<float> pixels;    // RGBA, row-major, no padding
+
+    void resize(int w, int h) {
+        width = w;
+        height = h;
+        pixels.assign((size_t)w * h * 4, 0.0f);
+    }
+    float*       row(int y)       { return &pixels[(size_t)y * width * 4]; }
+    const float* row(int y) const { return &pixels[(size_t)y * width * 4]; }
+};
+
+void fillImage(CpuImage& img, const float rgba[4]);
+// Rounds to 8-bit RGBA like a GL_RGBA8 target (clamped to [0, 1])
+void imageToRGBA8(const CpuImage& img, std::vector<uint8_t>& out);
+
+// The fields that have a uniform in the GL passes are named after it and
+// take the same values; the rest have no uniform and fix the reference's
+// own look.
+struct PostFxParams {
+    // gaussian.frag
+    int   blurRadius = 6;                // uRadius: taps on each side, sigma is a
+                                         // third of it; 0 copies the input
+    // ssao.frag
+    int   ssaoSamples  = 16;             // uSamples
+    float ssaoRadius   = 8.0f;           // pixels
+    float ssaoBias     = 0.002f;         // depth units
+    float ssaoRange    = 0.1f;           // occluders farther in front are ignored
+    float ssaoStrength = 1.0f;
+    // scatter.frag
+    float scatterAmount  = 0.25f;
+    float scatterTint[3] = {1.0f, 0.6f, 0.5f};
+    // sheen.frag
+    float sheenPower = 2.0f;
+    // shadow_comp.frag
+    float shadowStrength = 0.8f;
+    // gloss.frag
+    float glossSpread = 1.0f;            // uGlossSpread
+};
+
+// Tile edge for the parallel passes
+static const int POSTFX_TILE = 64;
+
+// uInputTex: separable Gaussian over blurRadius taps each side,
+// clamp-to-edge sampling
+void postBlur(const CpuImage& src, CpuImage& dst, const PostFxParams& params, ThreadPool& pool);
+// uNormalDepthTex: normal in xyz, linear depth in w. Counts samples on a
+// spiral around each pixel that lie in front of it; the result is the
+// visibility (1 = open) in rgb.
+void postSSAO(const CpuImage& normalDepth, CpuImage& dst, const PostFxParams& params,
+              ThreadPool& pool);
+// uBaseTex: tints the base toward its luminance times scatterTint
+void postScatter(const CpuImage& base, CpuImage& dst, const PostFxParams& params,
+                 ThreadPool& pool);
+// uOcclTex: visibility raised to sheenPower
+void postSheen(const CpuImage& occl, CpuImage& dst, const PostFxParams& params, ThreadPool& pool);
+// uColorTex, uSheenBlurTex: darkens color by the blurred sheen's red channel
+void postShadowComposite(const CpuImage& color, const CpuImage& sheenBlur, CpuImage& dst,
+                         const PostFxParams& params, ThreadPool& pool);
+// uBaseTex: moves each pixel toward the brightest of its 3x3 neighbours by
+// glossSpread / 2 (clamped to 1)
+void postGlossSpread(const CpuImage& base, CpuImage& dst, const PostFxParams& params,
+                     ThreadPool& pool);
+
+// The whole chain as the render graph in the SSAO pipeline runs it: the
+// white canvas and its blur are constants, the rest run in pass order.
+// Scratch images are reused between calls.
+struct PostChainScratch {
+    CpuImage a, b, c;
+};
+void runPostChain(const CpuImage& normalDepth, const PostFxParams& params, ThreadPool& pool,
+                  PostChainScratch& scratch, CpuImage& out);
@@ -0,0 +1,314 @@
+// Profiler.cpp
+#include "Profiler.h"
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cstdio>
+
+static std::atomic<uint64_t> nextProfilerId{1};
+
+// Chrome trace thread id of the GPU track
+static const int TRACE_GPU_TID = 1000;
+
+Profiler::Profiler(PacerClock* c, size_t events, int statsWindow)
+    : clock(c), id(nextProfilerId.fetch_add(1)), eventsPerThread(events),
+      window(statsWindow > 0 ? statsWindow : 1) {
+    if (!clock) {
+        ownedClock.reset(new SteadyPacerClock());
+        clock = ownedClock.get();
+    }
+}
+
+Profiler::~Profiler() {}
+
+int64_t Profiler::nowNs() {
+    return clock->nowNs();
+}
+
+Profiler::ThreadBuffer* Profiler::threadBuffer() {
+    // Buffers of the profilers this thread has used; a thread rarely
+    // sees more than one
+    static thread_local std::vector<std::pair<uint64_t, ThreadBuffer*>> cache;
+    for (const auto& c : cache)
+        if (c.first == id) return c.second;
+
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    threads.emplace_back(new ThreadBuffer(eventsPerThread));
+    ThreadBuffer* b = threads.back().get();
+    b->index = (int)threads.size() - 1;
+    b->open.reserve(32);
+    counts.threads = (int)threads.size();
+    cache.emplace_back(id, b);
+    return b;
+}
+
+void Profiler::beginZone(const char* name) {
+    ThreadBuffer* b = threadBuffer();
+    ProfileEvent e;
+    e.name = name;
+    e.thread = b->index;
+    e.depth = (int)b->open.size();
+    e.startNs = nowNs();
+    e.endNs = e.startNs;
+    b->open.push_back(e);
+}
+
+void Profiler::endZone() {
+    ThreadBuffer* b = threadBuffer();
+    if (b->open.empty()) return;
+    ProfileEvent e = b->open.back();
+    b->open.pop_back();
+    e.endNs = nowNs();
+    if (!b->events.push(e)) dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+// --- GPU ---
+
+void Profiler::setGpuBackend(ProfilerGpuBackend* backend, int latencyFrames, int queriesPerFrame) {
+    releaseGpu();
+    gpu = backend;
+    latency  = latencyFrames > 0 ? latencyFrames : 1;
+    perFrame = queriesPerFrame > 0 ? queriesPerFrame : 1;
+    if (gpu) gpuFrames.push_back(GpuFrame{{}, counts.frames, true});
+}
+
+void Profiler::releaseGpu() {
+    if (gpu)
+        for (unsigned q : queries) gpu->destroyQuery(q);
+    queries.clear();
+    freeQueries.clear();
+    gpuFrames.clear();
+    gpuOpen = false;
+    gpuNested = 0;
+    gpuFrameResolved = false;
+    gpu = nullptr;
+}
+
+void Profiler::beginGpuZone(const char* name) {
+    if (!gpu) return;
+    if (gpuOpen) {
+        ++gpuNested;
+        return;
+    }
+    unsigned q;
+    if (!freeQueries.empty()) {
+        q = freeQueries.back();
+        freeQueries.pop_back();
+    } else if (queries.size() < (size_t)latency * perFrame) {
+        q = gpu->createQuery();
+        queries.push_back(q);
+    } else {
+        ++counts.droppedQueries;
+        gpuFrames.back().complete = false;
+        return;
+    }
+    openGpu = GpuZone{name, nowNs(), q};
+    gpuOpen = true;
+    gpu->beginQuery(q);
+}
+
+void Profiler::endGpuZone() {
+    if (gpuNested > 0) {
+        --gpuNested;
+        return;
+    }
+    if (!gpuOpen) return;
+    gpu->endQuery(openGpu.query);
+    gpuFrames.back().zones.push_back(openGpu);
+    gpuOpen = false;
+}
+
+void Profiler::resolveGpu() {
+    // Frames resolve in order, each once all of its results are in. A
+    // frame still pending after `latency` frames is dropped so its
+    // queries can be reused.
+    while (!gpuFrames.empty()) {
+        GpuFrame& f = gpuFrames.front();
+        bool ready = true;
+        std::vector<int64_t> elapsed(f.zones.size());
+        for (size_t i = 0; i < f.zones.size() && ready; ++i)
+            ready = gpu->queryResult(f.zones[i].query, elapsed[i]);
+        if (!ready && counts.frames - f.frame < (uint64_t)latency) break;
+
+        if (ready && f.complete && !f.zones.empty()) {
+            gpuFrameResolved = true;
+            gpuFrameNs = 0;
+            for (int64_t ns : elapsed) gpuFrameNs += ns;
+        }
+        for (size_t i = 0; i < f.zones.size(); ++i) {
+            const GpuZone& z = f.zones[i];
+            freeQueries.push_back(z.query);
+            if (!ready) {
+                ++counts.droppedQueries;
+                continue;
+            }
+            // The GPU runs the zones in order, no earlier than they were issued
+            ProfileEvent e;
+            e.name = z.name;
+            e.startNs = std::max(z.issueNs, gpuCursorNs);
+            e.endNs = e.startNs + elapsed[i];
+            e.thread = PROFILE_GPU_THREAD;
+            e.depth = 0;
+            gpuCursorNs = e.endNs;
+            collect(e, true);
+        }
+        gpuFrames.erase(gpuFrames.begin());
+    }
+}
+
+// --- Frames and stats ---
+
+void Profiler::collect(const ProfileEvent& e, bool isGpu) {
+    History& h = (isGpu ? gpuHistory : cpuHistory)[e.name];
+    if (h.ms.empty()) {
+        h.ms.assign(window, 0.0);
+        h.calls.assign(window, 0);
+    }
+    h.pendingMs += (e.endNs - e.startNs) * 1e-6;
+    ++h.pendingCalls;
+    ++(isGpu ? counts.gpuEvents : counts.cpuEvents);
+    if (capturing && capture.size() < captureLimit) capture.push_back(e);
+}
+
+void Profiler::endFrame() {
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        ProfileEvent e;
+        for (auto& b : threads)
+            while (b->events.pop(e)) collect(e, false);
+    }
+    gpuFrameResolved = false;
+    if (gpu) resolveGpu();
+
+    for (auto* map : {&cpuHistory, &gpuHistory}) {
+        for (auto& entry : *map) {
+            History& h = entry.second;
+            h.ms[slot] = h.pendingMs;
+            h.calls[slot] = h.pendingCalls;
+            h.pendingMs = 0.0;
+            h.pendingCalls = 0;
+            if (h.frames < window) ++h.frames;
+        }
+    }
+    slot = (slot + 1) % window;
+    ++counts.frames;
+    counts.droppedEvents = dropped.load(std::memory_order_relaxed);
+    if (gpu) gpuFrames.push_back(GpuFrame{{}, counts.frames, true});
+}
+
+ProfileZoneStats Profiler::summarize(const std::string& name, const History& h, bool isGpu) const {
+    ProfileZoneStats s;
+    s.name = name;
+    s.gpu = isGpu;
+    s.frames = h.frames;
+    if (h.frames == 0) return s;
+    double total = 0.0;
+    long calls = 0;
+    for (int i = 1; i <= h.frames; ++i) {
+        int k = (slot - i + window) % window;
+        total += h.ms[k];
+        calls += h.calls[k];
+        s.maxMs = std::max(s.maxMs, h.ms[k]);
+    }
+    s.meanMs = total / h.frames;
+    s.callsPerFrame = (double)calls / h.frames;
+    s.lastMs = h.ms[(slot - 1 + window) % window];
+    return s;
+}
+
+std::vector<ProfileZoneStats> Profiler::zoneStats() const {
+    std::vector<ProfileZoneStats> out;
+    for (const auto& entry : cpuHistory) out.push_back(summarize(entry.first, entry.second, false));
+    for (const auto& entry : gpuHistory) out.push_back(summarize(entry.first, entry.second, true));
+    std::stable_sort(out.begin(), out.end(), [](const ProfileZoneStats& a, const ProfileZoneStats& b) {
+        return a.name < b.name;
+    });
+    return out;
+}
+
+bool Profiler::zoneStats(const char* name, ProfileZoneStats& out) const {
+    auto it = cpuHistory.find(name);
+    if (it != cpuHistory.end()) {
+        out = summarize(it->first, it->second, false);
+        return true;
+    }
+    it = gpuHistory.find(name);
+    if (it != gpuHistory.end()) {
+        out = summarize(it->first, it->second, true);
+        return true;
+    }
+    return false;
+}
+
+bool Profiler::lastGpuFrame(double& ms) const {
+    if (!gpuFrameResolved) return false;
+    ms = gpuFrameNs * 1e-6;
+    return true;
+}
+
+// --- Chrome trace ---
+
+void Profiler::startCapture(size_t maxEvents) {
+    capture.clear();
+    captureLimit = maxEvents;
+    captureStartNs = nowNs();
+    capturing = true;
+}
+
+static void appendJsonString(std::string& out, const char* s) {
+    out += '"';
+    for (; *s; ++s) {
+        char c = *s;
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char esc[8];
+            std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+std::string Profiler::chromeTrace() const {
+    std::string out = "{\"traceEvents\":[\n";
+    char buf[160];
+    // Track names first so viewers label the rows
+    int trackCount = counts.threads;
+    for (int t = 0; t <= trackCount; ++t) {
+        bool gpuTrack = t == trackCount;
+        std::snprintf(buf, sizeof(buf),
+                      "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                      "\"args\":{\"name\":\"%s%d\"}},\n",
+                      gpuTrack ? TRACE_GPU_TID : t, gpuTrack ? "GPU" : "thread ",
+                      gpuTrack ? 0 : t);
+        out += buf;
+    }
+    for (size_t i = 0; i < capture.size(); ++i) {
+        const ProfileEvent& e = capture[i];
+        bool isGpu = e.thread == PROFILE_GPU_THREAD;
+        out += "{\"name\":";
+        appendJsonString(out, e.name);
+        std::snprintf(buf, sizeof(buf),
+                      ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}%s\n",
+                      isGpu ? "gpu" : "cpu", (e.startNs - captureStartNs) * 1e-3,
+                      (e.endNs - e.startNs) * 1e-3, isGpu ? TRACE_GPU_TID : e.thread,
+                      i + 1 < capture.size() ? "," : "");
+        out += buf;
+    }
+    // The metadata lines end in a comma; an empty capture still has to parse
+    if (capture.empty()) out.erase(out.size() - 2, 1);
+    out += "],\"displayTimeUnit\":\"ms\"}\n";
+    return out;
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) const {
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    std::string json = chromeTrace();
+    bool ok = std::fwrite(json.data(), 1, json.size(), f) == json.size();
+    return std::fclose(f) == 0 && ok;
+}
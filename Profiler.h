@@ -0,0 +1,215 @@
+// Profiler.h
+// Frame profiler with nested CPU zones and GPU zones. CPU zones are
+// written to a lock-free buffer per thread and collected once a frame.
+// GPU zones go through a ProfilerGpuBackend (GL_TIME_ELAPSED queries in
+// ProfilerGL.h); their results are read a few frames later, so the CPU
+// never waits for the GPU. Finished zones feed rolling per-zone stats
+// and, while capturing, a Chrome trace (chrome://tracing, Perfetto).
+//
+// Use the PROFILE_ZONE / PROFILE_GPU_ZONE macros. Building with
+// TERRAIN_PROFILE=0 turns them into nothing; the Profiler class itself
+// stays available.
+#pragma once
+
+#include "LockFreeQueue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef TERRAIN_PROFILE
+#define TERRAIN_PROFILE 1
+#endif
+
+class PacerClock;
+
+// GPU side; queries are backend handles
+class ProfilerGpuBackend {
+public:
+    virtual ~ProfilerGpuBackend() {}
+    virtual unsigned createQuery() = 0;
+    virtual void     destroyQuery(unsigned query) = 0;
+    // At most one query is active at a time (GL_TIME_ELAPSED cannot nest)
+    virtual void     beginQuery(unsigned query) = 0;
+    virtual void     endQuery(unsigned query) = 0;
+    // Elapsed GPU time once the result is available; never blocks
+    virtual bool     queryResult(unsigned query, int64_t& ns) = 0;
+};
+
+// One finished zone. Names must outlive the profiler (string literals).
+struct ProfileEvent {
+    const char* name;
+    int64_t     startNs, endNs;   // profiler clock; GPU zones are placed after their CPU issue
+    int         thread;           // registration order; PROFILE_GPU_THREAD for GPU zones
+    int         depth;
+};
+
+static const int PROFILE_GPU_THREAD = -1;
+
+struct ProfileZoneStats {
+    std::string name;
+    bool   gpu = false;
+    int    frames = 0;             // frames in the window
+    double callsPerFrame = 0.0;
+    double meanMs = 0.0, maxMs = 0.0;   // time per frame, summed over calls
+    double lastMs = 0.0;
+};
+
+struct ProfilerCounters {
+    uint64_t frames = 0;
+    uint64_t cpuEvents = 0, gpuEvents = 0;
+    uint64_t droppedEvents = 0;   // a thread buffer was full
+    uint64_t droppedQueries = 0;  // no free query, or a result still pending after the ring
+    int      threads = 0;
+};
+
+class Profiler {
+public:
+    // clock == nullptr uses a SteadyPacerClock. eventsPerThread bounds
+    // what one thread can record between two endFrame() calls.
+    explicit Profiler(PacerClock* clock = nullptr, size_t eventsPerThread = 16384,
+                      int statsWindow = 120);
+    ~Profiler();
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // GPU zones are ignored until a backend is set. latencyFrames is how
+    // many frames a query may stay pending before its zone is dropped.
+    void setGpuBackend(ProfilerGpuBackend* backend, int latencyFrames = 4,
+                       int queriesPerFrame = 64);
+    // Destroys the queries; call while the backend's context is alive
+    void releaseGpu();
+
+    // CPU zones, from any thread; nest per thread
+    void beginZone(const char* name);
+    void endZone();
+    // GPU zones, from the thread that owns the GL context; do not nest
+    void beginGpuZone(const char* name);
+    void endGpuZone();
+
+    // Render thread, once per frame: collects every thread's zones and
+    // the GPU results that arrived, and updates the stats
+    void endFrame();
+
+    // Rolling stats over the last statsWindow frames, sorted by name
+    std::vector<ProfileZoneStats> zoneStats() const;
+    bool zoneStats(const char* name, ProfileZoneStats& out) const;
+    // GPU time of the newest frame whose results all arrived in the last
+    // endFrame(), summed over its zones. False if no frame resolved then,
+    // or the ones that did lost a zone to a dropped query.
+    bool lastGpuFrame(double& ms) const;
+    const ProfilerCounters& counters() const { return counts; }
+
+    // Keeps every collected zone until stopCapture() or maxEvents
+    void startCapture(size_t maxEvents = 1u << 20);
+    void stopCapture() { capturing = false; }
+    const std::vector<ProfileEvent>& captured() const { return capture; }
+    // Chrome trace JSON of the captured zones
+    std::string chromeTrace() const;
+    bool writeChromeTrace(const std::string& path) const;
+
+    int64_t nowNs();
+
+private:
+    struct ThreadBuffer {
+        explicit ThreadBuffer(size_t capacity) : events(capacity) {}
+        LockFreeQueue<ProfileEvent> events;
+        std::vector<ProfileEvent>   open;     // owner thread only
+        int index = 0;
+    };
+
+    struct GpuZone {
+        const char* name;
+        int64_t  issueNs;
+        unsigned query;
+    };
+    struct GpuFrame {
+        std::vector<GpuZone> zones;
+        uint64_t frame;
+        bool     complete;           // no zone was dropped for want of a query
+    };
+
+    struct History {
+        std::vector<double> ms;      // ring of per-frame totals
+        std::vector<int>    calls;
+        double pendingMs = 0.0;      // this frame so far
+        int    pendingCalls = 0;
+        int    frames = 0;           // frames since the zone first ran, up to the window
+    };
+
+    ThreadBuffer* threadBuffer();
+    void collect(const ProfileEvent& e, bool gpu);
+    void resolveGpu();
+    ProfileZoneStats summarize(const std::string& name, const History& h, bool isGpu) const;
+
+    PacerClock* clock;
+    std::unique_ptr<PacerClock> ownedClock;
+    uint64_t id;                     // tells thread caches of different profilers apart
+    size_t   eventsPerThread;
+    int      window;
+
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads;
+
+    ProfilerGpuBackend* gpu = nullptr;
+    int latency = 4, perFrame = 64;
+    std::vector<unsigned> queries, freeQueries;
+    std::vector<GpuFrame> gpuFrames;  // oldest first
+    GpuZone openGpu = {nullptr, 0, 0};
+    bool    gpuOpen = false;
+    int     gpuNested = 0;           // ignored zones inside the open one
+    int64_t gpuCursorNs = 0;         // end of the last placed GPU zone
+    bool    gpuFrameResolved = false;  // in the last endFrame()
+    int64_t gpuFrameNs = 0;
+
+    std::map<std::string, History> cpuHistory, gpuHistory;
+    int slot = 0;                    // ring position of the current frame
+    ProfilerCounters counts;
+    std::atomic<uint64_t> dropped{0};
+
+    bool capturing = false;
+    size_t captureLimit = 0;
+    int64_t captureStartNs = 0;
+    std::vector<ProfileEvent> capture;
+};
+
+// Scoped zones; PROFILE_ZONE(profiler, "name") opens one until the end
+// of the enclosing block
+class ProfileZone {
+public:
+    ProfileZone(Profiler& p, const char* name) : profiler(p) { profiler.beginZone(name); }
+    ~ProfileZone() { profiler.endZone(); }
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    Profiler& profiler;
+};
+
+class GpuProfileZone {
+public:
+    GpuProfileZone(Profiler& p, const char* name) : profiler(p) { profiler.beginGpuZone(name); }
+    ~GpuProfileZone() { profiler.endGpuZone(); }
+    GpuProfileZone(const GpuProfileZone&) = delete;
+    GpuProfileZone& operator=(const GpuProfileZone&) = delete;
+
+private:
+    Profiler& profiler;
+};
+
+#if TERRAIN_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(profiler, name) \
+    ProfileZone PROFILE_CONCAT(profileZone_, __LINE__)(profiler, name)
+#define PROFILE_GPU_ZONE(profiler, name) \
+    GpuProfileZone PROFILE_CONCAT(gpuProfileZone_, __LINE__)(profiler, name)
+#else
+#define PROFILE_ZONE(profiler, name) ((void)0)
+#define PROFILE_GPU_ZONE(profiler, name) ((void)0)
+#endif
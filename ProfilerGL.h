@@ -0,0 +1,35 @@
+// ProfilerGL.h
+// OpenGL backend for the profiler's GPU zones: one GL_TIME_ELAPSED query
+// per zone, read with GL_QUERY_RESULT_AVAILABLE so it never stalls.
+// Include after the GL loader (glew or glad); header-only like
+// RenderGraphGL.h. Needs GL 3.3 or ARB_timer_query.
+#pragma once
+
+#include "Profiler.h"
+
+class GLProfilerBackend : public ProfilerGpuBackend {
+public:
+    unsigned createQuery() override {
+        GLuint q = 0;
+        glGenQueries(1, &q);
+        return q;
+    }
+
+    void destroyQuery(unsigned query) override {
+        GLuint q = query;
+        glDeleteQueries(1, &q);
+    }
+
+    void beginQuery(unsigned query) override { glBeginQuery(GL_TIME_ELAPSED, query); }
+    void endQuery(unsigned) override { glEndQuery(GL_TIME_ELAPSED); }
+
+    bool queryResult(unsigned query, int64_t& ns) override {
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        ns = (int64_t)elapsed;
+        return true;
+    }
+};
@@ -0,0 +1,93 @@
+// QualityController.cpp
+#include "QualityController.h"
+
+#include <algorithm>
+
+std::vector<QualityLevel> defaultQualityLadder() {
+    // Resolution goes first on the way down since it scales every pass;
+    // the optional passes go before the SSAO drops to its last few samples
+    return {
+        //  scale  samples blur gloss  scatter sheen
+        {0.5f,    4,  1, 0.5f,  false, false},
+        {0.5f,    8,  2, 0.5f,  false, false},
+        {0.625f,  8,  2, 0.75f, true,  false},
+        {0.75f,   8,  3, 0.75f, true,  false},
+        {0.75f,  12,  3, 1.0f,  true,  true},
+        {0.875f, 16,  4, 1.0f,  true,  true},
+        {1.0f,   16,  4, 1.0f,  true,  true},
+        {1.0f,   32,  6, 1.0f,  true,  true},
+    };
+}
+
+QualityController::QualityController(const QualityControllerParams& p,
+                                     const std::vector<QualityLevel>& l)
+    : params(p), ladder(l), frames(std::max(p.window, 1), 0.0),
+      backoff(l.size(), 0) {
+    if (ladder.empty()) {
+        ladder = defaultQualityLadder();
+        backoff.assign(ladder.size(), 0);
+    }
+    current = params.startLevel < 0 ? (int)ladder.size() - 1
+                                    : std::min(params.startLevel, (int)ladder.size() - 1);
+}
+
+void QualityController::setTargetFps(double fps) {
+    params.targetFps = fps;
+    filled = next = 0;
+    underFrames = 0;
+}
+
+void QualityController::setLevel(int level) {
+    current = std::max(0, std::min(level, (int)ladder.size() - 1));
+    filled = next = 0;
+    underFrames = 0;
+    held = 0;
+}
+
+double QualityController::windowPercentile() {
+    sorted.assign(frames.begin(), frames.begin() + filled);
+    size_t k = std::min(sorted.size() - 1, (size_t)(params.percentile * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return sorted[k];
+}
+
+void QualityController::change(int level) {
+    if (level < current) {
+        // Coming back up to this level has to wait longer from now on
+        backoff[current] = std::min(backoff[current] + 1, params.maxBackoff);
+        ++counters.downgrades;
+    } else {
+        ++counters.upgrades;
+    }
+    current = level;
+    filled = next = 0;
+    underFrames = 0;
+    held = 0;
+}
+
+bool QualityController::addFrame(double workMs) {
+    ++counters.frames;
+    // A level that held long enough is trusted again
+    if (++held >= (params.upgradeHold << params.maxBackoff)) backoff[current] = 0;
+
+    frames[next] = workMs;
+    next = (next + 1) % (int)frames.size();
+    if (filled < (int)frames.size()) ++filled;
+    if (filled < (int)frames.size()) return false;
+
+    const double ms = windowPercentile();
+    counters.windowMs = ms;
+    if (ms > params.downgradeAt * budgetMs()) {
+        underFrames = 0;
+        if (current == 0) return false;
+        change(current - 1);
+        return true;
+    }
+    if (ms >= params.upgradeAt * budgetMs() || current + 1 == (int)ladder.size()) {
+        underFrames = 0;
+        return false;
+    }
+    if (++underFrames < (params.upgradeHold << backoff[current + 1])) return false;
+    change(current + 1);
+    return true;
+}
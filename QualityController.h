@@ -0,0 +1,82 @@
+// QualityController.h
+// Dynamic resolution and pass quality for the SSAO chain. The controller
+// is fed the work time of every frame (without the pacer's sleep) and
+// keeps a rolling window of them. When a high percentile of the window
+// runs over the frame budget it steps down a ladder of quality levels;
+// when it has stayed well under the budget for a while it steps back up.
+//
+// Hysteresis comes from three places: the downgrade and upgrade
+// thresholds are apart, the window starts over after every change (its
+// frames were measured at the old level), and an upgrade to a level that
+// already had to be left again must wait twice as long as the last time.
+// The controller never reads a clock, so tests drive it with synthetic
+// frame-time traces.
+#pragma once
+
+#include <vector>
+
+// One step of the ladder
+struct QualityLevel {
+    float renderScale;     // of the intermediate targets, per axis
+    int   ssaoSamples;
+    int   blurRadius;      // taps on each side of the blur passes
+    float glossSpread;
+    bool  scatter, sheen;  // optional passes
+};
+
+// Cheapest first; every level costs more than the one below it
+std::vector<QualityLevel> defaultQualityLadder();
+
+struct QualityControllerParams {
+    double targetFps = 60.0;
+    int    window = 30;              // frames per decision
+    double percentile = 0.9;         // of the window, compared with the budget
+    double downgradeAt = 0.95;       // fractions of the frame budget
+    double upgradeAt = 0.75;
+    int    upgradeHold = 60;         // frames under upgradeAt before stepping up
+    int    maxBackoff = 5;           // upgradeHold doubles at most this often
+    int    startLevel = -1;          // -1 = the top of the ladder
+};
+
+struct QualityControllerStats {
+    int    frames = 0;
+    int    upgrades = 0, downgrades = 0;
+    double windowMs = 0.0;           // percentile of the last full window
+};
+
+class QualityController {
+public:
+    explicit QualityController(const QualityControllerParams& params = QualityControllerParams(),
+                               const std::vector<QualityLevel>& ladder = defaultQualityLadder());
+
+    // Work time of one frame; true if the level changed and the caller
+    // must apply settings()
+    bool addFrame(double workMs);
+
+    void   setTargetFps(double fps);
+    double budgetMs() const { return 1000.0 / params.targetFps; }
+
+    int  level() const { return current; }
+    int  levels() const { return (int)ladder.size(); }
+    const QualityLevel& settings() const { return ladder[current]; }
+    // Jumps to a level and forgets the window, e.g. after a mode switch
+    void setLevel(int level);
+
+    const QualityControllerStats& stats() const { return counters; }
+
+private:
+    double windowPercentile();
+    void   change(int level);
+
+    QualityControllerParams   params;
+    std::vector<QualityLevel> ladder;
+    int current;
+
+    std::vector<double> frames;      // ring of the last params.window frames
+    std::vector<double> sorted;      // scratch for the percentile
+    int  filled = 0, next = 0;
+    int  underFrames = 0;            // consecutive decisions under upgradeAt
+    int  held = 0;                   // frames at the current level
+    std::vector<int> backoff;        // per level, how often it was left downwards
+    QualityControllerStats counters;
+};
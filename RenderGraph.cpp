@@ -0,0 +1,274 @@
+// RenderGraph.cpp
+#include "RenderGraph.h"
+
+#include <cstdio>
+
+size_t rgFormatBytes(unsigned format) {
+    switch (format) {
+        case RG_FORMAT_RGBA8:   return 4;
+        case RG_FORMAT_RGBA16F: return 8;
+        case RG_FORMAT_R8:      return 1;
+    }
+    return 4;
+}
+
+size_t rgTextureBytes(const RGTextureDesc& desc) {
+    return (size_t)desc.width * (size_t)desc.height * rgFormatBytes(desc.format);
+}
+
+static bool sameDesc(const RGTextureDesc& a, const RGTextureDesc& b) {
+    return a.width == b.width && a.height == b.height && a.format == b.format;
+}
+
+unsigned RGPassContext::input(int i) const {
+    return graph->textures[graph->passes[pass].inputs[i]].handle;
+}
+
+int RenderGraph::createTexture(const char* name, const RGTextureDesc& desc) {
+    Texture t;
+    t.name = name;
+    t.desc = desc;
+    textures.push_back(t);
+    compiled = false;
+    return (int)textures.size() - 1;
+}
+
+int RenderGraph::importTexture(const char* name, const RGTextureDesc& desc, unsigned handle) {
+    int id = createTexture(name, desc);
+    textures[id].imported = true;
+    textures[id].handle = handle;
+    return id;
+}
+
+int RenderGraph::addPass(const char* name, const std::vector<int>& reads,
+                         const std::vector<int>& writes, RGExecuteFn execute) {
+    Pass p;
+    p.name = name;
+    p.inputs = reads;
+    p.outputs = writes;
+    p.execute = execute;
+    passes.push_back(p);
+    compiled = false;
+    return (int)passes.size() - 1;
+}
+
+void RenderGraph::setClearColor(int pass, const float rgba[4]) {
+    passes[pass].clears = true;
+    for (int c = 0; c < 4; ++c) passes[pass].clearColor[c] = rgba[c];
+    compiled = false;
+}
+
+void RenderGraph::setFold(int pass, RGFoldFn fold) {
+    passes[pass].fold = fold;
+    compiled = false;
+}
+
+bool RenderGraph::foldIdentity(const float* const* inputs, int count, float out[4]) {
+    if (count == 0) return false;
+    for (int i = 1; i < count; ++i)
+        for (int c = 0; c < 4; ++c)
+            if (inputs[i][c] != inputs[0][c]) return false;
+    for (int c = 0; c < 4; ++c) out[c] = inputs[0][c];
+    return true;
+}
+
+void RenderGraph::markOutput(int texture) {
+    outputs.push_back(texture);
+    compiled = false;
+}
+
+bool RenderGraph::compile(RGCompileStats* stats) {
+    release();
+    compiled = false;
+    for (Texture& t : textures) {
+        t.writer = t.firstUse = t.lastUse = t.physical = -1;
+        t.constant = t.needed = false;
+        if (!t.imported) t.handle = 0;
+    }
+    physicals.clear();
+
+    // Validate: one writer per texture, reads only after the write
+    for (int p = 0; p < (int)passes.size(); ++p) {
+        Pass& pass = passes[p];
+        pass.folded = pass.culled = false;
+        for (int t : pass.inputs) {
+            if (t < 0 || t >= (int)textures.size() || textures[t].writer < 0) {
+                std::fprintf(stderr, "RenderGraph: pass '%s' reads a texture no earlier pass writes\n",
+                             pass.name.c_str());
+                return false;
+            }
+        }
+        for (int t : pass.outputs) {
+            if (t < 0 || t >= (int)textures.size()) {
+                std::fprintf(stderr, "RenderGraph: pass '%s' writes an unknown texture\n",
+                             pass.name.c_str());
+                return false;
+            }
+            if (textures[t].writer >= 0) {
+                std::fprintf(stderr, "RenderGraph: texture '%s' is written by '%s' and '%s'\n",
+                             textures[t].name.c_str(), passes[textures[t].writer].name.c_str(),
+                             pass.name.c_str());
+                return false;
+            }
+            textures[t].writer = p;
+        }
+    }
+    for (int t : outputs) {
+        if (t < 0 || t >= (int)textures.size() || textures[t].writer < 0) {
+            std::fprintf(stderr, "RenderGraph: an output texture is never written\n");
+            return false;
+        }
+    }
+
+    // Constant folding in pass order, so constants propagate down the chain
+    for (Pass& pass : passes) {
+        float color[4];
+        if (pass.clears) {
+            for (int c = 0; c < 4; ++c) color[c] = pass.clearColor[c];
+        } else {
+            if (!pass.fold || pass.inputs.empty()) continue;
+            std::vector<const float*> in;
+            for (int t : pass.inputs) {
+                if (!textures[t].constant) break;
+                in.push_back(textures[t].color);
+            }
+            if (in.size() != pass.inputs.size() ||
+                !pass.fold(in.data(), (int)in.size(), color))
+                continue;
+        }
+        pass.folded = true;
+        for (int t : pass.outputs) {
+            textures[t].constant = true;
+            for (int c = 0; c < 4; ++c) textures[t].color[c] = color[c];
+        }
+    }
+
+    // Culling, backwards from the outputs. A folded pass needs no inputs.
+    for (int t : outputs) textures[t].needed = true;
+    for (int p = (int)passes.size() - 1; p >= 0; --p) {
+        Pass& pass = passes[p];
+        pass.culled = true;
+        for (int t : pass.outputs)
+            if (textures[t].needed) pass.culled = false;
+        if (pass.culled || pass.folded) continue;
+        for (int t : pass.inputs) textures[t].needed = true;
+    }
+
+    // Lifetimes of the textures that get real targets: [writer, last reader]
+    for (int p = 0; p < (int)passes.size(); ++p) {
+        const Pass& pass = passes[p];
+        if (pass.culled || pass.folded) continue;
+        for (int t : pass.outputs)
+            if (textures[t].firstUse < 0) textures[t].firstUse = p;
+        for (int t : pass.inputs) textures[t].lastUse = p;
+    }
+    // Outputs are read after the last pass, so nothing may reuse their targets
+    for (int t : outputs) textures[t].lastUse = (int)passes.size();
+
+    // Aliasing: textures are visited in write order, so a greedy first fit
+    // on targets of the same size and format whose last reader has already
+    // run is an interval-graph coloring
+    RGCompileStats s;
+    for (int t = 0; t < (int)textures.size(); ++t) {
+        Texture& tex = textures[t];
+        if (!tex.imported) s.declaredBytes += rgTextureBytes(tex.desc);
+    }
+    for (int p = 0; p < (int)passes.size(); ++p)
+        for (int t : passes[p].outputs) {
+            Texture& tex = textures[t];
+            if (tex.imported || !tex.needed) continue;
+            if (tex.constant) {
+                ++s.constantTextures;
+                s.unaliasedBytes += rgFormatBytes(tex.desc.format);
+                s.aliasedBytes += rgFormatBytes(tex.desc.format);
+                continue;
+            }
+            if (tex.firstUse < 0) continue;
+            if (tex.lastUse < tex.firstUse) tex.lastUse = tex.firstUse;
+            s.unaliasedBytes += rgTextureBytes(tex.desc);
+            for (int i = 0; i < (int)physicals.size(); ++i) {
+                Physical& ph = physicals[i];
+                if (sameDesc(ph.desc, tex.desc) && ph.lastUse < tex.firstUse) {
+                    tex.physical = i;
+                    ph.lastUse = tex.lastUse;
+                    break;
+                }
+            }
+            if (tex.physical < 0) {
+                Physical ph;
+                ph.desc = tex.desc;
+                ph.lastUse = tex.lastUse;
+                ph.handle = 0;
+                physicals.push_back(ph);
+                tex.physical = (int)physicals.size() - 1;
+                s.aliasedBytes += rgTextureBytes(tex.desc);
+            }
+        }
+
+    s.passes = (int)passes.size();
+    s.textures = (int)textures.size();
+    s.physicalTargets = (int)physicals.size();
+    for (const Pass& pass : passes) {
+        if (pass.culled) ++s.culledPasses;
+        else if (pass.folded) ++s.foldedPasses;
+    }
+    if (stats) *stats = s;
+    compiled = true;
+    return true;
+}
+
+void RenderGraph::execute(RenderGraphBackend& backend) {
+    if (!compiled) return;
+    if (!realized) {
+        owner = &backend;
+        for (Physical& ph : physicals) {
+            ph.handle = backend.createTarget(ph.desc);
+            created.push_back(ph.handle);
+        }
+        for (Texture& tex : textures) {
+            if (tex.imported || !tex.needed) continue;
+            if (tex.constant) {
+                tex.handle = backend.createConstant(tex.color);
+                created.push_back(tex.handle);
+            } else if (tex.physical >= 0) {
+                tex.handle = physicals[tex.physical].handle;
+            }
+        }
+        realized = true;
+    }
+
+    std::vector<unsigned> targets;
+    for (int p = 0; p < (int)passes.size(); ++p) {
+        const Pass& pass = passes[p];
+        if (pass.culled) continue;
+        // A folded pass still has to fill imported targets; its transient
+        // outputs are the constant textures created above
+        if (pass.folded) {
+            targets.clear();
+            for (int t : pass.outputs)
+                if (textures[t].imported) targets.push_back(textures[t].handle);
+            if (targets.empty()) continue;
+            backend.bindTargets(targets.data(), (int)targets.size());
+            backend.clearTargets(textures[pass.outputs[0]].color);
+            continue;
+        }
+        targets.clear();
+        for (int t : pass.outputs) targets.push_back(textures[t].handle);
+        backend.bindTargets(targets.data(), (int)targets.size());
+        if (pass.execute) {
+            RGPassContext ctx = { this, p };
+            pass.execute(ctx);
+        }
+    }
+}
+
+void RenderGraph::release() {
+    if (owner)
+        for (unsigned handle : created) owner->destroyTexture(handle);
+    created.clear();
+    owner = nullptr;
+    realized = false;
+    for (Physical& ph : physicals) ph.handle = 0;
+    for (Texture& tex : textures)
+        if (!tex.imported) tex.handle = 0;
+}
@@ -0,0 +1,145 @@
+// RenderGraph.h
+// Declarative pass graph for the SSAO post chain. Passes declare the
+// textures they read and write; compile() then
+//  - folds passes whose output is a known constant color (clears, and
+//    filters of constant inputs) so they never run,
+//  - culls passes whose outputs nothing needs,
+//  - gives every remaining texture a lifetime and lets textures whose
+//    lifetimes do not overlap share one render target.
+// The graph only talks to GPU objects through RenderGraphBackend, so it
+// compiles and runs against a mock backend without a GL context.
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Texture formats by GL internal format, without pulling in a GL header
+static const unsigned RG_FORMAT_RGBA8   = 0x8058;   // GL_RGBA8
+static const unsigned RG_FORMAT_RGBA16F = 0x881A;   // GL_RGBA16F
+static const unsigned RG_FORMAT_R8      = 0x8229;   // GL_R8
+
+struct RGTextureDesc {
+    int      width = 0, height = 0;
+    unsigned format = RG_FORMAT_RGBA8;
+};
+
+size_t rgFormatBytes(unsigned format);
+size_t rgTextureBytes(const RGTextureDesc& desc);
+
+// GPU side of the graph; handles are backend texture names
+class RenderGraphBackend {
+public:
+    virtual ~RenderGraphBackend() {}
+    virtual unsigned createTarget(const RGTextureDesc& desc) = 0;
+    // 1x1 texture of one color; stands in for a constant full-size image
+    // because every pass samples it with normalized coordinates
+    virtual unsigned createConstant(const float rgba[4]) = 0;
+    virtual void     destroyTexture(unsigned texture) = 0;
+    // Makes the textures the current color targets; texture 0 is the
+    // default framebuffer
+    virtual void     bindTargets(const unsigned* textures, int count) = 0;
+    virtual void     clearTargets(const float rgba[4]) = 0;
+};
+
+class RenderGraph;
+
+// What a pass sees while it runs
+struct RGPassContext {
+    const RenderGraph* graph;
+    int pass;
+    unsigned input(int i) const;   // texture bound to the pass's i-th input
+};
+
+typedef std::function<void(const RGPassContext&)> RGExecuteFn;
+// Output color of a pass whose inputs are all constant, or false if the
+// pass cannot be folded for these colors
+typedef std::function<bool(const float* const* inputs, int count, float out[4])> RGFoldFn;
+
+struct RGCompileStats {
+    int    passes = 0, culledPasses = 0, foldedPasses = 0;
+    int    textures = 0, constantTextures = 0, physicalTargets = 0;
+    size_t declaredBytes = 0;    // one target per declared texture (no graph)
+    size_t unaliasedBytes = 0;   // after culling and folding, no sharing
+    size_t aliasedBytes = 0;     // what is actually allocated
+};
+
+class RenderGraph {
+public:
+    // Transient texture owned by the graph
+    int createTexture(const char* name, const RGTextureDesc& desc);
+    // Texture owned elsewhere, e.g. the default framebuffer (handle 0)
+    int importTexture(const char* name, const RGTextureDesc& desc, unsigned handle);
+
+    // Passes must be added in execution order; every texture is written by
+    // exactly one pass, before any pass reads it
+    int  addPass(const char* name, const std::vector<int>& reads,
+                 const std::vector<int>& writes, RGExecuteFn execute);
+    // The pass only clears its outputs to rgba
+    void setClearColor(int pass, const float rgba[4]);
+    // The pass may be folded when all its inputs are constant
+    void setFold(int pass, RGFoldFn fold);
+    // Folds for filters that keep a constant image unchanged (blurs)
+    static bool foldIdentity(const float* const* inputs, int count, float out[4]);
+
+    // Textures that must be produced every frame. Their targets are never
+    // shared, so they still hold the result after execute().
+    void markOutput(int texture);
+
+    // Returns false (with a message on stderr) for an invalid graph
+    bool compile(RGCompileStats* stats = nullptr);
+
+    // Runs the compiled passes. Targets are created on first use and kept
+    // until release(), which must run while the backend is still alive.
+    void execute(RenderGraphBackend& backend);
+    void release();
+
+    const char* passName(int pass) const { return passes[pass].name.c_str(); }
+
+    // Compile results, for tests and tools
+    bool passCulled(int pass) const { return passes[pass].culled; }
+    bool passFolded(int pass) const { return passes[pass].folded; }
+    bool textureConstant(int texture) const { return textures[texture].constant; }
+    int  texturePhysical(int texture) const { return textures[texture].physical; }
+
+private:
+    friend struct RGPassContext;
+
+    struct Texture {
+        std::string   name;
+        RGTextureDesc desc;
+        bool     imported = false;
+        unsigned handle = 0;          // imported handle, or the backend's after execute()
+        int      writer = -1;
+        int      firstUse = -1, lastUse = -1;
+        bool     constant = false;
+        float    color[4] = {0, 0, 0, 0};
+        bool     needed = false;
+        int      physical = -1;       // shared target index
+    };
+
+    struct Pass {
+        std::string      name;
+        std::vector<int> inputs, outputs;
+        RGExecuteFn      execute;
+        RGFoldFn         fold;
+        bool  clears = false;
+        float clearColor[4] = {0, 0, 0, 0};
+        bool  folded = false, culled = false;
+    };
+
+    struct Physical {
+        RGTextureDesc desc;
+        int      lastUse;
+        unsigned handle;
+    };
+
+    std::vector<Texture>  textures;
+    std::vector<Pass>     passes;
+    std::vector<int>      outputs;
+    std::vector<Physical> physicals;
+    std::vector<unsigned> created;     // backend textures to destroy
+    RenderGraphBackend*   owner = nullptr;
+    bool compiled = false, realized = false;
+};
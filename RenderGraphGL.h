@@ -0,0 +1,98 @@
+// RenderGraphGL.h
+// OpenGL backend for RenderGraph. Include after the GL loader (glew or
+// glad); header-only like VertexFormatGL.h. Each target texture gets its
+// own FBO, made the first time the texture is bound.
+#pragma once
+
+#include "RenderGraph.h"
+
+#include <map>
+#include <vector>
+
+class GLRenderGraphBackend : public RenderGraphBackend {
+public:
+    // Size of the default framebuffer, for the viewport of texture 0
+    GLRenderGraphBackend(int width, int height) : screenW(width), screenH(height) {}
+
+    ~GLRenderGraphBackend() override {
+        for (auto& t : targets)
+            if (t.second.fbo) glDeleteFramebuffers(1, &t.second.fbo);
+    }
+
+    unsigned createTarget(const RGTextureDesc& desc) override {
+        GLenum format = desc.format == RG_FORMAT_R8 ? GL_RED : GL_RGBA;
+        GLenum type   = desc.format == RG_FORMAT_RGBA16F ? GL_HALF_FLOAT : GL_UNSIGNED_BYTE;
+        GLuint tex = makeTexture();
+        glTexImage2D(GL_TEXTURE_2D, 0, (GLint)desc.format, desc.width, desc.height, 0,
+                     format, type, nullptr);
+        Target& t = targets[tex];
+        t.width = desc.width;
+        t.height = desc.height;
+        return tex;
+    }
+
+    unsigned createConstant(const float rgba[4]) override {
+        GLuint tex = makeTexture();
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 1, 1, 0, GL_RGBA, GL_FLOAT, rgba);
+        return tex;
+    }
+
+    void destroyTexture(unsigned texture) override {
+        auto it = targets.find(texture);
+        if (it != targets.end()) {
+            if (it->second.fbo) glDeleteFramebuffers(1, &it->second.fbo);
+            targets.erase(it);
+        }
+        GLuint tex = texture;
+        glDeleteTextures(1, &tex);
+    }
+
+    void bindTargets(const unsigned* textures, int count) override {
+        if (count == 0 || textures[0] == 0) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, screenW, screenH);
+            return;
+        }
+        // FBOs are cached by their first attachment
+        Target& t = targets[textures[0]];
+        if (!t.fbo) {
+            glGenFramebuffers(1, &t.fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, t.fbo);
+            std::vector<GLenum> buffers;
+            for (int i = 0; i < count; ++i) {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i,
+                                       GL_TEXTURE_2D, textures[i], 0);
+                buffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+            }
+            glDrawBuffers(count, buffers.data());
+        } else {
+            glBindFramebuffer(GL_FRAMEBUFFER, t.fbo);
+        }
+        glViewport(0, 0, t.width, t.height);
+    }
+
+    void clearTargets(const float rgba[4]) override {
+        glClearColor(rgba[0], rgba[1], rgba[2], rgba[3]);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+private:
+    struct Target {
+        int    width = 0, height = 0;
+        GLuint fbo = 0;
+    };
+
+    static GLuint makeTexture() {
+        GLuint tex;
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return tex;
+    }
+
+    int screenW, screenH;
+    std::map<unsigned, Target> targets;
+};
@@ -0,0 +1,183 @@
+// ShaderManager.cpp
+#include "ShaderManager.h"
+#include "MeshCache.h"
+
+#include <chrono>
+#include <cstdio>
+
+static const uint32_t TAG_BINARY_FORMAT = meshCacheTag("PFMT");
+static const uint32_t TAG_BINARY        = meshCacheTag("PBIN");
+
+static const char* STAGE_NAMES[SHADER_STAGE_COUNT] = {"vertex", "fragment"};
+
+static double msSince(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+bool readTextFile(const char* path, std::string& out) {
+    FILE* f = std::fopen(path, "rb");
+    if (!f) return false;
+    out.clear();
+    char buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) out.append(buf, n);
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+    return ok;
+}
+
+ShaderManager::ShaderManager(ShaderBackend& b, const char* cacheDir)
+    : backend(b), dir(cacheDir ? cacheDir : ""), useCache(cacheDir != nullptr) {}
+
+void ShaderManager::release() {
+    for (Program& p : programs) {
+        for (unsigned& s : p.shaders) {
+            if (s) backend.deleteShader(s);
+            s = 0;
+        }
+        if (p.program) backend.deleteProgram(p.program);
+        p.program = 0;
+        if (p.state != FAILED) p.state = ADDED;
+    }
+}
+
+int ShaderManager::add(const char* name, const std::string& vs, const std::string& fs) {
+    programs.emplace_back();
+    Program& p = programs.back();
+    p.name = name;
+    p.sources[SHADER_VERTEX] = vs;
+    p.sources[SHADER_FRAGMENT] = fs;
+    ++counters.programs;
+    return (int)programs.size() - 1;
+}
+
+int ShaderManager::addFiles(const char* name, const char* vsPath, const char* fsPath) {
+    std::string vs, fs;
+    bool vsOk = readTextFile(vsPath, vs);
+    bool fsOk = readTextFile(fsPath, fs);
+    int id = add(name, vs, fs);
+    if (!vsOk || !fsOk)
+        fail(programs[id], std::string("cannot read ") + (vsOk ? fsPath : vsPath));
+    return id;
+}
+
+std::string ShaderManager::cachePath(const Program& p) const {
+    return meshCachePath(dir.c_str(), ("shader-" + p.name).c_str(), p.key);
+}
+
+void ShaderManager::fail(Program& p, const std::string& log) {
+    for (unsigned& s : p.shaders) {
+        if (s) backend.deleteShader(s);
+        s = 0;
+    }
+    if (p.program) backend.deleteProgram(p.program);
+    p.program = 0;
+    p.state = FAILED;
+    p.log = log;
+    ++counters.failed;
+    std::fprintf(stderr, "shader %s: %s\n", p.name.c_str(), log.c_str());
+}
+
+void ShaderManager::compileAll() {
+    auto start = std::chrono::steady_clock::now();
+    bool binaries = useCache && backend.binarySupported();
+    if (binaries && driver.empty()) driver = backend.driverId();
+
+    // Cached binaries first; whatever is left gets every stage compiled
+    // before anything is linked so the driver can overlap them
+    std::vector<Program*> issued;
+    for (Program& p : programs) {
+        if (p.state != ADDED) continue;
+        if (binaries) {
+            MeshCacheKey key;
+            key.add("shader-program").add(driver.c_str());
+            for (const std::string& s : p.sources) key.add(s.data(), s.size()).add((uint64_t)s.size());
+            p.key = key.value();
+
+            MeshCacheFile file;
+            size_t formatCount = 0, bytes = 0;
+            if (file.open(cachePath(p), p.key)) {
+                const uint32_t* format = file.array<uint32_t>(TAG_BINARY_FORMAT, formatCount);
+                const uint8_t*  data   = file.array<uint8_t>(TAG_BINARY, bytes);
+                if (format && formatCount == 1 && data)
+                    p.program = backend.loadBinary(*format, data, bytes);
+                if (p.program) {
+                    p.state = READY;
+                    ++counters.cacheHits;
+                    continue;
+                }
+                ++counters.cacheRejected;
+            } else {
+                ++counters.cacheMisses;
+            }
+        }
+        for (int s = 0; s < SHADER_STAGE_COUNT; ++s)
+            p.shaders[s] = backend.compile((ShaderStage)s, p.sources[s]);
+        issued.push_back(&p);
+    }
+    for (Program* p : issued) {
+        p->program = backend.link(p->shaders, SHADER_STAGE_COUNT);
+        p->state = LINKING;
+    }
+    counters.issueMs += msSince(start);
+}
+
+void ShaderManager::finish(Program& p) {
+    std::string log;
+    if (!backend.linkStatus(p.program, log)) {
+        // The stage logs say more than "link failed" when a stage did not compile
+        std::string stageLogs;
+        for (int s = 0; s < SHADER_STAGE_COUNT; ++s) {
+            std::string stageLog;
+            if (!backend.compileStatus(p.shaders[s], stageLog))
+                stageLogs += std::string(STAGE_NAMES[s]) + ": " + stageLog;
+        }
+        fail(p, stageLogs.empty() ? "link: " + log : stageLogs);
+        return;
+    }
+    for (unsigned& s : p.shaders) {
+        backend.deleteShader(s);
+        s = 0;
+    }
+    p.state = READY;
+
+    if (!useCache || !backend.binarySupported()) return;
+    uint32_t format = 0;
+    std::vector<uint8_t> data;
+    if (!backend.getBinary(p.program, format, data) || data.empty()) return;
+    MeshCacheWriter writer;
+    writer.add(TAG_BINARY_FORMAT, &format, 1, sizeof(format));
+    writer.add(TAG_BINARY, data);
+    if (writer.write(cachePath(p), p.key))
+        ++counters.cacheWrites;
+    else
+        std::fprintf(stderr, "shader %s: cannot write %s\n", p.name.c_str(), cachePath(p).c_str());
+}
+
+bool ShaderManager::poll() {
+    auto start = std::chrono::steady_clock::now();
+    bool parallel = backend.parallelCompile();
+    bool pending = false;
+    for (Program& p : programs) {
+        if (p.state != LINKING) continue;
+        if (parallel && !backend.linkDone(p.program)) {
+            pending = true;
+            continue;
+        }
+        finish(p);
+    }
+    counters.finishMs += msSince(start);
+    return !pending;
+}
+
+bool ShaderManager::wait() {
+    compileAll();
+    auto start = std::chrono::steady_clock::now();
+    bool ok = true;
+    for (Program& p : programs) {
+        if (p.state == LINKING) finish(p);
+        ok = ok && p.state == READY;
+    }
+    counters.finishMs += msSince(start);
+    return ok;
+}
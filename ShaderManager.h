@@ -0,0 +1,130 @@
+// ShaderManager.h
+// Builds every shader program of a demo in one batch. All stages are
+// compiled up front and all programs linked without waiting on any of
+// them, so a driver with parallel compilation (KHR_parallel_shader_compile)
+// works on them together while the CPU does other startup work; poll()
+// and wait() pick the results up. Linked programs are stored on disk as
+// driver program binaries keyed by a hash of their sources and the driver
+// string. A binary the driver rejects (new driver, changed GPU) is simply
+// rebuilt from source and rewritten.
+//
+// The GL calls sit behind ShaderBackend; ShaderManagerGL.h has the
+// OpenGL one. Cache files use the MeshCache container.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum ShaderStage {
+    SHADER_VERTEX,
+    SHADER_FRAGMENT,
+    SHADER_STAGE_COUNT
+};
+
+// Shaders and programs are backend handles, 0 for none
+class ShaderBackend {
+public:
+    virtual ~ShaderBackend() {}
+    // Identifies the driver build; cached binaries are keyed by it
+    virtual std::string driverId() = 0;
+    // linkDone() can be polled without blocking
+    virtual bool     parallelCompile() = 0;
+    // getBinary() / loadBinary() work at all
+    virtual bool     binarySupported() = 0;
+
+    // Start work and return at once; errors show up in the status calls
+    virtual unsigned compile(ShaderStage stage, const std::string& source) = 0;
+    virtual unsigned link(const unsigned* shaders, int count) = 0;
+    // Whether compiling or linking has finished, never blocks
+    virtual bool     linkDone(unsigned program) = 0;
+    // These block until the result is known; false fills log
+    virtual bool     compileStatus(unsigned shader, std::string& log) = 0;
+    virtual bool     linkStatus(unsigned program, std::string& log) = 0;
+    virtual void     deleteShader(unsigned shader) = 0;
+    virtual void     deleteProgram(unsigned program) = 0;
+
+    // Binary of a linked program; false if the driver has none
+    virtual bool     getBinary(unsigned program, uint32_t& format, std::vector<uint8_t>& data) = 0;
+    // A linked program from a binary, or 0 if the driver rejects it
+    virtual unsigned loadBinary(uint32_t format, const void* data, size_t bytes) = 0;
+};
+
+struct ShaderManagerStats {
+    int programs = 0;
+    int cacheHits = 0;
+    int cacheMisses = 0;
+    int cacheRejected = 0;       // found on disk, refused by the driver
+    int cacheWrites = 0;
+    int failed = 0;
+    double issueMs = 0.0;        // compileAll(): cache loads and issuing the rest
+    double finishMs = 0.0;       // time spent in poll() / wait() finishing programs
+};
+
+class ShaderManager {
+public:
+    // cacheDir == nullptr keeps no binaries on disk
+    explicit ShaderManager(ShaderBackend& backend, const char* cacheDir = ".");
+    ~ShaderManager() { release(); }
+
+    ShaderManager(const ShaderManager&) = delete;
+    ShaderManager& operator=(const ShaderManager&) = delete;
+
+    // Register a program and return its id. Names label log messages and
+    // cache files, so keep them unique and file-name safe.
+    int add(const char* name, const std::string& vertexSource, const std::string& fragmentSource);
+    // Reads the sources now; an unreadable file fails the program
+    int addFiles(const char* name, const char* vertexPath, const char* fragmentPath);
+
+    // Loads cached binaries and issues compiles and links for every
+    // program added since the last call
+    void compileAll();
+    // Finishes programs whose link is done; true once none are pending.
+    // Without parallel compilation this finishes everything, blocking.
+    bool poll();
+    // Issues anything not yet issued and finishes every program; false
+    // if any failed
+    bool wait();
+
+    // Linked program, 0 while pending or after a failure
+    unsigned program(int id) const { return programs[id].program; }
+    bool ready(int id) const { return programs[id].state == READY; }
+    bool failed(int id) const { return programs[id].state == FAILED; }
+    // Compile or link log of a failed program
+    const std::string& error(int id) const { return programs[id].log; }
+    const char* name(int id) const { return programs[id].name.c_str(); }
+    int count() const { return (int)programs.size(); }
+    const ShaderManagerStats& stats() const { return counters; }
+
+    // Deletes every program; call while the backend's context is alive.
+    // The destructor calls it too, which is too late once the window is gone.
+    void release();
+
+private:
+    enum State { ADDED, LINKING, READY, FAILED };
+
+    struct Program {
+        std::string name;
+        std::string sources[SHADER_STAGE_COUNT];
+        uint64_t    key = 0;
+        unsigned    shaders[SHADER_STAGE_COUNT] = {};
+        unsigned    program = 0;
+        State       state = ADDED;
+        std::string log;
+    };
+
+    void finish(Program& p);
+    void fail(Program& p, const std::string& log);
+    std::string cachePath(const Program& p) const;
+
+    ShaderBackend& backend;
+    std::string    dir;
+    bool           useCache;
+    std::string    driver;           // queried on the first compileAll()
+    std::vector<Program> programs;
+    ShaderManagerStats counters;
+};
+
+// Whole file into out; false if it cannot be read
+bool readTextFile(const char* path, std::string& out);
@@ -0,0 +1,175 @@
+// ShaderManagerGL.h
+// OpenGL backend for ShaderManager. Completion is polled with
+// GL_COMPLETION_STATUS_KHR when the driver has KHR_parallel_shader_compile
+// (or the ARB version); without it the manager falls back to blocking
+// status queries. Program binaries need GL 4.1 or ARB_get_program_binary
+// in the loader and at least one binary format at run time; some drivers
+// report none, and then nothing is cached. Mesa's llvmpipe has both.
+// Include after the GL loader (glew or glad); header-only like
+// RenderGraphGL.h.
+#pragma once
+
+#include "ShaderManager.h"
+
+#include <cstring>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// A glad loader generated for GL 3.3 without the extension has no
+// binary entry points; the backend then never caches
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+#define SHADER_MANAGER_GL_BINARIES 1
+#else
+#define SHADER_MANAGER_GL_BINARIES 0
+#endif
+
+class GLShaderBackend : public ShaderBackend {
+public:
+    GLShaderBackend() {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i) {
+            const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (ext && (std::strcmp(ext, "GL_KHR_parallel_shader_compile") == 0 ||
+                        std::strcmp(ext, "GL_ARB_parallel_shader_compile") == 0))
+                parallel = true;
+        }
+#if SHADER_MANAGER_GL_BINARIES
+        GLint formats = 0;
+        if (glGetProgramBinary && glProgramBinary && glProgramParameteri)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        binaries = formats > 0;
+#endif
+    }
+
+    std::string driverId() override {
+        std::string id;
+        for (GLenum e : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}) {
+            const char* s = (const char*)glGetString(e);
+            id += s ? s : "";
+            id += '\n';
+        }
+        return id;
+    }
+
+    bool parallelCompile() override { return parallel; }
+    bool binarySupported() override { return binaries; }
+
+    unsigned compile(ShaderStage stage, const std::string& source) override {
+        GLuint s = glCreateShader(stage == SHADER_VERTEX ? GL_VERTEX_SHADER : GL_FRAGMENT_SHADER);
+        const char* src = source.c_str();
+        glShaderSource(s, 1, &src, nullptr);
+        glCompileShader(s);
+        return s;
+    }
+
+    unsigned link(const unsigned* shaders, int count) override {
+        GLuint p = glCreateProgram();
+        for (int i = 0; i < count; ++i) glAttachShader(p, shaders[i]);
+#if SHADER_MANAGER_GL_BINARIES
+        if (binaries) glProgramParameteri(p, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+        glLinkProgram(p);
+        return p;
+    }
+
+    bool linkDone(unsigned program) override {
+        GLint done = GL_TRUE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+        return done != GL_FALSE;
+    }
+
+    bool compileStatus(unsigned shader, std::string& log) override {
+        GLint ok = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+        if (!ok) log = infoLog(shader, false);
+        return ok != GL_FALSE;
+    }
+
+    bool linkStatus(unsigned program, std::string& log) override {
+        GLint ok = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &ok);
+        if (!ok) log = infoLog(program, true);
+        return ok != GL_FALSE;
+    }
+
+    void deleteShader(unsigned shader) override { glDeleteShader(shader); }
+    void deleteProgram(unsigned program) override { glDeleteProgram(program); }
+
+    bool getBinary(unsigned program, uint32_t& format, std::vector<uint8_t>& data) override {
+#if SHADER_MANAGER_GL_BINARIES
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return false;
+        data.resize(length);
+        GLenum fmt = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &fmt, data.data());
+        data.resize(written);
+        format = fmt;
+        return written > 0;
+#else
+        (void)program, (void)format, (void)data;
+        return false;
+#endif
+    }
+
+    unsigned loadBinary(uint32_t format, const void* data, size_t bytes) override {
+#if SHADER_MANAGER_GL_BINARIES
+        GLuint p = glCreateProgram();
+        glProgramBinary(p, format, data, (GLsizei)bytes);
+        // A rejected binary leaves the program unlinked (and may raise
+        // GL_INVALID_ENUM for an unknown format); neither is an error here
+        GLint ok = GL_FALSE;
+        glGetProgramiv(p, GL_LINK_STATUS, &ok);
+        while (glGetError() != GL_NO_ERROR) {}
+        if (!ok) {
+            glDeleteProgram(p);
+            return 0;
+        }
+        return p;
+#else
+        (void)format, (void)data, (void)bytes;
+        return 0;
+#endif
+    }
+
+private:
+    static std::string infoLog(GLuint object, bool program) {
+        GLint length = 0;
+        if (program)
+            glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+        else
+            glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+        if (length <= 1) return std::string();
+        std::string log(length, '\0');
+        if (program)
+            glGetProgramInfoLog(object, length, nullptr, &log[0]);
+        else
+            glGetShaderInfoLog(object, length, nullptr, &log[0]);
+        log.resize(std::strlen(log.c_str()));
+        return log;
+    }
+
+    bool parallel = false;
+    bool binaries = false;
+};
+
+// Shader-class style handle for pass code: use() and uniform setters on
+// a manager program. Uniforms are looked up by name on every call.
+class ManagedShader {
+public:
+    ManagedShader(const ShaderManager& m, int programId) : manager(m), id(programId) {}
+
+    void use() const { glUseProgram(manager.program(id)); }
+    void setInt(const char* name, int v) const { glUniform1i(location(name), v); }
+    void setFloat(const char* name, float v) const { glUniform1f(location(name), v); }
+
+private:
+    GLint location(const char* name) const { return glGetUniformLocation(manager.program(id), name); }
+
+    const ShaderManager& manager;
+    int id;
+};
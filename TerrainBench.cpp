@@ -0,0 +1,535 @@
+// TerrainBench.cpp
+// Headless benchmarks for the CPU side of the terrain programs: noise,
+// height grids and normals, voxel meshing and the SSAO pipeline's CPU
+// work. Links only terrain_core, so it runs without a window or GL.
+//
+// Usage: terrain_bench [--quick] [--threads N] [--baseline FILE]
+//                      [--write-baseline FILE] [--tolerance PERCENT]
+//
+// Every result is one tab-separated "metric value unit" line on stdout;
+// comment lines start with '#'. A baseline file has the same format.
+// With --baseline, metrics that got worse by more than the tolerance are
+// reported and the exit code is 1. Units ending in "/s" are throughputs
+// (higher is better); everything else is a cost (lower is better).
+#include "ChunkManager.h"
+#include "Heightfield.h"
+#include "HeightfieldQuery.h"
+#include "MeshBuilder.h"
+#include "NoiseGraph.h"
+#include "PerlinNoise.h"
+#include "PostProcessCpu.h"
+#include "Profiler.h"
+#include "QualityController.h"
+#include "RenderGraph.h"
+#include "ThreadPool.h"
+#include "VoxelStore.h"
+#include "VoxelTerrain.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// --- Heap high-water mark ---
+// Every plain operator new goes through these counters; a size header in
+// front of each block lets delete subtract what new added.
+
+static std::atomic<size_t> heapLive{0}, heapPeak{0};
+static const size_t HEAP_HEADER = 16;
+
+void* operator new(size_t size) {
+    void* p = std::malloc(size + HEAP_HEADER);
+    if (!p) throw std::bad_alloc();
+    *static_cast<size_t*>(p) = size;
+    size_t live = heapLive.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = heapPeak.load(std::memory_order_relaxed);
+    while (live > peak && !heapPeak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    return static_cast<char*>(p) + HEAP_HEADER;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    char* block = static_cast<char*>(p) - HEAP_HEADER;
+    heapLive.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void  operator delete[](void* p) noexcept { operator delete(p); }
+void  operator delete(void* p, size_t) noexcept { operator delete(p); }
+void  operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+// Peak live heap bytes since the last call, above what was live then
+static size_t heapHighWater(bool restart) {
+    static size_t base = 0;
+    size_t peak = heapPeak.load() - base;
+    if (restart) {
+        base = heapLive.load();
+        heapPeak.store(base);
+    }
+    return peak;
+}
+
+static size_t peakResidentBytes() {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+// --- Results ---
+
+struct Metric {
+    std::string name;
+    double      value;
+    std::string unit;
+};
+
+static std::vector<Metric> results;
+
+static void report(const std::string& name, double value, const char* unit) {
+    results.push_back(Metric{name, value, unit});
+    std::printf("%s\t%.6g\t%s\n", name.c_str(), value, unit);
+    std::fflush(stdout);
+}
+
+static bool higherIsBetter(const std::string& unit) {
+    return unit.size() >= 2 && unit.compare(unit.size() - 2, 2, "/s") == 0;
+}
+
+// Short runs are repeated until one sample takes at least this long, so
+// timer resolution and scheduler noise stay small against the work
+static const double MIN_SAMPLE_SECONDS = 0.05;
+
+static double secondsSince(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Seconds per call of fn: the best of `repeats` samples, after a warm-up
+// call that also sizes the samples
+template <class Fn>
+static double bestSeconds(int repeats, Fn fn) {
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    double once = secondsSince(t0);
+    int calls = once >= MIN_SAMPLE_SECONDS ? 1 : (int)(MIN_SAMPLE_SECONDS / std::max(once, 1e-7)) + 1;
+    double best = 1e30;
+    for (int r = 0; r < repeats; ++r) {
+        t0 = std::chrono::steady_clock::now();
+        for (int c = 0; c < calls; ++c) fn();
+        best = std::min(best, secondsSince(t0) / calls);
+    }
+    return best;
+}
+
+// Keeps the optimizer from dropping results nobody reads
+static volatile float sink;
+
+// --- Benchmarks ---
+
+static void benchNoise(int repeats) {
+    const int N = 1 << 20;
+    std::vector<float> xs(N), ys(N), out(N);
+    for (int i = 0; i < N; ++i) {
+        xs[i] = (i % 1024) * 0.173f;
+        ys[i] = (i / 1024) * 0.173f;
+    }
+    heapHighWater(true);
+
+    double s = bestSeconds(repeats, [&] {
+        float acc = 0.0f;
+        for (int i = 0; i < N; ++i) acc += perlinNoise(xs[i], ys[i]);
+        sink = acc;
+    });
+    report("noise.scalar", N / s, "samples/s");
+
+    s = bestSeconds(repeats, [&] { perlinNoiseBatch(xs.data(), ys.data(), N, out.data()); });
+    report("noise.batch", N / s, "samples/s");
+
+    FbmParams fbm;
+    fbm.octaves = 4;
+    s = bestSeconds(repeats, [&] { perlinFbmBatch(xs.data(), ys.data(), N, fbm, out.data()); });
+    report("noise.fbm4_batch", N * 4.0 / s, "samples/s");
+
+    // A terrain-shaped graph (warp, ridges, blend, one shared node), in
+    // tiles the size of a streamed chunk's column grid
+    typedef Shared<0, Fbm<3, SimplexNoise>> Continents;
+    Blend<DomainWarp<Continents, Fbm<5, GradientNoise>>, Ridged<4, SimplexNoise>, Continents> graph;
+    graph.a.warp = graph.mask = Continents(Fbm<3, SimplexNoise>(SimplexNoise(1)));
+    graph.a.source = Fbm<5, GradientNoise>(GradientNoise(2));
+    graph.b = Ridged<4, SimplexNoise>(SimplexNoise(3));
+    const int GRAPH_N = 1 << 16, TILE = 34 * 34;
+    s = bestSeconds(repeats, [&] {
+        for (int i = 0; i < GRAPH_N; i += TILE) {
+            int n = std::min(TILE, GRAPH_N - i);
+            sampleNoise(graph, xs.data() + i, ys.data() + i, n, out.data() + i);
+        }
+    });
+    report("noise.graph", GRAPH_N / s, "samples/s");
+}
+
+static void benchHeightfield(ThreadPool& pool, int repeats) {
+    HeightfieldParams params;
+    params.width = params.depth = 1024;
+    params.fbm.octaves = 4;
+    const size_t points = (size_t)params.width * params.depth;
+    Heightfield hf;
+    heapHighWater(true);
+
+    double s = bestSeconds(repeats, [&] { generateHeightfield(params, pool, hf); });
+    report("grid.heights", points / s, "vertices/s");
+
+    std::vector<float> xyz(points * 3), normals(points * 3);
+    s = bestSeconds(repeats, [&] { buildGridPositions(hf, pool, xyz.data()); });
+    report("grid.positions", points / s, "vertices/s");
+
+    s = bestSeconds(repeats, [&] { computeGridNormals(hf, NORMALS_CENTRAL_DIFF, pool, normals.data()); });
+    report("grid.normals_central", points / s, "normals/s");
+
+    s = bestSeconds(repeats, [&] { computeGridNormals(hf, NORMALS_AREA_WEIGHTED, pool, normals.data()); });
+    report("grid.normals_area", points / s, "normals/s");
+
+    std::vector<unsigned> indices(gridIndexCount(params.width, params.depth));
+    s = bestSeconds(repeats, [&] { buildGridIndices(params.width, params.depth, pool, indices.data()); });
+    report("grid.indices", indices.size() / s, "indices/s");
+    report("grid.heap_peak", (double)heapHighWater(false), "bytes");
+
+    HeightfieldQuery query;
+    s = bestSeconds(repeats, [&] { query.build(hf); });
+    report("query.build", s * 1e3, "ms");
+
+    // Picking-like rays from above, and line of sight between points just
+    // over the ground, spread over the whole grid
+    const int RAYS = 16384;
+    const float extent = (params.width - 1) * params.scale;
+    std::vector<HeightfieldRay> rays(RAYS);
+    std::vector<Vec3> from(RAYS), to(RAYS);
+    unsigned h = 7;
+    auto next = [&h] { h = h * 1664525u + 1013904223u; return (h >> 8) / 16777216.0f; };
+    for (int i = 0; i < RAYS; ++i) {
+        rays[i].origin = {next() * extent, 30.0f, next() * extent};
+        rays[i].dir    = {(next() - 0.5f) * 40.0f, -40.0f, (next() - 0.5f) * 40.0f};
+        rays[i].maxT   = 1.0f;
+        float ground;
+        from[i] = {next() * extent, 0.0f, next() * extent};
+        to[i]   = {next() * extent, 0.0f, next() * extent};
+        query.heightAt(from[i].x, from[i].z, ground);
+        from[i].y = ground + 2.0f;
+        query.heightAt(to[i].x, to[i].z, ground);
+        to[i].y = ground + 2.0f;
+    }
+    std::vector<HeightfieldHit> hits(RAYS);
+    s = bestSeconds(repeats, [&] { query.raycastBatch(rays.data(), RAYS, pool, hits.data()); });
+    report("query.rays", RAYS / s, "rays/s");
+
+    std::vector<uint8_t> visible(RAYS);
+    s = bestSeconds(repeats, [&] { query.lineOfSight(from.data(), to.data(), RAYS, pool, visible.data()); });
+    report("query.line_of_sight", RAYS / s, "rays/s");
+}
+
+static void sampleBenchHeights(const float* wx, const float* wz, int count, float* h) {
+    // The TerraVoxel height function, without glm
+    std::vector<float> xs(wx, wx + count), zs(wz, wz + count);
+    for (int i = 0; i < count; ++i) {
+        xs[i] *= 0.0015f;
+        zs[i] *= 0.0015f;
+    }
+    perlinNoiseBatch(xs.data(), zs.data(), count, h);
+    for (int i = 0; i < count; ++i) h[i] = 50.0f + (h[i] * 2.0f - 1.0f) * 200.0f;
+}
+
+static void benchVoxel(ThreadPool& pool, int repeats) {
+    VoxelTerrainParams params;
+    params.resolution = 512;
+    params.floorY = -150.0f;
+    VoxelColumns cols;
+    VoxelMesh mesh;
+    heapHighWater(true);
+
+    double s = bestSeconds(repeats, [&] { generateVoxelColumns(params, sampleBenchHeights, pool, cols); });
+    report("voxel.columns", (double)params.resolution * params.resolution / s, "columns/s");
+
+    s = bestSeconds(repeats, [&] { meshVoxelTerrain(cols, params, pool, mesh); });
+    report("voxel.mesh", mesh.stats.vertices / s, "vertices/s");
+    report("voxel.mesh_naive_equiv", mesh.stats.naiveVertices / s, "vertices/s");
+
+    params.greedyMerge = false;
+    VoxelMesh plain;
+    s = bestSeconds(repeats, [&] { meshVoxelTerrain(cols, params, pool, plain); });
+    report("voxel.mesh_unmerged", plain.stats.vertices / s, "vertices/s");
+    report("voxel.heap_peak", (double)heapHighWater(true), "bytes");
+
+    // One streamed chunk on the calling thread, sampling included
+    ChunkManagerParams chunkParams;
+    chunkParams.terrain = params;
+    chunkParams.terrain.greedyMerge = true;
+    StreamedChunk chunk;
+    const int CHUNKS = 64;
+    s = bestSeconds(repeats, [&] {
+        for (int i = 0; i < CHUNKS; ++i)
+            ChunkManager::buildChunk(chunkParams, sampleBenchHeights, i % 8, i / 8, chunk);
+    });
+    report("voxel.stream_chunk", s / CHUNKS * 1e6, "us");
+    report("voxel.stream_heap_peak", (double)heapHighWater(false), "bytes");
+
+    // The same columns as a sparse volume
+    VoxelStore store;
+    s = bestSeconds(repeats, [&] {
+        store.clear();
+        storeVoxelColumns(cols, store);
+    });
+    report("voxel.store_fill", (double)params.resolution * params.resolution / s, "columns/s");
+
+    const int GETS = 1 << 20;
+    int height = 0;
+    for (int top : cols.top) height = std::max(height, top);
+    s = bestSeconds(repeats, [&] {
+        unsigned acc = 0, h = 1;
+        for (int i = 0; i < GETS; ++i) {
+            h = h * 1664525u + 1013904223u;
+            acc += store.get((int)(h >> 8) % params.resolution, (int)(h >> 4) % (height + 1),
+                             (int)(h >> 16) % params.resolution);
+        }
+        sink = (float)acc;
+    });
+    report("voxel.store_get", GETS / s, "voxels/s");
+
+    std::vector<VoxelRun> runs;
+    s = bestSeconds(repeats, [&] {
+        size_t acc = 0;
+        for (int x = 0; x < params.resolution; ++x)
+            for (int z = 0; z < params.resolution; ++z) {
+                store.columnRuns(x, z, 0, height + 1, runs);
+                acc += runs.size();
+            }
+        sink = (float)acc;
+    });
+    report("voxel.store_column_runs", (double)params.resolution * params.resolution / s, "columns/s");
+    report("voxel.store_bytes_per_voxel", store.stats().bytesPerVoxel, "bytes/voxel");
+}
+
+// Backend that hands out numbers and does nothing, so execute() costs
+// only the graph's own bookkeeping
+class NullBackend : public RenderGraphBackend {
+public:
+    unsigned createTarget(const RGTextureDesc&) override { return ++next; }
+    unsigned createConstant(const float*) override { return ++next; }
+    void     destroyTexture(unsigned) override {}
+    void     bindTargets(const unsigned*, int) override {}
+    void     clearTargets(const float*) override {}
+
+private:
+    unsigned next = 0;
+};
+
+static void benchPipeline(ThreadPool& pool, int repeats) {
+    // The SSAO program's pass structure, empty passes
+    RenderGraph graph;
+    RGTextureDesc full = {1280, 720, RG_FORMAT_RGBA16F};
+    int gbuffer = graph.createTexture("normalDepth", full);
+    int ssao    = graph.createTexture("ssao", full);
+    int blur    = graph.createTexture("ssaoBlur", full);
+    int scatter = graph.createTexture("scatter", full);
+    int sheen   = graph.createTexture("sheen", full);
+    int sheenB  = graph.createTexture("sheenBlur", full);
+    int screen  = graph.importTexture("screen", full, 0);
+    volatile int work = 0;
+    RGExecuteFn draw = [&](const RGPassContext&) { work = work + 1; };
+    graph.addPass("geometry", {}, {gbuffer}, draw);
+    graph.addPass("ssao", {gbuffer}, {ssao}, draw);
+    graph.addPass("blur", {ssao}, {blur}, draw);
+    graph.addPass("scatter", {blur}, {scatter}, draw);
+    graph.addPass("sheen", {scatter}, {sheen}, draw);
+    graph.addPass("sheenBlur", {sheen}, {sheenB}, draw);
+    graph.addPass("composite", {scatter, sheenB}, {screen}, draw);
+    graph.markOutput(screen);
+
+    if (!graph.compile()) return;
+    double s = bestSeconds(repeats, [&] { graph.compile(); });
+    report("pipeline.graph_compile", s * 1e6, "us");
+
+    NullBackend backend;
+    s = bestSeconds(repeats, [&] { graph.execute(backend); });
+    report("pipeline.graph_execute", s * 1e6, "us");
+    graph.release();
+
+    // Post chain on the CPU at a quarter of 720p
+    CpuImage normalDepth, out;
+    normalDepth.resize(640, 360);
+    for (int y = 0; y < normalDepth.height; ++y) {
+        for (int x = 0; x < normalDepth.width; ++x) {
+            float* p = normalDepth.row(y) + x * 4;
+            p[0] = 0.0f;
+            p[1] = 1.0f;
+            p[2] = 0.0f;
+            p[3] = 0.5f + 0.3f * (float)((x * 7 + y * 13) % 64) / 64.0f;
+        }
+    }
+    PostFxParams fx;
+    PostChainScratch scratch;
+    heapHighWater(true);
+    s = bestSeconds(repeats, [&] { runPostChain(normalDepth, fx, pool, scratch, out); });
+    report("pipeline.post_chain", s * 1e3, "ms");
+    report("pipeline.post_chain_pixels", normalDepth.width * normalDepth.height / s, "pixels/s");
+    report("pipeline.heap_peak", (double)heapHighWater(false), "bytes");
+}
+
+static void benchProfiler(int repeats) {
+    // Cost of one CPU zone, and of collecting it at the end of a frame
+    Profiler profiler(nullptr, 1 << 16);
+    const int ZONES = 10000;
+    double s = bestSeconds(repeats, [&] {
+        for (int i = 0; i < ZONES; ++i) {
+            profiler.beginZone("bench");
+            profiler.endZone();
+        }
+        profiler.endFrame();
+    });
+    report("profiler.zone", s / ZONES * 1e9, "ns");
+}
+
+static void benchQuality() {
+    // A synthetic GPU whose cost per level grows with the pixels and the
+    // pass settings, and which gets 60% slower for a while halfway
+    // through. Deterministic, so the metrics are frame counts rather than
+    // timings: how long the controller takes to settle after each load
+    // change, and how often it changes level in total.
+    QualityController quality;
+    const int FRAMES = 6000, SLOW_FROM = 2000, SLOW_TO = 4000;
+    const double GPU_MS = 4.0;
+    uint32_t rng = 12345;
+    int lastChange[2] = {0, 0}, changes = 0;
+    for (int f = 0; f < FRAMES; ++f) {
+        const QualityLevel& q = quality.settings();
+        double cost = q.renderScale * q.renderScale *
+                      (1.0 + q.ssaoSamples / 16.0 + q.blurRadius / 4.0 + (q.scatter ? 0.5 : 0.0) +
+                       (q.sheen ? 0.5 : 0.0) + q.glossSpread * 0.3) + 0.3;
+        rng = rng * 1664525u + 1013904223u;
+        double jitter = 1.0 + 0.1 * ((rng >> 8) / 16777216.0 - 0.5);
+        double slow = f >= SLOW_FROM && f < SLOW_TO ? 1.6 : 1.0;
+        if (quality.addFrame(GPU_MS * cost * slow * jitter)) {
+            ++changes;
+            lastChange[f >= SLOW_FROM && f < SLOW_TO] = f;
+        }
+    }
+    report("quality.settle_frames",
+           std::max(lastChange[1] - SLOW_FROM, std::max(lastChange[0] - SLOW_TO, 0)), "frames");
+    report("quality.changes", changes, "changes");
+}
+
+// --- Baseline ---
+
+static bool readBaseline(const char* path, std::map<std::string, Metric>& out) {
+    FILE* f = std::fopen(path, "r");
+    if (!f) {
+        std::fprintf(stderr, "Could not read baseline %s\n", path);
+        return false;
+    }
+    char line[512], name[256], unit[64];
+    double value;
+    while (std::fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        if (std::sscanf(line, "%255s %lf %63s", name, &value, unit) == 3)
+            out[name] = Metric{name, value, unit};
+    }
+    std::fclose(f);
+    return true;
+}
+
+static bool writeBaseline(const char* path, unsigned threads) {
+    FILE* f = std::fopen(path, "w");
+    if (!f) {
+        std::fprintf(stderr, "Could not write baseline %s\n", path);
+        return false;
+    }
+    std::fprintf(f, "# terrain_bench baseline, %u threads, noise %s\n",
+                 threads, noiseIsaName(perlinNoiseIsa()));
+    for (const Metric& m : results)
+        std::fprintf(f, "%s\t%.6g\t%s\n", m.name.c_str(), m.value, m.unit.c_str());
+    std::fclose(f);
+    return true;
+}
+
+// Returns the number of regressions
+static int compareBaseline(const std::map<std::string, Metric>& baseline, double tolerance) {
+    int regressions = 0;
+    std::printf("# metric\tbaseline\tnow\tchange\n");
+    for (const Metric& m : results) {
+        auto it = baseline.find(m.name);
+        if (it == baseline.end() || it->second.value <= 0.0) continue;
+        double change = m.value / it->second.value - 1.0;
+        bool worse = higherIsBetter(m.unit) ? change < -tolerance : change > tolerance;
+        // Memory counts are exact; a few bytes of noise is not a regression
+        if (m.unit == "bytes" && m.value - it->second.value < 4096.0) worse = false;
+        std::printf("# %s\t%.6g\t%.6g\t%+.1f%%%s\n", m.name.c_str(), it->second.value, m.value,
+                    change * 100.0, worse ? "\tREGRESSION" : "");
+        if (worse) ++regressions;
+    }
+    return regressions;
+}
+
+int main(int argc, char** argv) {
+    bool quick = false;
+    unsigned threads = 0;
+    const char* baselinePath = nullptr;
+    const char* writePath = nullptr;
+    double tolerance = 0.15;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--quick") quick = true;
+        else if (arg == "--threads" && hasValue) threads = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--baseline" && hasValue) baselinePath = argv[++i];
+        else if (arg == "--write-baseline" && hasValue) writePath = argv[++i];
+        else if (arg == "--tolerance" && hasValue) tolerance = std::atof(argv[++i]) / 100.0;
+        else {
+            std::fprintf(stderr, "usage: %s [--quick] [--threads N] [--baseline FILE] "
+                                 "[--write-baseline FILE] [--tolerance PERCENT]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // threads counts the calling thread, like ThreadPool::concurrency()
+    ThreadPool pool(threads > 0 ? threads - 1 : 0);
+    const int repeats = quick ? 2 : 5;
+    std::printf("# terrain_bench: %u threads, noise %s, %d repeats (best)\n",
+                pool.concurrency(), noiseIsaName(perlinNoiseIsa()), repeats);
+    heapHighWater(true);
+
+    benchNoise(repeats);
+    benchHeightfield(pool, repeats);
+    benchVoxel(pool, repeats);
+    benchPipeline(pool, repeats);
+    benchProfiler(repeats);
+    benchQuality();
+    report("process.peak_rss", (double)peakResidentBytes(), "bytes");
+    report("process.arena_blocks", (double)meshArenaHeapTotals().heapAllocations, "blocks");
+
+    if (writePath && !writeBaseline(writePath, pool.concurrency())) return 2;
+    if (baselinePath) {
+        std::map<std::string, Metric> baseline;
+        if (!readBaseline(baselinePath, baseline)) return 2;
+        int regressions = compareBaseline(baseline, tolerance);
+        std::printf("# %d regression%s beyond %.0f%%\n", regressions,
+                    regressions == 1 ? "" : "s", tolerance * 100.0);
+        if (regressions) return 1;
+    }
+    return 0;
+}
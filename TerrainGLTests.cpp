@@ -0,0 +1,482 @@
+// TerrainGLTests.cpp
+// Checks of the GL side on an offscreen EGL context (Mesa's llvmpipe is
+// enough): shaders against the CPU code they mirror, run with rasterizer
+// discard and read back through transform feedback, and the GL backends
+// of the CPU-side managers.
+//
+// Usage: terrain_gl_tests [CASE...]    (no argument runs every case)
+//
+// Exits with 77, which CTest reports as skipped, when no OpenGL 3.3 core
+// context can be created. With Mesa and no display, run it with
+// EGL_PLATFORM=surfaceless (the CTest tests set it).
+#define GL_GLEXT_PROTOTYPES
+#include <EGL/egl.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "Heightfield.h"
+#include "HeightTextureGL.h"
+#include "MeshCache.h"
+#include "ShaderManagerGL.h"
+#include "TerrainLod.h"
+#include "ThreadPool.h"
+#include "UploadRingGL.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                       \
+    do {                                                                                  \
+        if (!(cond)) {                                                                    \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++failures;                                                                   \
+        }                                                                                 \
+    } while (0)
+
+// Pbuffer-backed 3.3 core context, current on this thread
+static bool createContext() {
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) return false;
+    const EGLint configAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config;
+    EGLint configs = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &configs) || configs < 1) return false;
+    const EGLint surfaceAttribs[] = {EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE};
+    EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    if (surface == EGL_NO_SURFACE || !eglBindAPI(EGL_OPENGL_API)) return false;
+    const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                                     EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                     EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    return context != EGL_NO_CONTEXT && eglMakeCurrent(display, surface, surface, context);
+}
+
+// Vertex-only program whose outputs are captured interleaved
+static GLuint linkFeedbackProgram(const char* vertexSrc, const char* const* varyings, int count) {
+    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vs, 1, &vertexSrc, nullptr);
+    glCompileShader(vs);
+    GLuint prog = glCreateProgram();
+    glAttachShader(prog, vs);
+    glTransformFeedbackVaryings(prog, count, varyings, GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(prog);
+    glDeleteShader(vs);
+    GLint ok = 0;
+    glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[4096];
+        glGetProgramInfoLog(prog, sizeof(log), nullptr, log);
+        std::fprintf(stderr, "link failed: %s\n", log);
+        glDeleteProgram(prog);
+        return 0;
+    }
+    return prog;
+}
+
+// --- Height displacement ---
+
+// HEIGHT_DISPLACE_VERT_SRC for every patch of every level, with the morph
+// off and fully on, against the heights, TerrainLod::buildMorphHeights()
+// and computeGridNormals(). Positions and morph targets may be off by the
+// texture's half step, normals by what that does to the differences.
+static void testDisplacement() {
+    const int SIZE = 257;
+    ThreadPool pool;
+    HeightfieldParams params;
+    params.width = params.depth = SIZE;
+    params.scale = 0.1f;
+    Heightfield field;
+    field.width = field.depth = SIZE;
+    field.spacing = params.scale;
+    generateHeightfield(params, pool, field);
+    TerrainLodParams lodParams;
+    TerrainLod lod;
+    CHECK(lod.build(field, lodParams));
+    if (failures) return;
+    HeightTexture heights;
+    heights.build(field);
+    GLuint tex = createHeightTexture(heights);
+
+    const char* varyings[] = {"FragPos", "Normal"};
+    GLuint prog = linkFeedbackProgram(HEIGHT_DISPLACE_VERT_SRC, varyings, 2);
+    CHECK(prog != 0);
+    if (!prog) return;
+    glUseProgram(prog);
+    const float identity[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    for (const char* m : {"model", "view", "projection"})
+        glUniformMatrix4fv(glGetUniformLocation(prog, m), 1, GL_FALSE, identity);
+    glUniform1i(glGetUniformLocation(prog, "uHeights"), 0);
+    glUniform2f(glGetUniformLocation(prog, "uHeightFrame"), heights.offset(), heights.step() * 65535.0f);
+    glUniform1f(glGetUniformLocation(prog, "uGridSpacing"), field.spacing);
+    glUniform1i(glGetUniformLocation(prog, "uPatchWidth"), lod.sharedPatchWidth());
+    glUniform3f(glGetUniformLocation(prog, "viewPos"), 0.0f, 1000.0f, 0.0f);
+    const GLint levelLoc  = glGetUniformLocation(prog, "uLevel");
+    const GLint originLoc = glGetUniformLocation(prog, "uPatchOrigin");
+    const GLint morphLoc  = glGetUniformLocation(prog, "uMorphRange");
+
+    // The shared patch indices are the level-0 patch at the grid origin,
+    // renumbered to the patch's own points
+    const int W = lod.sharedPatchWidth();
+    std::vector<uint16_t> shared(lod.patchIndexCount());
+    std::vector<unsigned> level0(lod.patchIndexCount());
+    lod.buildSharedPatchIndices(shared.data());
+    lod.buildPatchIndices(0, level0.data());
+    int badIndices = 0;
+    for (size_t i = 0; i < shared.size(); ++i)
+        badIndices += (int)(level0[i] % SIZE + level0[i] / SIZE * W) != shared[i];
+    CHECK(badIndices == 0);
+
+    // Every point of the patch once, as GL_POINTS
+    std::vector<uint16_t> points(W * W);
+    for (int i = 0; i < W * W; ++i) points[i] = (uint16_t)i;
+    GLuint vao, ebo, feedback;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, points.size() * sizeof(uint16_t), points.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &feedback);
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, feedback);
+    glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, points.size() * 6 * sizeof(float), nullptr, GL_STREAM_READ);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedback);
+    glEnable(GL_RASTERIZER_DISCARD);
+
+    std::vector<float> normals((size_t)SIZE * SIZE * 3), morph((size_t)SIZE * SIZE);
+    computeGridNormals(field, NORMALS_CENTRAL_DIFF, pool, normals.data());
+    lod.buildMorphHeights(field, morph.data());
+    double posErr = 0.0, morphErr = 0.0, normalErr = 0.0;
+    std::vector<float> out(points.size() * 6);
+    auto run = [&](int level, int x0, int z0, bool morphed) {
+        glUniform1i(levelLoc, level);
+        glUniform2i(originLoc, x0, z0);
+        // A range behind the camera morphs every point fully; one far away none
+        if (morphed) glUniform2f(morphLoc, -2.0f, -1.0f);
+        else         glUniform2f(morphLoc, 1e30f, 2e30f);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawElements(GL_POINTS, (GLsizei)points.size(), GL_UNSIGNED_SHORT, nullptr);
+        glEndTransformFeedback();
+        glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, out.size() * sizeof(float), out.data());
+        for (int i = 0; i < W * W; ++i) {
+            const int gx = x0 + ((i % W) << level), gz = z0 + ((i / W) << level);
+            const size_t k = (size_t)gz * SIZE + gx;
+            const float* o = &out[i * 6];
+            posErr = std::max(posErr, (double)std::fabs(o[0] - gx * field.spacing));
+            posErr = std::max(posErr, (double)std::fabs(o[2] - gz * field.spacing));
+            // Points that the next level drops move onto its surface
+            const bool dropped = morphed && lodPointLevel(gx, gz) == level;
+            double& err = dropped ? morphErr : posErr;
+            err = std::max(err, (double)std::fabs(o[1] - (dropped ? morph[k] : field.heights[k])));
+            for (int a = 0; a < 3; ++a)
+                normalErr = std::max(normalErr, (double)std::fabs(o[3 + a] - normals[k * 3 + a]));
+        }
+    };
+    // The top level has no coarser level to morph to
+    for (int level = 0; level < lod.levels(); ++level) {
+        const int span = lodParams.patchCells << level;
+        for (int z = 0; z + span < SIZE; z += span)
+            for (int x = 0; x + span < SIZE; x += span) {
+                run(level, x, z, false);
+                if (level + 1 < lod.levels()) run(level, x, z, true);
+            }
+    }
+    const double halfStep = 0.5 * heights.step() + 1e-5;
+    CHECK(posErr <= halfStep);
+    CHECK(morphErr <= halfStep);
+    // Two half-step errors over one spacing (one-sided at the edges) move
+    // the gradient, and so the unit normal, by at most step / spacing
+    CHECK(normalErr <= heights.step() / field.spacing + 1e-5);
+
+    // An edit reaches the GPU through the dirty rectangle alone
+    field.heights[(size_t)100 * SIZE + 50] += 1.0f;
+    heights.update(field, HeightTexelRect{50, 100, 51, 101});
+    CHECK(uploadHeightTexture(tex, heights) == sizeof(uint16_t));
+    posErr = 0.0;
+    run(0, 48, 96, false);
+    CHECK(posErr <= halfStep);
+    CHECK(glGetError() == GL_NO_ERROR);
+
+    glDeleteBuffers(1, &feedback);
+    glDeleteBuffers(1, &ebo);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteProgram(prog);
+    glDeleteTextures(1, &tex);
+}
+
+// --- Shader manager ---
+
+static const char* CACHE_TEST_VERT = R"glsl(
+#version 330 core
+layout(location=0) in vec3 aPos;
+uniform mat4 uMVP;
+void main() { gl_Position = uMVP * vec4(aPos, 1.0); }
+)glsl";
+
+static const char* CACHE_TEST_FRAG = R"glsl(
+#version 330 core
+out vec4 FragColor;
+uniform vec3 uColor;
+void main() { FragColor = vec4(uColor, 1.0); }
+)glsl";
+
+// Paths of the cache files in dir whose name starts with prefix
+static std::vector<std::string> cacheFiles(const std::string& dir, const char* prefix) {
+    std::vector<std::string> out;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return out;
+    while (dirent* e = readdir(d))
+        if (std::strncmp(e->d_name, prefix, std::strlen(prefix)) == 0)
+            out.push_back(dir + "/" + e->d_name);
+    closedir(d);
+    return out;
+}
+
+// The key is the hex part of "<name>-<key>.meshcache"
+static uint64_t cacheFileKey(const std::string& path) {
+    size_t dash = path.rfind('-');
+    return dash == std::string::npos ? 0 : std::strtoull(path.c_str() + dash + 1, nullptr, 16);
+}
+
+// A linked program with the uniforms of the test sources
+static bool usableProgram(GLuint prog) {
+    GLint linked = GL_FALSE;
+    if (prog) glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+    return linked && glGetUniformLocation(prog, "uMVP") >= 0 &&
+           glGetUniformLocation(prog, "uColor") >= 0;
+}
+
+// ShaderManager on the GL backend: a cold cache compiles and writes a
+// binary, a warm one loads it, a binary the driver refuses and a file
+// that fails its checksum both fall back to the sources and rewrite it,
+// and a compile error fails the program with the driver's log
+static void testShaderManager() {
+    const std::string dir = "gl-shader-cache";
+    mkdir(dir.c_str(), 0755);
+    for (const std::string& f : cacheFiles(dir, "shader-")) std::remove(f.c_str());
+    GLShaderBackend backend;
+    if (!backend.binarySupported()) std::printf("no program binary formats; cache not tested\n");
+
+    auto build = [&](ShaderManagerStats& stats) {
+        ShaderManager manager(backend, dir.c_str());
+        int id = manager.add("cached", CACHE_TEST_VERT, CACHE_TEST_FRAG);
+        manager.compileAll();
+        bool ok = manager.wait() && manager.ready(id) && usableProgram(manager.program(id));
+        stats = manager.stats();
+        manager.release();
+        return ok;
+    };
+    ShaderManagerStats stats;
+    CHECK(build(stats));
+    if (backend.binarySupported()) {
+        CHECK(stats.cacheMisses == 1 && stats.cacheHits == 0 && stats.cacheWrites == 1);
+        CHECK(build(stats));
+        CHECK(stats.cacheHits == 1 && stats.cacheMisses == 0 && stats.cacheWrites == 0);
+
+        const std::vector<std::string> files = cacheFiles(dir, "shader-cached-");
+        CHECK(files.size() == 1);
+        MeshCacheFile file;
+        std::vector<uint32_t> format;
+        std::vector<uint8_t> binary;
+        CHECK(!files.empty() && file.open(files[0], cacheFileKey(files[0])));
+        CHECK(file.copy(meshCacheTag("PFMT"), format) && format.size() == 1);
+        CHECK(file.copy(meshCacheTag("PBIN"), binary) && !binary.empty());
+        file.close();
+        if (files.empty() || format.size() != 1 || binary.empty()) return;
+
+        // Driver-side rejections: damaged binary data, an unknown format
+        for (int variant = 0; variant < 2; ++variant) {
+            std::vector<uint8_t> damaged = binary;
+            uint32_t badFormat = format[0];
+            if (variant == 0)
+                for (size_t i = damaged.size() / 4; i < damaged.size(); i += 7) damaged[i] ^= 0x5a;
+            else
+                badFormat = 0xdeadbeef;
+            MeshCacheWriter writer;
+            writer.add(meshCacheTag("PFMT"), &badFormat, 1, sizeof(badFormat));
+            writer.add(meshCacheTag("PBIN"), damaged);
+            CHECK(writer.write(files[0], cacheFileKey(files[0])));
+            CHECK(build(stats));
+            CHECK(stats.cacheRejected == 1 && stats.cacheHits == 0 && stats.cacheWrites == 1);
+        }
+        CHECK(build(stats));
+        CHECK(stats.cacheHits == 1);
+
+        // A flipped byte on disk fails the checksum: a plain miss
+        FILE* f = std::fopen(files[0].c_str(), "r+b");
+        CHECK(f != nullptr);
+        if (!f) return;
+        std::fseek(f, -100, SEEK_END);
+        int c = std::fgetc(f);
+        std::fseek(f, -100, SEEK_END);
+        std::fputc(c ^ 1, f);
+        std::fclose(f);
+        CHECK(build(stats));
+        CHECK(stats.cacheMisses == 1 && stats.cacheWrites == 1);
+        CHECK(build(stats));
+        CHECK(stats.cacheHits == 1);
+    }
+
+    // A fragment stage that does not compile
+    ShaderManager manager(backend, dir.c_str());
+    int good = manager.add("good", CACHE_TEST_VERT, CACHE_TEST_FRAG);
+    int broken = manager.add("broken", CACHE_TEST_VERT,
+                             "#version 330 core\nout vec4 FragColor;\n"
+                             "void main() { FragColor = undefinedName; }\n");
+    manager.compileAll();
+    CHECK(!manager.wait());
+    CHECK(manager.ready(good) && usableProgram(manager.program(good)));
+    CHECK(manager.failed(broken) && manager.program(broken) == 0);
+    CHECK(manager.error(broken).compare(0, 10, "fragment: ") == 0);
+    CHECK(manager.error(broken).find("undefinedName") != std::string::npos);
+    CHECK(manager.stats().failed == 1);
+    CHECK(cacheFiles(dir, "shader-broken-").empty());
+    manager.release();
+    CHECK(glGetError() == GL_NO_ERROR);
+
+    for (const std::string& f : cacheFiles(dir, "shader-")) std::remove(f.c_str());
+    rmdir(dir.c_str());
+}
+
+// --- Upload ring ---
+
+// UploadRing on persistently mapped GL memory: bytes written into slices
+// reach another buffer through copy(), space returns through the frame
+// fence, and a full ring blocks on the oldest fence and counts a stall
+static void testUploadRingGL() {
+    if (!GLUploadRingBackend::supported()) {
+        std::printf("no persistent mapping; upload ring not tested\n");
+        return;
+    }
+    const size_t SLICE = 4096, SLICES = 16;
+    GLUploadRingBackend backend;
+    UploadRing ring(backend, SLICE * SLICES);
+    CHECK(ring.valid() && backend.buffer() != 0);
+    if (!ring.valid()) return;
+    GLuint dst;
+    glGenBuffers(1, &dst);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+    glBufferData(GL_COPY_WRITE_BUFFER, SLICE * SLICES, nullptr, GL_STATIC_DRAW);
+
+    // Slice i, byte k holds a value that differs per lap
+    auto fill = [&](UploadSlice& s, int lap, size_t i) {
+        for (size_t k = 0; k < s.bytes; ++k) s.data[k] = (uint8_t)(k * 7 + i * 13 + lap * 101);
+    };
+    auto check = [&](int lap) {
+        std::vector<uint8_t> back(SLICE * SLICES);
+        glBindBuffer(GL_COPY_READ_BUFFER, dst);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, back.size(), back.data());
+        int wrong = 0;
+        for (size_t i = 0; i < SLICES; ++i)
+            for (size_t k = 0; k < SLICE; ++k)
+                wrong += back[i * SLICE + k] != (uint8_t)(k * 7 + i * 13 + lap * 101);
+        return wrong;
+    };
+
+    // A lap of slices, each copied to its place in dst, then released
+    UploadSlice slices[SLICES];
+    for (size_t i = 0; i < SLICES; ++i) {
+        CHECK(ring.allocate(SLICE, 256, slices[i]));
+        CHECK(slices[i].offset == i * SLICE);
+        fill(slices[i], 0, i);
+        backend.copy(slices[i], 0, dst, i * SLICE, SLICE);
+        ring.release(slices[i]);
+    }
+    CHECK(check(0) == 0);
+    UploadRingStats s = ring.stats();
+    CHECK(s.used == SLICE * SLICES && s.fences == 0);
+
+    // The ring is full; the frame fence gives the space back once passed
+    UploadSlice extra;
+    CHECK(!ring.allocate(SLICE, 256, extra));
+    ring.endFrame();
+    glFinish();
+    ring.endFrame();
+    s = ring.stats();
+    CHECK(s.fences == 1 && s.used == 0 && s.stalls == 0);
+
+    // Second lap without an endFrame(): every allocation past the first
+    // lap waits for the fence of the released slices
+    for (size_t i = 0; i < SLICES; ++i) {
+        CHECK(ring.allocate(SLICE, 256, slices[i]));
+        fill(slices[i], 1, i);
+        backend.copy(slices[i], 0, dst, i * SLICE, SLICE);
+        ring.release(slices[i]);
+    }
+    CHECK(ring.allocate(SLICE, 256, extra, true));
+    s = ring.stats();
+    CHECK(s.stalls == 1 && s.fences == 2 && s.failed == 1);
+    CHECK(extra.offset == 0);
+    CHECK(check(1) == 0);
+
+    // Part of a slice, to an offset
+    for (size_t k = 0; k < SLICE; ++k) extra.data[k] = (uint8_t)(255 - k);
+    backend.copy(extra, 100, dst, 3 * SLICE + 8, 50);
+    ring.release(extra);
+    std::vector<uint8_t> part(60);
+    glBindBuffer(GL_COPY_READ_BUFFER, dst);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 3 * SLICE, part.size(), part.data());
+    int wrong = 0;
+    for (size_t k = 0; k < part.size(); ++k) {
+        const bool copied = k >= 8 && k < 58;
+        wrong += part[k] != (copied ? (uint8_t)(255 - (k - 8 + 100)) : (uint8_t)(k * 7 + 3 * 13 + 101));
+    }
+    CHECK(wrong == 0);
+
+    ring.endFrame();
+    glFinish();
+    ring.endFrame();
+    CHECK(ring.stats().used == 0);
+    ring.unmap();
+    CHECK(!ring.valid() && backend.buffer() == 0);
+    glDeleteBuffers(1, &dst);
+    CHECK(glGetError() == GL_NO_ERROR);
+}
+
+// --- Driver ---
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+static const TestCase CASES[] = {
+    {"gl_displacement", testDisplacement},
+    {"gl_shader_manager", testShaderManager},
+    {"gl_upload_ring", testUploadRingGL},
+};
+
+int main(int argc, char** argv) {
+    if (!createContext()) {
+        std::fprintf(stderr, "no OpenGL 3.3 core context; skipping\n");
+        return 77;
+    }
+    std::printf("Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+    int ran = 0;
+    for (const TestCase& c : CASES) {
+        bool wanted = argc < 2;
+        for (int i = 1; i < argc; ++i) wanted |= std::strcmp(argv[i], c.name) == 0;
+        if (!wanted) continue;
+        int before = failures;
+        c.run();
+        std::printf("%-12s %s\n", c.name, failures == before ? "ok" : "FAILED");
+        ++ran;
+    }
+    if (ran == 0) {
+        std::fprintf(stderr, "no test case matches\n");
+        return 2;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,212 @@
+// TerrainLod.cpp
+#include "TerrainLod.h"
+
+#include "IndexOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+int lodPointLevel(int x, int z) {
+    unsigned bits = (unsigned)(x | z);
+    if (bits == 0) return 31;
+    int level = 0;
+    while (!(bits & 1u)) {
+        bits >>= 1;
+        ++level;
+    }
+    return level;
+}
+
+// Height of the next coarser level's surface at a point that is odd at
+// level l. Edge midpoints average their edge; cell centers average the
+// diagonal used by buildGridIndices() (from (x+s, z-s) to (x-s, z+s)).
+static float coarseHeight(const Heightfield& hf, int x, int z, int l) {
+    const int s = 1 << l;
+    const bool oddX = (x >> l) & 1, oddZ = (z >> l) & 1;
+    if (oddX && oddZ) return 0.5f * (hf.at(x + s, z - s) + hf.at(x - s, z + s));
+    if (oddX)         return 0.5f * (hf.at(x - s, z) + hf.at(x + s, z));
+    return 0.5f * (hf.at(x, z - s) + hf.at(x, z + s));
+}
+
+bool TerrainLod::build(const Heightfield& hf, const TerrainLodParams& params) {
+    const int cellsX = hf.width - 1, cellsZ = hf.depth - 1;
+    if (params.patchCells < 2 || params.patchCells % 2 != 0) return false;
+    if (cellsX <= 0 || cellsZ <= 0) return false;
+    if (cellsX % params.patchCells != 0 || cellsZ % params.patchCells != 0) return false;
+
+    cells      = params.patchCells;
+    gridWidth  = hf.width;
+    spacing    = hf.spacing;
+    morphStart = params.morphStart;
+
+    // As many levels as keep whole top-level nodes on the grid
+    int levelCount = 1;
+    while (levelCount < params.maxLevels) {
+        int nodeCells = cells << levelCount;
+        if (cellsX % nodeCells != 0 || cellsZ % nodeCells != 0) break;
+        ++levelCount;
+    }
+
+    // Height range of every node, leaves first
+    nodes.assign(levelCount, LevelNodes());
+    for (int l = 0; l < levelCount; ++l) {
+        LevelNodes& ln = nodes[l];
+        ln.countX = cellsX / (cells << l);
+        ln.countZ = cellsZ / (cells << l);
+        ln.minY.resize((size_t)ln.countX * ln.countZ);
+        ln.maxY.resize((size_t)ln.countX * ln.countZ);
+        for (int nz = 0; nz < ln.countZ; ++nz) {
+            for (int nx = 0; nx < ln.countX; ++nx) {
+                float lo = FLT_MAX, hi = -FLT_MAX;
+                if (l == 0) {
+                    for (int z = nz * cells; z <= (nz + 1) * cells; ++z) {
+                        for (int x = nx * cells; x <= (nx + 1) * cells; ++x) {
+                            lo = std::min(lo, hf.at(x, z));
+                            hi = std::max(hi, hf.at(x, z));
+                        }
+                    }
+                } else {
+                    const LevelNodes& c = nodes[l - 1];
+                    for (int q = 0; q < 4; ++q) {
+                        size_t i = (size_t)(nz * 2 + (q >> 1)) * c.countX + nx * 2 + (q & 1);
+                        lo = std::min(lo, c.minY[i]);
+                        hi = std::max(hi, c.maxY[i]);
+                    }
+                }
+                ln.minY[(size_t)nz * ln.countX + nx] = lo;
+                ln.maxY[(size_t)nz * ln.countX + nx] = hi;
+            }
+        }
+    }
+
+    // Error added by each level: how far its dropped points lie from the
+    // coarser surface. Summing them bounds the error against the full grid.
+    std::vector<float> dropped(levelCount, 0.0f);
+    for (int z = 0; z < hf.depth; ++z) {
+        for (int x = 0; x < hf.width; ++x) {
+            int l = lodPointLevel(x, z);
+            if (l >= levelCount - 1) continue;
+            float e = std::fabs(hf.at(x, z) - coarseHeight(hf, x, z, l));
+            dropped[l + 1] = std::max(dropped[l + 1], e);
+        }
+    }
+    errors.assign(levelCount, 0.0f);
+    for (int l = 1; l < levelCount; ++l) errors[l] = errors[l - 1] + dropped[l];
+
+    // Level l ends where level l + 1 projects to less than pixelError.
+    // Ranges at least double per level, which keeps neighbors within one
+    // level of each other so the morph closes every seam.
+    const float pixelsPerUnit = params.screenHeight / (2.0f * std::tan(params.fovY * 0.5f));
+    const float k = pixelsPerUnit / params.pixelError;
+    const float leafDiagonal = cells * spacing * 1.4142135f;
+    ranges.assign(levelCount, FLT_MAX);
+    for (int l = 0; l + 1 < levelCount; ++l) {
+        float minRange = l == 0 ? 2.0f * leafDiagonal : 2.0f * ranges[l - 1];
+        ranges[l] = std::max(errors[l + 1] * k, minRange);
+    }
+    return true;
+}
+
+AABB TerrainLod::nodeBox(int level, int nx, int nz) const {
+    const LevelNodes& ln = nodes[level];
+    const float size = (cells << level) * spacing;
+    size_t i = (size_t)nz * ln.countX + nx;
+    return AABB{{nx * size, ln.minY[i], nz * size},
+                {(nx + 1) * size, ln.maxY[i], (nz + 1) * size}};
+}
+
+static bool sphereHitsBox(Vec3 c, float r, const AABB& b) {
+    Vec3 p = vmax(b.min, vmin(c, b.max));
+    Vec3 d = p - c;
+    return r == FLT_MAX || dot(d, d) <= r * r;
+}
+
+LodPatch TerrainLod::makePatch(int level, int nx, int nz, int quadrants) const {
+    LodPatch p;
+    p.x0 = nx * (cells << level);
+    p.z0 = nz * (cells << level);
+    p.level = level;
+    p.quadrants = quadrants;
+    if (level + 1 == levels()) {
+        // Top level: never morphs
+        p.morphStart = FLT_MAX * 0.5f;
+        p.morphEnd   = FLT_MAX;
+    } else {
+        float prev = level > 0 ? ranges[level - 1] : 0.0f;
+        p.morphEnd   = ranges[level];
+        p.morphStart = prev + (p.morphEnd - prev) * morphStart;
+    }
+    return p;
+}
+
+// Returns false if the node is beyond its level's range, in which case the
+// parent draws that quarter itself
+bool TerrainLod::selectNode(int level, int nx, int nz, Vec3 eye,
+                            std::vector<LodPatch>& out) const {
+    AABB box = nodeBox(level, nx, nz);
+    if (!sphereHitsBox(eye, ranges[level], box)) return false;
+    if (level == 0 || !sphereHitsBox(eye, ranges[level - 1], box)) {
+        out.push_back(makePatch(level, nx, nz, 15));
+        return true;
+    }
+    int quadrants = 0;
+    for (int q = 0; q < 4; ++q)
+        if (!selectNode(level - 1, nx * 2 + (q & 1), nz * 2 + (q >> 1), eye, out))
+            quadrants |= 1 << q;
+    if (quadrants) out.push_back(makePatch(level, nx, nz, quadrants));
+    return true;
+}
+
+void TerrainLod::select(Vec3 eye, std::vector<LodPatch>& out) const {
+    out.clear();
+    if (nodes.empty()) return;
+    const LevelNodes& top = nodes.back();
+    for (int nz = 0; nz < top.countZ; ++nz)
+        for (int nx = 0; nx < top.countX; ++nx)
+            selectNode(levels() - 1, nx, nz, eye, out);
+}
+
+// cells x cells quads with a stride of s points on a grid w points wide,
+// quadrant by quadrant
+static void patchIndices(int cells, int s, unsigned w, unsigned* out) {
+    const int half = cells / 2;
+    for (int q = 0; q < 4; ++q) {
+        for (int z = 0; z < half; ++z) {
+            for (int x = 0; x < half; ++x) {
+                unsigned cx = (unsigned)(((q & 1) * half + x) * s);
+                unsigned cz = (unsigned)(((q >> 1) * half + z) * s);
+                unsigned i0 = cz * w + cx;
+                unsigned i1 = i0 + s;
+                unsigned i2 = i0 + s * w;
+                unsigned i3 = i2 + s;
+                *out++ = i0; *out++ = i2; *out++ = i1;
+                *out++ = i1; *out++ = i2; *out++ = i3;
+            }
+        }
+        // Each quarter is drawn on its own, so each is reordered on its own
+        size_t count = (size_t)half * half * 6;
+        unsigned* quarter = out - count;
+        optimizeVertexCache(quarter, count, (size_t)*std::max_element(quarter, out) + 1, quarter);
+    }
+}
+
+void TerrainLod::buildPatchIndices(int level, unsigned* out) const {
+    patchIndices(cells, 1 << level, (unsigned)gridWidth, out);
+}
+
+void TerrainLod::buildSharedPatchIndices(uint16_t* out) const {
+    std::vector<unsigned> wide(patchIndexCount());
+    patchIndices(cells, 1, (unsigned)sharedPatchWidth(), wide.data());
+    std::copy(wide.begin(), wide.end(), out);
+}
+
+void TerrainLod::buildMorphHeights(const Heightfield& hf, float* out) const {
+    const int top = levels() - 1;
+    for (int z = 0; z < hf.depth; ++z) {
+        for (int x = 0; x < hf.width; ++x) {
+            int l = lodPointLevel(x, z);
+            out[(size_t)z * hf.width + x] = l < top ? coarseHeight(hf, x, z, l) : hf.at(x, z);
+        }
+    }
+}
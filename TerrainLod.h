@@ -0,0 +1,91 @@
+// TerrainLod.h
+// CDLOD-style quadtree over a Heightfield. Every node is drawn as a patch
+// of patchCells x patchCells quads with a stride of 2^level grid points,
+// so one index buffer per level serves all nodes of that level (offset by
+// the node's first vertex). Selection runs on the CPU and needs no GL.
+#pragma once
+
+#include "Heightfield.h"
+#include "MathTypes.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct TerrainLodParams {
+    int   patchCells   = 16;          // quads per patch side; even
+    int   maxLevels    = 8;
+    float pixelError   = 2.0f;        // allowed geometric error on screen
+    float screenHeight = 600.0f;      // viewport height in pixels
+    float fovY         = 0.7853982f;  // vertical field of view in radians
+    float morphStart   = 0.7f;        // fraction of a level's range where morphing starts
+};
+
+// A node to draw. quadrants has bit (qz * 2 + qx) set for each quarter of
+// the node that is drawn at this level; 15 = the whole node.
+struct LodPatch {
+    int   x0, z0;                 // first grid point of the node
+    int   level;
+    int   quadrants;
+    float morphStart, morphEnd;   // camera distances where k goes 0 -> 1
+};
+
+class TerrainLod {
+public:
+    // Fails if the cell counts are not a multiple of patchCells.
+    // Uses as many levels as the grid allows, up to maxLevels.
+    bool build(const Heightfield& hf, const TerrainLodParams& params);
+
+    int   levels() const { return (int)ranges.size(); }
+    // Distance up to which a level is used; the top level never ends
+    float levelRange(int level) const { return ranges[level]; }
+    // Upper bound on the height error of a level against the full grid
+    float levelError(int level) const { return errors[level]; }
+
+    // Patches covering the whole terrain for a camera at eye, finest near it
+    void select(Vec3 eye, std::vector<LodPatch>& out) const;
+
+    // Index buffer of one level, relative to the node's first vertex and
+    // laid out quadrant by quadrant: quadrant q is the range
+    // [q * patchIndexCount() / 4, (q + 1) * patchIndexCount() / 4), its
+    // triangles in vertex cache order
+    size_t patchIndexCount() const { return (size_t)cells * cells * 6; }
+    void   buildPatchIndices(int level, unsigned* out) const;
+
+    // Vertex index of a patch's first grid point (its base vertex)
+    int patchBaseVertex(const LodPatch& p) const { return p.z0 * gridWidth + p.x0; }
+
+    // GPU displacement: one patch of (patchCells + 1)^2 points serves every
+    // node of every level. Index i is local point (i % sharedPatchWidth(),
+    // i / sharedPatchWidth()), which the vertex shader scales by the
+    // level's stride and offsets by the node's first grid point. Quadrants
+    // are laid out like buildPatchIndices().
+    int  sharedPatchWidth() const { return cells + 1; }
+    void buildSharedPatchIndices(uint16_t* out) const;
+
+    // Per grid point, the height it morphs to: the coarser level's surface
+    // at that point, for the level where the point is odd. Points on the
+    // top-level corners keep their own height.
+    void buildMorphHeights(const Heightfield& hf, float* out) const;
+
+private:
+    struct LevelNodes {
+        int countX = 0, countZ = 0;
+        std::vector<float> minY, maxY;
+    };
+
+    bool selectNode(int level, int nx, int nz, Vec3 eye, std::vector<LodPatch>& out) const;
+    AABB nodeBox(int level, int nx, int nz) const;
+    LodPatch makePatch(int level, int nx, int nz, int quadrants) const;
+
+    int   cells = 16;
+    int   gridWidth = 0;
+    float spacing = 1.0f;
+    float morphStart = 0.7f;
+    std::vector<float> ranges, errors;
+    std::vector<LevelNodes> nodes;
+};
+
+// Finest level at which grid point (x, z) is odd, i.e. the number of
+// trailing zero bits shared by x and z
+int lodPointLevel(int x, int z);
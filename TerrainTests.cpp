@@ -0,0 +1,2432 @@
+// TerrainTests.cpp
+// Headless checks of the CPU side of the terrain programs. Links only
+// terrain_core, like terrain_bench, so every case runs without a window
+// or GL. CTest runs each case on its own.
+//
+// Usage: terrain_tests [CASE...]    (no argument runs every case)
+//
+// A failed CHECK prints its file, line and condition to stderr; the exit
+// code is 1 if any check failed.
+#include "ChunkManager.h"
+#include "CollisionIndex.h"
+#include "FramePacer.h"
+#include "FrustumCuller.h"
+#include "Heightfield.h"
+#include "HeightfieldQuery.h"
+#include "HeightTexture.h"
+#include "IndexOptimizer.h"
+#include "MeshBuilder.h"
+#include "MeshCache.h"
+#include "NoiseGraph.h"
+#include "PerlinNoise.h"
+#include "PostProcessCpu.h"
+#include "Profiler.h"
+#include "QualityController.h"
+#include "RenderGraph.h"
+#include "TerrainLod.h"
+#include "ThreadPool.h"
+#include "UploadRing.h"
+#include "VertexFormat.h"
+#include "VoxelEditor.h"
+#include "VoxelStore.h"
+#include "VoxelTerrain.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                       \
+    do {                                                                                  \
+        if (!(cond)) {                                                                    \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++failures;                                                                   \
+        }                                                                                 \
+    } while (0)
+
+// Deterministic values in [0, 1) for camera paths and jitter
+static float nextUnit(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return (state >> 8) / 16777216.0f;
+}
+
+// --- FramePacer ---
+
+// Time only moves when the pacer sleeps or spins, or when the test adds
+// frame work. Every sleep oversleeps by up to 2 ms, like a loaded Linux box.
+class FakePacerClock : public PacerClock {
+public:
+    int64_t  now = 1000000000;
+    uint32_t rng = 7;
+    int64_t nowNs() override { return now; }
+    void    sleepNs(int64_t ns) override { now += ns + (int64_t)(nextUnit(rng) * 2e6f); }
+    void    relax() override { now += 2000; }
+};
+
+// Frames of random work at 45 fps with one 100 ms stall: frames end on
+// their absolute deadlines without drift, the stall is the only miss and
+// the pacer does not rush the frames after it
+static void testFramePacer() {
+    FakePacerClock clock;
+    FramePacer pacer(45.0, &clock);
+    const int64_t period = (int64_t)(1e9 / 45.0);
+    const int FRAMES = 1000, STALL = 500;
+    pacer.waitForNextFrame();
+    int64_t start = clock.now, last = clock.now, shortest = period;
+    for (int i = 0; i < FRAMES; ++i) {
+        clock.now += 2000000 + (int64_t)(nextUnit(clock.rng) * 16e6f);
+        if (i == STALL) clock.now += 100000000;
+        pacer.waitForNextFrame();
+        if (i != STALL) shortest = std::min(shortest, clock.now - last);
+        // Spinning ends at most one relax step past the deadline
+        int64_t late = clock.now - (start + (i + 1) * period);
+        if (i < STALL) CHECK(late >= 0 && late <= 2000);
+        last = clock.now;
+    }
+    FrameTimeStats st = pacer.stats();
+    CHECK(st.frames == FRAMES);
+    CHECK(st.missed == 1);
+    CHECK(st.maxMs >= 100.0);
+    CHECK(std::fabs(st.p50Ms - period * 1e-6) <= 0.1);
+    CHECK(std::fabs(st.p99Ms - period * 1e-6) <= 0.1);
+    CHECK(shortest >= period - 100000);
+    // The margin follows the measured oversleep plus its pad
+    CHECK(st.sleepMarginMs >= 1.5 && st.sleepMarginMs <= 2.3);
+
+    pacer.resetStats();
+    CHECK(pacer.stats().frames == 0);
+}
+
+// --- RenderGraph ---
+
+// Hands out texture names and counts what the graph asks for
+class MockGraphBackend : public RenderGraphBackend {
+public:
+    unsigned next = 1;
+    int targets = 0, constants = 0, destroyed = 0;
+    unsigned createTarget(const RGTextureDesc&) override { ++targets; return next++; }
+    unsigned createConstant(const float*) override { ++constants; return next++; }
+    void     destroyTexture(unsigned) override { ++destroyed; }
+    void     bindTargets(const unsigned*, int) override {}
+    void     clearTargets(const float*) override {}
+};
+
+// The SSAO chain as what.cpp declares it: the canvas and its blur fold to
+// white, a pass nobody reads is culled, and the rest share three targets
+static void testRenderGraphChain() {
+    RGTextureDesc screen;
+    screen.width = 1280;
+    screen.height = 720;
+    RenderGraph g;
+    int canvas  = g.createTexture("canvas", screen),  blur      = g.createTexture("blur", screen);
+    int ssao    = g.createTexture("ssao", screen),    scatter   = g.createTexture("scatter", screen);
+    int sheen   = g.createTexture("sheen", screen),   sheenBlur = g.createTexture("sheenBlur", screen);
+    int shadows = g.createTexture("shadows", screen), gloss     = g.createTexture("gloss", screen);
+    int debug   = g.createTexture("debug", screen);
+    int back    = g.importTexture("backbuffer", screen, 0);
+    std::vector<int> ran;
+    auto pass = [&](int id) { return [&ran, id](const RGPassContext&) { ran.push_back(id); }; };
+    const float white[4] = {1, 1, 1, 1};
+    int canvasPass = g.addPass("canvas", {}, {canvas}, nullptr);
+    g.setClearColor(canvasPass, white);
+    int blurPass = g.addPass("blur", {canvas}, {blur}, pass(1));
+    g.setFold(blurPass, RenderGraph::foldIdentity);
+    g.addPass("ssao", {}, {ssao}, pass(2));
+    g.addPass("scatter", {blur}, {scatter}, pass(3));
+    g.addPass("sheen", {ssao}, {sheen}, pass(4));
+    int sheenBlurPass = g.addPass("sheenBlur", {sheen}, {sheenBlur}, pass(5));
+    g.setFold(sheenBlurPass, RenderGraph::foldIdentity);
+    g.addPass("shadows", {scatter, sheenBlur}, {shadows}, pass(6));
+    int debugPass = g.addPass("debug", {shadows}, {debug}, pass(7));
+    g.addPass("gloss", {shadows}, {gloss}, pass(8));
+    g.addPass("present", {gloss}, {back}, pass(9));
+    g.markOutput(back);
+
+    RGCompileStats st;
+    CHECK(g.compile(&st));
+    CHECK(g.passCulled(debugPass) && g.passCulled(canvasPass));
+    CHECK(g.passFolded(blurPass) && !g.passFolded(sheenBlurPass));
+    CHECK(g.textureConstant(blur));
+    CHECK(st.physicalTargets == 3 && st.constantTextures == 1);
+    CHECK(st.aliasedBytes < st.unaliasedBytes);
+
+    MockGraphBackend backend;
+    g.execute(backend);
+    g.execute(backend);
+    CHECK(backend.targets == 3 && backend.constants == 1);
+    CHECK((ran == std::vector<int>{2, 3, 4, 5, 6, 8, 9, 2, 3, 4, 5, 6, 8, 9}));
+    g.release();
+    CHECK(backend.destroyed == 4);
+
+    // Two passes writing one texture
+    RenderGraph bad;
+    int t = bad.createTexture("t", screen);
+    bad.addPass("a", {}, {t}, nullptr);
+    bad.addPass("b", {}, {t}, nullptr);
+    CHECK(!bad.compile());
+}
+
+// A marked output nothing reads must keep its target to the end of the
+// frame; a later texture of the same size may not overwrite it
+static void testRenderGraphOutputs() {
+    RGTextureDesc desc;
+    desc.width = desc.height = 64;
+    RenderGraph g;
+    int result = g.createTexture("result", desc);
+    int temp   = g.createTexture("temp", desc);
+    int last   = g.createTexture("last", desc);
+    g.addPass("result", {}, {result}, [](const RGPassContext&) {});
+    g.addPass("temp", {}, {temp}, [](const RGPassContext&) {});
+    g.addPass("last", {temp}, {last}, [](const RGPassContext&) {});
+    g.markOutput(result);
+    g.markOutput(last);
+    RGCompileStats st;
+    CHECK(g.compile(&st));
+    CHECK(g.texturePhysical(result) != g.texturePhysical(temp));
+    CHECK(g.texturePhysical(result) != g.texturePhysical(last));
+    CHECK(st.physicalTargets == 3);
+}
+
+// --- TerrainLod ---
+
+// Height a point of patch p has after the vertex shader's morph
+static float morphedHeight(const Heightfield& hf, const std::vector<float>& morph,
+                           const LodPatch& p, int x, int z, Vec3 eye) {
+    float h = hf.at(x, z);
+    if (!(((x | z) >> p.level) & 1)) return h;
+    Vec3 d = Vec3{x * hf.spacing, h, z * hf.spacing} - eye;
+    float k = (std::sqrt(dot(d, d)) - p.morphStart) / (p.morphEnd - p.morphStart);
+    k = std::min(1.0f, std::max(0.0f, k));
+    return h + (morph[(size_t)z * hf.width + x] - h) * k;
+}
+
+// A camera sweeps over and around the terrain. Every selection must cover
+// each cell exactly once, neighboring cells may differ by at most one
+// level, and where two patches meet their morphed edges must coincide.
+static void testLodSelection() {
+    const int SIZE = 257;
+    ThreadPool pool;
+    HeightfieldParams params;
+    params.width = params.depth = SIZE;
+    Heightfield hf;
+    generateHeightfield(params, pool, hf);
+    TerrainLodParams lodParams;
+    lodParams.pixelError = 1.0f;
+    TerrainLod lod;
+    CHECK(lod.build(hf, lodParams));
+    CHECK(lod.levels() > 2);
+    std::vector<float> morph(hf.heights.size());
+    lod.buildMorphHeights(hf, morph.data());
+
+    const int cells = SIZE - 1, N = lodParams.patchCells;
+    const float extent = cells * hf.spacing;
+    std::vector<int> cover(cells * cells), level(cells * cells);
+    std::vector<LodPatch> patches;
+    uint32_t rng = 3;
+    float worstSeam = 0.0f;
+    int badCover = 0, badLevel = 0;
+    for (int trial = 0; trial < 200; ++trial) {
+        Vec3 eye = {-5.0f + nextUnit(rng) * (extent + 10.0f), nextUnit(rng) * 15.0f,
+                    -5.0f + nextUnit(rng) * (extent + 10.0f)};
+        lod.select(eye, patches);
+        std::fill(cover.begin(), cover.end(), 0);
+        // Edge heights by grid point, from the first patch that reached it
+        std::map<std::pair<int, int>, float> edges;
+        for (const LodPatch& p : patches) {
+            const int s = 1 << p.level, half = N * s / 2;
+            for (int q = 0; q < 4; ++q) {
+                if (!(p.quadrants & (1 << q))) continue;
+                const int qx = p.x0 + (q & 1) * half, qz = p.z0 + (q >> 1) * half;
+                for (int z = qz; z < qz + half; ++z)
+                    for (int x = qx; x < qx + half; ++x) {
+                        ++cover[z * cells + x];
+                        level[z * cells + x] = p.level;
+                    }
+                // Every grid point on the quarter's border, interpolated
+                // along the border's triangle edges
+                auto edge = [&](int ax, int az, int dx, int dz) {
+                    for (int i = 0; i <= half; ++i) {
+                        int j = i / s * s;
+                        float ha = morphedHeight(hf, morph, p, ax + dx * j, az + dz * j, eye);
+                        float hb = j == half ? ha
+                                 : morphedHeight(hf, morph, p, ax + dx * (j + s), az + dz * (j + s), eye);
+                        float h = ha + (hb - ha) * (float)(i - j) / s;
+                        auto at = edges.emplace(std::make_pair(ax + dx * i, az + dz * i), h);
+                        if (!at.second) worstSeam = std::max(worstSeam, std::fabs(at.first->second - h));
+                    }
+                };
+                edge(qx, qz, 1, 0);
+                edge(qx, qz + half, 1, 0);
+                edge(qx, qz, 0, 1);
+                edge(qx + half, qz, 0, 1);
+            }
+        }
+        for (int c : cover) badCover += c != 1;
+        for (int z = 0; z < cells; ++z)
+            for (int x = 0; x < cells; ++x) {
+                int l = level[z * cells + x];
+                if (x + 1 < cells) badLevel += std::abs(l - level[z * cells + x + 1]) > 1;
+                if (z + 1 < cells) badLevel += std::abs(l - level[(z + 1) * cells + x]) > 1;
+            }
+    }
+    CHECK(badCover == 0);
+    CHECK(badLevel == 0);
+    CHECK(worstSeam <= 1e-6f);
+}
+
+// --- HeightfieldQuery ---
+
+// First t in [0, maxT] where the ray enters a bilinear patch of hf, solved
+// cell by cell over the whole grid: along the ray, ray height minus patch
+// height is a quadratic in t. -1 on a miss. The ray must start above the
+// surface.
+static double bruteForceBilinear(const Heightfield& hf, const double* o, const double* d,
+                                 double maxT) {
+    double best = -1.0;
+    for (int cz = 0; cz + 1 < hf.depth; ++cz) {
+        for (int cx = 0; cx + 1 < hf.width; ++cx) {
+            // t range over which the ray lies above this cell
+            double t0 = 0.0, t1 = maxT;
+            const double lo[2] = {cx * hf.spacing, cz * hf.spacing};
+            const double dd[2] = {d[0], d[2]}, oo[2] = {o[0], o[2]};
+            for (int a = 0; a < 2; ++a) {
+                if (dd[a] == 0.0) {
+                    if (oo[a] < lo[a] || oo[a] > lo[a] + hf.spacing) t1 = -1.0;
+                    continue;
+                }
+                double ta = (lo[a] - oo[a]) / dd[a], tb = (lo[a] + hf.spacing - oo[a]) / dd[a];
+                t0 = std::max(t0, std::min(ta, tb));
+                t1 = std::min(t1, std::max(ta, tb));
+            }
+            if (t0 > t1 || (best >= 0.0 && t0 > best)) continue;
+            const double h00 = hf.at(cx, cz), h10 = hf.at(cx + 1, cz);
+            const double h01 = hf.at(cx, cz + 1), h11 = hf.at(cx + 1, cz + 1);
+            const double a = h10 - h00, b = h01 - h00, c = h00 - h10 - h01 + h11;
+            const double u0 = (o[0] - lo[0]) / hf.spacing, du = d[0] / hf.spacing;
+            const double v0 = (o[2] - lo[1]) / hf.spacing, dv = d[2] / hf.spacing;
+            const double A = -c * du * dv;
+            const double B = d[1] - (a * du + b * dv + c * (u0 * dv + v0 * du));
+            const double C = o[1] - (h00 + a * u0 + b * v0 + c * u0 * v0);
+            double roots[2];
+            int n = 0;
+            if (std::fabs(A) < 1e-12) {
+                if (B != 0.0) roots[n++] = -C / B;
+            } else {
+                double disc = B * B - 4.0 * A * C;
+                if (disc >= 0.0) {
+                    double q = -0.5 * (B + (B < 0.0 ? -1.0 : 1.0) * std::sqrt(disc));
+                    roots[n++] = q / A;
+                    if (q != 0.0) roots[n++] = C / q;
+                }
+            }
+            for (int i = 0; i < n; ++i)
+                if (roots[i] >= t0 && roots[i] <= t1 && (best < 0.0 || roots[i] < best))
+                    best = roots[i];
+        }
+    }
+    return best;
+}
+
+// Bilinear ray casts against the brute-force patch intersection above;
+// the batch call must return the same hits as single casts
+static void testHeightfieldRaycast() {
+    Heightfield hf;
+    hf.width = hf.depth = 65;
+    hf.spacing = 0.5f;
+    hf.heights.resize((size_t)hf.width * hf.depth);
+    for (int z = 0; z < hf.depth; ++z)
+        for (int x = 0; x < hf.width; ++x)
+            hf.heights[(size_t)z * hf.width + x] =
+                2.0f * std::sin(x * 0.3f) * std::cos(z * 0.2f) + 0.5f * std::sin(x * z * 0.05f);
+    HeightfieldQuery query;
+    query.build(hf);
+
+    const int RAYS = 400;
+    std::vector<HeightfieldRay> rays(RAYS);
+    std::vector<HeightfieldHit> single(RAYS), batch(RAYS);
+    uint32_t rng = 23;
+    int hits = 0, mismatches = 0;
+    double worstT = 0.0;
+    for (int i = 0; i < RAYS; ++i) {
+        HeightfieldRay& r = rays[i];
+        r.origin = {nextUnit(rng) * 32.0f, 4.0f, nextUnit(rng) * 32.0f};
+        r.dir = {nextUnit(rng) * 2.0f - 1.0f, -0.3f - 0.7f * nextUnit(rng), nextUnit(rng) * 2.0f - 1.0f};
+        r.maxT = 40.0f;
+        const double o[3] = {r.origin.x, r.origin.y, r.origin.z};
+        const double d[3] = {r.dir.x, r.dir.y, r.dir.z};
+        double ref = bruteForceBilinear(hf, o, d, r.maxT);
+        bool hit = query.raycast(r.origin, r.dir, r.maxT, single[i]);
+        if (hit != (ref >= 0.0)) {
+            ++mismatches;
+            continue;
+        }
+        if (!hit) continue;
+        ++hits;
+        worstT = std::max(worstT, std::fabs(single[i].t - ref));
+    }
+    CHECK(mismatches == 0);
+    CHECK(hits > RAYS / 2);
+    // Heights are kept to 1e-4 (16-bit steps of a range of about 5), which
+    // moves a hit by well under 1e-3 at these slopes
+    CHECK(worstT < 1e-3);
+
+    ThreadPool pool(4);
+    query.raycastBatch(rays.data(), RAYS, pool, batch.data());
+    int batchDiffs = 0;
+    for (int i = 0; i < RAYS; ++i)
+        batchDiffs += batch[i].x != single[i].x || batch[i].z != single[i].z ||
+                      (single[i].x >= 0 && batch[i].t != single[i].t);
+    CHECK(batchDiffs == 0);
+
+    // A bump above the highest point stays within the headroom
+    const int bx = 20, bz = 30;
+    const float top = *std::max_element(hf.heights.begin(), hf.heights.end());
+    hf.heights[(size_t)bz * hf.width + bx] = top + 1.0f;
+    query.updateHeight(hf, bx, bz);
+    query.refit();
+    HeightfieldHit bump;
+    const Vec3 above = {bx * hf.spacing, top + 3.0f, bz * hf.spacing};
+    CHECK(query.raycast(above, Vec3{0, -1, 0}, 10.0f, bump));
+    CHECK(std::fabs(above.y - bump.t - (top + 1.0f)) < 1e-3f);
+}
+
+// Column ray casts against CollisionIndex::raycast over the collision
+// boxes of the same columns. Rays start above every column, where the two
+// agree; a ray through a corner may name either column, at the same t.
+static void testColumnRaycast() {
+    VoxelColumns cols;
+    cols.resolution = 48;
+    cols.step = 2.0f;
+    cols.originX = cols.originZ = -20.0f;
+    cols.floorY = 0.0f;
+    cols.voxelHeight = 0.5f;
+    cols.top.resize((size_t)cols.resolution * cols.resolution);
+    cols.material.assign(cols.top.size(), 0);
+    uint32_t rng = 5;
+    for (int& t : cols.top) t = 1 + (int)(nextUnit(rng) * 20.0f);
+    HeightfieldQuery query;
+    query.build(cols);
+    std::vector<AABB> boxes(cols.top.size());
+    for (int x = 0; x < cols.resolution; ++x)
+        for (int z = 0; z < cols.resolution; ++z) boxes[cols.index(x, z)] = voxelColumnBox(cols, x, z);
+    CollisionIndex index;
+    index.build(boxes);
+
+    int hits = 0, mismatches = 0, otherColumn = 0;
+    for (int i = 0; i < 2000; ++i) {
+        Vec3 origin = {-20.0f + nextUnit(rng) * 96.0f, 12.0f, -20.0f + nextUnit(rng) * 96.0f};
+        Vec3 dir = {nextUnit(rng) * 2.0f - 1.0f, -0.2f - nextUnit(rng), nextUnit(rng) * 2.0f - 1.0f};
+        HeightfieldHit a;
+        RayHit b;
+        bool ha = query.raycast(origin, dir, 100.0f, a);
+        bool hb = index.raycast(origin, dir, 100.0f, b);
+        if (ha != hb) {
+            ++mismatches;
+            continue;
+        }
+        if (!ha) continue;
+        ++hits;
+        if (std::fabs(a.t - b.t) > 1e-4f * (1.0f + b.t)) ++mismatches;
+        else if (cols.index(a.x, a.z) != (size_t)b.box) ++otherColumn;
+    }
+    CHECK(mismatches == 0);
+    CHECK(hits > 1000);
+    CHECK(otherColumn <= 2);
+}
+
+// --- Post chain ---
+
+// Runs render graph passes on CpuImages. Every texture is w x h, so the
+// constants are full images instead of 1x1 ones; handle 0 is the
+// backbuffer.
+class CpuGraphBackend : public RenderGraphBackend {
+public:
+    CpuGraphBackend(int w, int h) : width(w), height(h) { images[0].resize(w, h); }
+    unsigned createTarget(const RGTextureDesc& desc) override {
+        images[next].resize(desc.width, desc.height);
+        return next++;
+    }
+    unsigned createConstant(const float rgba[4]) override {
+        images[next].resize(width, height);
+        fillImage(images[next], rgba);
+        return next++;
+    }
+    void destroyTexture(unsigned texture) override { images.erase(texture); }
+    void bindTargets(const unsigned* textures, int count) override {
+        bound.assign(textures, textures + count);
+    }
+    void clearTargets(const float rgba[4]) override {
+        for (unsigned t : bound) fillImage(images[t], rgba);
+    }
+
+    CpuImage& image(unsigned texture) { return images[texture]; }
+    CpuImage& target() { return images[bound[0]]; }
+
+private:
+    int width, height;
+    unsigned next = 1;
+    std::map<unsigned, CpuImage> images;
+    std::vector<unsigned> bound;
+};
+
+// The SSAO chain as what.cpp's buildGraph declares it, with the CPU
+// passes in place of the shaders. Leaves the result in the backbuffer.
+static void runPostGraph(const CpuImage& normalDepth, const PostFxParams& fx, bool sheen,
+                         ThreadPool& pool, CpuGraphBackend& backend) {
+    RGTextureDesc screen;
+    screen.width = normalDepth.width;
+    screen.height = normalDepth.height;
+    RenderGraph g;
+    int texCanvas    = g.createTexture("canvas", screen);
+    int texBlur      = g.createTexture("blur", screen);
+    int texSSAO      = g.createTexture("ssao", screen);
+    int texScatter   = g.createTexture("scatter", screen);
+    int texSheen     = g.createTexture("sheen", screen);
+    int texSheenBlur = g.createTexture("sheenBlur", screen);
+    int texShadows   = g.createTexture("shadows", screen);
+    int texGloss     = g.createTexture("gloss", screen);
+    int backbuffer   = g.importTexture("backbuffer", screen, 0);
+    auto in = [&](const RGPassContext& ctx, int i) -> CpuImage& { return backend.image(ctx.input(i)); };
+
+    const float white[4] = {1, 1, 1, 1};
+    int canvasPass = g.addPass("canvas", {}, {texCanvas}, nullptr);
+    g.setClearColor(canvasPass, white);
+    int blurPass = g.addPass("blur", {texCanvas}, {texBlur}, [&](const RGPassContext& ctx) {
+        postBlur(in(ctx, 0), backend.target(), fx, pool);
+    });
+    g.setFold(blurPass, RenderGraph::foldIdentity);
+    g.addPass("ssao", {}, {texSSAO}, [&](const RGPassContext&) {
+        postSSAO(normalDepth, backend.target(), fx, pool);
+    });
+    g.addPass("scatter", {texBlur}, {texScatter}, [&](const RGPassContext& ctx) {
+        postScatter(in(ctx, 0), backend.target(), fx, pool);
+    });
+    if (sheen) {
+        g.addPass("sheen", {texSSAO}, {texSheen}, [&](const RGPassContext& ctx) {
+            postSheen(in(ctx, 0), backend.target(), fx, pool);
+        });
+    } else {
+        int sheenPass = g.addPass("sheen", {}, {texSheen}, nullptr);
+        g.setClearColor(sheenPass, white);
+    }
+    int sheenBlurPass = g.addPass("sheenBlur", {texSheen}, {texSheenBlur},
+                                  [&](const RGPassContext& ctx) {
+        postBlur(in(ctx, 0), backend.target(), fx, pool);
+    });
+    g.setFold(sheenBlurPass, RenderGraph::foldIdentity);
+    g.addPass("shadows", {texScatter, texSheenBlur}, {texShadows}, [&](const RGPassContext& ctx) {
+        postShadowComposite(in(ctx, 0), in(ctx, 1), backend.target(), fx, pool);
+    });
+    g.addPass("gloss", {texShadows}, {texGloss}, [&](const RGPassContext& ctx) {
+        postGlossSpread(in(ctx, 0), backend.target(), fx, pool);
+    });
+    g.addPass("present", {texGloss}, {backbuffer}, [&](const RGPassContext& ctx) {
+        PostFxParams copy = fx;
+        copy.blurRadius = 0;
+        postBlur(in(ctx, 0), backend.target(), copy, pool);
+    });
+    g.markOutput(backbuffer);
+    CHECK(g.compile());
+    CHECK(g.textureConstant(texSheenBlur) == !sheen);
+    g.execute(backend);
+    g.release();
+}
+
+static float maxDifference(const CpuImage& a, const CpuImage& b) {
+    if (a.pixels.size() != b.pixels.size()) return 1e30f;
+    float worst = 0.0f;
+    for (size_t i = 0; i < a.pixels.size(); ++i)
+        worst = std::max(worst, std::fabs(a.pixels[i] - b.pixels[i]));
+    return worst;
+}
+
+// The graph with the sheen on must give runPostChain's image; with the
+// sheen off it must give the full chain fed a white (fully visible) sheen
+static void testPostGraph() {
+    CpuImage normalDepth;
+    normalDepth.resize(96, 80);
+    for (int y = 0; y < normalDepth.height; ++y)
+        for (int x = 0; x < normalDepth.width; ++x) {
+            float* p = normalDepth.row(y) + x * 4;
+            p[1] = 1.0f;
+            p[3] = 0.5f + 0.3f * (float)((x * 7 + y * 13) % 64) / 64.0f;
+        }
+    PostFxParams fx;
+    ThreadPool pool(4);
+
+    CpuImage full;
+    PostChainScratch scratch;
+    runPostChain(normalDepth, fx, pool, scratch, full);
+    CpuGraphBackend on(normalDepth.width, normalDepth.height);
+    runPostGraph(normalDepth, fx, true, pool, on);
+    CHECK(maxDifference(on.image(0), full) < 1e-5f);
+
+    // The full chain from the sheen on, with a white sheen
+    const float white[4] = {1, 1, 1, 1};
+    CpuImage base, sheen, sheenBlur, shadows, whiteSheen;
+    base.resize(normalDepth.width, normalDepth.height);
+    fillImage(base, white);
+    postScatter(base, base, fx, pool);
+    sheen.resize(normalDepth.width, normalDepth.height);
+    fillImage(sheen, white);
+    postBlur(sheen, sheenBlur, fx, pool);
+    postShadowComposite(base, sheenBlur, shadows, fx, pool);
+    postGlossSpread(shadows, whiteSheen, fx, pool);
+    CpuGraphBackend off(normalDepth.width, normalDepth.height);
+    runPostGraph(normalDepth, fx, false, pool, off);
+    CHECK(maxDifference(off.image(0), whiteSheen) < 1e-5f);
+    // The sheen does darken the image when it is on
+    CHECK(maxDifference(full, whiteSheen) > 0.01f);
+}
+
+// --- Profiler ---
+
+// Queries finish with the time set in nextNs; results show up once
+// release() makes every finished query available
+class FakeGpuBackend : public ProfilerGpuBackend {
+public:
+    int64_t nextNs = 0;
+    unsigned createQuery() override { return next++; }
+    void     destroyQuery(unsigned) override {}
+    void     beginQuery(unsigned) override {}
+    void     endQuery(unsigned query) override { results[query] = {nextNs, false}; }
+    bool     queryResult(unsigned query, int64_t& ns) override {
+        auto it = results.find(query);
+        if (it == results.end() || !it->second.second) return false;
+        ns = it->second.first;
+        results.erase(it);
+        return true;
+    }
+    void release() {
+        for (auto& r : results) r.second.second = true;
+    }
+
+private:
+    unsigned next = 1;
+    std::map<unsigned, std::pair<int64_t, bool>> results;
+};
+
+static void gpuZone(Profiler& profiler, FakeGpuBackend& gpu, const char* name, double ms) {
+    gpu.nextNs = (int64_t)(ms * 1e6);
+    profiler.beginGpuZone(name);
+    profiler.endGpuZone();
+}
+
+// lastGpuFrame() reports one frame's total however many frames resolve in
+// an endFrame(), and nothing when none did
+static void testProfilerGpuFrames() {
+    FakeGpuBackend gpu;
+    Profiler profiler;
+    profiler.setGpuBackend(&gpu);
+    double ms = -1.0;
+
+    gpuZone(profiler, gpu, "a", 1.0);
+    gpuZone(profiler, gpu, "b", 2.0);
+    profiler.endFrame();
+    CHECK(!profiler.lastGpuFrame(ms));
+
+    // Two frames resolve at once: the newer one counts, on its own
+    gpuZone(profiler, gpu, "a", 3.0);
+    gpuZone(profiler, gpu, "b", 4.0);
+    gpu.release();
+    profiler.endFrame();
+    CHECK(profiler.lastGpuFrame(ms) && std::fabs(ms - 7.0) < 1e-9);
+
+    // Nothing resolves; the zone stats still hold the old times
+    gpuZone(profiler, gpu, "a", 5.0);
+    profiler.endFrame();
+    CHECK(!profiler.lastGpuFrame(ms));
+
+    // A frame without GPU zones resolves too but has nothing to report
+    gpu.release();
+    profiler.endFrame();
+    CHECK(profiler.lastGpuFrame(ms) && std::fabs(ms - 5.0) < 1e-9);
+    profiler.endFrame();
+    CHECK(!profiler.lastGpuFrame(ms));
+
+    // A frame that lost a zone for want of a query is not a total
+    FakeGpuBackend small;
+    Profiler limited;
+    limited.setGpuBackend(&small, 1, 1);
+    gpuZone(limited, small, "a", 1.0);
+    gpuZone(limited, small, "b", 2.0);
+    small.release();
+    limited.endFrame();
+    CHECK(limited.counters().droppedQueries == 1);
+    CHECK(!limited.lastGpuFrame(ms));
+    gpuZone(limited, small, "a", 3.0);
+    small.release();
+    limited.endFrame();
+    CHECK(limited.lastGpuFrame(ms) && std::fabs(ms - 3.0) < 1e-9);
+    profiler.releaseGpu();
+    limited.releaseGpu();
+}
+
+// Advances a fixed step on every reading, from any thread
+class StepClock : public PacerClock {
+public:
+    std::atomic<int64_t> now{0};
+    int64_t nowNs() override { return now.fetch_add(1000); }
+    void    sleepNs(int64_t ns) override { now.fetch_add(ns); }
+};
+
+// Nested zones from several threads at once: every zone is collected,
+// each thread gets its own track, and every zone sits inside its parent
+// on the same thread
+static void testProfilerCpuZones() {
+    const int THREADS = 4, FRAMES = 3;
+    StepClock clock;
+    Profiler profiler(&clock);
+    profiler.startCapture();
+    for (int frame = 0; frame < FRAMES; ++frame) {
+        {
+            // Opened first, so this thread is track 0
+            PROFILE_ZONE(profiler, "main");
+            std::vector<std::thread> workers;
+            for (int t = 0; t < THREADS; ++t)
+                workers.emplace_back([&profiler] {
+                    PROFILE_ZONE(profiler, "outer");
+                    for (int i = 0; i < 2; ++i) {
+                        PROFILE_ZONE(profiler, "middle");
+                        PROFILE_ZONE(profiler, "leaf");
+                    }
+                });
+            for (std::thread& w : workers) w.join();
+        }
+        profiler.endFrame();
+    }
+    const int perThread = 1 + 2 * 2;
+    const ProfilerCounters& counts = profiler.counters();
+    CHECK(counts.frames == (uint64_t)FRAMES);
+    CHECK(counts.droppedEvents == 0);
+    // Thread ids are not reused, so each frame's workers register anew
+    CHECK(counts.threads == 1 + THREADS * FRAMES);
+    CHECK(counts.cpuEvents == (uint64_t)FRAMES * (1 + THREADS * perThread));
+
+    const std::vector<ProfileEvent>& events = profiler.captured();
+    CHECK(events.size() == counts.cpuEvents);
+    std::map<int, int> perTrack;
+    int orphans = 0, badDepth = 0;
+    for (const ProfileEvent& e : events) {
+        ++perTrack[e.thread];
+        const int wantDepth = std::strcmp(e.name, "leaf") == 0     ? 2
+                              : std::strcmp(e.name, "middle") == 0 ? 1
+                                                                   : 0;
+        badDepth += e.depth != wantDepth || e.endNs <= e.startNs;
+        if (e.depth == 0) continue;
+        bool inside = false;
+        for (const ProfileEvent& p : events)
+            inside |= p.thread == e.thread && p.depth == e.depth - 1 && p.startNs < e.startNs &&
+                      p.endNs > e.endNs;
+        orphans += !inside;
+    }
+    CHECK(orphans == 0);
+    CHECK(badDepth == 0);
+    CHECK((int)perTrack.size() == counts.threads);
+    for (const auto& track : perTrack) CHECK(track.second == (track.first == 0 ? FRAMES : perThread));
+}
+
+// Stats over a two-frame window: per-frame totals summed over calls,
+// calls per frame, the newest frame, and frames rolling out of the window
+static void testProfilerZoneStats() {
+    FakePacerClock clock;
+    Profiler profiler(&clock, 64, 2);
+    FakeGpuBackend gpu;
+    profiler.setGpuBackend(&gpu);
+    auto zone = [&](const char* name, double ms) {
+        profiler.beginZone(name);
+        clock.now += (int64_t)(ms * 1e6);
+        profiler.endZone();
+    };
+    zone("b", 2.0);
+    profiler.beginZone("b");
+    zone("a", 1.0);
+    clock.now += 2000000;
+    profiler.endZone();
+    gpuZone(profiler, gpu, "gpu", 0.5);
+    gpu.release();
+    profiler.endFrame();
+    zone("b", 4.0);
+    profiler.endFrame();
+
+    std::vector<ProfileZoneStats> stats = profiler.zoneStats();
+    CHECK(stats.size() == 3);
+    if (stats.size() != 3) return;
+    CHECK(stats[0].name == "a" && stats[1].name == "b" && stats[2].name == "gpu");
+    const ProfileZoneStats& a = stats[0];
+    const ProfileZoneStats& b = stats[1];
+    CHECK(!a.gpu && !b.gpu && stats[2].gpu);
+    // b: 2 + 3 ms in two calls, then 4 ms in one
+    CHECK(b.frames == 2);
+    CHECK(std::fabs(b.meanMs - 4.5) < 1e-9 && std::fabs(b.maxMs - 5.0) < 1e-9);
+    CHECK(std::fabs(b.lastMs - 4.0) < 1e-9 && std::fabs(b.callsPerFrame - 1.5) < 1e-9);
+    CHECK(a.frames == 2 && std::fabs(a.meanMs - 0.5) < 1e-9 && a.lastMs == 0.0);
+    CHECK(std::fabs(stats[2].meanMs - 0.25) < 1e-9);
+
+    // The first frame leaves the window
+    profiler.endFrame();
+    ProfileZoneStats s;
+    CHECK(profiler.zoneStats("b", s));
+    CHECK(s.frames == 2 && std::fabs(s.meanMs - 2.0) < 1e-9 && std::fabs(s.maxMs - 4.0) < 1e-9);
+    CHECK(s.lastMs == 0.0 && std::fabs(s.callsPerFrame - 0.5) < 1e-9);
+    CHECK(profiler.zoneStats("a", s) && s.maxMs == 0.0);
+    CHECK(!profiler.zoneStats("missing", s));
+    profiler.releaseGpu();
+}
+
+// A full thread buffer drops zones and counts them; the next frame has
+// room again
+static void testProfilerDroppedEvents() {
+    FakePacerClock clock;
+    Profiler profiler(&clock, 8);
+    for (int i = 0; i < 20; ++i) {
+        PROFILE_ZONE(profiler, "zone");
+    }
+    std::thread other([&profiler] {
+        for (int i = 0; i < 10; ++i) {
+            PROFILE_ZONE(profiler, "other");
+        }
+    });
+    other.join();
+    profiler.endFrame();
+    CHECK(profiler.counters().droppedEvents == 12 + 2);
+    CHECK(profiler.counters().cpuEvents == 8 + 8);
+    ProfileZoneStats s;
+    CHECK(profiler.zoneStats("zone", s) && s.callsPerFrame == 8.0);
+
+    for (int i = 0; i < 8; ++i) {
+        PROFILE_ZONE(profiler, "zone");
+    }
+    profiler.endFrame();
+    CHECK(profiler.counters().droppedEvents == 14);
+    CHECK(profiler.counters().cpuEvents == 24);
+}
+
+static const char* jsonSpace(const char* p) {
+    while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') ++p;
+    return p;
+}
+
+// Past one JSON value, or nullptr if it does not parse. Numbers, strings,
+// arrays and objects only: the trace has no literals.
+static const char* jsonValue(const char* p) {
+    p = jsonSpace(p);
+    if (*p == '{' || *p == '[') {
+        const bool object = *p == '{';
+        const char close = object ? '}' : ']';
+        p = jsonSpace(p + 1);
+        if (*p == close) return p + 1;
+        for (;;) {
+            if (object) {
+                p = jsonSpace(p);
+                if (*p != '"' || !(p = jsonValue(p))) return nullptr;
+                p = jsonSpace(p);
+                if (*p++ != ':') return nullptr;
+            }
+            if (!(p = jsonValue(p))) return nullptr;
+            p = jsonSpace(p);
+            if (*p == close) return p + 1;
+            if (*p++ != ',') return nullptr;
+        }
+    }
+    if (*p == '"') {
+        for (++p; *p != '"'; ++p) {
+            if ((unsigned char)*p < 0x20) return nullptr;   // the terminator too
+            if (*p == '\\' && !std::strchr("\"\\/bfnrtu", *++p)) return nullptr;
+        }
+        return p + 1;
+    }
+    char* end;
+    std::strtod(p, &end);
+    return end == p ? nullptr : end;
+}
+
+static bool isJson(const std::string& s) {
+    const char* end = jsonValue(s.c_str());
+    return end && *jsonSpace(end) == '\0';
+}
+
+static int countOf(const std::string& s, const char* what) {
+    int n = 0;
+    for (size_t at = s.find(what); at != std::string::npos; at = s.find(what, at + 1)) ++n;
+    return n;
+}
+
+// chromeTrace() is valid JSON with a track name per thread and the GPU
+// and one complete event per captured zone, with names escaped; an
+// empty capture still parses
+static void testProfilerChromeTrace() {
+    FakePacerClock clock;
+    Profiler profiler(&clock);
+    FakeGpuBackend gpu;
+    profiler.setGpuBackend(&gpu);
+
+    std::string json = profiler.chromeTrace();
+    CHECK(isJson(json));
+    CHECK(countOf(json, "\"ph\":\"X\"") == 0);
+    profiler.startCapture();
+    json = profiler.chromeTrace();
+    CHECK(isJson(json));
+    CHECK(json.compare(0, 16, "{\"traceEvents\":[") == 0);
+
+    {
+        PROFILE_ZONE(profiler, "frame");
+        clock.now += 1000000;
+        PROFILE_ZONE(profiler, "say \"hi\"\\\n");
+        clock.now += 500000;
+    }
+    gpuZone(profiler, gpu, "draw", 2.0);
+    gpu.release();
+    profiler.endFrame();
+    profiler.endFrame();
+    profiler.stopCapture();
+    json = profiler.chromeTrace();
+    CHECK(isJson(json));
+    CHECK(profiler.captured().size() == 3);
+    CHECK(countOf(json, "\"ph\":\"X\"") == 3);
+    CHECK(countOf(json, "\"ph\":\"M\"") == profiler.counters().threads + 1);
+    CHECK(countOf(json, "\"cat\":\"gpu\"") == 1 && countOf(json, "\"tid\":1000") == 2);
+    CHECK(json.find("\"name\":\"say \\\"hi\\\"\\\\\\u000a\"") != std::string::npos);
+    CHECK(json.find("\"name\":\"frame\",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":") != std::string::npos);
+    CHECK(json.find("\"dur\":1500.000") != std::string::npos);
+    profiler.releaseGpu();
+}
+
+// --- PerlinNoise ---
+
+// Every batch kernel the CPU has must give the scalar path's bits, for
+// single samples and for fBm, over negative and far-off coordinates too
+static void testNoiseIsa() {
+    const int COUNT = 1003;   // not a multiple of any vector width
+    std::vector<float> xs(COUNT), ys(COUNT), batch(COUNT);
+    uint32_t rng = 77;
+    for (int i = 0; i < COUNT; ++i) {
+        xs[i] = (nextUnit(rng) - 0.5f) * (i < COUNT / 2 ? 64.0f : 4096.0f);
+        ys[i] = (nextUnit(rng) - 0.5f) * (i < COUNT / 2 ? 64.0f : 4096.0f);
+    }
+    FbmParams fbm;
+    fbm.octaves = 6;
+    fbm.lacunarity = 2.03f;
+    fbm.gain = 0.47f;
+
+    const NoiseIsa startup = perlinNoiseIsa();
+    for (NoiseIsa isa : {NOISE_SCALAR, NOISE_SSE41, NOISE_AVX2}) {
+        if (setPerlinNoiseIsa(isa) != isa) continue;
+        int noiseDiffs = 0, fbmDiffs = 0;
+        perlinNoiseBatch(xs.data(), ys.data(), COUNT, batch.data());
+        for (int i = 0; i < COUNT; ++i) {
+            float ref = perlinNoise(xs[i], ys[i]);
+            noiseDiffs += std::memcmp(&ref, &batch[i], sizeof(float)) != 0;
+        }
+        perlinFbmBatch(xs.data(), ys.data(), COUNT, fbm, batch.data());
+        for (int i = 0; i < COUNT; ++i) {
+            float ref = perlinFbm(xs[i], ys[i], fbm);
+            fbmDiffs += std::memcmp(&ref, &batch[i], sizeof(float)) != 0;
+        }
+        if (noiseDiffs || fbmDiffs)
+            std::fprintf(stderr, "%s: %d noise, %d fbm samples differ\n", noiseIsaName(isa),
+                         noiseDiffs, fbmDiffs);
+        CHECK(noiseDiffs == 0);
+        CHECK(fbmDiffs == 0);
+    }
+    setPerlinNoiseIsa(startup);
+}
+
+// --- Parallel generation ---
+
+static bool sameBytes(const void* a, const void* b, size_t bytes) {
+    return std::memcmp(a, b, bytes) == 0;
+}
+
+template <typename T>
+static bool sameBytes(const std::vector<T>& a, const std::vector<T>& b) {
+    return a.size() == b.size() && sameBytes(a.data(), b.data(), a.size() * sizeof(T));
+}
+
+// Everything generateHeightfield(), the grid builders and the voxel
+// mesher produce, run on a pool of the given size
+struct GeneratedTerrain {
+    Heightfield field;
+    std::vector<float> positions, normals;
+    std::vector<unsigned> indices;
+    VoxelMesh voxels;
+};
+
+static void generateAll(unsigned workers, GeneratedTerrain& out) {
+    ThreadPool pool(workers);
+    HeightfieldParams params;
+    params.width = 301;
+    params.depth = 173;
+    params.fbm.octaves = 4;
+    params.tileSize = 32;
+    generateHeightfield(params, pool, out.field);
+    const size_t points = (size_t)params.width * params.depth;
+    out.positions.resize(points * 3);
+    out.normals.resize(points * 3);
+    out.indices.resize(gridIndexCount(params.width, params.depth));
+    buildGridPositions(out.field, pool, out.positions.data());
+    computeGridNormals(out.field, NORMALS_AREA_WEIGHTED, pool, out.normals.data());
+    buildGridIndices(params.width, params.depth, pool, out.indices.data());
+
+    VoxelTerrainParams voxel;
+    voxel.worldSize = 960.0f;
+    voxel.resolution = 96;
+    voxel.chunkSize = 16;
+    HeightSampler sampler = [](const float* wx, const float* wz, int count, float* h) {
+        for (int i = 0; i < count; ++i)
+            h[i] = 120.0f + 90.0f * std::sin(wx[i] * 0.011f) * std::cos(wz[i] * 0.017f);
+    };
+    generateVoxelTerrain(voxel, sampler, pool, out.voxels);
+}
+
+// Tiles write only their own slices, so the output is byte-identical for
+// any number of threads
+static void testParallelDeterminism() {
+    GeneratedTerrain serial, parallel;
+    generateAll(0, serial);
+    generateAll(7, parallel);
+    CHECK(sameBytes(serial.field.heights, parallel.field.heights));
+    CHECK(sameBytes(serial.positions, parallel.positions));
+    CHECK(sameBytes(serial.normals, parallel.normals));
+    CHECK(sameBytes(serial.indices, parallel.indices));
+    CHECK(sameBytes(serial.voxels.vertices, parallel.voxels.vertices));
+    CHECK(sameBytes(serial.voxels.indices, parallel.voxels.indices));
+    CHECK(sameBytes(serial.voxels.collisionBoxes, parallel.voxels.collisionBoxes));
+    CHECK(sameBytes(serial.voxels.chunks, parallel.voxels.chunks));
+    CHECK(!serial.voxels.indices.empty());
+}
+
+// --- Grid normals ---
+
+static double angleDegrees(const double* a, const float* b) {
+    double dot = 0.0, la = 0.0, lb = 0.0;
+    for (int c = 0; c < 3; ++c) {
+        dot += a[c] * b[c];
+        la += a[c] * a[c];
+        lb += (double)b[c] * b[c];
+    }
+    return std::acos(std::min(1.0, dot / std::sqrt(la * lb))) * 57.29577951308232;
+}
+
+// NORMALS_AREA_WEIGHTED against summing the unnormalized cross products
+// of the mesh triangles, and NORMALS_CENTRAL_DIFF against the gradient
+// from the same differences, both in double
+static void testGridNormals() {
+    ThreadPool pool;
+    HeightfieldParams params;
+    params.width = 150;
+    params.depth = 130;
+    params.fbm.octaves = 5;
+    Heightfield field;
+    generateHeightfield(params, pool, field);
+    const int w = field.width, d = field.depth;
+    const size_t points = (size_t)w * d;
+    std::vector<float> positions(points * 3), smooth(points * 3), central(points * 3);
+    std::vector<unsigned> indices(gridIndexCount(w, d));
+    buildGridPositions(field, pool, positions.data());
+    buildGridIndices(w, d, pool, indices.data());
+    computeGridNormals(field, NORMALS_AREA_WEIGHTED, pool, smooth.data());
+    computeGridNormals(field, NORMALS_CENTRAL_DIFF, pool, central.data());
+
+    std::vector<double> sum(points * 3, 0.0);
+    for (size_t t = 0; t < indices.size(); t += 3) {
+        const float* p0 = &positions[indices[t] * 3];
+        const float* p1 = &positions[indices[t + 1] * 3];
+        const float* p2 = &positions[indices[t + 2] * 3];
+        double e1[3], e2[3];
+        for (int c = 0; c < 3; ++c) {
+            e1[c] = (double)p1[c] - p0[c];
+            e2[c] = (double)p2[c] - p0[c];
+        }
+        const double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                             e1[0] * e2[1] - e1[1] * e2[0]};
+        for (int k = 0; k < 3; ++k)
+            for (int c = 0; c < 3; ++c) sum[indices[t + k] * 3 + c] += n[c];
+    }
+    double worstSmooth = 0.0, worstCentral = 0.0;
+    for (int z = 0; z < d; ++z) {
+        for (int x = 0; x < w; ++x) {
+            const size_t i = (size_t)z * w + x;
+            worstSmooth = std::max(worstSmooth, angleDegrees(&sum[i * 3], &smooth[i * 3]));
+            const int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, w - 1);
+            const int z0 = std::max(z - 1, 0), z1 = std::min(z + 1, d - 1);
+            const double ref[3] = {
+                -((double)field.at(x1, z) - field.at(x0, z)) / ((x1 - x0) * (double)field.spacing), 1.0,
+                -((double)field.at(x, z1) - field.at(x, z0)) / ((z1 - z0) * (double)field.spacing)};
+            worstCentral = std::max(worstCentral, angleDegrees(ref, &central[i * 3]));
+        }
+    }
+    // The float paths round differently from the double references only
+    CHECK(worstSmooth < 0.04);
+    CHECK(worstCentral < 0.001);
+}
+
+// --- Voxel meshing ---
+
+// Emitted area per face direction (+x, -x, +y, -y, +z, -z), taken from
+// the triangles; also counts triangles whose winding disagrees with
+// their vertex normal
+static void voxelFaceArea(const VoxelChunkMesh& mesh, double area[6], int& badWinding) {
+    for (int f = 0; f < 6; ++f) area[f] = 0.0;
+    const float* v = mesh.vertices.data();
+    for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+        const float* p0 = v + mesh.indices[t] * VOXEL_VERTEX_FLOATS;
+        const float* p1 = v + mesh.indices[t + 1] * VOXEL_VERTEX_FLOATS;
+        const float* p2 = v + mesh.indices[t + 2] * VOXEL_VERTEX_FLOATS;
+        double e1[3], e2[3];
+        for (int c = 0; c < 3; ++c) {
+            e1[c] = (double)p1[c] - p0[c];
+            e2[c] = (double)p2[c] - p0[c];
+        }
+        const double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                             e1[0] * e2[1] - e1[1] * e2[0]};
+        int axis = 0;
+        for (int c = 1; c < 3; ++c)
+            if (std::fabs(p0[3 + c]) > std::fabs(p0[3 + axis])) axis = c;
+        const bool negative = p0[3 + axis] < 0.0f;
+        area[axis * 2 + negative] += 0.5 * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if ((n[axis] < 0.0) != negative) ++badWinding;
+    }
+}
+
+// Greedy and per-face meshes must cover exactly the exposed voxel faces:
+// tops and bottoms of every column, and each side layer above the
+// neighbour (the grid edge counts as open)
+static void testVoxelGreedyArea() {
+    VoxelColumns cols;
+    cols.resolution = 40;
+    cols.step = 2.0f;
+    cols.originX = -40.0f;
+    cols.originZ = 10.0f;
+    cols.floorY = -5.0f;
+    cols.voxelHeight = 0.5f;
+    cols.top.resize((size_t)cols.resolution * cols.resolution);
+    cols.material.resize(cols.top.size());
+    for (int i = 0; i < 3; ++i) cols.palette[i] = {0.3f * i, 0.5f, 1.0f - 0.3f * i};
+    uint32_t rng = 41;
+    for (int x = 0; x < cols.resolution; ++x)
+        for (int z = 0; z < cols.resolution; ++z) {
+            // Smooth terraces with some noise, so merging has work to do
+            int top = 6 + (int)(4.0f * std::sin(x * 0.3f) + 4.0f * std::cos(z * 0.2f));
+            if (nextUnit(rng) < 0.1f) top += (int)(nextUnit(rng) * 5.0f) - 2;
+            cols.top[cols.index(x, z)] = std::max(top, 0);
+            cols.material[cols.index(x, z)] = (unsigned char)(top < 4 ? 0 : top < 9 ? 1 : 2);
+        }
+
+    double expected[6] = {0, 0, 0, 0, 0, 0};
+    const double topArea = (double)cols.step * cols.step, sideArea = (double)cols.step * cols.voxelHeight;
+    for (int x = 0; x < cols.resolution; ++x)
+        for (int z = 0; z < cols.resolution; ++z) {
+            const int top = cols.topAt(x, z);
+            if (top == 0) continue;
+            expected[2] += topArea;
+            expected[3] += topArea;
+            expected[0] += sideArea * std::max(top - cols.topAt(x + 1, z), 0);
+            expected[1] += sideArea * std::max(top - cols.topAt(x - 1, z), 0);
+            expected[4] += sideArea * std::max(top - cols.topAt(x, z + 1), 0);
+            expected[5] += sideArea * std::max(top - cols.topAt(x, z - 1), 0);
+        }
+
+    VoxelChunkMesh greedy, plain;
+    meshVoxelRegion(cols, 0, 0, cols.resolution, cols.resolution, true, greedy);
+    meshVoxelRegion(cols, 0, 0, cols.resolution, cols.resolution, false, plain);
+    double greedyArea[6], plainArea[6];
+    int badWinding = 0;
+    voxelFaceArea(greedy, greedyArea, badWinding);
+    voxelFaceArea(plain, plainArea, badWinding);
+    for (int f = 0; f < 6; ++f) {
+        CHECK(std::fabs(greedyArea[f] - expected[f]) < 1e-6 * expected[f] + 1e-3);
+        CHECK(std::fabs(plainArea[f] - expected[f]) < 1e-6 * expected[f] + 1e-3);
+    }
+    CHECK(badWinding == 0);
+    CHECK(greedy.stats.triangles < plain.stats.triangles);
+    CHECK(plain.stats.triangles < plain.stats.naiveTriangles);
+}
+
+// --- Vertex formats ---
+
+// Encode then decode: positions within quantFrameMaxError() of the
+// input, normals within OCT8_MAX_ERROR_DEGREES, heights (int16 morph
+// targets and the R16 height texture) within half a step. Anything the
+// frame or the formats cannot hold makes the encoder return false.
+static void testVertexFormat() {
+    const int COUNT = 20000;
+    const AABB bounds = {{-37.5f, -3.0f, 12.0f}, {81.0f, 20.25f, 140.0f}};
+    const QuantFrame frame = makeQuantFrame(bounds);
+    const Vec3 maxErr = quantFrameMaxError(frame);
+    // Float rounding of origin + q * scale at these magnitudes
+    const double ROUNDING = 2e-5;
+    uint32_t rng = 5;
+    std::vector<float> positions(COUNT * 3), normals(COUNT * 3);
+    for (int i = 0; i < COUNT; ++i) {
+        float* p = &positions[i * 3];
+        p[0] = bounds.min.x + nextUnit(rng) * (bounds.max.x - bounds.min.x);
+        p[1] = bounds.min.y + nextUnit(rng) * (bounds.max.y - bounds.min.y);
+        p[2] = bounds.min.z + nextUnit(rng) * (bounds.max.z - bounds.min.z);
+        // Uniform directions, then the axes and the octahedron's folds
+        float* n = &normals[i * 3];
+        double len;
+        do {
+            for (int c = 0; c < 3; ++c) n[c] = nextUnit(rng) * 2.0f - 1.0f;
+            len = std::sqrt((double)n[0] * n[0] + (double)n[1] * n[1] + (double)n[2] * n[2]);
+        } while (len < 0.1 || len > 1.0);
+        if (i < 6) {
+            const Vec3& f = FACE_NORMAL_TABLE[i];
+            n[0] = f.x; n[1] = f.y; n[2] = f.z;
+            len = 1.0;
+        } else if (i < 14) {
+            n[0] = i & 1 ? 1.0f : -1.0f;
+            n[1] = i & 2 ? 1.0f : -1.0f;
+            n[2] = i & 4 ? 0.0f : -1e-4f;
+        }
+        for (int c = 0; c < 3; ++c) n[c] = (float)(n[c] / len);
+    }
+    // The corners are in the frame
+    for (int c = 0; c < 3; ++c) {
+        positions[c] = (&bounds.min.x)[c];
+        positions[3 + c] = (&bounds.max.x)[c];
+    }
+
+    std::vector<PackedTerrainVertex> packed(COUNT);
+    std::vector<float> decodedPos(COUNT * 3), decodedNormals(COUNT * 3);
+    CHECK(encodeTerrainVertices(positions.data(), normals.data(), COUNT, frame, packed.data()));
+    decodeTerrainVertices(packed.data(), COUNT, frame, decodedPos.data(), decodedNormals.data());
+    double posErr[3] = {0.0, 0.0, 0.0}, worstAngle = 0.0;
+    for (int i = 0; i < COUNT; ++i) {
+        for (int c = 0; c < 3; ++c)
+            posErr[c] = std::max(posErr[c], std::fabs((double)decodedPos[i * 3 + c] - positions[i * 3 + c]));
+        const double n[3] = {normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]};
+        worstAngle = std::max(worstAngle, angleDegrees(n, &decodedNormals[i * 3]));
+    }
+    CHECK(posErr[0] <= maxErr.x + ROUNDING);
+    CHECK(posErr[1] <= maxErr.y + ROUNDING);
+    CHECK(posErr[2] <= maxErr.z + ROUNDING);
+    CHECK(worstAngle <= OCT8_MAX_ERROR_DEGREES);
+
+    std::vector<float> heights(COUNT);
+    std::vector<int16_t> packedHeights(COUNT);
+    for (int i = 0; i < COUNT; ++i) heights[i] = positions[i * 3 + 1];
+    CHECK(encodeHeights(heights.data(), COUNT, frame, packedHeights.data()));
+    double heightErr = 0.0;
+    for (int i = 0; i < COUNT; ++i)
+        heightErr = std::max(heightErr, std::fabs((double)frame.origin.y + packedHeights[i] * (double)frame.scale.y -
+                                                  heights[i]));
+    CHECK(heightErr <= maxErr.y + ROUNDING);
+
+    // The R16 texture keeps the whole field, headroom included
+    ThreadPool pool;
+    HeightfieldParams params;
+    params.width = params.depth = 129;
+    Heightfield field;
+    generateHeightfield(params, pool, field);
+    HeightTexture texture;
+    texture.build(field);
+    double texelErr = 0.0;
+    for (int z = 0; z < field.depth; ++z)
+        for (int x = 0; x < field.width; ++x)
+            texelErr = std::max(texelErr, std::fabs((double)texture.height(texture.texels()[z * texture.width() + x]) -
+                                                    field.at(x, z)));
+    CHECK(texelErr <= 0.5 * texture.step() + ROUNDING);
+
+    // Out of the frame by more than half a step, on each axis and each side
+    for (int c = 0; c < 6; ++c) {
+        float p[3] = {positions[0], positions[1], positions[2]};
+        const float scale = (&frame.scale.x)[c % 3];
+        p[c % 3] = c < 3 ? (&bounds.min.x)[c] - scale : (&bounds.max.x)[c - 3] + scale;
+        PackedTerrainVertex v;
+        CHECK(!encodeTerrainVertices(p, normals.data(), 1, frame, &v));
+        int16_t h;
+        if (c % 3 == 1) CHECK(!encodeHeights(&p[1], 1, frame, &h));
+    }
+
+    // Voxel vertices: lattice corners come back exactly; a slanted normal
+    // or a color missing from the palette does not encode
+    const Vec3 palette[2] = {{0.2f, 0.6f, 0.1f}, {0.5f, 0.4f, 0.3f}};
+    const QuantFrame voxelFrame = {{-4.0f, 0.0f, 8.0f}, {0.5f, 0.5f, 0.5f}};
+    const float voxel[9] = {-3.5f, 12.0f, 20.5f, 0.0f, 0.0f, -1.0f, 0.5f, 0.4f, 0.3f};
+    PackedVoxelVertex pv;
+    float back[9];
+    CHECK(encodeVoxelVertices(voxel, 1, voxelFrame, palette, 2, &pv));
+    decodeVoxelVertices(&pv, 1, voxelFrame, palette, back);
+    CHECK(std::memcmp(voxel, back, sizeof(back)) == 0);
+    float slanted[9], unknownColor[9], outside[9];
+    std::memcpy(slanted, voxel, sizeof(voxel));
+    std::memcpy(unknownColor, voxel, sizeof(voxel));
+    std::memcpy(outside, voxel, sizeof(voxel));
+    slanted[3] = 0.6f;
+    slanted[5] = -0.8f;
+    unknownColor[8] = 0.31f;
+    outside[1] = 0.5f * 40000.0f;
+    CHECK(!encodeVoxelVertices(slanted, 1, voxelFrame, palette, 2, &pv));
+    CHECK(!encodeVoxelVertices(unknownColor, 1, voxelFrame, palette, 2, &pv));
+    CHECK(!encodeVoxelVertices(outside, 1, voxelFrame, palette, 2, &pv));
+}
+
+// --- Collision BVH ---
+
+static AABB randomBox(uint32_t& rng, float world, float maxSize) {
+    Vec3 lo = {nextUnit(rng) * world, nextUnit(rng) * world, nextUnit(rng) * world};
+    Vec3 size = {0.01f + nextUnit(rng) * maxSize, 0.01f + nextUnit(rng) * maxSize,
+                 0.01f + nextUnit(rng) * maxSize};
+    return AABB{lo, lo + size};
+}
+
+// Slab test in double; -1 on a miss, 0 when the ray starts inside
+static double bruteForceRayBox(const AABB& b, Vec3 origin, Vec3 dir, float maxT) {
+    const double o[3] = {origin.x, origin.y, origin.z}, d[3] = {dir.x, dir.y, dir.z};
+    const double lo[3] = {b.min.x, b.min.y, b.min.z}, hi[3] = {b.max.x, b.max.y, b.max.z};
+    double enter = 0.0, exit = maxT;
+    for (int a = 0; a < 3; ++a) {
+        if (d[a] == 0.0) {
+            if (o[a] < lo[a] || o[a] > hi[a]) return -1.0;
+            continue;
+        }
+        double t0 = (lo[a] - o[a]) / d[a], t1 = (hi[a] - o[a]) / d[a];
+        if (t0 > t1) std::swap(t0, t1);
+        enter = std::max(enter, t0);
+        exit = std::min(exit, t1);
+    }
+    return enter <= exit ? enter : -1.0;
+}
+
+// overlap() and raycast() against testing every box, on a fresh build
+// and again after moving a third of the boxes and refitting
+static void testCollisionBvh() {
+    const int BOXES = 3000;
+    const float WORLD = 100.0f;
+    uint32_t rng = 17;
+    std::vector<AABB> boxes(BOXES);
+    for (AABB& b : boxes) b = randomBox(rng, WORLD, 8.0f);
+    CollisionIndex index;
+    index.build(boxes);
+    CHECK(index.size() == BOXES);
+
+    auto compare = [&](int& overlapMismatches, int& rayMismatches, int& rayHits) {
+        overlapMismatches = rayMismatches = rayHits = 0;
+        std::vector<int> found, expected;
+        for (int q = 0; q < 300; ++q) {
+            const AABB query = randomBox(rng, WORLD, 15.0f);
+            found.clear();
+            expected.clear();
+            index.overlap(query, found);
+            for (int i = 0; i < BOXES; ++i) {
+                const AABB& b = boxes[i];
+                if (b.min.x < query.max.x && query.min.x < b.max.x && b.min.y < query.max.y &&
+                    query.min.y < b.max.y && b.min.z < query.max.z && query.min.z < b.max.z)
+                    expected.push_back(i);
+            }
+            std::sort(found.begin(), found.end());
+            overlapMismatches += found != expected;
+        }
+        for (int r = 0; r < 1000; ++r) {
+            // Starts inside the world and outside it, some along an axis
+            Vec3 origin = {(nextUnit(rng) * 1.4f - 0.2f) * WORLD, (nextUnit(rng) * 1.4f - 0.2f) * WORLD,
+                           (nextUnit(rng) * 1.4f - 0.2f) * WORLD};
+            Vec3 dir = {nextUnit(rng) * 2.0f - 1.0f, nextUnit(rng) * 2.0f - 1.0f,
+                        nextUnit(rng) * 2.0f - 1.0f};
+            if (r % 10 == 0) dir.x = dir.z = 0.0f;
+            const float maxT = r % 2 ? 1e30f : nextUnit(rng) * 60.0f;
+            double nearest = -1.0;
+            for (int i = 0; i < BOXES; ++i) {
+                double t = bruteForceRayBox(boxes[i], origin, dir, maxT);
+                if (t >= 0.0 && (nearest < 0.0 || t < nearest)) nearest = t;
+            }
+            RayHit hit;
+            const bool hasHit = index.raycast(origin, dir, maxT, hit);
+            if (hasHit != (nearest >= 0.0)) {
+                ++rayMismatches;
+                continue;
+            }
+            if (!hasHit) continue;
+            ++rayHits;
+            // Ties may name either box, at the same t
+            const double own = bruteForceRayBox(boxes[hit.box], origin, dir, maxT);
+            const double tolerance = 1e-4 * (1.0 + nearest);
+            if (std::fabs(hit.t - nearest) > tolerance || std::fabs(own - nearest) > tolerance)
+                ++rayMismatches;
+        }
+    };
+    int overlapMismatches, rayMismatches, rayHits;
+    compare(overlapMismatches, rayMismatches, rayHits);
+    CHECK(overlapMismatches == 0);
+    CHECK(rayMismatches == 0);
+    CHECK(rayHits > 300);
+
+    // Small nudges and jumps across the world
+    for (int i = 0; i < BOXES; i += 3) {
+        if (i % 2) {
+            const Vec3 delta = {nextUnit(rng) - 0.5f, nextUnit(rng) - 0.5f, nextUnit(rng) - 0.5f};
+            boxes[i] = AABB{boxes[i].min + delta, boxes[i].max + delta};
+        } else {
+            boxes[i] = randomBox(rng, WORLD, 8.0f);
+        }
+        index.updateBox(i, boxes[i]);
+    }
+    index.refit();
+    int moved = 0;
+    for (int i = 0; i < BOXES; ++i) {
+        const AABB b = index.box(i);
+        moved += std::memcmp(&b, &boxes[i], sizeof(AABB)) != 0;
+    }
+    CHECK(moved == 0);
+    compare(overlapMismatches, rayMismatches, rayHits);
+    CHECK(overlapMismatches == 0);
+    CHECK(rayMismatches == 0);
+    CHECK(rayHits > 300);
+}
+
+// --- Frustum culling ---
+
+// Column-major perspective * look-at, as glm builds them for the renderer
+static void viewProjection(Vec3 eye, Vec3 target, float fovY, float aspect, float zNear, float zFar,
+                           float* out) {
+    const Vec3 f = normalize(target - eye);
+    const Vec3 s = normalize(cross(f, Vec3{0, 1, 0}));
+    const Vec3 u = cross(s, f);
+    const float view[16] = {s.x, u.x, -f.x, 0, s.y, u.y, -f.y, 0, s.z, u.z, -f.z, 0,
+                            -dot(s, eye), -dot(u, eye), dot(f, eye), 1};
+    const float t = 1.0f / std::tan(fovY * 0.5f);
+    float proj[16] = {};
+    proj[0] = t / aspect;
+    proj[5] = t;
+    proj[10] = -(zFar + zNear) / (zFar - zNear);
+    proj[11] = -1.0f;
+    proj[14] = -2.0f * zFar * zNear / (zFar - zNear);
+    for (int c = 0; c < 4; ++c)
+        for (int r = 0; r < 4; ++r) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; ++k) sum += proj[k * 4 + r] * view[c * 4 + k];
+            out[c * 4 + r] = sum;
+        }
+}
+
+// FrustumCuller::cull (four boxes per SSE test where available) must
+// keep exactly the boxes frustumTestBox keeps, for random frusta and
+// boxes, many of them straddling a plane, and after updateBox()
+static void testFrustumCull() {
+    uint32_t rng = 23;
+    auto randomBox = [&] {
+        Vec3 c = {(nextUnit(rng) - 0.5f) * 400.0f, (nextUnit(rng) - 0.5f) * 100.0f,
+                  (nextUnit(rng) - 0.5f) * 400.0f};
+        Vec3 e = {nextUnit(rng) * 20.0f, nextUnit(rng) * 20.0f, nextUnit(rng) * 20.0f};
+        // Some flat boxes, like a chunk with a single layer
+        if (nextUnit(rng) < 0.1f) e.y = 0.0f;
+        return AABB{c - e, c + e};
+    };
+    const int BOXES = 4003;   // padding lanes in the last group
+    std::vector<AABB> boxes(BOXES);
+    for (AABB& b : boxes) b = randomBox();
+    FrustumCuller culler;
+    culler.setBoxes(boxes.data(), BOXES);
+    CHECK(culler.size() == BOXES);
+
+    int mismatches = 0, kept = 0, total = 0;
+    std::vector<int> visible, expected;
+    for (int i = 0; i < 200; ++i) {
+        if (i == 100)
+            for (int k = 0; k < BOXES; k += 7) culler.updateBox(k, boxes[k] = randomBox());
+        const Vec3 eye = {(nextUnit(rng) - 0.5f) * 300.0f, nextUnit(rng) * 80.0f,
+                          (nextUnit(rng) - 0.5f) * 300.0f};
+        const Vec3 target = {(nextUnit(rng) - 0.5f) * 300.0f, (nextUnit(rng) - 0.5f) * 40.0f,
+                             (nextUnit(rng) - 0.5f) * 300.0f};
+        float m[16];
+        viewProjection(eye, target, 0.3f + nextUnit(rng) * 1.2f, 0.5f + nextUnit(rng) * 2.0f,
+                       0.1f + nextUnit(rng), 50.0f + nextUnit(rng) * 300.0f, m);
+        Frustum frustum;
+        extractFrustum(m, frustum);
+        visible.clear();
+        expected.clear();
+        culler.cull(frustum, visible);
+        for (int k = 0; k < BOXES; ++k)
+            if (frustumTestBox(frustum, boxes[k])) expected.push_back(k);
+        mismatches += visible != expected;
+        kept += (int)expected.size();
+        total += BOXES;
+    }
+    CHECK(mismatches == 0);
+    // Frusta that keep some boxes and cull most
+    CHECK(kept > total / 100);
+    CHECK(kept < total / 2);
+
+    // A box at the target is kept and one behind the eye culled
+    float m[16];
+    viewProjection(Vec3{0, 10, 0}, Vec3{0, 10, -50}, 1.0f, 1.5f, 0.1f, 100.0f, m);
+    Frustum frustum;
+    extractFrustum(m, frustum);
+    CHECK(frustumTestBox(frustum, AABB{{-1, 9, -51}, {1, 11, -49}}));
+    CHECK(!frustumTestBox(frustum, AABB{{-1, 9, 49}, {1, 11, 51}}));
+}
+
+// --- Mesh cache ---
+
+static std::vector<uint8_t> readFile(const std::string& path) {
+    std::vector<uint8_t> bytes;
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return bytes;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) bytes.insert(bytes.end(), buf, buf + n);
+    std::fclose(f);
+    return bytes;
+}
+
+static bool writeFile(const std::string& path, const std::vector<uint8_t>& bytes) {
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = bytes.empty() || std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    return (std::fclose(f) == 0) && ok;
+}
+
+static bool fileExists(const std::string& path) {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (f) std::fclose(f);
+    return f != nullptr;
+}
+
+// A written cache reads back section by section; a flipped byte anywhere
+// that is checked, a truncated or extended file, another version or key
+// all read as a miss and leave the file closed. Writes go through a
+// temporary file, so none is left behind and a reader that mapped the
+// old file keeps seeing it whole.
+static void testMeshCache() {
+    const uint32_t TAG_VERT = meshCacheTag("VERT"), TAG_INDX = meshCacheTag("INDX");
+    const uint64_t key = MeshCacheKey().add("mesh-cache-test").add(1).value();
+    const std::string path = meshCachePath(".", "terrain-tests", key);
+    std::vector<float> vertices(3001);
+    std::vector<unsigned> indices(999);
+    uint32_t rng = 41;
+    for (float& v : vertices) v = nextUnit(rng);
+    for (unsigned& i : indices) i = (unsigned)(nextUnit(rng) * 3001.0f);
+
+    MeshCacheWriter writer;
+    writer.add(TAG_VERT, vertices);
+    writer.add(TAG_INDX, indices);
+    CHECK(writer.write(path, key));
+    CHECK(!fileExists(path + ".tmp"));
+
+    MeshCacheFile cache;
+    CHECK(cache.open(path, key));
+    std::vector<float> vertexCopy;
+    std::vector<unsigned> indexCopy;
+    CHECK(cache.copy(TAG_VERT, vertexCopy) && vertexCopy == vertices);
+    CHECK(cache.copy(TAG_INDX, indexCopy) && indexCopy == indices);
+    size_t count = 0;
+    const void* p = cache.array<float>(TAG_VERT, count);
+    CHECK(p && (uintptr_t)p % MESH_CACHE_ALIGN == 0 && count == vertices.size());
+    CHECK(cache.array<uint16_t>(TAG_INDX, count) == nullptr);
+    CHECK(cache.array<float>(meshCacheTag("NONE"), count) == nullptr && count == 0);
+    cache.close();
+    CHECK(!cache.isOpen());
+    CHECK(!cache.open(path, key + 1));
+    CHECK(!cache.isOpen());
+
+    const std::vector<uint8_t> good = readFile(path);
+    CHECK(good.size() % MESH_CACHE_ALIGN == 0);
+    const MeshCacheHeader header = *reinterpret_cast<const MeshCacheHeader*>(good.data());
+    const MeshCacheSection* table =
+        reinterpret_cast<const MeshCacheSection*>(good.data() + sizeof(MeshCacheHeader));
+    CHECK(header.sectionCount == 2);
+    auto rejects = [&](const std::vector<uint8_t>& bytes) {
+        if (!writeFile(path, bytes)) return false;
+        bool opened = cache.open(path, key);
+        return !opened && !cache.isOpen();
+    };
+    // A byte in each section, the section table, and the header
+    int accepted = 0;
+    for (uint32_t s = 0; s < header.sectionCount; ++s)
+        for (uint64_t at : {table[s].offset, table[s].offset + table[s].bytes / 2,
+                            table[s].offset + table[s].bytes - 1}) {
+            std::vector<uint8_t> bytes = good;
+            bytes[at] ^= 0x10;
+            accepted += !rejects(bytes);
+        }
+    for (size_t at : {sizeof(MeshCacheHeader), sizeof(MeshCacheHeader) + sizeof(MeshCacheSection) + 8,
+                      (size_t)0, offsetof(MeshCacheHeader, sectionCount)}) {
+        std::vector<uint8_t> bytes = good;
+        bytes[at] ^= 0x01;
+        accepted += !rejects(bytes);
+    }
+    CHECK(accepted == 0);
+    // Truncated anywhere, or with bytes appended
+    for (size_t size : {(size_t)0, (size_t)10, sizeof(MeshCacheHeader), good.size() / 2,
+                        good.size() - 1}) {
+        std::vector<uint8_t> bytes(good.begin(), good.begin() + size);
+        CHECK(rejects(bytes));
+    }
+    std::vector<uint8_t> longer = good;
+    longer.push_back(0);
+    CHECK(rejects(longer));
+    // Written by another format version
+    std::vector<uint8_t> bumped = good;
+    reinterpret_cast<MeshCacheHeader*>(bumped.data())->version = MESH_CACHE_VERSION + 1;
+    CHECK(rejects(bumped));
+    CHECK(writeFile(path, good));
+    CHECK(cache.open(path, key));
+
+    // Replacing the file under an open mapping leaves the mapping whole
+    std::vector<float> other(vertices.size(), 7.0f);
+    MeshCacheWriter replace;
+    replace.add(TAG_VERT, other);
+    CHECK(replace.write(path, key));
+    CHECK(cache.copy(TAG_VERT, vertexCopy) && vertexCopy == vertices);
+    cache.close();
+    CHECK(cache.open(path, key) && cache.copy(TAG_VERT, vertexCopy) && vertexCopy == other);
+    cache.close();
+
+    // A write that cannot even start leaves nothing behind
+    const std::string missingDir = meshCachePath("./no-such-dir", "terrain-tests", key);
+    CHECK(!writer.write(missingDir, key));
+    CHECK(!fileExists(missingDir) && !fileExists(missingDir + ".tmp"));
+    std::remove(path.c_str());
+}
+
+// --- Vertex cache ---
+
+// Triangles rotated so the smallest index leads, winding kept, and sorted
+static std::vector<unsigned> canonicalTriangles(const std::vector<unsigned>& indices) {
+    std::vector<std::vector<unsigned>> tris;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        std::vector<unsigned> tri(indices.begin() + t, indices.begin() + t + 3);
+        std::rotate(tri.begin(), std::min_element(tri.begin(), tri.end()), tri.end());
+        tris.push_back(tri);
+    }
+    std::sort(tris.begin(), tris.end());
+    std::vector<unsigned> out;
+    for (const std::vector<unsigned>& tri : tris) out.insert(out.end(), tri.begin(), tri.end());
+    return out;
+}
+
+// optimizeVertexCache() keeps every triangle and its winding, and never
+// makes ACMR worse than the input order under either cache model: grid
+// rows, the same grid shuffled, a voxel mesh and a mesh smaller than the
+// cache
+static void testVertexCache() {
+    ThreadPool pool;
+    const int W = 120, D = 90;
+    struct Input {
+        const char* name;
+        std::vector<unsigned> indices;
+        size_t vertexCount;
+    };
+    std::vector<Input> inputs(4);
+    inputs[0].name = "grid";
+    inputs[0].indices.resize(gridIndexCount(W, D));
+    inputs[0].vertexCount = (size_t)W * D;
+    buildGridIndices(W, D, pool, inputs[0].indices.data());
+
+    inputs[1] = inputs[0];
+    inputs[1].name = "shuffled grid";
+    uint32_t rng = 3;
+    std::vector<unsigned>& shuffled = inputs[1].indices;
+    for (size_t t = shuffled.size() / 3 - 1; t > 0; --t) {
+        size_t k = (size_t)(nextUnit(rng) * (t + 1));
+        for (int c = 0; c < 3; ++c) std::swap(shuffled[t * 3 + c], shuffled[k * 3 + c]);
+    }
+
+    VoxelColumns cols;
+    cols.resolution = 48;
+    cols.top.resize((size_t)cols.resolution * cols.resolution);
+    cols.material.assign(cols.top.size(), 0);
+    for (int& t : cols.top) t = 1 + (int)(nextUnit(rng) * 12.0f);
+    VoxelChunkMesh voxels;
+    meshVoxelRegion(cols, 0, 0, cols.resolution, cols.resolution, true, voxels);
+    inputs[2].name = "voxels";
+    inputs[2].indices = voxels.indices;
+    inputs[2].vertexCount = voxels.vertices.size() / VOXEL_VERTEX_FLOATS;
+
+    inputs[3].name = "small";
+    inputs[3].vertexCount = 5 * 4;
+    inputs[3].indices.resize(gridIndexCount(5, 4));
+    buildGridIndices(5, 4, pool, inputs[3].indices.data());
+
+    for (const Input& in : inputs) {
+        std::vector<unsigned> optimized(in.indices.size());
+        optimizeVertexCache(in.indices.data(), in.indices.size(), in.vertexCount, optimized.data());
+        CHECK(canonicalTriangles(optimized) == canonicalTriangles(in.indices));
+        // In place gives the same order
+        std::vector<unsigned> inPlace = in.indices;
+        optimizeVertexCache(inPlace.data(), inPlace.size(), in.vertexCount, inPlace.data());
+        CHECK(inPlace == optimized);
+        for (VertexCacheModel model : {VERTEX_CACHE_FIFO, VERTEX_CACHE_LRU}) {
+            VertexCacheStats before = analyzeVertexCache(in.indices.data(), in.indices.size(),
+                                                         in.vertexCount, VERTEX_CACHE_SIZE, model);
+            VertexCacheStats after = analyzeVertexCache(optimized.data(), optimized.size(),
+                                                        in.vertexCount, VERTEX_CACHE_SIZE, model);
+            if (after.acmr > before.acmr)
+                std::fprintf(stderr, "%s, %s: ACMR %.3f -> %.3f\n", in.name,
+                             model == VERTEX_CACHE_FIFO ? "FIFO" : "LRU", before.acmr, after.acmr);
+            CHECK(after.acmr <= before.acmr);
+            CHECK(after.triangles == before.triangles && after.vertices == before.vertices);
+            CHECK(after.atvr >= 1.0);
+        }
+    }
+    // A shuffled grid comes back close to the ideal 0.5
+    std::vector<unsigned> optimized(shuffled.size());
+    optimizeVertexCache(shuffled.data(), shuffled.size(), inputs[1].vertexCount, optimized.data());
+    CHECK(analyzeVertexCache(optimized.data(), optimized.size(), inputs[1].vertexCount).acmr < 0.75);
+    CHECK(analyzeVertexCache(shuffled.data(), shuffled.size(), inputs[1].vertexCount).acmr > 2.0);
+}
+
+// --- Mesh arena ---
+
+// Once the thread's arena has seen a chunk, meshing the same chunk again
+// takes no heap blocks, whether the scratch is released by a scope,
+// by rewinding to a marker or by reset(), and gives the same mesh
+static void testMeshArenaReuse() {
+    VoxelColumns cols;
+    cols.resolution = 66;
+    cols.step = 2.0f;
+    cols.voxelHeight = 0.5f;
+    cols.top.resize((size_t)cols.resolution * cols.resolution);
+    cols.material.resize(cols.top.size());
+    uint32_t rng = 8;
+    for (size_t i = 0; i < cols.top.size(); ++i) {
+        cols.top[i] = 1 + (int)(nextUnit(rng) * 30.0f);
+        cols.material[i] = (unsigned char)(nextUnit(rng) * 3.0f);
+    }
+    MeshArena& arena = threadMeshArena();
+    // Greedy on even passes, per face on odd ones
+    std::vector<float> refVertices[2];
+    std::vector<unsigned> refIndices[2];
+    auto meshChunk = [&](int pass) {
+        MeshBuilder mesh(arena, VOXEL_VERTEX_FLOATS);
+        AABB bounds;
+        MeshStats stats;
+        meshVoxelRegion(cols, 1, 1, 64, 64, pass % 2 == 0, mesh, bounds, stats);
+        const std::vector<float> vertices(mesh.vertices(),
+                                          mesh.vertices() + mesh.vertexCount() * VOXEL_VERTEX_FLOATS);
+        const std::vector<unsigned> indices(mesh.indices(), mesh.indices() + mesh.indexCount());
+        if (pass < 2) {
+            refVertices[pass] = vertices;
+            refIndices[pass] = indices;
+        }
+        return vertices == refVertices[pass % 2] && indices == refIndices[pass % 2];
+    };
+
+    // Warm-up: both meshing modes, then the reset that folds the blocks
+    // into one
+    for (int pass = 0; pass < 2; ++pass) {
+        MeshArenaScope scope(arena);
+        meshChunk(pass);
+    }
+    arena.reset();
+    const size_t warmBlocks = arena.stats().heapAllocations;
+    const size_t warmTotal = meshArenaHeapTotals().heapAllocations;
+    const size_t capacity = arena.capacity();
+    CHECK(capacity > 0);
+
+    int sameMesh = 0;
+    for (int pass = 2; pass < 8; ++pass) {
+        if (pass < 4) {
+            MeshArenaScope scope(arena);
+            sameMesh += meshChunk(pass);
+        } else if (pass < 6) {
+            const MeshArena::Marker start = arena.mark();
+            sameMesh += meshChunk(pass);
+            arena.rewind(start);
+        } else {
+            sameMesh += meshChunk(pass);
+            arena.reset();
+        }
+        CHECK(arena.bytesUsed() == 0);
+    }
+    CHECK(sameMesh == 6);
+    CHECK(arena.stats().heapAllocations == warmBlocks);
+    CHECK(meshArenaHeapTotals().heapAllocations == warmTotal);
+    CHECK(arena.capacity() == capacity);
+
+    // The streaming build through the same arena, after its own warm-up
+    ChunkManagerParams params;
+    params.terrain.resolution = 256;
+    params.terrain.worldSize = 1024.0f;
+    HeightSampler sampler = [](const float* wx, const float* wz, int count, float* h) {
+        for (int i = 0; i < count; ++i)
+            h[i] = 300.0f + 200.0f * std::sin(wx[i] * 0.01f) * std::cos(wz[i] * 0.013f);
+    };
+    StreamedChunk chunk;
+    ChunkManager::buildChunk(params, sampler, 2, 3, chunk);
+    arena.reset();
+    const size_t streamBlocks = arena.stats().heapAllocations;
+    for (int pass = 0; pass < 3; ++pass) CHECK(ChunkManager::buildChunk(params, sampler, 2, 3, chunk));
+    CHECK(arena.stats().heapAllocations == streamBlocks);
+    CHECK(chunk.ok && chunk.vertexCount > 0);
+}
+
+// --- Voxel editing ---
+
+// Random edits on the static world. After every update() a copy of the
+// GPU buffers that only receives uploads() (or everything after a
+// repack) must hold, chunk by chunk, what a full remesh of the edited
+// columns packs to, and the chunk ranges, bounds, collision boxes and
+// totals must match it too. Little headroom, so chunks move to the tail
+// and the buffers get repacked along the way.
+static void testVoxelEditRemesh() {
+    ThreadPool pool;
+    VoxelTerrainParams params;
+    params.resolution = 80;
+    params.chunkSize = 16;
+    params.worldSize = 160.0f;
+    params.voxelHeight = 1.0f;
+    params.grassH = 20.0f;
+    params.rockH = 40.0f;
+    HeightSampler sampler = [](const float* wx, const float* wz, int count, float* h) {
+        for (int i = 0; i < count; ++i)
+            h[i] = 25.0f + 15.0f * std::sin(wx[i] * 0.05f) * std::cos(wz[i] * 0.04f);
+    };
+    VoxelColumns cols;
+    VoxelMesh mesh;
+    generateVoxelColumns(params, sampler, pool, cols);
+    meshVoxelTerrain(cols, params, pool, mesh);
+    QuantFrame frame;
+    std::vector<PackedVoxelVertex> packed;
+    std::vector<uint16_t> indices;
+    CHECK(packVoxelMeshWorld(mesh, frame, packed));
+    CHECK(localChunkIndices16(mesh, indices));
+    VoxelEditor editor(cols, mesh, params, frame, packed.data(), packed.size(), indices.data(),
+                       indices.size(), 0.05f);
+    std::vector<PackedVoxelVertex> gpuVertices = editor.vertices();
+    std::vector<uint16_t> gpuIndices = editor.indices();
+
+    uint32_t rng = 61;
+    auto randomRect = [&] {
+        int x = (int)(nextUnit(rng) * cols.resolution), z = (int)(nextUnit(rng) * cols.resolution);
+        int w = 1 + (int)(nextUnit(rng) * 12.0f), d = 1 + (int)(nextUnit(rng) * 12.0f);
+        return VoxelEditRect{x - w / 2, z - d / 2, x + w - w / 2, z + d - d / 2};
+    };
+    int wrongUploads = 0, wrongChunks = 0, wrongBoxes = 0;
+    for (int round = 0; round < 40; ++round) {
+        const int edits = 1 + (int)(nextUnit(rng) * 6.0f);
+        for (int e = 0; e < edits; ++e) {
+            const int kind = (int)(nextUnit(rng) * 4.0f);
+            const int top = (int)(nextUnit(rng) * 60.0f);
+            if (kind == 0) {
+                editor.setColumn((int)(nextUnit(rng) * cols.resolution),
+                                 (int)(nextUnit(rng) * cols.resolution), top,
+                                 (int)(nextUnit(rng) * 3.0f));
+            } else if (kind == 1) {
+                editor.fill(randomRect(), top, (int)(nextUnit(rng) * 3.0f));
+            } else if (kind == 2) {
+                editor.carve(randomRect(), top / 2);
+            } else {
+                const Vec3 center = {cols.originX + nextUnit(rng) * params.worldSize,
+                                     20.0f + nextUnit(rng) * 20.0f,
+                                     cols.originZ + nextUnit(rng) * params.worldSize};
+                editor.carveSphere(center, 3.0f + nextUnit(rng) * 10.0f);
+            }
+        }
+        CHECK(editor.update(pool));
+        if (editor.fullUploadNeeded()) {
+            CHECK(editor.uploads().empty());
+            gpuVertices = editor.vertices();
+            gpuIndices = editor.indices();
+            editor.clearFullUpload();
+        }
+        wrongUploads += gpuVertices.size() != editor.vertices().size() ||
+                        gpuIndices.size() != editor.indices().size();
+        if (wrongUploads) break;
+        for (const VoxelUploadRange& u : editor.uploads()) {
+            std::copy(editor.vertices().begin() + u.firstVertex,
+                      editor.vertices().begin() + u.firstVertex + u.vertexCount,
+                      gpuVertices.begin() + u.firstVertex);
+            std::copy(editor.indices().begin() + u.firstIndex,
+                      editor.indices().begin() + u.firstIndex + u.indexCount,
+                      gpuIndices.begin() + u.firstIndex);
+        }
+
+        VoxelMesh full;
+        meshVoxelTerrain(cols, params, pool, full);
+        CHECK(full.chunks.size() == mesh.chunks.size());
+        for (size_t c = 0; c < full.chunks.size(); ++c) {
+            const ChunkRange& want = full.chunks[c];
+            const ChunkRange& got = mesh.chunks[c];
+            std::vector<PackedVoxelVertex> wantVertices(want.vertexCount);
+            CHECK(encodeVoxelVertices(full.vertices.data() + (size_t)want.baseVertex * VOXEL_VERTEX_FLOATS,
+                                      want.vertexCount, frame, cols.palette, 3, wantVertices.data()));
+            bool same = got.vertexCount == want.vertexCount && got.indexCount == want.indexCount &&
+                        std::memcmp(&got.bounds, &want.bounds, sizeof(AABB)) == 0 &&
+                        got.stats.vertices == want.stats.vertices &&
+                        got.stats.triangles == want.stats.triangles;
+            same = same && (want.vertexCount == 0 ||
+                            std::memcmp(&gpuVertices[got.baseVertex], wantVertices.data(),
+                                        want.vertexCount * sizeof(PackedVoxelVertex)) == 0);
+            for (unsigned i = 0; same && i < want.indexCount; ++i)
+                same = gpuIndices[got.firstIndex + i] == full.indices[want.firstIndex + i] - want.baseVertex;
+            wrongChunks += !same;
+        }
+        wrongBoxes += !sameBytes(full.collisionBoxes, mesh.collisionBoxes);
+        CHECK(full.stats.vertices == mesh.stats.vertices && full.stats.triangles == mesh.stats.triangles);
+    }
+    CHECK(wrongUploads == 0);
+    CHECK(wrongChunks == 0);
+    CHECK(wrongBoxes == 0);
+    CHECK(editor.stats().chunksRemeshed > 0);
+    CHECK(editor.stats().chunksMoved > 0);
+    CHECK(editor.stats().repacks > 0);
+}
+
+// --- Upload ring ---
+
+// Mapping in host memory; fences signal when the test says so, or on a
+// blocking wait when signalOnWait is set (the GPU catching up)
+class FakeUploadBackend : public UploadRingBackend {
+public:
+    bool signalOnWait = true;
+    int  mapped = 0, badDeletes = 0;
+    std::map<uintptr_t, bool> fences;   // live fences -> signaled
+
+    uint8_t* map(size_t bytes) override {
+        memory.assign(bytes, 0);
+        ++mapped;
+        return memory.data();
+    }
+    void unmap() override { --mapped; }
+    UploadFence insertFence() override {
+        fences[++lastFence] = false;
+        return (UploadFence)lastFence;
+    }
+    bool fenceSignaled(UploadFence fence, int64_t timeoutNs) override {
+        auto it = fences.find((uintptr_t)fence);
+        if (it == fences.end()) return true;
+        if (timeoutNs > 0 && signalOnWait) it->second = true;
+        return it->second;
+    }
+    void deleteFence(UploadFence fence) override { badDeletes += fences.erase((uintptr_t)fence) != 1; }
+    void signalAll() {
+        for (auto& f : fences) f.second = true;
+    }
+
+private:
+    std::vector<uint8_t> memory;
+    uintptr_t lastFence = 0;
+};
+
+// UploadRing accounting on a fake backend: alignment and padding, space
+// coming back only through signaled fences and in allocation order, the
+// wait path and its stall counter, and fences deleted exactly once
+static void testUploadRing() {
+    FakeUploadBackend backend;
+    UploadRing ring(backend, 1024);
+    CHECK(ring.valid() && ring.capacity() == 1024 && backend.mapped == 1);
+
+    UploadSlice a, b, c, d;
+    CHECK(ring.allocate(100, 16, a) && a.offset == 0 && a.bytes == 100);
+    CHECK(ring.allocate(50, 64, b) && b.offset == 128);
+    CHECK(b.data == a.data + 128);
+    CHECK(ring.stats().used == 178 && ring.stats().allocations == 2 && ring.stats().bytes == 150);
+    UploadSlice none;
+    CHECK(!ring.allocate(0, 16, none));
+    CHECK(!ring.allocate(1024, 16, none));
+    CHECK(ring.stats().failed == 2);
+
+    // Up to 1000; a slice never wraps, so the next one starts a new lap
+    CHECK(ring.allocate(822, 1, c) && c.offset == 178);
+    CHECK(!ring.allocate(100, 1, none));
+    CHECK(ring.stats().used == 1000 && ring.stats().highWater == 1000);
+
+    // Released out of order: b's space waits for a, which is still written
+    ring.release(b);
+    ring.endFrame();
+    CHECK(ring.stats().fences == 1);
+    backend.signalAll();
+    ring.endFrame();
+    CHECK(ring.stats().used == 1000);
+    ring.release(a);
+    ring.release(a);   // twice is harmless
+    ring.endFrame();
+    CHECK(ring.stats().fences == 2);
+    CHECK(ring.stats().used == 1000);
+    backend.signalAll();
+    ring.endFrame();
+    CHECK(ring.stats().used == 1000 - 178);
+    CHECK(backend.fences.empty() && backend.badDeletes == 0);
+
+    // The padding at the end of the lap counts as used
+    CHECK(ring.allocate(100, 1, d) && d.offset == 0 && d.data == a.data);
+    CHECK(ring.stats().used == 1024 - 178 + 100);
+
+    // Full, and the oldest slice is still being written: no wait possible
+    const uint64_t stalls = ring.stats().stalls;
+    CHECK(!ring.allocate(200, 1, none, true));
+    CHECK(ring.stats().stalls == stalls);
+    // Released but not fenced yet: the wait fences it and blocks on it
+    ring.release(c);
+    backend.signalOnWait = true;
+    UploadSlice e;
+    CHECK(ring.allocate(200, 1, e, true) && e.offset == 100);
+    CHECK(ring.stats().stalls == stalls + 1 && ring.stats().fences == 3);
+    // d still holds the padding before it
+    CHECK(ring.stats().used == 24 + 300);
+    // A fence that never signals on a poll leaves the space taken
+    ring.release(d);
+    ring.release(e);
+    backend.signalOnWait = false;
+    ring.endFrame();
+    CHECK(ring.stats().used == 24 + 300);
+    backend.signalAll();
+    ring.endFrame();
+    CHECK(ring.stats().used == 0);
+
+    // Workers allocate and release while the render thread fences; no
+    // slice ever overlaps one still in use
+    std::atomic<int> running{4}, corrupt{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t)
+        workers.emplace_back([&, t] {
+            uint32_t rng = 100 + t;
+            for (int i = 0; i < 2000;) {
+                UploadSlice s;
+                size_t bytes = 1 + (size_t)(nextUnit(rng) * 120.0f);
+                if (!ring.allocate(bytes, 8, s)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                std::memset(s.data, t + 1, bytes);
+                std::this_thread::yield();
+                for (size_t k = 0; k < bytes; ++k) corrupt += s.data[k] != t + 1;
+                ring.release(s);
+                ++i;
+            }
+            --running;
+        });
+    while (running > 0) {
+        ring.endFrame();
+        backend.signalAll();
+        std::this_thread::yield();
+    }
+    for (std::thread& w : workers) w.join();
+    ring.endFrame();
+    backend.signalAll();
+    ring.endFrame();
+    CHECK(corrupt == 0);
+    CHECK(ring.stats().used == 0);
+
+    // unmap() deletes the fences still pending, each once
+    CHECK(ring.allocate(10, 1, a) && ring.allocate(10, 1, b));
+    ring.release(a);
+    ring.release(b);
+    ring.endFrame();
+    CHECK(backend.fences.size() == 1);
+    ring.unmap();
+    CHECK(backend.fences.empty() && backend.badDeletes == 0 && backend.mapped == 0);
+    CHECK(!ring.valid() && !ring.allocate(10, 1, a));
+}
+
+// --- NoiseGraph ---
+
+// Samples where batch() and sample() of the same node differ in any bit
+template <class Node>
+static int noiseBatchDiffs(const Node& node, const std::vector<float>& xs,
+                           const std::vector<float>& ys) {
+    std::vector<float> batch(xs.size());
+    sampleNoise(node, xs.data(), ys.data(), (int)xs.size(), batch.data());
+    int diffs = 0;
+    for (size_t i = 0; i < xs.size(); ++i) {
+        float ref = node.sample(xs[i], ys[i]);
+        diffs += std::memcmp(&ref, &batch[i], sizeof(float)) != 0;
+    }
+    return diffs;
+}
+
+// Each combinator's batch path must give its sample path's bits, and a
+// shared node asked twice for the same points must compute them once
+static void testNoiseGraphBatch() {
+    const int COUNT = 517;
+    std::vector<float> xs(COUNT), ys(COUNT);
+    uint32_t rng = 31;
+    for (int i = 0; i < COUNT; ++i) {
+        xs[i] = (nextUnit(rng) - 0.5f) * (i < COUNT / 2 ? 16.0f : 2048.0f);
+        ys[i] = (nextUnit(rng) - 0.5f) * (i < COUNT / 2 ? 16.0f : 2048.0f);
+    }
+
+    Fbm<4, GradientNoise> fbm(GradientNoise(11));
+    fbm.lacunarity = 2.03f;
+    fbm.gain = 0.47f;
+    CHECK(noiseBatchDiffs(fbm, xs, ys) == 0);
+
+    Ridged<3, SimplexNoise> ridged(SimplexNoise(12));
+    ridged.weighting = 1.5f;
+    CHECK(noiseBatchDiffs(ridged, xs, ys) == 0);
+
+    typedef Fbm<2, SimplexNoise> Warp;
+    DomainWarp<Warp, GradientNoise> warped(Warp(SimplexNoise(13)), GradientNoise(14), 0.7f);
+    CHECK(noiseBatchDiffs(warped, xs, ys) == 0);
+
+    Blend<GradientNoise, Ridged<3, SimplexNoise>, SimplexNoise> blend(
+        GradientNoise(15), ridged, SimplexNoise(16));
+    blend.center = 0.1f;
+    blend.width = 0.5f;
+    CHECK(noiseBatchDiffs(blend, xs, ys) == 0);
+
+    // The continents drive both the warp and the mask
+    typedef Shared<0, Fbm<3, SimplexNoise>> Continents;
+    Continents continents(Fbm<3, SimplexNoise>(SimplexNoise(17)));
+    Blend<DomainWarp<Continents, GradientNoise>, Fbm<4, GradientNoise>, Continents> terrain(
+        DomainWarp<Continents, GradientNoise>(continents, GradientNoise(18), 2.0f), fbm,
+        continents);
+    CHECK(noiseBatchDiffs(terrain, xs, ys) == 0);
+
+    // The warp reads the continents at the points and at offset points;
+    // the mask's read of the points is the one repeat
+    std::vector<float> out(COUNT);
+    NoiseContext ctx(threadMeshArena());
+    terrain.batch(xs.data(), ys.data(), COUNT, out.data(), ctx);
+    CHECK(ctx.misses == 2 && ctx.hits == 1);
+}
+
+// A seed gives the same permutation every time and on every platform,
+// and a different seed gives a different one
+static void testNoisePermSeed() {
+    NoisePerm a = makeNoisePerm(1), b = makeNoisePerm(1), c = makeNoisePerm(2);
+    CHECK(std::memcmp(a.p, b.p, sizeof(a.p)) == 0);
+    CHECK(std::memcmp(a.p, c.p, sizeof(a.p)) != 0);
+    // splitmix64 and Fisher-Yates have no platform-dependent step
+    const uint8_t SEED1[8] = {86, 84, 62, 52, 122, 157, 182, 140};
+    CHECK(std::memcmp(a.p, SEED1, sizeof(SEED1)) == 0);
+
+    // Each half holds every byte once, and the halves match
+    int seen[256] = {};
+    for (int i = 0; i < 256; ++i) ++seen[a.p[i]];
+    CHECK(std::count(seen, seen + 256, 1) == 256);
+    CHECK(std::memcmp(a.p, a.p + 256, 256) == 0);
+
+    // Same for the noise built on the tables
+    GradientNoise g1(5), g2(5), g3(6);
+    SimplexNoise s1(5), s2(5), s3(6);
+    int gSame = 0, gOther = 0, sSame = 0, sOther = 0;
+    uint32_t rng = 8;
+    for (int i = 0; i < 256; ++i) {
+        float x = (nextUnit(rng) - 0.5f) * 100.0f, y = (nextUnit(rng) - 0.5f) * 100.0f;
+        gSame += g1.sample(x, y) == g2.sample(x, y);
+        gOther += g1.sample(x, y) == g3.sample(x, y);
+        sSame += s1.sample(x, y, 0.5f) == s2.sample(x, y, 0.5f);
+        sOther += s1.sample(x, y, 0.5f) == s3.sample(x, y, 0.5f);
+    }
+    CHECK(gSame == 256 && sSame == 256);
+    CHECK(gOther < 16 && sOther < 16);
+}
+
+// --- VoxelStore ---
+
+// A dense copy of the box [-16, 32)^3, which spans 27 chunks on both
+// sides of zero
+struct DenseVoxels {
+    static const int LO = -16, SIZE = 48;
+    std::vector<VoxelMaterial> v = std::vector<VoxelMaterial>(SIZE * SIZE * SIZE, VOXEL_AIR);
+
+    VoxelMaterial& at(int x, int y, int z) {
+        return v[((size_t)(x - LO) * SIZE + (z - LO)) * SIZE + (y - LO)];
+    }
+    void fill(int x0, int y0, int z0, int x1, int y1, int z1, VoxelMaterial m) {
+        for (int x = x0; x < x1; ++x)
+            for (int z = z0; z < z1; ++z)
+                for (int y = y0; y < y1; ++y) at(x, y, z) = m;
+    }
+};
+
+// Voxels of the box where the store and the dense copy disagree
+static int voxelMismatches(const VoxelStore& store, DenseVoxels& dense) {
+    const int LO = DenseVoxels::LO, HI = LO + DenseVoxels::SIZE;
+    int wrong = 0;
+    for (int x = LO; x < HI; ++x)
+        for (int z = LO; z < HI; ++z)
+            for (int y = LO; y < HI; ++y) wrong += store.get(x, y, z) != dense.at(x, y, z);
+    return wrong;
+}
+
+// Columns whose runs differ from the dense copy's, over a range that
+// sticks out of the box where everything is air
+static int runMismatches(const VoxelStore& store, DenseVoxels& dense, uint32_t& rng) {
+    const int LO = DenseVoxels::LO, HI = LO + DenseVoxels::SIZE;
+    int wrong = 0;
+    std::vector<VoxelRun> runs, expected;
+    for (int c = 0; c < 64; ++c) {
+        int x = LO + (int)(nextUnit(rng) * DenseVoxels::SIZE);
+        int z = LO + (int)(nextUnit(rng) * DenseVoxels::SIZE);
+        int y0 = LO - 8 + (int)(nextUnit(rng) * 40), y1 = y0 + 1 + (int)(nextUnit(rng) * 40);
+        expected.clear();
+        for (int y = y0; y < y1; ++y) {
+            VoxelMaterial m = y >= LO && y < HI ? dense.at(x, y, z) : VOXEL_AIR;
+            if (!expected.empty() && expected.back().material == m) ++expected.back().length;
+            else expected.push_back(VoxelRun{y, 1, m});
+        }
+        store.columnRuns(x, z, y0, y1, runs);
+        bool same = runs.size() == expected.size();
+        for (size_t i = 0; same && i < runs.size(); ++i)
+            same = runs[i].y == expected[i].y && runs[i].length == expected[i].length &&
+                   runs[i].material == expected[i].material;
+        wrong += !same;
+    }
+    return wrong;
+}
+
+// One chunk's indices widen through 1, 2, 4, 8 and 16 bits as materials
+// arrive, narrow again on compact(), and drop when the chunk is one
+// material
+static void testVoxelStoreWidths() {
+    VoxelStore store;
+    DenseVoxels dense;
+    const int INDEX_BYTES_PER_BIT = VOXEL_STORE_CHUNK_VOXELS / 8;
+    uint32_t rng = 5;
+    int next = 1;
+    // Air is the first palette entry, so 2^bits + 1 entries need the next width
+    for (int bits : {1, 2, 4, 8, 16}) {
+        const int entries = bits == 1 ? 2 : (1 << (bits / 2)) + 1;
+        for (; next < entries; ++next) {
+            int x = (int)(nextUnit(rng) * 16), y = (int)(nextUnit(rng) * 16);
+            int z = (int)(nextUnit(rng) * 16);
+            if (dense.at(x, y, z) != VOXEL_AIR) {
+                --next;   // keep every material in use
+                continue;
+            }
+            store.set(x, y, z, (VoxelMaterial)next);
+            dense.at(x, y, z) = (VoxelMaterial)next;
+        }
+        VoxelStoreStats s = store.stats();
+        CHECK(s.chunks == 1 && s.uniformChunks == 0 && s.paletteEntries == (size_t)entries);
+        CHECK(s.indexBytes == (size_t)bits * INDEX_BYTES_PER_BIT);
+        CHECK(voxelMismatches(store, dense) == 0);
+        CHECK(runMismatches(store, dense, rng) == 0);
+    }
+
+    // Clear all but materials 1 and 2: three entries left, so 2 bits
+    for (int x = 0; x < 16; ++x)
+        for (int z = 0; z < 16; ++z)
+            for (int y = 0; y < 16; ++y)
+                if (dense.at(x, y, z) > 2) {
+                    store.set(x, y, z, VOXEL_AIR);
+                    dense.at(x, y, z) = VOXEL_AIR;
+                }
+    CHECK(store.stats().indexBytes == 16 * INDEX_BYTES_PER_BIT);
+    store.compact();
+    VoxelStoreStats s = store.stats();
+    CHECK(s.paletteEntries == 3 && s.indexBytes == 2 * INDEX_BYTES_PER_BIT);
+    CHECK(voxelMismatches(store, dense) == 0);
+
+    // Writing material 9 everywhere collapses the chunk, voxel by voxel
+    for (int x = 0; x < 16; ++x)
+        for (int z = 0; z < 16; ++z)
+            for (int y = 0; y < 16; ++y) store.set(x, y, z, 9);
+    dense.fill(0, 0, 0, 16, 16, 16, 9);
+    s = store.stats();
+    CHECK(s.chunks == 1 && s.uniformChunks == 1 && s.indexBytes == 0);
+    CHECK(voxelMismatches(store, dense) == 0);
+    // And air everywhere drops it
+    for (int x = 0; x < 16; ++x)
+        for (int z = 0; z < 16; ++z)
+            for (int y = 0; y < 16; ++y) store.set(x, y, z, VOXEL_AIR);
+    CHECK(store.chunkCount() == 0);
+}
+
+// Random sets, fills and compactions against the dense copy: reads and
+// column runs must agree after every batch, and a chunk of one material
+// must be stored uniform
+static void testVoxelStoreRandom() {
+    const int LO = DenseVoxels::LO, SIZE = DenseVoxels::SIZE;
+    VoxelStore store;
+    DenseVoxels dense;
+    uint32_t rng = 2024;
+    auto coord = [&]() { return LO + (int)(nextUnit(rng) * SIZE); };
+    // Mostly a few materials, sometimes one of hundreds for wide palettes
+    auto material = [&]() {
+        float r = nextUnit(rng);
+        if (r < 0.3f) return VOXEL_AIR;
+        if (r < 0.9f) return (VoxelMaterial)(1 + (int)(nextUnit(rng) * 4));
+        return (VoxelMaterial)(5 + (int)(nextUnit(rng) * 600));
+    };
+    int wrongReads = 0, wrongRuns = 0, notUniform = 0;
+    for (int round = 0; round < 40; ++round) {
+        for (int op = 0; op < 400; ++op) {
+            int x = coord(), y = coord(), z = coord();
+            VoxelMaterial m = material();
+            store.set(x, y, z, m);
+            dense.at(x, y, z) = m;
+        }
+        for (int op = 0; op < 3; ++op) {
+            int x0 = coord(), y0 = coord(), z0 = coord();
+            int x1 = std::min(x0 + 1 + (int)(nextUnit(rng) * 24), LO + SIZE);
+            int y1 = std::min(y0 + 1 + (int)(nextUnit(rng) * 24), LO + SIZE);
+            int z1 = std::min(z0 + 1 + (int)(nextUnit(rng) * 24), LO + SIZE);
+            VoxelMaterial m = nextUnit(rng) < 0.5f ? VOXEL_AIR : material();
+            store.fill(x0, y0, z0, x1, y1, z1, m);
+            dense.fill(x0, y0, z0, x1, y1, z1, m);
+        }
+        // Some rounds set whole chunks, which must store uniform
+        if (round % 5 == 4) {
+            int cx = (int)(nextUnit(rng) * 3) - 1, cy = (int)(nextUnit(rng) * 3) - 1;
+            int cz = (int)(nextUnit(rng) * 3) - 1;
+            VoxelMaterial m = (VoxelMaterial)(1 + round);
+            store.fill(cx * 16, cy * 16, cz * 16, cx * 16 + 16, cy * 16 + 16, cz * 16 + 16, m);
+            dense.fill(cx * 16, cy * 16, cz * 16, cx * 16 + 16, cy * 16 + 16, cz * 16 + 16, m);
+        }
+        if (round % 7 == 6) store.compact();
+        wrongReads += voxelMismatches(store, dense);
+        wrongRuns += runMismatches(store, dense, rng);
+
+        // Chunks the dense copy says are one material, against the store
+        size_t uniform = 0, stored = 0;
+        for (int cx = -1; cx <= 1; ++cx)
+            for (int cy = -1; cy <= 1; ++cy)
+                for (int cz = -1; cz <= 1; ++cz) {
+                    VoxelMaterial first = dense.at(cx * 16, cy * 16, cz * 16);
+                    bool one = true;
+                    for (int i = 0; one && i < VOXEL_STORE_CHUNK_VOXELS; ++i)
+                        one = dense.at(cx * 16 + i / 256, cy * 16 + i % 16,
+                                       cz * 16 + i / 16 % 16) == first;
+                    stored += !(one && first == VOXEL_AIR);
+                    uniform += one && first != VOXEL_AIR;
+                }
+        VoxelStoreStats s = store.stats();
+        notUniform += s.chunks != stored || s.uniformChunks != uniform;
+    }
+    if (wrongReads || wrongRuns || notUniform)
+        std::fprintf(stderr, "%d voxels, %d columns, %d chunk counts wrong\n", wrongReads,
+                     wrongRuns, notUniform);
+    CHECK(wrongReads == 0 && wrongRuns == 0 && notUniform == 0);
+}
+
+// --- Quality controller ---
+
+// Frames fed until the controller changes level, or -1 if it holds for
+// all of them. The trace gets the frame number and the current level.
+template <class Trace>
+static int framesUntilChange(QualityController& qc, int limit, Trace trace) {
+    for (int f = 1; f <= limit; ++f)
+        if (qc.addFrame(trace(f, qc.level()))) return f;
+    return -1;
+}
+
+// With the defaults: a 30 frame window, 60 frames of hold and a 16.7 ms
+// budget whose downgrade and upgrade lines sit at 15.8 and 12.5 ms
+static void testQualityController() {
+    const QualityControllerParams params;
+    const int WINDOW = params.window, HOLD = params.upgradeHold;
+    auto fast = [](int, int) { return 10.0; };
+
+    // An over-budget step downgrades once the window's 90th percentile is
+    // over: three slow frames in thirty
+    QualityController qc(params);
+    const int top = qc.levels() - 1;
+    CHECK(framesUntilChange(qc, 200, fast) == -1 && qc.level() == top);
+    CHECK(framesUntilChange(qc, 30, [](int, int) { return 20.0; }) == 3);
+    CHECK(qc.level() == top - 1 && qc.stats().downgrades == 1);
+    // Staying slow steps down one level per refilled window, to the bottom
+    for (int l = top - 2; l >= 0; --l) {
+        CHECK(framesUntilChange(qc, 100, [](int, int) { return 20.0; }) == WINDOW);
+        CHECK(qc.level() == l);
+    }
+    CHECK(framesUntilChange(qc, 200, [](int, int) { return 20.0; }) == -1 && qc.level() == 0);
+
+    // Recovering, each level up waits for the hold, doubled since every
+    // level above the bottom was left once. The bottom's window still has
+    // slow frames, and the percentile is under once all but two are gone;
+    // the levels after start from an empty window.
+    CHECK(framesUntilChange(qc, 1000, fast) == WINDOW - 2 + 2 * HOLD - 1 && qc.level() == 1);
+    for (int l = 2; l <= top; ++l) {
+        CHECK(framesUntilChange(qc, 1000, fast) == WINDOW + 2 * HOLD - 1);
+        CHECK(qc.level() == l);
+    }
+    CHECK(qc.stats().upgrades == top && qc.stats().downgrades == top);
+
+    // Frames between the two lines move nothing, nor does one spike per
+    // window; a few slow frames restart the hold
+    QualityController jitter(params);
+    jitter.setLevel(3);
+    CHECK(framesUntilChange(jitter, 500, [](int f, int) { return f % 2 ? 11.0 : 14.0; }) == -1);
+    CHECK(framesUntilChange(jitter, 500, [](int f, int) { return f % 31 ? 13.0 : 30.0; }) ==
+          -1);
+    CHECK(framesUntilChange(jitter, 50, fast) == -1);
+    CHECK(framesUntilChange(jitter, 3, [](int, int) { return 14.0; }) == -1);
+    // The slow frames leave the window WINDOW - 3 frames later, then the
+    // whole hold again
+    CHECK(framesUntilChange(jitter, 1000, fast) == WINDOW - 3 + HOLD && jitter.level() == 4);
+
+    // Oscillating: the top level runs over budget and the one below runs
+    // well under it. Each return to the top waits twice as long as the
+    // one before, up to maxBackoff doublings, instead of every window.
+    QualityController osc(params);
+    auto cost = [&](int, int level) { return level == top ? 17.0 : 12.0; };
+    int wait = framesUntilChange(osc, 100, cost);
+    CHECK(wait == WINDOW && osc.level() == top - 1);
+    int framesAtTop = wait, total = wait, cycles = 0;
+    for (int leftTop = 1; leftTop <= params.maxBackoff + 3; ++leftTop) {
+        const int backoff = std::min(leftTop, params.maxBackoff);
+        wait = framesUntilChange(osc, 100000, cost);
+        CHECK(wait == WINDOW + (HOLD << backoff) - 1 && osc.level() == top);
+        total += wait;
+        wait = framesUntilChange(osc, 100, cost);
+        CHECK(wait == WINDOW && osc.level() == top - 1);
+        framesAtTop += wait;
+        total += wait;
+        ++cycles;
+    }
+    CHECK(osc.stats().downgrades == cycles + 1 && osc.stats().upgrades == cycles);
+    CHECK(framesAtTop * 20 < total);
+}
+
+// --- Driver ---
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+static const TestCase CASES[] = {
+    {"pacer", testFramePacer},
+    {"rendergraph", testRenderGraphChain},
+    {"rendergraph_outputs", testRenderGraphOutputs},
+    {"lod", testLodSelection},
+    {"postfx_graph", testPostGraph},
+    {"profiler_gpu", testProfilerGpuFrames},
+    {"profiler_cpu_zones", testProfilerCpuZones},
+    {"profiler_stats", testProfilerZoneStats},
+    {"profiler_dropped", testProfilerDroppedEvents},
+    {"profiler_trace", testProfilerChromeTrace},
+    {"raycast", testHeightfieldRaycast},
+    {"raycast_columns", testColumnRaycast},
+    {"noise_isa", testNoiseIsa},
+    {"parallel_determinism", testParallelDeterminism},
+    {"grid_normals", testGridNormals},
+    {"voxel_greedy_area", testVoxelGreedyArea},
+    {"vertex_format", testVertexFormat},
+    {"collision_bvh", testCollisionBvh},
+    {"frustum_cull", testFrustumCull},
+    {"mesh_cache", testMeshCache},
+    {"vertex_cache", testVertexCache},
+    {"mesh_arena", testMeshArenaReuse},
+    {"voxel_edit", testVoxelEditRemesh},
+    {"upload_ring", testUploadRing},
+    {"noise_graph_batch", testNoiseGraphBatch},
+    {"noise_perm_seed", testNoisePermSeed},
+    {"voxel_store_widths", testVoxelStoreWidths},
+    {"voxel_store_random", testVoxelStoreRandom},
+    {"quality_controller", testQualityController},
+};
+
+int main(int argc, char** argv) {
+    int ran = 0;
+    for (const TestCase& c : CASES) {
+        bool wanted = argc < 2;
+        for (int i = 1; i < argc; ++i) wanted |= std::strcmp(argv[i], c.name) == 0;
+        if (!wanted) continue;
+        int before = failures;
+        c.run();
+        std::printf("%-12s %s\n", c.name, failures == before ? "ok" : "FAILED");
+        ++ran;
+    }
+    if (ran == 0) {
+        std::fprintf(stderr, "no test case matches\n");
+        return 2;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+// ThreadPool.cpp
+#include "ThreadPool.h"
+
+// Which pool/worker the current thread belongs to; -1 outside any pool
+static thread_local const ThreadPool* tlsPool   = nullptr;
+static thread_local int               tlsWorker = -1;
+
+ThreadPool::ThreadPool(unsigned workers) {
+    if (workers == 0) {
+        unsigned hw = std::thread::hardware_concurrency();
+        workers = hw > 1 ? hw - 1 : 0;
+    }
+    // One queue per worker plus one shared by outside threads
+    for (unsigned i = 0; i <= workers; ++i)
+        queues.emplace_back(new Queue);
+    for (unsigned i = 0; i < workers; ++i)
+        threads.emplace_back(&ThreadPool::workerLoop, this, (int)i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+int ThreadPool::currentWorker() const {
+    return tlsPool == this ? tlsWorker : -1;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    int self = currentWorker();
+    int q = self >= 0 ? self : (int)(nextQueue.fetch_add(1) % queues.size());
+    pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queues[q]->m);
+        queues[q]->tasks.push_back(std::move(task));
+    }
+    // Take the sleep lock so a worker between its check and its wait
+    // cannot miss this notification
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wake.notify_one();
+}
+
+bool ThreadPool::tryRunOne(int self) {
+    std::function<void()> task;
+    int n = (int)queues.size();
+    // Own queue first (LIFO keeps caches warm), then steal FIFO from others
+    if (self >= 0) {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.m);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+    for (int i = 1; !task && i <= n; ++i) {
+        Queue& victim = *queues[(self + i + n) % n];
+        std::lock_guard<std::mutex> lock(victim.m);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+    if (!task) return false;
+    pending.fetch_sub(1);
+    task();
+    return true;
+}
+
+void ThreadPool::workerLoop(int index) {
+    tlsPool   = this;
+    tlsWorker = index;
+    for (;;) {
+        if (tryRunOne(index)) continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || pending.load() > 0; });
+        if (stopping && pending.load() == 0) return;
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& fn) {
+    if (count <= 0) return;
+    if (count == 1 || threads.empty()) {
+        for (int i = 0; i < count; ++i) fn(i);
+        return;
+    }
+    std::atomic<int> remaining(count);
+    // Deal tasks round-robin so every worker starts with local work
+    int n = (int)queues.size();
+    pending.fetch_add(count);
+    for (int i = 0; i < count; ++i) {
+        Queue& q = *queues[i % n];
+        std::lock_guard<std::mutex> lock(q.m);
+        q.tasks.push_back([&fn, &remaining, i] {
+            fn(i);
+            remaining.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wake.notify_all();
+
+    int self = currentWorker();
+    if (self < 0) self = n - 1;   // outside threads work the shared queue
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (!tryRunOne(self)) std::this_thread::yield();
+    }
+}
+
+void parallelForTiles(ThreadPool& pool, int width, int depth, int tileSize,
+                      const std::function<void(int, int, int, int)>& fn) {
+    if (width <= 0 || depth <= 0) return;
+    if (tileSize <= 0) tileSize = 64;
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int tilesZ = (depth + tileSize - 1) / tileSize;
+    pool.parallelFor(tilesX * tilesZ, [&](int t) {
+        int x0 = (t % tilesX) * tileSize;
+        int z0 = (t / tilesX) * tileSize;
+        int w  = width - x0 < tileSize ? width - x0 : tileSize;
+        int h  = depth - z0 < tileSize ? depth - z0 : tileSize;
+        fn(x0, z0, w, h);
+    });
+}
@@ -0,0 +1,57 @@
+// ThreadPool.h
+// Work-stealing thread pool. Each worker owns a deque: it pops its own
+// work from the back and steals from the front of the others when idle.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // workers == 0 picks hardware_concurrency() - 1; the thread calling
+    // parallelFor() always helps, so a pool with no workers still works.
+    explicit ThreadPool(unsigned workers = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Threads that execute parallelFor() work, including the caller
+    unsigned concurrency() const { return (unsigned)threads.size() + 1; }
+
+    // Queue a task and return immediately
+    void submit(std::function<void()> task);
+
+    // Run fn(0..count-1) and wait for all of them. The caller runs tasks
+    // while it waits, so nested calls from inside a task do not deadlock.
+    void parallelFor(int count, const std::function<void(int)>& fn);
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool tryRunOne(int self);
+    void workerLoop(int index);
+    int  currentWorker() const;
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<int>      pending{0};     // queued, not yet started
+    std::atomic<unsigned> nextQueue{0};   // round-robin for outside threads
+    std::mutex              sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+// Split a width x depth grid into tileSize squares and run fn on each tile
+// in parallel. fn(x0, z0, w, h) gets the tile origin and its clipped size.
+void parallelForTiles(ThreadPool& pool, int width, int depth, int tileSize,
+                      const std::function<void(int, int, int, int)>& fn);
@@ -0,0 +1,152 @@
+// UploadRing.cpp
+#include "UploadRing.h"
+
+#include <algorithm>
+#include <chrono>
+
+// Longest single fence wait before checking again
+static const int64_t FENCE_WAIT_NS = 1000000000;
+
+static int64_t steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+UploadRing::UploadRing(UploadRingBackend& b, size_t capacity)
+    : backend(b), size(capacity) {
+    base = size ? backend.map(size) : nullptr;
+    if (!base) size = 0;
+    lastFrameNs = steadyNs();
+}
+
+void UploadRing::unmap() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!base) return;
+    // GL keeps a deleted buffer alive until the GPU is done with it, so
+    // there is nothing to wait for; each fence goes once
+    for (size_t i = 0; i < records.size(); ++i) {
+        if (records[i].state != FENCED) continue;
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; ++j) seen = records[j].fence == records[i].fence;
+        if (!seen) backend.deleteFence(records[i].fence);
+    }
+    backend.unmap();
+    base = nullptr;
+    records.clear();
+    counters.used = 0;
+}
+
+bool UploadRing::tryAllocate(size_t bytes, size_t alignment, UploadSlice& out) {
+    size_t offset = (size_t)(head % size);
+    size_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+    // A slice never wraps; the rest of the lap becomes padding
+    uint64_t start = head - offset + aligned;
+    if (aligned + bytes > size) {
+        start = head - offset + size;
+        aligned = 0;
+    }
+    uint64_t end = start + bytes;
+    if (end - tail > size) return false;
+
+    out.data   = base + aligned;
+    out.offset = aligned;
+    out.bytes  = bytes;
+    out.id     = firstId + records.size();
+    records.push_back(Record{head, end, WRITING, nullptr});
+    head = end;
+
+    ++counters.allocations;
+    counters.bytes += bytes;
+    frameBytes += bytes;
+    counters.used = (size_t)(head - tail);
+    counters.highWater = std::max(counters.highWater, counters.used);
+    return true;
+}
+
+void UploadRing::fenceReleased() {
+    bool released = false;
+    for (const Record& r : records) released = released || r.state == RELEASED;
+    if (!released) return;
+    UploadFence fence = backend.insertFence();
+    ++counters.fences;
+    for (Record& r : records) {
+        if (r.state != RELEASED) continue;
+        r.state = FENCED;
+        r.fence = fence;
+    }
+}
+
+bool UploadRing::allocate(size_t bytes, size_t alignment, UploadSlice& out, bool wait) {
+    if (alignment == 0) alignment = 1;
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!base || bytes == 0 || bytes + alignment - 1 > size) {
+        ++counters.failed;
+        return false;
+    }
+    while (!tryAllocate(bytes, alignment, out)) {
+        if (!wait || records.empty()) {
+            ++counters.failed;
+            return false;
+        }
+        // Wait for the oldest slice. Released slices get their fence now;
+        // one still being written cannot be waited for.
+        Record& front = records.front();
+        if (front.state == WRITING) {
+            ++counters.failed;
+            return false;
+        }
+        if (front.state == RELEASED) fenceReleased();
+        UploadFence fence = front.fence;
+        lock.unlock();
+        int64_t t0 = steadyNs();
+        while (!backend.fenceSignaled(fence, FENCE_WAIT_NS)) {}
+        int64_t waited = steadyNs() - t0;
+        lock.lock();
+        ++counters.stalls;
+        counters.stallMs += waited * 1e-6;
+        reclaim();
+    }
+    return true;
+}
+
+void UploadRing::release(const UploadSlice& slice) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (slice.id < firstId || slice.id >= firstId + records.size()) return;
+    Record& r = records[(size_t)(slice.id - firstId)];
+    if (r.state == WRITING) r.state = RELEASED;
+}
+
+void UploadRing::reclaim() {
+    // One fence covers several records; delete it with the last of them
+    while (!records.empty() && records.front().state == FENCED &&
+           backend.fenceSignaled(records.front().fence, 0)) {
+        UploadFence fence = records.front().fence;
+        while (!records.empty() && records.front().state == FENCED &&
+               records.front().fence == fence) {
+            tail = records.front().end;
+            records.pop_front();
+            ++firstId;
+        }
+        bool shared = false;
+        for (const Record& r : records) shared = shared || r.fence == fence;
+        if (!shared) backend.deleteFence(fence);
+    }
+    counters.used = (size_t)(head - tail);
+}
+
+void UploadRing::endFrame() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!base) return;
+    fenceReleased();
+    reclaim();
+
+    int64_t now = steadyNs();
+    if (now > lastFrameNs) counters.mbPerSecond = frameBytes / ((now - lastFrameNs) * 1e-9) / 1048576.0;
+    frameBytes = 0;
+    lastFrameNs = now;
+}
+
+UploadRingStats UploadRing::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
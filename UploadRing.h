@@ -0,0 +1,116 @@
+// UploadRing.h
+// Streaming upload space: one persistently mapped, coherent buffer used
+// as a ring. Producers write mesh data straight into the mapping, with no
+// staging copy, and the render thread hands the written ranges to the GPU
+// (a buffer-to-buffer copy, or a draw from the ring itself). Space comes
+// back through fences: a slice is reused only once the GPU has passed the
+// fence of the frame that consumed it.
+//
+// allocate() may be called from any thread; a worker gets a slice or a
+// failure right away, since waiting on a fence needs the GL context. The
+// render thread can pass wait = true to block on the oldest fence instead,
+// which counts as a stall. Slices are released in any order, but space is
+// reclaimed in allocation order.
+//
+// The GL side sits behind UploadRingBackend; UploadRingGL.h has the
+// OpenGL one (GL 4.4 or ARB_buffer_storage).
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+typedef void* UploadFence;
+
+class UploadRingBackend {
+public:
+    virtual ~UploadRingBackend() {}
+    // Creates and maps the ring buffer; nullptr if persistent mapping is
+    // unavailable
+    virtual uint8_t*    map(size_t bytes) = 0;
+    virtual void        unmap() = 0;
+    // Fence after every GPU command issued so far
+    virtual UploadFence insertFence() = 0;
+    // Whether the GPU has passed the fence, waiting up to timeoutNs
+    virtual bool        fenceSignaled(UploadFence fence, int64_t timeoutNs) = 0;
+    virtual void        deleteFence(UploadFence fence) = 0;
+};
+
+// Write-only window into the mapped ring
+struct UploadSlice {
+    uint8_t* data = nullptr;
+    size_t   offset = 0;       // from the start of the ring buffer
+    size_t   bytes = 0;
+    uint64_t id = 0;           // for release()
+};
+
+struct UploadRingStats {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;              // allocated in total
+    uint64_t failed = 0;             // no room and no wait, or larger than the ring
+    uint64_t stalls = 0;             // blocking waits on a fence
+    double   stallMs = 0.0;
+    uint64_t fences = 0;
+    size_t   used = 0;               // allocated and not yet reclaimed, padding included
+    size_t   highWater = 0;
+    double   mbPerSecond = 0.0;      // allocated bytes over the last endFrame() interval
+};
+
+class UploadRing {
+public:
+    // Maps `capacity` bytes through the backend; check valid()
+    UploadRing(UploadRingBackend& backend, size_t capacity);
+    ~UploadRing() { unmap(); }
+
+    UploadRing(const UploadRing&) = delete;
+    UploadRing& operator=(const UploadRing&) = delete;
+
+    bool   valid() const { return base != nullptr; }
+    size_t capacity() const { return size; }
+
+    // Reserves bytes at an offset aligned to `alignment` (a power of two).
+    // The data must be written before the slice is released.
+    bool allocate(size_t bytes, size_t alignment, UploadSlice& out, bool wait = false);
+    // The GPU commands reading the slice have been issued (or it is no
+    // longer needed); its space returns after the next endFrame() fence
+    void release(const UploadSlice& slice);
+
+    // Render thread, once per frame after the frame's GPU commands: fences
+    // the slices released since the last call and reclaims those whose
+    // fence has passed
+    void endFrame();
+
+    UploadRingStats stats() const;
+
+    // Deletes the fences and unmaps; call while the backend's context is
+    // alive. The destructor calls it too, which is too late once the
+    // window is gone.
+    void unmap();
+
+private:
+    enum State { WRITING, RELEASED, FENCED };
+
+    struct Record {
+        uint64_t    begin, end;      // ring positions, padding included
+        State       state;
+        UploadFence fence;
+    };
+
+    bool tryAllocate(size_t bytes, size_t alignment, UploadSlice& out);
+    void fenceReleased();
+    void reclaim();
+
+    UploadRingBackend& backend;
+    uint8_t* base = nullptr;
+    size_t   size;
+
+    // Positions count bytes since construction; the offset is pos % size
+    mutable std::mutex mutex;
+    uint64_t head = 0, tail = 0;
+    uint64_t firstId = 0;            // id of records.front()
+    std::deque<Record> records;      // oldest first
+    UploadRingStats counters;
+    uint64_t frameBytes = 0;
+    int64_t  lastFrameNs = 0;
+};
@@ -0,0 +1,98 @@
+// UploadRingGL.h
+// OpenGL backend for UploadRing: an immutable buffer mapped once with
+// GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT, and GLsync fences. Coherent
+// mapping means CPU writes are visible to commands issued after them with
+// no flush. Needs GL 4.4 or ARB_buffer_storage both in the loader and at
+// run time; otherwise map() fails and callers keep their old upload path.
+// Mesa's llvmpipe has it. Include after the GL loader (glew or glad);
+// header-only like RenderGraphGL.h.
+#pragma once
+
+#include "UploadRing.h"
+
+#include <cstring>
+
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define UPLOAD_RING_GL_STORAGE 1
+#else
+#define UPLOAD_RING_GL_STORAGE 0
+#endif
+
+class GLUploadRingBackend : public UploadRingBackend {
+public:
+    // Whether the running context can map persistently
+    static bool supported() {
+#if UPLOAD_RING_GL_STORAGE
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major > 4 || (major == 4 && minor >= 4)) return glBufferStorage != nullptr;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i) {
+            const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (ext && std::strcmp(ext, "GL_ARB_buffer_storage") == 0) return glBufferStorage != nullptr;
+        }
+#endif
+        return false;
+    }
+
+    uint8_t* map(size_t bytes) override {
+#if UPLOAD_RING_GL_STORAGE
+        if (!supported()) return nullptr;
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &ring);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ring);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)bytes, nullptr, flags);
+        void* p = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr)bytes, flags);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if (!p) {
+            glDeleteBuffers(1, &ring);
+            ring = 0;
+        }
+        return (uint8_t*)p;
+#else
+        (void)bytes;
+        return nullptr;
+#endif
+    }
+
+    void unmap() override {
+        if (!ring) return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ring);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &ring);
+        ring = 0;
+    }
+
+    UploadFence insertFence() override { return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); }
+
+    bool fenceSignaled(UploadFence fence, int64_t timeoutNs) override {
+        // Flush on a blocking wait, or a fence still in the command queue
+        // would never signal. A failed wait (lost context) counts as
+        // signaled so callers never spin on it.
+        GLenum r = glClientWaitSync((GLsync)fence, timeoutNs > 0 ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                    (GLuint64)timeoutNs);
+        return r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED || r == GL_WAIT_FAILED;
+    }
+
+    void deleteFence(UploadFence fence) override { glDeleteSync((GLsync)fence); }
+
+    // The ring buffer, for glCopyBufferSubData or as a vertex source
+    GLuint buffer() const { return ring; }
+
+    // Copies a written slice into dst at dstOffset on the GPU. Release the
+    // slice after this.
+    void copy(const UploadSlice& slice, size_t sliceOffset, GLuint dst, size_t dstOffset,
+              size_t bytes) const {
+        glBindBuffer(GL_COPY_READ_BUFFER, ring);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            (GLintptr)(slice.offset + sliceOffset), (GLintptr)dstOffset,
+                            (GLsizeiptr)bytes);
+    }
+
+private:
+    GLuint ring = 0;
+};
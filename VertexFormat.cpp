@@ -0,0 +1,198 @@
+// VertexFormat.cpp
+#include "VertexFormat.h"
+
+#include <cmath>
+
+const Vec3 FACE_NORMAL_TABLE[6] = {
+    { 1, 0, 0}, {-1, 0, 0},
+    { 0, 1, 0}, { 0,-1, 0},
+    { 0, 0, 1}, { 0, 0,-1}
+};
+
+const VertexLayout PACKED_VOXEL_LAYOUT = {
+    sizeof(PackedVoxelVertex), 2, {
+        {0, 3, VERTEX_TYPE_SHORT,         false, false, 0},
+        {1, 2, VERTEX_TYPE_UNSIGNED_BYTE, false, true,  6},
+    }
+};
+
+const VertexLayout PACKED_TERRAIN_LAYOUT = {
+    sizeof(PackedTerrainVertex), 2, {
+        {0, 3, VERTEX_TYPE_SHORT, false, false, 0},
+        {1, 2, VERTEX_TYPE_BYTE,  true,  false, 6},
+    }
+};
+
+const VertexLayout LOD_MORPH_LAYOUT = {
+    sizeof(int16_t), 1, {
+        {2, 1, VERTEX_TYPE_SHORT, false, false, 0},
+    }
+};
+
+const VertexLayout FLOAT_TERRAIN_LAYOUT = {
+    sizeof(FloatTerrainVertex), 2, {
+        {0, 3, VERTEX_TYPE_FLOAT, false, false, 0},
+        {1, 2, VERTEX_TYPE_FLOAT, false, false, 12},
+    }
+};
+
+const VertexLayout FLOAT_MORPH_LAYOUT = {
+    sizeof(float), 1, {
+        {2, 1, VERTEX_TYPE_FLOAT, false, false, 0},
+    }
+};
+
+static const float INT16_STEPS = 65535.0f;
+
+QuantFrame makeQuantFrame(const AABB& bounds) {
+    QuantFrame f;
+    Vec3 extent = bounds.max - bounds.min;
+    f.scale = {extent.x > 0 ? extent.x / INT16_STEPS : 1.0f,
+               extent.y > 0 ? extent.y / INT16_STEPS : 1.0f,
+               extent.z > 0 ? extent.z / INT16_STEPS : 1.0f};
+    // q = -32768 lands on bounds.min
+    f.origin = bounds.min + f.scale * 32768.0f;
+    return f;
+}
+
+Vec3 quantFrameMaxError(const QuantFrame& frame) {
+    return frame.scale * 0.5f;
+}
+
+int faceIndexOf(const Vec3& n) {
+    for (int f = 0; f < 6; ++f)
+        if (n.x == FACE_NORMAL_TABLE[f].x && n.y == FACE_NORMAL_TABLE[f].y &&
+            n.z == FACE_NORMAL_TABLE[f].z)
+            return f;
+    return -1;
+}
+
+static inline float signNotZero(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+
+void octEncode(const Vec3& n, float& u, float& v) {
+    float s = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    float x = n.x / s, y = n.y / s;
+    if (n.z < 0.0f) {
+        u = (1.0f - std::fabs(y)) * signNotZero(x);
+        v = (1.0f - std::fabs(x)) * signNotZero(y);
+    } else {
+        u = x;
+        v = y;
+    }
+}
+
+Vec3 octDecode(float u, float v) {
+    Vec3 n = {u, v, 1.0f - std::fabs(u) - std::fabs(v)};
+    if (n.z < 0.0f) {
+        n.x = (1.0f - std::fabs(v)) * signNotZero(u);
+        n.y = (1.0f - std::fabs(u)) * signNotZero(v);
+    }
+    return normalize(n);
+}
+
+static inline int8_t toSnorm8(float f) {
+    float c = f < -1.0f ? -1.0f : (f > 1.0f ? 1.0f : f);
+    return (int8_t)std::lround(c * 127.0f);
+}
+
+// Same rule as GL's snorm conversion: max(c / 127, -1)
+static inline float fromSnorm8(int8_t c) {
+    float f = c / 127.0f;
+    return f < -1.0f ? -1.0f : f;
+}
+
+static inline bool quantize(float p, float origin, float scale, int16_t& q) {
+    long v = std::lround((p - origin) / scale);
+    if (v < -32768 || v > 32767) return false;
+    q = (int16_t)v;
+    return true;
+}
+
+bool encodeVoxelVertices(const float* vertices, size_t count, const QuantFrame& frame,
+                         const Vec3* palette, int paletteSize, PackedVoxelVertex* out) {
+    for (size_t i = 0; i < count; ++i) {
+        const float* v = vertices + i * 9;
+        PackedVoxelVertex& o = out[i];
+        if (!quantize(v[0], frame.origin.x, frame.scale.x, o.x) ||
+            !quantize(v[1], frame.origin.y, frame.scale.y, o.y) ||
+            !quantize(v[2], frame.origin.z, frame.scale.z, o.z))
+            return false;
+        int face = faceIndexOf({v[3], v[4], v[5]});
+        if (face < 0) return false;
+        o.face = (uint8_t)face;
+        int color = -1;
+        for (int c = 0; c < paletteSize && c < 256; ++c) {
+            if (palette[c].x == v[6] && palette[c].y == v[7] && palette[c].z == v[8]) {
+                color = c;
+                break;
+            }
+        }
+        if (color < 0) return false;
+        o.color = (uint8_t)color;
+    }
+    return true;
+}
+
+void decodeVoxelVertices(const PackedVoxelVertex* in, size_t count, const QuantFrame& frame,
+                         const Vec3* palette, float* vertices) {
+    for (size_t i = 0; i < count; ++i) {
+        const PackedVoxelVertex& p = in[i];
+        float* v = vertices + i * 9;
+        v[0] = frame.origin.x + p.x * frame.scale.x;
+        v[1] = frame.origin.y + p.y * frame.scale.y;
+        v[2] = frame.origin.z + p.z * frame.scale.z;
+        const Vec3& n = FACE_NORMAL_TABLE[p.face];
+        v[3] = n.x; v[4] = n.y; v[5] = n.z;
+        const Vec3& c = palette[p.color];
+        v[6] = c.x; v[7] = c.y; v[8] = c.z;
+    }
+}
+
+bool encodeTerrainVertices(const float* positions, const float* normals, size_t count,
+                           const QuantFrame& frame, PackedTerrainVertex* out) {
+    for (size_t i = 0; i < count; ++i) {
+        const float* p = positions + i * 3;
+        const float* n = normals + i * 3;
+        PackedTerrainVertex& o = out[i];
+        if (!quantize(p[0], frame.origin.x, frame.scale.x, o.x) ||
+            !quantize(p[1], frame.origin.y, frame.scale.y, o.y) ||
+            !quantize(p[2], frame.origin.z, frame.scale.z, o.z))
+            return false;
+        float u, v;
+        octEncode({n[0], n[1], n[2]}, u, v);
+        o.octU = toSnorm8(u);
+        o.octV = toSnorm8(v);
+    }
+    return true;
+}
+
+void decodeTerrainVertices(const PackedTerrainVertex* in, size_t count, const QuantFrame& frame,
+                           float* positions, float* normals) {
+    for (size_t i = 0; i < count; ++i) {
+        const PackedTerrainVertex& t = in[i];
+        float* p = positions + i * 3;
+        p[0] = frame.origin.x + t.x * frame.scale.x;
+        p[1] = frame.origin.y + t.y * frame.scale.y;
+        p[2] = frame.origin.z + t.z * frame.scale.z;
+        Vec3 n = octDecode(fromSnorm8(t.octU), fromSnorm8(t.octV));
+        float* o = normals + i * 3;
+        o[0] = n.x; o[1] = n.y; o[2] = n.z;
+    }
+}
+
+void encodeFloatTerrainVertices(const float* positions, const float* normals, size_t count,
+                                FloatTerrainVertex* out) {
+    for (size_t i = 0; i < count; ++i) {
+        const float* p = positions + i * 3;
+        const float* n = normals + i * 3;
+        FloatTerrainVertex& o = out[i];
+        o.x = p[0]; o.y = p[1]; o.z = p[2];
+        octEncode({n[0], n[1], n[2]}, o.octU, o.octV);
+    }
+}
+
+bool encodeHeights(const float* heights, size_t count, const QuantFrame& frame, int16_t* out) {
+    for (size_t i = 0; i < count; ++i)
+        if (!quantize(heights[i], frame.origin.y, frame.scale.y, out[i])) return false;
+    return true;
+}
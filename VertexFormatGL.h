@@ -0,0 +1,20 @@
+// VertexFormatGL.h
+// Binds a VertexLayout to the current VAO. Include after the GL loader
+// (glew or glad); header-only so it works with whichever one the
+// program uses.
+#pragma once
+
+#include "VertexFormat.h"
+
+inline void applyVertexLayout(const VertexLayout& layout) {
+    for (int i = 0; i < layout.count; ++i) {
+        const VertexAttribLayout& a = layout.attribs[i];
+        const void* offset = (const void*)(size_t)a.offset;
+        if (a.integer)
+            glVertexAttribIPointer(a.index, a.size, (GLenum)a.type, layout.stride, offset);
+        else
+            glVertexAttribPointer(a.index, a.size, (GLenum)a.type,
+                                  a.normalized ? GL_TRUE : GL_FALSE, layout.stride, offset);
+        glEnableVertexAttribArray(a.index);
+    }
+}
@@ -0,0 +1,244 @@
+// VoxelEditor.cpp
+#include "VoxelEditor.h"
+#include "CollisionIndex.h"
+#include "HeightfieldQuery.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+VoxelEditor::VoxelEditor(VoxelColumns& c, VoxelMesh& m, const VoxelTerrainParams& params,
+                         const QuantFrame& f,
+                         const PackedVoxelVertex* vertices, size_t vertexCount,
+                         const uint16_t* indices, size_t indexCount, float room)
+    : cols(c), mesh(m), frame(f), greedyMerge(params.greedyMerge), headroom(room) {
+    chunkSize     = params.chunkSize > 0 ? params.chunkSize : 32;
+    chunksPerSide = (cols.resolution + chunkSize - 1) / chunkSize;
+    if (headroom < 0.0f) headroom = 0.0f;
+
+    // Chunks start packed back to back; the tail takes the ones that grow
+    vertexData.resize(withHeadroom(vertexCount));
+    indexData.resize(withHeadroom(indexCount));
+    std::copy(vertices, vertices + vertexCount, vertexData.begin());
+    std::copy(indices, indices + indexCount, indexData.begin());
+    vertexEnd = vertexCount;
+    indexEnd  = indexCount;
+
+    slots.resize(mesh.chunks.size());
+    for (size_t i = 0; i < mesh.chunks.size(); ++i)
+        slots[i] = Slot{mesh.chunks[i].vertexCount, mesh.chunks[i].indexCount};
+    chunkDirty.assign(mesh.chunks.size(), 0);
+}
+
+void VoxelEditor::markChunk(int cx, int cz) {
+    if (cx < 0 || cz < 0 || cx >= chunksPerSide || cz >= chunksPerSide) return;
+    int c = cz * chunksPerSide + cx;
+    if (chunkDirty[c]) return;
+    chunkDirty[c] = 1;
+    dirtyChunks.push_back(c);
+}
+
+void VoxelEditor::markColumn(int x, int z) {
+    // Side faces of the neighbors depend on this column too, so a column
+    // on a chunk edge dirties the chunk across that edge
+    int cx = x / chunkSize, cz = z / chunkSize;
+    markChunk(cx, cz);
+    if (x % chunkSize == 0)             markChunk(cx - 1, cz);
+    if (x % chunkSize == chunkSize - 1) markChunk(cx + 1, cz);
+    if (z % chunkSize == 0)             markChunk(cx, cz - 1);
+    if (z % chunkSize == chunkSize - 1) markChunk(cx, cz + 1);
+    changedColumns.push_back((int)cols.index(x, z));
+    ++counters.columnsChanged;
+}
+
+bool VoxelEditor::setColumn(int x, int z, int top, int material) {
+    if (x < 0 || z < 0 || x >= cols.resolution || z >= cols.resolution) return false;
+    if (top < 0) top = 0;
+    if (material < 0) material = 0;
+    if (material > 2) material = 2;
+    size_t i = cols.index(x, z);
+    ++counters.edits;
+    if (cols.top[i] == top && cols.material[i] == material) return true;
+    cols.top[i] = top;
+    cols.material[i] = (unsigned char)material;
+    markColumn(x, z);
+    return true;
+}
+
+void VoxelEditor::fill(const VoxelEditRect& r, int top, int material) {
+    for (int x = std::max(r.x0, 0); x < std::min(r.x1, cols.resolution); ++x)
+        for (int z = std::max(r.z0, 0); z < std::min(r.z1, cols.resolution); ++z)
+            if (cols.top[cols.index(x, z)] < top) setColumn(x, z, top, material);
+}
+
+void VoxelEditor::carve(const VoxelEditRect& r, int top) {
+    for (int x = std::max(r.x0, 0); x < std::min(r.x1, cols.resolution); ++x) {
+        for (int z = std::max(r.z0, 0); z < std::min(r.z1, cols.resolution); ++z) {
+            size_t i = cols.index(x, z);
+            if (cols.top[i] > top) setColumn(x, z, top, cols.material[i]);
+        }
+    }
+}
+
+void VoxelEditor::carveSphere(Vec3 center, float radius) {
+    int x0 = (int)std::floor((center.x - radius - cols.originX) / cols.step);
+    int x1 = (int)std::floor((center.x + radius - cols.originX) / cols.step) + 1;
+    int z0 = (int)std::floor((center.z - radius - cols.originZ) / cols.step);
+    int z1 = (int)std::floor((center.z + radius - cols.originZ) / cols.step) + 1;
+    for (int x = std::max(x0, 0); x < std::min(x1, cols.resolution); ++x) {
+        for (int z = std::max(z0, 0); z < std::min(z1, cols.resolution); ++z) {
+            // Column centers inside the circle lose everything above the
+            // sphere's lower surface
+            float dx = cols.columnMinX(x) + cols.step * 0.5f - center.x;
+            float dz = cols.columnMinZ(z) + cols.step * 0.5f - center.z;
+            float d2 = dx * dx + dz * dz;
+            if (d2 >= radius * radius) continue;
+            float bottom = center.y - std::sqrt(radius * radius - d2);
+            long layer = (long)std::floor((bottom - cols.floorY) / cols.voxelHeight);
+            size_t i = cols.index(x, z);
+            if (cols.top[i] > layer) setColumn(x, z, layer > 0 ? (int)layer : 0, cols.material[i]);
+        }
+    }
+}
+
+bool VoxelEditor::update(ThreadPool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    uploadList.clear();
+    remeshedList.clear();
+
+    if (collision) {
+        for (int i : changedColumns)
+            collision->updateBox(i, voxelColumnBox(cols, i / cols.resolution, i % cols.resolution));
+        collision->refit();
+    }
+    if (heightQuery) {
+        for (int i : changedColumns)
+            heightQuery->updateColumn(cols, i / cols.resolution, i % cols.resolution);
+        heightQuery->refit();
+    }
+    for (int i : changedColumns)
+        mesh.collisionBoxes[i] = voxelColumnBox(cols, i / cols.resolution, i % cols.resolution);
+    changedColumns.clear();
+
+    // Mesh and pack on the pool, lay out on this thread
+    const int count = (int)dirtyChunks.size();
+    if (work.size() < (size_t)count) work.resize(count);
+    pool.parallelFor(count, [&](int i) {
+        int c = dirtyChunks[i];
+        Remeshed& w = work[i];
+        meshVoxelChunk(cols, c % chunksPerSide, c / chunksPerSide, chunkSize, greedyMerge, w.mesh);
+        size_t n = w.mesh.stats.vertices;
+        w.ok = n <= 65536;
+        if (!w.ok) return;
+        w.vertices.resize(n);
+        w.ok = encodeVoxelVertices(w.mesh.vertices.data(), n, frame, cols.palette, 3,
+                                   w.vertices.data());
+        w.indices.resize(w.mesh.indices.size());
+        for (size_t k = 0; k < w.indices.size(); ++k) w.indices[k] = (uint16_t)w.mesh.indices[k];
+    });
+
+    bool ok = true, needRepack = false;
+    for (int i = 0; i < count; ++i) {
+        int c = dirtyChunks[i];
+        Remeshed& w = work[i];
+        if (!w.ok) {
+            // Keeps its old mesh, which repack() must carry over
+            chunkDirty[c] = 0;
+            ok = false;
+            continue;
+        }
+        ChunkRange& r = mesh.chunks[c];
+        Slot& s = slots[c];
+        size_t nv = w.vertices.size(), ni = w.indices.size();
+        if (nv > s.vertexCapacity || ni > s.indexCapacity) {
+            size_t vcap = withHeadroom(nv), icap = withHeadroom(ni);
+            if (vertexEnd + vcap > vertexData.size() || indexEnd + icap > indexData.size()) {
+                needRepack = true;
+            } else {
+                // The old slot stays unused until the next repack
+                r.baseVertex = (unsigned)vertexEnd;
+                r.firstIndex = (unsigned)indexEnd;
+                s = Slot{vcap, icap};
+                vertexEnd += vcap;
+                indexEnd  += icap;
+                ++counters.chunksMoved;
+            }
+        }
+
+        mesh.stats.vertices  -= r.stats.vertices;
+        mesh.stats.triangles -= r.stats.triangles;
+        r.vertexCount = (unsigned)nv;
+        r.indexCount  = (unsigned)ni;
+        r.bounds = w.mesh.bounds;
+        r.stats  = w.mesh.stats;
+        mesh.stats.vertices  += r.stats.vertices;
+        mesh.stats.triangles += r.stats.triangles;
+        remeshedList.push_back(c);
+        ++counters.chunksRemeshed;
+        if (needRepack) continue;
+
+        std::copy(w.vertices.begin(), w.vertices.end(), vertexData.begin() + r.baseVertex);
+        std::copy(w.indices.begin(), w.indices.end(), indexData.begin() + r.firstIndex);
+        uploadList.push_back(VoxelUploadRange{r.baseVertex, nv, r.firstIndex, ni});
+    }
+
+    if (needRepack) {
+        // Chunks written above are already in place; the rest still waits
+        // in work and is copied by repack()
+        repack();
+        for (int i = 0; i < count; ++i) {
+            if (!work[i].ok) continue;
+            const ChunkRange& r = mesh.chunks[dirtyChunks[i]];
+            std::copy(work[i].vertices.begin(), work[i].vertices.end(),
+                      vertexData.begin() + r.baseVertex);
+            std::copy(work[i].indices.begin(), work[i].indices.end(),
+                      indexData.begin() + r.firstIndex);
+        }
+    }
+    for (int c : dirtyChunks) chunkDirty[c] = 0;
+    dirtyChunks.clear();
+
+    counters.lastUpdateMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
+
+void VoxelEditor::repack() {
+    // Every chunk gets its own headroom, in chunk order, and the tail
+    // keeps the same fraction again. Chunks that were remeshed this update
+    // are copied by the caller, so their old data is not carried over.
+    std::vector<size_t> vertexFrom(mesh.chunks.size()), indexFrom(mesh.chunks.size());
+    size_t vertexTotal = 0, indexTotal = 0;
+    for (size_t c = 0; c < mesh.chunks.size(); ++c) {
+        ChunkRange& r = mesh.chunks[c];
+        vertexFrom[c] = r.baseVertex;
+        indexFrom[c]  = r.firstIndex;
+        slots[c] = Slot{withHeadroom(r.vertexCount), withHeadroom(r.indexCount)};
+        r.baseVertex = (unsigned)vertexTotal;
+        r.firstIndex = (unsigned)indexTotal;
+        vertexTotal += slots[c].vertexCapacity;
+        indexTotal  += slots[c].indexCapacity;
+    }
+
+    std::vector<PackedVoxelVertex> vertices(withHeadroom(vertexTotal));
+    std::vector<uint16_t>          indices(withHeadroom(indexTotal));
+    for (size_t c = 0; c < mesh.chunks.size(); ++c) {
+        const ChunkRange& r = mesh.chunks[c];
+        if (chunkDirty[c]) continue;
+        std::copy(vertexData.begin() + vertexFrom[c],
+                  vertexData.begin() + vertexFrom[c] + r.vertexCount,
+                  vertices.begin() + r.baseVertex);
+        std::copy(indexData.begin() + indexFrom[c],
+                  indexData.begin() + indexFrom[c] + r.indexCount,
+                  indices.begin() + r.firstIndex);
+    }
+    vertexData.swap(vertices);
+    indexData.swap(indices);
+    vertexEnd = vertexTotal;
+    indexEnd  = indexTotal;
+
+    uploadList.clear();
+    fullUpload = true;
+    ++counters.repacks;
+}
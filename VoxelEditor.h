@@ -0,0 +1,130 @@
+// VoxelEditor.h
+// Runtime edits of the static TerraVoxel world. Edits change column
+// heights and mark the chunks whose faces they touch; update() remeshes
+// only those chunks on the pool, moves their collision boxes and height
+// query columns and writes the new packed data into a CPU copy of the GPU
+// buffers. The renderer then uploads just the ranges listed in uploads().
+#pragma once
+
+#include "MathTypes.h"
+#include "VertexFormat.h"
+#include "VoxelTerrain.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class CollisionIndex;
+class HeightfieldQuery;
+class ThreadPool;
+
+// Columns [x0, x1) x [z0, z1) of the grid; clipped to the grid by the editor
+struct VoxelEditRect {
+    int x0, z0, x1, z1;
+};
+
+// Part of the buffers to copy to the GPU, in vertices and indices
+struct VoxelUploadRange {
+    size_t firstVertex, vertexCount;
+    size_t firstIndex, indexCount;
+};
+
+struct VoxelEditStats {
+    size_t edits = 0, columnsChanged = 0;
+    size_t chunksRemeshed = 0;
+    size_t chunksMoved = 0;       // outgrew their slot and went to the buffer tail
+    size_t repacks = 0;           // tail ran out: everything was laid out again
+    double lastUpdateMs = 0.0;    // remesh + pack + collision of the last update()
+};
+
+class VoxelEditor {
+public:
+    // cols and mesh are the world the packed buffers were built from and
+    // are edited in place; both must outlive the editor. vertices and
+    // indices are the packVoxelMeshWorld() / localChunkIndices16() output.
+    // headroom is the fraction of extra room kept at the buffer tail and
+    // given to every slot that moves there.
+    VoxelEditor(VoxelColumns& cols, VoxelMesh& mesh, const VoxelTerrainParams& params,
+                const QuantFrame& frame,
+                const PackedVoxelVertex* vertices, size_t vertexCount,
+                const uint16_t* indices, size_t indexCount, float headroom = 0.25f);
+
+    // Boxes of the index are kept in step with mesh.collisionBoxes
+    void setCollision(CollisionIndex* index) { collision = index; }
+    // A query built from cols is kept in step with the column tops
+    void setHeightQuery(HeightfieldQuery* query) { heightQuery = query; }
+
+    // Column (x, z) becomes top layers of material; false outside the grid
+    bool setColumn(int x, int z, int top, int material);
+    // Raises every column in rect to at least top layers of material
+    void fill(const VoxelEditRect& rect, int top, int material);
+    // Lowers every column in rect to at most top layers
+    void carve(const VoxelEditRect& rect, int top);
+    // Removes the sphere and, since columns have no overhangs, everything
+    // above its lower surface
+    void carveSphere(Vec3 center, float radius);
+
+    bool dirty() const { return !dirtyChunks.empty(); }
+
+    // Remeshes the dirty chunks and refits the collision index and the
+    // height query. Clears the previous uploads. Returns false if a chunk
+    // could not be packed (more than 65536 vertices or off the int16
+    // lattice); the chunk keeps its old mesh then.
+    bool update(ThreadPool& pool);
+
+    // What the last update() changed. After a repack the whole buffer
+    // must be uploaded again and uploads() is empty.
+    const std::vector<VoxelUploadRange>& uploads() const { return uploadList; }
+    bool fullUploadNeeded() const { return fullUpload; }
+    void clearFullUpload() { fullUpload = false; }
+    // Chunks whose range or bounds changed in the last update()
+    const std::vector<int>& remeshed() const { return remeshedList; }
+
+    // CPU copy of the GPU buffers; the GPU buffers must be this large
+    const std::vector<PackedVoxelVertex>& vertices() const { return vertexData; }
+    const std::vector<uint16_t>&          indices() const { return indexData; }
+
+    const VoxelEditStats& stats() const { return counters; }
+
+private:
+    struct Slot {
+        size_t vertexCapacity, indexCapacity;
+    };
+
+    void markColumn(int x, int z);
+    void markChunk(int cx, int cz);
+    size_t withHeadroom(size_t n) const { return n + (size_t)(n * headroom); }
+    void repack();
+
+    VoxelColumns& cols;
+    VoxelMesh&    mesh;
+    QuantFrame    frame;
+    int   chunkSize, chunksPerSide;
+    bool  greedyMerge;
+    float headroom;
+    CollisionIndex* collision = nullptr;
+    HeightfieldQuery* heightQuery = nullptr;
+
+    std::vector<PackedVoxelVertex> vertexData;
+    std::vector<uint16_t>          indexData;
+    size_t vertexEnd = 0, indexEnd = 0;   // start of the unused tail
+    std::vector<Slot> slots;              // per chunk, where mesh.chunks puts it
+
+    std::vector<char> chunkDirty;
+    std::vector<int>  dirtyChunks;
+    std::vector<int>  changedColumns;
+
+    // Per dirty chunk results of update(), reused between calls
+    struct Remeshed {
+        VoxelChunkMesh mesh;
+        std::vector<PackedVoxelVertex> vertices;
+        std::vector<uint16_t>          indices;
+        bool ok;
+    };
+    std::vector<Remeshed> work;
+
+    std::vector<VoxelUploadRange> uploadList;
+    std::vector<int>              remeshedList;
+    bool fullUpload = false;
+    VoxelEditStats counters;
+};
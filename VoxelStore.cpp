@@ -0,0 +1,251 @@
+// VoxelStore.cpp
+#include "VoxelStore.h"
+#include "VoxelTerrain.h"
+
+#include <algorithm>
+
+static const int CHUNK_MASK = VOXEL_STORE_CHUNK - 1;
+
+// Floor division by the chunk size, negative coordinates included
+static int chunkOf(int v) {
+    return v >= 0 ? v >> VOXEL_STORE_CHUNK_SHIFT : ~(~v >> VOXEL_STORE_CHUNK_SHIFT);
+}
+
+// Voxel index inside its chunk; y fastest so a column is contiguous
+static int localIndex(int x, int y, int z) {
+    return ((x & CHUNK_MASK) << (2 * VOXEL_STORE_CHUNK_SHIFT)) |
+           ((z & CHUNK_MASK) << VOXEL_STORE_CHUNK_SHIFT) | (y & CHUNK_MASK);
+}
+
+// Narrowest index width that holds entries palette slots
+static int bitsFor(size_t entries) {
+    if (entries <= 1) return 0;
+    int bits = 1;
+    while (((size_t)1 << bits) < entries) bits *= 2;
+    return bits;
+}
+
+// One 21-bit field of a chunk key, sign extended
+static int chunkCoord(uint64_t key, int shift) {
+    return (int)((int64_t)(key << (43 - shift)) >> 43);
+}
+
+static size_t wordCount(int bits) {
+    return ((size_t)VOXEL_STORE_CHUNK_VOXELS * bits + 63) / 64;
+}
+
+void VoxelStore::Chunk::makeUniform(VoxelMaterial material) {
+    bits = 0;
+    uniform = material;
+    mixed.reset();
+}
+
+void VoxelStore::Chunk::repack(int newBits) {
+    std::vector<uint64_t> packed(wordCount(newBits), 0);
+    for (int i = 0; i < VOXEL_STORE_CHUNK_VOXELS; ++i) {
+        size_t bit = (size_t)i * newBits;
+        packed[bit >> 6] |= (uint64_t)index(i) << (bit & 63);
+    }
+    mixed->words.swap(packed);
+    bits = (uint8_t)newBits;
+}
+
+uint32_t VoxelStore::Chunk::slotFor(VoxelMaterial material) {
+    std::vector<VoxelMaterial>& palette = mixed->palette;
+    std::vector<uint16_t>& refs = mixed->refs;
+    uint32_t freeSlot = (uint32_t)palette.size();
+    for (uint32_t s = 0; s < palette.size(); ++s) {
+        if (refs[s] && palette[s] == material) return s;
+        if (!refs[s] && freeSlot == palette.size()) freeSlot = s;
+    }
+    if (freeSlot < palette.size()) {
+        palette[freeSlot] = material;
+        return freeSlot;
+    }
+    palette.push_back(material);
+    refs.push_back(0);
+    if (bitsFor(palette.size()) > bits) repack(bitsFor(palette.size()));
+    return freeSlot;
+}
+
+void VoxelStore::Chunk::setLocal(int i, VoxelMaterial material) {
+    if (!bits) {
+        if (uniform == material) return;
+        // One palette entry that every (zero) index points at
+        mixed.reset(new Mixed());
+        mixed->palette.assign(1, uniform);
+        mixed->refs.assign(1, (uint16_t)VOXEL_STORE_CHUNK_VOXELS);
+    }
+    uint32_t old = index(i);
+    if (mixed->palette[old] == material) return;
+    uint32_t slot = slotFor(material);
+    setIndex(i, slot);
+    --mixed->refs[old];
+    if (++mixed->refs[slot] == VOXEL_STORE_CHUNK_VOXELS) makeUniform(material);
+}
+
+const VoxelStore::Chunk* VoxelStore::find(int cx, int cy, int cz) const {
+    auto it = chunks.find(key(cx, cy, cz));
+    return it != chunks.end() ? &it->second : nullptr;
+}
+
+VoxelStore::Chunk& VoxelStore::obtain(int cx, int cy, int cz) {
+    return chunks[key(cx, cy, cz)];
+}
+
+VoxelMaterial VoxelStore::get(int x, int y, int z) const {
+    const Chunk* c = find(chunkOf(x), chunkOf(y), chunkOf(z));
+    return c ? c->at(localIndex(x, y, z)) : VOXEL_AIR;
+}
+
+void VoxelStore::set(int x, int y, int z, VoxelMaterial material) {
+    const uint64_t k = key(chunkOf(x), chunkOf(y), chunkOf(z));
+    auto it = chunks.find(k);
+    if (it == chunks.end()) {
+        if (material == VOXEL_AIR) return;
+        it = chunks.emplace(k, Chunk()).first;
+    }
+    Chunk& c = it->second;
+    c.setLocal(localIndex(x, y, z), material);
+    if (c.empty()) chunks.erase(it);
+}
+
+void VoxelStore::fill(int x0, int y0, int z0, int x1, int y1, int z1, VoxelMaterial material) {
+    if (x1 <= x0 || y1 <= y0 || z1 <= z0) return;
+    const int N = VOXEL_STORE_CHUNK;
+    for (int cx = chunkOf(x0); cx <= chunkOf(x1 - 1); ++cx)
+        for (int cy = chunkOf(y0); cy <= chunkOf(y1 - 1); ++cy)
+            for (int cz = chunkOf(z0); cz <= chunkOf(z1 - 1); ++cz) {
+                // The box in chunk-local voxels
+                int lx0 = std::max(x0 - cx * N, 0), lx1 = std::min(x1 - cx * N, N);
+                int ly0 = std::max(y0 - cy * N, 0), ly1 = std::min(y1 - cy * N, N);
+                int lz0 = std::max(z0 - cz * N, 0), lz1 = std::min(z1 - cz * N, N);
+                bool whole = lx0 == 0 && ly0 == 0 && lz0 == 0 && lx1 == N && ly1 == N && lz1 == N;
+                if (material == VOXEL_AIR && (whole || !find(cx, cy, cz))) {
+                    chunks.erase(key(cx, cy, cz));
+                    continue;
+                }
+                Chunk& c = obtain(cx, cy, cz);
+                if (whole) {
+                    c.makeUniform(material);
+                    continue;
+                }
+                for (int lx = lx0; lx < lx1; ++lx)
+                    for (int lz = lz0; lz < lz1; ++lz)
+                        for (int ly = ly0; ly < ly1; ++ly)
+                            c.setLocal(localIndex(lx, ly, lz), material);
+                if (c.empty()) chunks.erase(key(cx, cy, cz));
+            }
+}
+
+static void appendRun(std::vector<VoxelRun>& out, int y, int length, VoxelMaterial material) {
+    if (!out.empty()) {
+        VoxelRun& last = out.back();
+        if (last.material == material && last.y + last.length == y) {
+            last.length += length;
+            return;
+        }
+    }
+    out.push_back(VoxelRun{y, length, material});
+}
+
+void VoxelStore::columnRuns(int x, int z, int y0, int y1, std::vector<VoxelRun>& out) const {
+    out.clear();
+    const int cx = chunkOf(x), cz = chunkOf(z);
+    const int column = localIndex(x, 0, z);
+    for (int y = y0; y < y1;) {
+        const int ly = y & CHUNK_MASK;
+        const int length = std::min(y1 - y, VOXEL_STORE_CHUNK - ly);
+        const Chunk* c = find(cx, chunkOf(y), cz);
+        if (!c || !c->bits) {
+            appendRun(out, y, length, c ? c->uniform : VOXEL_AIR);
+        } else {
+            for (int i = 0; i < length; ++i)
+                appendRun(out, y + i, 1, c->mixed->palette[c->index(column + ly + i)]);
+        }
+        y += length;
+    }
+}
+
+void VoxelStore::compact() {
+    for (auto it = chunks.begin(); it != chunks.end();) {
+        Chunk& c = it->second;
+        if (!c.bits) {
+            ++it;
+            continue;
+        }
+        Mixed& m = *c.mixed;
+        std::vector<uint32_t> remap(m.palette.size());
+        Mixed kept;
+        for (size_t s = 0; s < m.palette.size(); ++s) {
+            if (!m.refs[s]) continue;
+            remap[s] = (uint32_t)kept.palette.size();
+            kept.palette.push_back(m.palette[s]);
+            kept.refs.push_back(m.refs[s]);
+        }
+        if (kept.palette.size() == 1) {
+            c.makeUniform(kept.palette[0]);
+        } else if (kept.palette.size() < m.palette.size()) {
+            const int bits = bitsFor(kept.palette.size());
+            kept.words.assign(wordCount(bits), 0);
+            for (int i = 0; i < VOXEL_STORE_CHUNK_VOXELS; ++i) {
+                size_t bit = (size_t)i * bits;
+                kept.words[bit >> 6] |= (uint64_t)remap[c.index(i)] << (bit & 63);
+            }
+            m = std::move(kept);
+            c.bits = (uint8_t)bits;
+        }
+        if (c.mixed) {
+            c.mixed->palette.shrink_to_fit();
+            c.mixed->refs.shrink_to_fit();
+            c.mixed->words.shrink_to_fit();
+        }
+        if (c.empty()) it = chunks.erase(it);
+        else ++it;
+    }
+}
+
+VoxelStoreStats VoxelStore::stats() const {
+    VoxelStoreStats s;
+    s.chunks = chunks.size();
+    // Roughly what a libstdc++ node costs: the pair, a next pointer and
+    // the cached hash
+    s.bytes = sizeof(*this) + chunks.bucket_count() * sizeof(void*) +
+              chunks.size() * (sizeof(std::pair<const uint64_t, Chunk>) + 2 * sizeof(void*));
+    int lo[3] = {0, 0, 0}, hi[3] = {-1, -1, -1};
+    bool first = true;
+    for (const auto& entry : chunks) {
+        const Chunk& c = entry.second;
+        if (c.mixed) {
+            const Mixed& m = *c.mixed;
+            s.paletteEntries += m.palette.size();
+            s.indexBytes += m.words.capacity() * sizeof(uint64_t);
+            s.bytes += sizeof(Mixed) + m.palette.capacity() * sizeof(VoxelMaterial) +
+                       m.refs.capacity() * sizeof(uint16_t) + m.words.capacity() * sizeof(uint64_t);
+        } else {
+            ++s.uniformChunks;
+            ++s.paletteEntries;
+        }
+        const int at[3] = {chunkCoord(entry.first, 42), chunkCoord(entry.first, 21),
+                           chunkCoord(entry.first, 0)};
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = first ? at[a] : std::min(lo[a], at[a]);
+            hi[a] = first ? at[a] : std::max(hi[a], at[a]);
+        }
+        first = false;
+    }
+    s.volume = (uint64_t)(hi[0] - lo[0] + 1) * (uint64_t)(hi[1] - lo[1] + 1) *
+               (uint64_t)(hi[2] - lo[2] + 1) * VOXEL_STORE_CHUNK_VOXELS;
+    if (s.volume) s.bytesPerVoxel = (double)s.bytes / s.volume;
+    s.denseBytes = s.volume * sizeof(VoxelMaterial);
+    return s;
+}
+
+void storeVoxelColumns(const VoxelColumns& cols, VoxelStore& out) {
+    for (int x = 0; x < cols.resolution; ++x)
+        for (int z = 0; z < cols.resolution; ++z) {
+            size_t i = cols.index(x, z);
+            if (cols.top[i] > 0)
+                out.fill(x, 0, z, x + 1, cols.top[i], z + 1, (VoxelMaterial)(cols.material[i] + 1));
+        }
+}
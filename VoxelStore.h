@@ -0,0 +1,115 @@
+// VoxelStore.h
+// Sparse voxel volume for worlds a dense grid could never hold. Space is
+// cut into 16^3 chunks kept in a hash map; each chunk has its own palette
+// of the materials it contains and bit-packed indices into it, 1, 2, 4, 8
+// or 16 bits per voxel so an index never straddles a word. A chunk of a
+// single material keeps no indices at all, and an all-air chunk is not
+// stored, so open sky and solid ground cost a few bytes per 4096 voxels.
+//
+// Voxels inside a chunk are laid out y fastest, so one column of a chunk
+// is 16 consecutive indices and columnRuns() walks it without a lookup
+// per voxel. Reads are safe from several threads; writes need the store
+// to themselves.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct VoxelColumns;
+
+typedef uint16_t VoxelMaterial;
+static const VoxelMaterial VOXEL_AIR = 0;
+
+static const int VOXEL_STORE_CHUNK_SHIFT  = 4;
+static const int VOXEL_STORE_CHUNK        = 1 << VOXEL_STORE_CHUNK_SHIFT;
+static const int VOXEL_STORE_CHUNK_VOXELS = VOXEL_STORE_CHUNK * VOXEL_STORE_CHUNK * VOXEL_STORE_CHUNK;
+
+// Voxels y .. y + length - 1 of a column share one material
+struct VoxelRun {
+    int y, length;
+    VoxelMaterial material;
+};
+
+struct VoxelStoreStats {
+    size_t   chunks = 0;           // stored chunks; the rest are air
+    size_t   uniformChunks = 0;    // one material, no indices
+    size_t   paletteEntries = 0;
+    size_t   indexBytes = 0;       // packed indices, 512 per chunk per index bit
+    size_t   bytes = 0;            // heap and map overhead included
+    uint64_t volume = 0;           // voxels in the bounding box of the stored chunks
+    double   bytesPerVoxel = 0.0;  // bytes / volume
+    uint64_t denseBytes = 0;       // the same box as a flat VoxelMaterial array
+};
+
+class VoxelStore {
+public:
+    // Chunk coordinates must fit in 21 bits (about +-16 million voxels)
+    VoxelMaterial get(int x, int y, int z) const;
+    void set(int x, int y, int z, VoxelMaterial material);
+
+    // Sets the box [x0, x1) x [y0, y1) x [z0, z1). Chunks the box covers
+    // become uniform without touching their indices.
+    void fill(int x0, int y0, int z0, int x1, int y1, int z1, VoxelMaterial material);
+
+    // Replaces out with the runs of column (x, z) over [y0, y1), air
+    // included, merged across chunk borders
+    void columnRuns(int x, int z, int y0, int y1, std::vector<VoxelRun>& out) const;
+
+    // Drops palette entries no voxel uses any more and narrows the indices.
+    // Chunks collapse to uniform on their own; palettes only ever grow
+    // otherwise.
+    void compact();
+
+    void   clear() { chunks.clear(); }
+    size_t chunkCount() const { return chunks.size(); }
+    VoxelStoreStats stats() const;
+
+private:
+    // Palette and indices of a chunk with more than one material
+    struct Mixed {
+        std::vector<VoxelMaterial> palette;
+        std::vector<uint16_t>      refs;      // voxels per palette entry; 0 = free slot
+        std::vector<uint64_t>      words;
+    };
+
+    // 16 bytes while uniform, which is most chunks of a large world
+    struct Chunk {
+        uint8_t       bits = 0;               // per index; 0 = every voxel is `uniform`
+        VoxelMaterial uniform = VOXEL_AIR;
+        std::unique_ptr<Mixed> mixed;         // null while uniform
+
+        uint32_t index(int i) const {
+            if (!bits) return 0;
+            size_t bit = (size_t)i * bits;
+            return (uint32_t)(mixed->words[bit >> 6] >> (bit & 63)) & ((1u << bits) - 1);
+        }
+        void setIndex(int i, uint32_t v) {
+            size_t bit = (size_t)i * bits;
+            uint64_t mask = (((uint64_t)1 << bits) - 1) << (bit & 63);
+            uint64_t& word = mixed->words[bit >> 6];
+            word = (word & ~mask) | ((uint64_t)v << (bit & 63));
+        }
+        VoxelMaterial at(int i) const { return bits ? mixed->palette[index(i)] : uniform; }
+        void makeUniform(VoxelMaterial material);
+        void repack(int newBits);
+        uint32_t slotFor(VoxelMaterial material);
+        void setLocal(int i, VoxelMaterial material);
+        bool empty() const { return bits == 0 && uniform == VOXEL_AIR; }
+    };
+
+    static uint64_t key(int cx, int cy, int cz) {
+        const uint64_t M = (1u << 21) - 1;
+        return (((uint64_t)cx & M) << 42) | (((uint64_t)cy & M) << 21) | ((uint64_t)cz & M);
+    }
+    const Chunk* find(int cx, int cy, int cz) const;
+    Chunk& obtain(int cx, int cy, int cz);
+
+    std::unordered_map<uint64_t, Chunk> chunks;
+};
+
+// Column terrain as voxels: column (x, z) of the grid holds layers
+// [0, top) at store x, z, with its palette index + 1 as the material
+void storeVoxelColumns(const VoxelColumns& cols, VoxelStore& out);
@@ -0,0 +1,393 @@
+// VoxelTerrain.cpp
+#include "VoxelTerrain.h"
+#include "MeshBuilder.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+// What addCube emitted per column, for MeshStats
+static const int CUBE_VERTICES  = 24;
+static const int CUBE_TRIANGLES = 12;
+
+static const Vec3 NORMAL_POS_X = { 1, 0, 0}, NORMAL_NEG_X = {-1, 0, 0};
+static const Vec3 NORMAL_POS_Y = { 0, 1, 0}, NORMAL_NEG_Y = { 0,-1, 0};
+static const Vec3 NORMAL_POS_Z = { 0, 0, 1}, NORMAL_NEG_Z = { 0, 0,-1};
+
+static void setupColumns(const VoxelTerrainParams& params, float originX, float originZ,
+                         int size, VoxelColumns& out) {
+    out.resolution  = size;
+    out.step        = params.worldSize / params.resolution;
+    out.originX     = originX;
+    out.originZ     = originZ;
+    out.floorY      = params.floorY;
+    out.voxelHeight = params.voxelHeight > 0.0f ? params.voxelHeight : out.step;
+    for (int i = 0; i < 3; ++i) out.palette[i] = params.palette[i];
+    out.top.assign((size_t)size * size, 0);
+    out.material.assign((size_t)size * size, 0);
+}
+
+// Samples the w x h block at (x0, z0) and snaps it to layers and materials
+static void fillColumns(const VoxelTerrainParams& params, const HeightSampler& sampleHeights,
+                        int x0, int z0, int w, int h, VoxelColumns& out) {
+    MeshArena& arena = threadMeshArena();
+    MeshArenaScope scope(arena);
+    float* wx      = arena.allocate<float>(w * h);
+    float* wz      = arena.allocate<float>(w * h);
+    float* heights = arena.allocate<float>(w * h);
+    for (int i = 0; i < w; ++i) {
+        for (int k = 0; k < h; ++k) {
+            wx[i * h + k] = out.originX + (x0 + i) * out.step + out.step * 0.5f;
+            wz[i * h + k] = out.originZ + (z0 + k) * out.step + out.step * 0.5f;
+        }
+    }
+    sampleHeights(wx, wz, w * h, heights);
+
+    for (int i = 0; i < w; ++i) {
+        for (int k = 0; k < h; ++k) {
+            float hgt = heights[i * h + k];
+            size_t c = out.index(x0 + i, z0 + k);
+            long layers = std::lround((hgt - out.floorY) / out.voxelHeight);
+            out.top[c] = layers > 0 ? (int)layers : 0;
+            if (hgt < params.grassH)     out.material[c] = 0;
+            else if (hgt < params.rockH) out.material[c] = 1;
+            else                         out.material[c] = 2;
+        }
+    }
+}
+
+void initVoxelColumns(const VoxelTerrainParams& params, VoxelColumns& out) {
+    const float halfWorld = params.worldSize * 0.5f;
+    setupColumns(params, -halfWorld, -halfWorld, params.resolution, out);
+}
+
+void generateVoxelColumns(const VoxelTerrainParams& params,
+                          const HeightSampler& sampleHeights,
+                          ThreadPool& pool, VoxelColumns& out) {
+    const int res = params.resolution;
+    initVoxelColumns(params, out);
+    parallelForTiles(pool, res, res, params.chunkSize, [&](int x0, int z0, int w, int h) {
+        fillColumns(params, sampleHeights, x0, z0, w, h, out);
+    });
+}
+
+void sampleVoxelColumns(const VoxelTerrainParams& params,
+                        const HeightSampler& sampleHeights,
+                        float originX, float originZ, int size, VoxelColumns& out) {
+    setupColumns(params, originX, originZ, size, out);
+    fillColumns(params, sampleHeights, 0, 0, size, size, out);
+}
+
+// Covers a U x V grid of face keys (-1 = no face) with rectangles of equal
+// key and calls emit(u, v, w, h, key) for each. mergeU/mergeV control
+// along which axes faces may be joined. The mask is consumed.
+template <class Emit>
+static void greedyRects(int* mask, int U, int V, bool mergeU, bool mergeV, Emit emit) {
+    for (int v = 0; v < V; ++v) {
+        for (int u = 0; u < U; ) {
+            int key = mask[v * U + u];
+            if (key < 0) { ++u; continue; }
+            int w = 1, h = 1;
+            if (mergeU)
+                while (u + w < U && mask[v * U + u + w] == key) ++w;
+            if (mergeV) {
+                for (; v + h < V; ++h) {
+                    int k = 0;
+                    while (k < w && mask[(v + h) * U + u + k] == key) ++k;
+                    if (k < w) break;
+                }
+            }
+            for (int j = 0; j < h; ++j)
+                for (int i = 0; i < w; ++i) mask[(v + j) * U + u + i] = -1;
+            emit(u, v, w, h, key);
+            u += w;
+        }
+    }
+}
+
+// Which way a merged face points
+enum FaceDir { FACE_TOP, FACE_BOTTOM, FACE_POS_X, FACE_NEG_X, FACE_POS_Z, FACE_NEG_Z };
+
+// One greedy rectangle before it becomes a quad: (u, v, w, h) in the
+// face's slice, which is column row `slice` for side faces
+struct FaceRect {
+    int dir, key;
+    int slice, u, v, w, h;
+    int layer;     // top faces: the column height in layers
+};
+
+// Corners in counter-clockwise order seen from the side the normal faces
+static void emitQuad(MeshBuilder& out, const Vec3 (&p)[4],
+                     const Vec3& normal, const Vec3& color) {
+    unsigned base = (unsigned)out.vertexCount();
+    float* v = out.addVertices(4);
+    for (int i = 0; i < 4; ++i, v += VOXEL_VERTEX_FLOATS) {
+        v[0] = p[i].x;   v[1] = p[i].y;   v[2] = p[i].z;
+        v[3] = normal.x; v[4] = normal.y; v[5] = normal.z;
+        v[6] = color.x;  v[7] = color.y;  v[8] = color.z;
+    }
+    out.addQuad(base);
+}
+
+static void emitFace(const VoxelColumns& cols, int X0, int Z0, const FaceRect& f,
+                     MeshBuilder& out) {
+    const Vec3& color = cols.palette[f.key];
+    if (f.dir == FACE_TOP || f.dir == FACE_BOTTOM) {
+        float x0 = cols.columnMinX(X0 + f.u), x1 = cols.columnMinX(X0 + f.u + f.w);
+        float z0 = cols.columnMinZ(Z0 + f.v), z1 = cols.columnMinZ(Z0 + f.v + f.h);
+        if (f.dir == FACE_TOP) {
+            float y = cols.layerY(f.layer);
+            Vec3 p[4] = {{x0, y, z0}, {x0, y, z1}, {x1, y, z1}, {x1, y, z0}};
+            emitQuad(out, p, NORMAL_POS_Y, color);
+        } else {
+            float y = cols.floorY;
+            Vec3 p[4] = {{x0, y, z0}, {x1, y, z0}, {x1, y, z1}, {x0, y, z1}};
+            emitQuad(out, p, NORMAL_NEG_Y, color);
+        }
+    } else if (f.dir == FACE_POS_X || f.dir == FACE_NEG_X) {
+        float X  = cols.columnMinX(X0 + f.slice + (f.dir == FACE_POS_X ? 1 : 0));
+        float z0 = cols.columnMinZ(Z0 + f.u), z1 = cols.columnMinZ(Z0 + f.u + f.w);
+        float y0 = cols.layerY(f.v), y1 = cols.layerY(f.v + f.h);
+        if (f.dir == FACE_POS_X) {
+            Vec3 p[4] = {{X, y0, z0}, {X, y1, z0}, {X, y1, z1}, {X, y0, z1}};
+            emitQuad(out, p, NORMAL_POS_X, color);
+        } else {
+            Vec3 p[4] = {{X, y0, z0}, {X, y0, z1}, {X, y1, z1}, {X, y1, z0}};
+            emitQuad(out, p, NORMAL_NEG_X, color);
+        }
+    } else {
+        float Z  = cols.columnMinZ(Z0 + f.slice + (f.dir == FACE_POS_Z ? 1 : 0));
+        float x0 = cols.columnMinX(X0 + f.u), x1 = cols.columnMinX(X0 + f.u + f.w);
+        float y0 = cols.layerY(f.v), y1 = cols.layerY(f.v + f.h);
+        if (f.dir == FACE_POS_Z) {
+            Vec3 p[4] = {{x0, y0, Z}, {x1, y0, Z}, {x1, y1, Z}, {x0, y1, Z}};
+            emitQuad(out, p, NORMAL_POS_Z, color);
+        } else {
+            Vec3 p[4] = {{x0, y0, Z}, {x0, y1, Z}, {x1, y1, Z}, {x1, y0, Z}};
+            emitQuad(out, p, NORMAL_NEG_Z, color);
+        }
+    }
+}
+
+void meshVoxelRegion(const VoxelColumns& cols, int X0, int Z0, int W, int D,
+                     bool greedyMerge, MeshBuilder& out, AABB& bounds, MeshStats& stats) {
+    // Scratch stays allocated until the caller's scope ends: rewinding
+    // here would also drop the builder's arrays if they share the arena
+    MeshArena& arena = threadMeshArena();
+    out.clear();
+
+    int maxTop = 0;
+    for (int i = 0; i < W; ++i)
+        for (int k = 0; k < D; ++k)
+            if (cols.top[cols.index(X0 + i, Z0 + k)] > maxTop)
+                maxTop = cols.top[cols.index(X0 + i, Z0 + k)];
+
+    auto keyAt = [&](int x, int z) { return (int)cols.material[cols.index(x, z)]; };
+    int maskSize = std::max(W * D, std::max(W, D) * maxTop);
+    int* mask       = arena.allocate<int>(maskSize);
+    int* bottomMask = arena.allocate<int>(W * D);
+
+    // Faces are collected first so the builder is sized exactly
+    ArenaArray<FaceRect> faces(arena);
+    faces.reserve((size_t)W * D * 2);
+    auto collect = [&](int dir, int slice) {
+        return [&faces, dir, slice](int u, int v, int w, int h, int key) {
+            FaceRect f;
+            f.dir = dir;
+            f.key = dir == FACE_TOP ? key & 255 : key;
+            f.slice = slice;
+            f.u = u;
+            f.v = v;
+            f.w = w;
+            f.h = h;
+            f.layer = dir == FACE_TOP ? key / 256 : 0;
+            faces.push_back(f);
+        };
+    };
+
+    // Tops (+y): same layer and material merge; bottoms (-y): same material
+    for (int k = 0; k < D; ++k) {
+        for (int i = 0; i < W; ++i) {
+            int t = cols.top[cols.index(X0 + i, Z0 + k)];
+            mask[k * W + i]       = t > 0 ? t * 256 + keyAt(X0 + i, Z0 + k) : -1;
+            bottomMask[k * W + i] = t > 0 ? keyAt(X0 + i, Z0 + k) : -1;
+        }
+    }
+    greedyRects(mask, W, D, greedyMerge, greedyMerge, collect(FACE_TOP, 0));
+    greedyRects(bottomMask, W, D, greedyMerge, greedyMerge, collect(FACE_BOTTOM, 0));
+
+    // Sides: one slice per column row, U along the row and V over layers.
+    // A layer is exposed where this column is solid and the neighbor is not.
+    // Without greedy merging each column still gets one quad per exposed span.
+    if (maxTop > 0) {
+        for (int dir = -1; dir <= 1; dir += 2) {
+            // x-facing slices
+            for (int i = 0; i < W; ++i) {
+                int x = X0 + i;
+                std::fill(mask, mask + D * maxTop, -1);
+                for (int k = 0; k < D; ++k) {
+                    int z = Z0 + k;
+                    int t = cols.top[cols.index(x, z)], n = cols.topAt(x + dir, z);
+                    for (int l = n; l < t; ++l) mask[l * D + k] = keyAt(x, z);
+                }
+                greedyRects(mask, D, maxTop, greedyMerge, true,
+                            collect(dir > 0 ? FACE_POS_X : FACE_NEG_X, i));
+            }
+            // z-facing slices
+            for (int k = 0; k < D; ++k) {
+                int z = Z0 + k;
+                std::fill(mask, mask + W * maxTop, -1);
+                for (int i = 0; i < W; ++i) {
+                    int x = X0 + i;
+                    int t = cols.top[cols.index(x, z)], n = cols.topAt(x, z + dir);
+                    for (int l = n; l < t; ++l) mask[l * W + i] = keyAt(x, z);
+                }
+                greedyRects(mask, W, maxTop, greedyMerge, true,
+                            collect(dir > 0 ? FACE_POS_Z : FACE_NEG_Z, k));
+            }
+        }
+    }
+
+    out.reserve(faces.size() * 4, faces.size() * 6);
+    for (const FaceRect& f : faces) emitFace(cols, X0, Z0, f, out);
+
+    bounds.min = {cols.columnMinX(X0), cols.floorY, cols.columnMinZ(Z0)};
+    bounds.max = {cols.columnMinX(X0 + W), cols.layerY(maxTop), cols.columnMinZ(Z0 + D)};
+
+    stats.naiveVertices  = (size_t)W * D * CUBE_VERTICES;
+    stats.naiveTriangles = (size_t)W * D * CUBE_TRIANGLES;
+    stats.vertices       = out.vertexCount();
+    stats.triangles      = out.indexCount() / 3;
+}
+
+void meshVoxelRegion(const VoxelColumns& cols, int X0, int Z0, int W, int D,
+                     bool greedyMerge, VoxelChunkMesh& out) {
+    MeshArenaScope scope(threadMeshArena());
+    MeshBuilder mesh(threadMeshArena(), VOXEL_VERTEX_FLOATS);
+    meshVoxelRegion(cols, X0, Z0, W, D, greedyMerge, mesh, out.bounds, out.stats);
+    out.vertices.assign(mesh.vertices(), mesh.vertices() + mesh.vertexCount() * VOXEL_VERTEX_FLOATS);
+    out.indices.assign(mesh.indices(), mesh.indices() + mesh.indexCount());
+}
+
+void meshVoxelChunk(const VoxelColumns& cols, int cx, int cz, int chunkSize,
+                    bool greedyMerge, VoxelChunkMesh& out) {
+    const int res = cols.resolution;
+    const int X0 = cx * chunkSize, Z0 = cz * chunkSize;
+    const int W  = res - X0 < chunkSize ? res - X0 : chunkSize;
+    const int D  = res - Z0 < chunkSize ? res - Z0 : chunkSize;
+    out.cx = cx;
+    out.cz = cz;
+    meshVoxelRegion(cols, X0, Z0, W, D, greedyMerge, out);
+}
+
+AABB voxelColumnBox(const VoxelColumns& cols, int x, int z) {
+    AABB box;
+    box.min = {cols.columnMinX(x), cols.floorY, cols.columnMinZ(z)};
+    box.max = {cols.columnMinX(x + 1), cols.layerY(cols.top[cols.index(x, z)]),
+               cols.columnMinZ(z + 1)};
+    return box;
+}
+
+void meshVoxelTerrain(const VoxelColumns& cols, const VoxelTerrainParams& params,
+                      ThreadPool& pool, VoxelMesh& out) {
+    const int res = cols.resolution;
+    const int C   = params.chunkSize > 0 ? params.chunkSize : 32;
+    const int perSide = (res + C - 1) / C;
+    const int count   = perSide * perSide;
+
+    std::vector<VoxelChunkMesh> chunks(count);
+    pool.parallelFor(count, [&](int c) {
+        meshVoxelChunk(cols, c % perSide, c / perSide, C, params.greedyMerge, chunks[c]);
+    });
+
+    // Prefix sums give every chunk a fixed slice of the combined buffers
+    out.chunks.resize(count);
+    out.stats = MeshStats();
+    out.voxelScale = {cols.step, cols.voxelHeight, cols.step};
+    for (int i = 0; i < 3; ++i) out.palette[i] = cols.palette[i];
+    size_t vertexTotal = 0, indexTotal = 0;
+    for (int c = 0; c < count; ++c) {
+        const VoxelChunkMesh& m = chunks[c];
+        ChunkRange& r = out.chunks[c];
+        r.cx = m.cx;
+        r.cz = m.cz;
+        r.firstIndex  = (unsigned)indexTotal;
+        r.indexCount  = (unsigned)m.indices.size();
+        r.baseVertex  = (unsigned)vertexTotal;
+        r.vertexCount = (unsigned)m.stats.vertices;
+        r.bounds = m.bounds;
+        r.stats  = m.stats;
+        vertexTotal += m.stats.vertices;
+        indexTotal  += m.indices.size();
+        out.stats.naiveVertices  += m.stats.naiveVertices;
+        out.stats.naiveTriangles += m.stats.naiveTriangles;
+        out.stats.vertices       += m.stats.vertices;
+        out.stats.triangles      += m.stats.triangles;
+    }
+    out.vertices.resize(vertexTotal * VOXEL_VERTEX_FLOATS);
+    out.indices.resize(indexTotal);
+    out.collisionBoxes.resize((size_t)res * res);
+
+    pool.parallelFor(count, [&](int c) {
+        const VoxelChunkMesh& m = chunks[c];
+        const ChunkRange& r = out.chunks[c];
+        std::copy(m.vertices.begin(), m.vertices.end(),
+                  out.vertices.begin() + (size_t)r.baseVertex * VOXEL_VERTEX_FLOATS);
+        unsigned* dst = out.indices.data() + r.firstIndex;
+        for (unsigned idx : m.indices) *dst++ = idx + r.baseVertex;
+
+        // Collision boxes for this chunk's columns
+        int X0 = m.cx * C, Z0 = m.cz * C;
+        for (int x = X0; x < X0 + C && x < res; ++x) {
+            for (int z = Z0; z < Z0 + C && z < res; ++z)
+                out.collisionBoxes[cols.index(x, z)] = voxelColumnBox(cols, x, z);
+        }
+    });
+}
+
+QuantFrame chunkQuantFrame(const VoxelMesh& mesh, const ChunkRange& chunk) {
+    return QuantFrame{chunk.bounds.min, mesh.voxelScale};
+}
+
+bool packVoxelMesh(const VoxelMesh& mesh, std::vector<PackedVoxelVertex>& out) {
+    out.resize(mesh.vertices.size() / VOXEL_VERTEX_FLOATS);
+    for (const ChunkRange& r : mesh.chunks) {
+        if (!encodeVoxelVertices(mesh.vertices.data() + (size_t)r.baseVertex * VOXEL_VERTEX_FLOATS,
+                                 r.vertexCount, chunkQuantFrame(mesh, r),
+                                 mesh.palette, 3, out.data() + r.baseVertex))
+            return false;
+    }
+    return true;
+}
+
+bool packVoxelMeshWorld(const VoxelMesh& mesh, QuantFrame& frame,
+                        std::vector<PackedVoxelVertex>& out) {
+    if (mesh.chunks.empty()) {
+        out.clear();
+        return true;
+    }
+    Vec3 origin = mesh.chunks[0].bounds.min;
+    for (const ChunkRange& r : mesh.chunks) origin = vmin(origin, r.bounds.min);
+    frame = QuantFrame{origin, mesh.voxelScale};
+    out.resize(mesh.vertices.size() / VOXEL_VERTEX_FLOATS);
+    return encodeVoxelVertices(mesh.vertices.data(), out.size(), frame, mesh.palette, 3,
+                               out.data());
+}
+
+bool localChunkIndices16(const VoxelMesh& mesh, std::vector<uint16_t>& out) {
+    out.resize(mesh.indices.size());
+    for (const ChunkRange& r : mesh.chunks) {
+        if (r.vertexCount > 65536) return false;
+        for (unsigned i = r.firstIndex; i < r.firstIndex + r.indexCount; ++i)
+            out[i] = (uint16_t)(mesh.indices[i] - r.baseVertex);
+    }
+    return true;
+}
+
+void generateVoxelTerrain(const VoxelTerrainParams& params,
+                          const HeightSampler& sampleHeights,
+                          ThreadPool& pool, VoxelMesh& out) {
+    VoxelColumns cols;
+    generateVoxelColumns(params, sampleHeights, pool, cols);
+    meshVoxelTerrain(cols, params, pool, out);
+}
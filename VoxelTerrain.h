@@ -0,0 +1,156 @@
+// VoxelTerrain.h
+// TerraVoxel column terrain: every (x, z) column is solid from the world
+// floor up to its height, in whole voxel layers, meshed chunk by chunk.
+#pragma once
+
+#include "MathTypes.h"
+#include "VertexFormat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class MeshBuilder;
+class ThreadPool;
+
+struct VoxelTerrainParams {
+    float worldSize  = 7880.0f;   // size of the giant cube in world units
+    int   resolution = 200;       // columns per side
+    int   chunkSize  = 32;        // columns per chunk side (one task, one draw range)
+
+    float floorY      = 0.0f;     // bottom of every column
+    float voxelHeight = 0.0f;     // height of one layer; 0 = cubic (worldSize / resolution)
+    bool  greedyMerge = true;     // merge coplanar same-color faces into larger quads
+
+    // Color thresholds and palette (material 0, 1, 2)
+    float grassH = 80.0f;
+    float rockH  = 160.0f;
+    Vec3  palette[3] = {{0.1f, 0.8f, 0.1f}, {0.5f, 0.4f, 0.3f}, {0.6f, 0.6f, 0.6f}};
+};
+
+// Fills h[i] with the world-space column height at (wx[i], wz[i]).
+// Called once per chunk from worker threads, so it must be thread-safe.
+typedef std::function<void(const float* wx, const float* wz, int count, float* h)>
+    HeightSampler;
+
+// Column grid, indexed [x * resolution + z] like the original loop
+struct VoxelColumns {
+    int   resolution = 0;
+    float step = 0.0f;
+    float originX = 0.0f, originZ = 0.0f;   // min corner of column (0, 0)
+    float floorY = 0.0f, voxelHeight = 0.0f;
+    std::vector<int>           top;        // solid layers above the floor
+    std::vector<unsigned char> material;   // palette index
+    Vec3  palette[3];
+
+    size_t index(int x, int z) const { return (size_t)x * resolution + z; }
+    int    topAt(int x, int z) const {
+        if (x < 0 || z < 0 || x >= resolution || z >= resolution) return 0;
+        return top[index(x, z)];
+    }
+    float  columnMinX(int x) const { return originX + x * step; }
+    float  columnMinZ(int z) const { return originZ + z * step; }
+    float  layerY(int layer) const { return floorY + layer * voxelHeight; }
+};
+
+// Before/after counts; "naive" is what addCube emitted (6 faces per column)
+struct MeshStats {
+    size_t naiveVertices = 0, naiveTriangles = 0;
+    size_t vertices = 0, triangles = 0;
+};
+
+// One chunk's mesh with chunk-local indices
+struct VoxelChunkMesh {
+    int cx = 0, cz = 0;
+    std::vector<float>    vertices;   // x,y,z, nx,ny,nz, r,g,b
+    std::vector<unsigned> indices;
+    AABB      bounds = {};
+    MeshStats stats;
+};
+
+// Where a chunk landed inside the combined buffers
+struct ChunkRange {
+    int cx, cz;
+    unsigned firstIndex, indexCount;
+    unsigned baseVertex, vertexCount;
+    AABB      bounds;
+    MeshStats stats;
+};
+
+struct VoxelMesh {
+    std::vector<float>      vertices;   // x,y,z, nx,ny,nz, r,g,b
+    std::vector<unsigned>   indices;    // already offset by each chunk's baseVertex
+    std::vector<AABB>       collisionBoxes;
+    std::vector<ChunkRange> chunks;
+    MeshStats               stats;      // totals over all chunks
+    Vec3                    voxelScale = {1, 1, 1};   // column width, layer height, column width
+    Vec3                    palette[3];
+};
+
+// Floats per vertex in the vertex arrays above
+static const int VOXEL_VERTEX_FLOATS = 9;
+
+// Static-world grid for params with every column empty, for filling
+// from saved heights
+void initVoxelColumns(const VoxelTerrainParams& params, VoxelColumns& out);
+
+// Samples heights chunk by chunk and snaps them to whole layers
+void generateVoxelColumns(const VoxelTerrainParams& params,
+                          const HeightSampler& sampleHeights,
+                          ThreadPool& pool, VoxelColumns& out);
+
+// Fills a size x size grid whose column (0, 0) starts at (originX, originZ),
+// on the calling thread. Streamed chunks use it with a one-column border.
+void sampleVoxelColumns(const VoxelTerrainParams& params,
+                        const HeightSampler& sampleHeights,
+                        float originX, float originZ, int size, VoxelColumns& out);
+
+// Meshes the w x d columns starting at (x0, z0). Faces against a taller or
+// equal neighbor are dropped; columns outside the region still count as
+// neighbors, and the edge of the grid counts as open.
+void meshVoxelRegion(const VoxelColumns& cols, int x0, int z0, int w, int d,
+                     bool greedyMerge, VoxelChunkMesh& out);
+
+// Same, into a builder with VOXEL_VERTEX_FLOATS floats per vertex. Scratch
+// comes from threadMeshArena() and is released by the caller's
+// MeshArenaScope, so a warm arena meshes without heap allocations.
+void meshVoxelRegion(const VoxelColumns& cols, int x0, int z0, int w, int d,
+                     bool greedyMerge, MeshBuilder& out, AABB& bounds, MeshStats& stats);
+
+// meshVoxelRegion() over chunk (cx, cz) of the grid
+void meshVoxelChunk(const VoxelColumns& cols, int cx, int cz, int chunkSize,
+                    bool greedyMerge, VoxelChunkMesh& out);
+
+// Collision box of column (x, z): from the floor to its top
+AABB voxelColumnBox(const VoxelColumns& cols, int x, int z);
+
+// Meshes every chunk in parallel and concatenates them in chunk order, so
+// the buffers are identical for any thread count. Also fills one
+// collision box per column.
+void meshVoxelTerrain(const VoxelColumns& cols, const VoxelTerrainParams& params,
+                      ThreadPool& pool, VoxelMesh& out);
+
+// Quantization frame of one chunk: its min corner and one voxel per step,
+// so every vertex lands exactly on an int16 lattice point
+QuantFrame chunkQuantFrame(const VoxelMesh& mesh, const ChunkRange& chunk);
+
+// Packs every chunk's vertices against its own frame into out (same
+// vertex order, so the index buffer is unchanged). 8 bytes per vertex.
+bool packVoxelMesh(const VoxelMesh& mesh, std::vector<PackedVoxelVertex>& out);
+
+// Packs the whole mesh against one frame at the min corner of all chunks,
+// so every chunk draws with the same origin and visible chunks can go out
+// in one multi-draw. Fails if the world spans more than the int16 lattice.
+bool packVoxelMeshWorld(const VoxelMesh& mesh, QuantFrame& frame,
+                        std::vector<PackedVoxelVertex>& out);
+
+// mesh.indices made chunk-local (minus each chunk's baseVertex) and
+// narrowed to 16 bits, for drawing chunk ranges with a base vertex. Fails
+// if a chunk has more than 65536 vertices.
+bool localChunkIndices16(const VoxelMesh& mesh, std::vector<uint16_t>& out);
+
+// generateVoxelColumns() followed by meshVoxelTerrain()
+void generateVoxelTerrain(const VoxelTerrainParams& params,
+                          const HeightSampler& sampleHeights,
+                          ThreadPool& pool, VoxelMesh& out);
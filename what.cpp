@@ -6,13 +6,21 @@
 // SSAO_Pipeline.cpp
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
-#include <thread>
-#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
 #include <vector>
-#include "Shader.h"    // Helper class for shader compile/link
 #include "GLUtils.h"   // FBO/texture creation helpers
-
-// Target FPS by device class
+#include "FramePacer.h"
+#include "Profiler.h"
+#include "ProfilerGL.h"
+#include "QualityController.h"
+#include "RenderGraph.h"
+#include "RenderGraphGL.h"
+#include "ShaderManagerGL.h"
+
+// Target FPS by device class; the quality controller finds the settings
+// that reach it on the hardware at hand
 enum DeviceClass { PC, TABLET, HIGH_END_PHONE, PHONE };
 int getTargetFPS(DeviceClass dc) {
     switch(dc) {
@@ -45,140 +53,250 @@ int main() {
     glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-    // 2. Allocate FBOs + textures for each pass
-    GLuint fboCanvas, texCanvas;
-    GLuint fboBlur,   texBlur;
-    GLuint fboSSAO,   texSSAO;
-    GLuint fboScatter,texScatter;
-    GLuint fboSheen,  texSheen;
-    GLuint fboShadows,texShadows;
-    GLuint fboGloss,  texGloss;
-
-    createColorFBO(1280, 720, fboCanvas,   texCanvas);
-    createColorFBO(1280, 720, fboBlur,     texBlur);
-    createColorFBO(1280, 720, fboSSAO,     texSSAO);
-    createColorFBO(1280, 720, fboScatter,  texScatter);
-    createColorFBO(1280, 720, fboSheen,    texSheen);
-    createColorFBO(1280, 720, fboShadows,  texShadows);
-    createColorFBO(1280, 720, fboGloss,    texGloss);
-
-    // 3. Compile shaders for each stage
-    Shader canvasShader("canvas.vert",   "canvas.frag");    // just clears white
-    Shader blurShader(  "quad.vert",     "gaussian.frag");
-    Shader ssaoShader(  "quad.vert",     "ssao.frag");
-    Shader scatterShader("quad.vert",    "scatter.frag");
-    Shader sheenShader( "quad.vert",     "sheen.frag");
-    Shader shadowShader("quad.vert",     "shadow_comp.frag");
-    Shader glossShader( "quad.vert",     "gloss.frag");
+    // 2. Compile shaders for each stage. Everything is issued at once and
+    // linked in the background; linked programs come from the binary cache
+    // after the first run.
+    GLShaderBackend shaderBackend;
+    ShaderManager shaders(shaderBackend);
+    ManagedShader canvasShader( shaders, shaders.addFiles("canvas",  "canvas.vert", "canvas.frag"));  // just clears white
+    ManagedShader blurShader(   shaders, shaders.addFiles("blur",    "quad.vert",   "gaussian.frag"));
+    ManagedShader ssaoShader(   shaders, shaders.addFiles("ssao",    "quad.vert",   "ssao.frag"));
+    ManagedShader scatterShader(shaders, shaders.addFiles("scatter", "quad.vert",   "scatter.frag"));
+    ManagedShader sheenShader(  shaders, shaders.addFiles("sheen",   "quad.vert",   "sheen.frag"));
+    ManagedShader shadowShader( shaders, shaders.addFiles("shadow",  "quad.vert",   "shadow_comp.frag"));
+    ManagedShader glossShader(  shaders, shaders.addFiles("gloss",   "quad.vert",   "gloss.frag"));
+    shaders.compileAll();
 
     // Choose device class; could be detected or set at runtime
     DeviceClass devClass = PC;
     int targetFPS = getTargetFPS(devClass);
-    double frameDuration = 1.0 / targetFPS;
+    // Absolute deadlines on steady_clock; sleeps, then spins the last bit
+    FramePacer pacer(targetFPS);
+    double lastReport = glfwGetTime();
+
+    // CPU phases and per-pass GPU time; the first frames go to a trace
+    const int TRACE_FRAMES = 300;
+    Profiler profiler;
+    GLProfilerBackend profilerGpu;
+    profiler.setGpuBackend(&profilerGpu);
+    profiler.startCapture();
 
     // Fullscreen quad VAO
     GLuint quadVAO = createScreenQuad();
 
-    while (!glfwWindowShouldClose(win)) {
-        // Frame‐rate limiter
-        auto t0 = std::chrono::high_resolution_clock::now();
-        
-        // PASS 1: White Canvas
-        glBindFramebuffer(GL_FRAMEBUFFER, fboCanvas);
-        canvasShader.use();
-        glClearColor(1,1,1,1);
-        glClear(GL_COLOR_BUFFER_BIT);
+    // Draws the fullscreen quad with the pass's inputs on units 0..n-1
+    auto drawQuad = [&](const RGPassContext& ctx, int inputs) {
+        PROFILE_ZONE(profiler, ctx.graph->passName(ctx.pass));
+        PROFILE_GPU_ZONE(profiler, ctx.graph->passName(ctx.pass));
+        for (int i = 0; i < inputs; ++i) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, ctx.input(i));
+        }
         glBindVertexArray(quadVAO);
         glDrawArrays(GL_TRIANGLES, 0, 6);
+    };
 
-        // PASS 2: Blur on white canvas
-        glBindFramebuffer(GL_FRAMEBUFFER, fboBlur);
-        blurShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texCanvas);
-        blurShader.setInt("uInputTex", 0);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+    // 3. Declare the passes; the graph allocates the targets. The canvas is
+    // a constant white clear, so it and its blur fold away, and targets
+    // whose lifetimes do not overlap share memory. The intermediate
+    // targets follow the quality level's render scale and the present pass
+    // scales them up, so the graph is declared again whenever the level
+    // changes.
+    const int SCREEN_W = 1280, SCREEN_H = 720;
+    QualityControllerParams qualityParams;
+    qualityParams.targetFps = targetFPS;
+    QualityController quality(qualityParams);
+    RenderGraph graph;
+    RGCompileStats rgStats;
+    auto buildGraph = [&](const QualityLevel& q) {
+        graph.release();
+        graph = RenderGraph();
+        RGTextureDesc screen;
+        screen.width = SCREEN_W;
+        screen.height = SCREEN_H;
+        RGTextureDesc scaled;
+        scaled.width  = std::max(1, (int)(SCREEN_W * q.renderScale + 0.5f));
+        scaled.height = std::max(1, (int)(SCREEN_H * q.renderScale + 0.5f));
+        int texCanvas    = graph.createTexture("canvas",    scaled);
+        int texBlur      = graph.createTexture("blur",      scaled);
+        int texSSAO      = graph.createTexture("ssao",      scaled);
+        int texScatter   = graph.createTexture("scatter",   scaled);
+        int texSheen     = graph.createTexture("sheen",     scaled);
+        int texSheenBlur = graph.createTexture("sheenBlur", scaled);
+        int texShadows   = graph.createTexture("shadows",   scaled);
+        int texGloss     = graph.createTexture("gloss",     scaled);
+        int backbuffer   = graph.importTexture("backbuffer", screen, 0);
 
-        // PASS 3: SSAO
-        glBindFramebuffer(GL_FRAMEBUFFER, fboSSAO);
-        ssaoShader.use();
-        ssaoShader.setInt("uNormalDepthTex", 0);
-        // bind depth+normal if available...
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        // PASS 1: White Canvas
+        const float white[4] = {1, 1, 1, 1};
+        int canvasPass = graph.addPass("canvas", {}, {texCanvas}, nullptr);
+        graph.setClearColor(canvasPass, white);
 
-        // PASS 4: Scattering
-        glBindFramebuffer(GL_FRAMEBUFFER, fboScatter);
-        scatterShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texBlur);
-        scatterShader.setInt("uBaseTex", 0);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        // PASS 2: Blur on white canvas
+        int blurPass = graph.addPass("blur", {texCanvas}, {texBlur}, [&](const RGPassContext& ctx) {
+            blurShader.use();
+            blurShader.setInt("uInputTex", 0);
+            blurShader.setInt("uRadius", quality.settings().blurRadius);
+            drawQuad(ctx, 1);
+        });
+        graph.setFold(blurPass, RenderGraph::foldIdentity);
 
-        // PASS 5: Sheen
-        glBindFramebuffer(GL_FRAMEBUFFER, fboSheen);
-        sheenShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texSSAO);
-        sheenShader.setInt("uOcclTex", 0);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        // PASS 3: SSAO
+        graph.addPass("ssao", {}, {texSSAO}, [&](const RGPassContext& ctx) {
+            ssaoShader.use();
+            ssaoShader.setInt("uNormalDepthTex", 0);
+            ssaoShader.setInt("uSamples", quality.settings().ssaoSamples);
+            // bind depth+normal if available...
+            drawQuad(ctx, 0);
+        });
+
+        // PASS 4: Scattering; when it is off the composite takes the blur
+        // directly and the graph culls the pass
+        graph.addPass("scatter", {texBlur}, {texScatter}, [&](const RGPassContext& ctx) {
+            scatterShader.use();
+            scatterShader.setInt("uBaseTex", 0);
+            drawQuad(ctx, 1);
+        });
+
+        // PASS 5: Sheen; when it is off it clears to white, full
+        // visibility, so the composite leaves the color alone and the sheen
+        // blur folds away as well
+        if (q.sheen) {
+            graph.addPass("sheen", {texSSAO}, {texSheen}, [&](const RGPassContext& ctx) {
+                sheenShader.use();
+                sheenShader.setInt("uOcclTex", 0);
+                drawQuad(ctx, 1);
+            });
+        } else {
+            int sheenPass = graph.addPass("sheen", {}, {texSheen}, nullptr);
+            graph.setClearColor(sheenPass, white);
+        }
 
         // PASS 6: Sheen → Blur map
-        glBindFramebuffer(GL_FRAMEBUFFER, fboBlur);
-        blurShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texSheen);
-        blurShader.setInt("uInputTex", 0);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        int sheenBlurPass = graph.addPass("sheenBlur", {texSheen}, {texSheenBlur},
+                                          [&](const RGPassContext& ctx) {
+            blurShader.use();
+            blurShader.setInt("uInputTex", 0);
+            blurShader.setInt("uRadius", quality.settings().blurRadius);
+            drawQuad(ctx, 1);
+        });
+        graph.setFold(sheenBlurPass, RenderGraph::foldIdentity);
 
         // PASS 7: Shadows & composite
-        glBindFramebuffer(GL_FRAMEBUFFER, fboShadows);
-        shadowShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texScatter);
-        shadowShader.setInt("uColorTex", 0);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texBlur);
-        shadowShader.setInt("uSheenBlurTex", 1);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        graph.addPass("shadows", {q.scatter ? texScatter : texBlur, texSheenBlur}, {texShadows},
+                      [&](const RGPassContext& ctx) {
+            shadowShader.use();
+            shadowShader.setInt("uColorTex", 0);
+            shadowShader.setInt("uSheenBlurTex", 1);
+            drawQuad(ctx, 2);
+        });
 
         // PASS 8: Glossiness spreading
-        glBindFramebuffer(GL_FRAMEBUFFER, fboGloss);
-        glossShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texShadows);
-        glossShader.setInt("uBaseTex", 0);
-        glossShader.setFloat("uGlossSpread", 1.0f); // tune per GPU
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        graph.addPass("gloss", {texShadows}, {texGloss}, [&](const RGPassContext& ctx) {
+            glossShader.use();
+            glossShader.setInt("uBaseTex", 0);
+            glossShader.setFloat("uGlossSpread", quality.settings().glossSpread);
+            drawQuad(ctx, 1);
+        });
 
         // Final: Present to screen
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClear(GL_COLOR_BUFFER_BIT);
-        blurShader.use();  // re‐use simple quad shader
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texGloss);
-        blurShader.setInt("uInputTex", 0);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        graph.addPass("present", {texGloss}, {backbuffer}, [&](const RGPassContext& ctx) {
+            glClear(GL_COLOR_BUFFER_BIT);
+            blurShader.use();  // re‐use simple quad shader
+            blurShader.setInt("uInputTex", 0);
+            blurShader.setInt("uRadius", 0);
+            drawQuad(ctx, 1);
+        });
+        graph.markOutput(backbuffer);
+
+        if (!graph.compile(&rgStats)) return false;
+        std::printf("Render graph at quality %d (%dx%d): %d passes (%d culled, %d folded), "
+                    "%d targets + %d constants, %.1f MB declared, %.1f MB live, %.1f MB aliased\n",
+                    quality.level(), scaled.width, scaled.height,
+                    rgStats.passes, rgStats.culledPasses, rgStats.foldedPasses,
+                    rgStats.physicalTargets, rgStats.constantTextures,
+                    rgStats.declaredBytes / 1048576.0, rgStats.unaliasedBytes / 1048576.0,
+                    rgStats.aliasedBytes / 1048576.0);
+        return true;
+    };
+    if (!buildGraph(quality.settings())) return 1;
+    GLRenderGraphBackend backend(SCREEN_W, SCREEN_H);
 
-        glfwSwapBuffers(win);
-        glfwPollEvents();
+    // The programs linked while the graph was set up
+    if (!shaders.wait()) return 1;
+    const ShaderManagerStats& sh = shaders.stats();
+    std::printf("Shaders: %d programs, %d cached, %d rejected, %.1f ms issue, %.1f ms wait\n",
+                sh.programs, sh.cacheHits, sh.cacheRejected, sh.issueMs, sh.finishMs);
 
-        // Frame‐rate lock 
-        auto t1 = std::chrono::high_resolution_clock::now();
-        double elapsed = std::chrono::duration<double>(t1 - t0).count();
-        if (elapsed < frameDuration) {
-            std::this_thread::sleep_for(
-                std::chrono::duration<double>(frameDuration - elapsed)
-            );
+    while (!glfwWindowShouldClose(win)) {
+        int64_t workNs = 0;
+        {
+            PROFILE_ZONE(profiler, "frame");
+            int64_t frameStart = profiler.nowNs();
+            {
+                PROFILE_ZONE(profiler, "graph");
+                graph.execute(backend);
+            }
+            {
+                PROFILE_ZONE(profiler, "swap");
+                glfwSwapBuffers(win);
+            }
+            {
+                PROFILE_ZONE(profiler, "poll");
+                glfwPollEvents();
+            }
+            workNs = profiler.nowNs() - frameStart;
+            // Frame‐rate lock
+            PROFILE_ZONE(profiler, "pace");
+            pacer.waitForNextFrame();
+        }
+        profiler.endFrame();
+        if (profiler.counters().frames == TRACE_FRAMES) profiler.stopCapture();
+
+        // The controller sees the frame's work without the pacing sleep:
+        // the CPU side, or the GPU passes if they took longer. GPU times
+        // arrive a few frames late, which its window absorbs; frames in
+        // which no GPU frame resolved are left out rather than counted as
+        // free on the GPU.
+        double gpuMs;
+        if (profiler.lastGpuFrame(gpuMs) &&
+            quality.addFrame(std::max(workNs * 1e-6, gpuMs)) && !buildGraph(quality.settings()))
+            return 1;
+
+        // Frame-time telemetry in the title, once a second
+        if (glfwGetTime() - lastReport >= 1.0) {
+            FrameTimeStats st = pacer.stats();
+            char title[160];
+            std::snprintf(title, sizeof(title),
+                          "SSAO Pipeline - %d fps target, quality %d/%d at %.0f%%, "
+                          "p50 %.2f ms, p99 %.2f ms, max %.2f ms",
+                          targetFPS, quality.level(), quality.levels() - 1,
+                          quality.settings().renderScale * 100.0f, st.p50Ms, st.p99Ms, st.maxMs);
+            glfwSetWindowTitle(win, title);
+            pacer.resetStats();
+            lastReport = glfwGetTime();
         }
     }
 
+    // Per-zone times over the last frames, and the trace of the first ones
+    for (const ProfileZoneStats& z : profiler.zoneStats())
+        std::printf("%-10s %s %6.3f ms mean, %6.3f ms max, %.1f calls/frame\n",
+                    z.name.c_str(), z.gpu ? "GPU" : "CPU", z.meanMs, z.maxMs, z.callsPerFrame);
+    if (!profiler.writeChromeTrace("ssao_trace.json"))
+        std::fprintf(stderr, "Could not write ssao_trace.json\n");
+
     // Cleanup
+    profiler.releaseGpu();
+    shaders.release();
+    graph.release();
     glfwDestroyWindow(win);
     glfwTerminate();
     return 0;
 }
 // main.cpp
+#include <algorithm>
 #include <cstdio>
+#include <string>
 #include <vector>
 #include <cmath>
 
@@ -190,60 +308,58 @@ int main() {
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "Heightfield.h"
+#include "HeightfieldQuery.h"
+#include "HeightTexture.h"
+#include "HeightTextureGL.h"
+#include "MeshCache.h"
+#include "TerrainLod.h"
+#include "ShaderManagerGL.h"
+#include "ThreadPool.h"
+#include "VertexFormatGL.h"
+
 // Window dimensions
 static const int WIDTH  = 800;
 static const int HEIGHT = 600;
 
-// Perlin noise helper (Ken Perlin’s improved noise)
-float perlinNoise(float x, float y) {
-    static int p[512], permutation[256] = {
-        151,160,137,91,90,15, // … fill in the standard 256 perm array …
-        // (complete with values 0–255 in a scrambled order)
-    };
-    static bool initialized = false;
-    if (!initialized) {
-        for (int i = 0; i < 256; ++i)
-            p[256 + i] = p[i] = permutation[i];
-        initialized = true;
-    }
-    auto fade = [](float t) { return t * t * t * (t * (t * 6 - 15) + 10); };
-    auto lerp = [](float a, float b, float t) { return a + t * (b - a); };
-    auto grad = [](int hash, float x, float y) {
-        switch (hash & 3) {
-            case 0: return  x + y;
-            case 1: return -x + y;
-            case 2: return  x - y;
-            case 3: return -x - y;
-        }
-        return 0.0f; // never happens
-    };
-
-    int xi = (int)std::floor(x) & 255;
-    int yi = (int)std::floor(y) & 255;
-    float xf = x - std::floor(x), yf = y - std::floor(y);
-    float u = fade(xf), v = fade(yf);
-
-    int aa = p[p[xi] + yi], ab = p[p[xi] + yi + 1];
-    int ba = p[p[xi + 1] + yi], bb = p[p[xi + 1] + yi + 1];
-
-    float x1 = lerp(grad(aa, xf,    yf),
-                    grad(ba, xf-1,  yf),    u);
-    float x2 = lerp(grad(ab, xf,    yf-1),
-                    grad(bb, xf-1,  yf-1),  u);
-    return (lerp(x1, x2, v) + 1.0f) * 0.5f; // normalize to [0,1]
-}
+// GPU displacement: the GPU keeps a 16-bit height texture and one shared
+// patch index buffer, and the vertex shader rebuilds position, morph
+// target and normal from the heights. Otherwise every grid point has a
+// packed vertex and a morph height in vertex buffers. Height edits
+// (right click) need the displacement mode.
+static const bool GPU_DISPLACEMENT = true;
 
 // Shader sources
 const char* vertSrc = R"glsl(
 #version 330 core
-layout(location=0) in vec3 aPos;
-layout(location=1) in vec3 aNormal;
+layout(location=0) in vec3 aPos;      // int16 steps from uQuantOrigin (or floats)
+layout(location=1) in vec2 aOct;      // octahedral normal (snorm8 or float)
+layout(location=2) in float aMorphY;  // coarser level's height, in the same steps
 out vec3 FragPos;
 out vec3 Normal;
 uniform mat4 model, view, projection;
+uniform vec3 uQuantOrigin, uQuantScale;
+uniform vec3 viewPos;
+uniform float uGridSpacing;
+uniform int uLevel;                   // LOD level of the patch being drawn
+uniform vec2 uMorphRange;             // camera distances where the morph runs 0 -> 1
+vec3 octDecode(vec2 e){
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
 void main(){
-    FragPos = vec3(model * vec4(aPos,1.0));
-    Normal  = mat3(transpose(inverse(model))) * aNormal;
+    vec3 pos = uQuantOrigin + aPos * uQuantScale;
+    // Points that the next level drops slide onto its surface with distance
+    ivec2 g = ivec2(round(pos.xz / uGridSpacing));
+    if ((((g.x | g.y) >> uLevel) & 1) != 0) {
+        float k = clamp((distance(pos, viewPos) - uMorphRange.x) /
+                        (uMorphRange.y - uMorphRange.x), 0.0, 1.0);
+        pos.y = mix(pos.y, uQuantOrigin.y + aMorphY * uQuantScale.y, k);
+    }
+    FragPos = vec3(model * vec4(pos,1.0));
+    Normal  = mat3(transpose(inverse(model))) * octDecode(aOct);
     gl_Position = projection * view * vec4(FragPos,1.0);
 }
 )glsl";
@@ -274,21 +390,6 @@ void main(){
 }
 )glsl";
 
-// Build and compile shaders
-GLuint compileShader(GLenum type, const char* src) {
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &src, nullptr);
-    glCompileShader(shader);
-    GLint ok;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
-    if (!ok) {
-        char buf[512];
-        glGetShaderInfoLog(shader, 512, nullptr, buf);
-        std::fprintf(stderr, "Shader compile error: %s\n", buf);
-    }
-    return shader;
-}
-
 int main(){
     if (!glfwInit()) return -1;
     GLFWwindow* win = glfwCreateWindow(WIDTH, HEIGHT, "Perlin Terrain", nullptr, nullptr);
@@ -297,80 +398,206 @@ int main(){
     glewExperimental = GL_TRUE;
     if (glewInit() != GLEW_OK) return -1;
 
-    // Generate terrain grid
-    const int SIZE = 200;
+    // The driver compiles and links while the terrain is generated
+    GLShaderBackend shaderBackend;
+    ShaderManager shaders(shaderBackend);
+    int terrainProgram = GPU_DISPLACEMENT
+        ? shaders.add("perlin-displace", HEIGHT_DISPLACE_VERT_SRC, fragSrc)
+        : shaders.add("perlin-terrain", vertSrc, fragSrc);
+    shaders.compileAll();
+
+    // Generate terrain grid; SIZE - 1 must be a multiple of the LOD patch size
+    const int SIZE = 257;
     const float SCALE = 0.1f;
-    std::vector<glm::vec3>  positions;
-    std::vector<glm::vec3>  normals;
-    std::vector<unsigned>   indices;
-
-    positions.reserve(SIZE * SIZE);
-    normals   .reserve(SIZE * SIZE);
-    // compute positions & normals placeholder
-    for (int z = 0; z < SIZE; ++z) {
-        for (int x = 0; x < SIZE; ++x) {
-            float fx = x * SCALE, fz = z * SCALE;
-            float y  = perlinNoise(fx, fz) * 10.0f;
-            positions.emplace_back(fx, y, fz);
-            normals.emplace_back(0,1,0); // temp; we’ll recalc
-        }
+
+    // heights, positions and indices are built tile by tile on the pool
+    ThreadPool pool;
+    HeightfieldParams params;
+    params.width = params.depth = SIZE;
+    params.scale = SCALE;
+    params.heightScale = 10.0f;
+    Heightfield field;
+    field.width = field.depth = SIZE;
+    field.spacing = SCALE;
+
+    TerrainLodParams lodParams;
+    lodParams.screenHeight = float(HEIGHT);
+    TerrainLod lod;
+
+    // Everything below depends only on these, so it comes from the cache
+    // when they match the last run. Bump the version whenever the code
+    // behind the cached arrays changes its output: the noise and
+    // generateHeightfield, computeGridNormals, the terrain vertex packing
+    // or TerrainLod's patch indices and morph heights.
+    const uint32_t PERLIN_TERRAIN_VERSION = 1;
+    MeshCacheKey key;
+    key.add("perlin-terrain").add(PERLIN_TERRAIN_VERSION).add(SIZE).add(SCALE).add(params.heightScale)
+       .add(params.fbm.octaves).add(params.fbm.lacunarity).add(params.fbm.gain)
+       .add(lodParams.patchCells).add(lodParams.maxLevels).add(GPU_DISPLACEMENT);
+    const std::string cachePath = meshCachePath(".", "terrain", key.value());
+    const uint32_t TAG_HEIGHTS = meshCacheTag("HGHT"), TAG_VERTICES = meshCacheTag("VERT"),
+                   TAG_MORPH = meshCacheTag("MRPH"), TAG_INDICES = meshCacheTag("INDX"),
+                   TAG_FRAME = meshCacheTag("FRAM");
+    MeshCacheFile cache;
+
+    QuantFrame frame;
+    std::vector<PackedTerrainVertex> packed;
+    std::vector<int16_t> morphPacked;
+    std::vector<FloatTerrainVertex> floatVertices;
+    std::vector<float> morphHeights;
+    std::vector<unsigned> indices;
+    size_t vertexCount = 0, morphCount = 0, indexCount = 0, frameCount = 0;
+    const PackedTerrainVertex* vertexData = nullptr;
+    const int16_t*  morphData = nullptr;
+    const unsigned* indexData = nullptr;
+    const QuantFrame* cachedFrame = nullptr;
+    // The displacement mode needs nothing but the heights
+    bool cached = cache.open(cachePath, key.value()) && cache.copy(TAG_HEIGHTS, field.heights) &&
+                  field.heights.size() == (size_t)SIZE * SIZE && lod.build(field, lodParams);
+    if (cached && !GPU_DISPLACEMENT) {
+        vertexData  = cache.array<PackedTerrainVertex>(TAG_VERTICES, vertexCount);
+        morphData   = cache.array<int16_t>(TAG_MORPH, morphCount);
+        indexData   = cache.array<unsigned>(TAG_INDICES, indexCount);
+        cachedFrame = cache.array<QuantFrame>(TAG_FRAME, frameCount);
+        cached = vertexData && morphData && indexData && cachedFrame && frameCount == 1;
+        if (cached) frame = *cachedFrame;
+    }
+    if (!cached) {
+        cache.close();
+        generateHeightfield(params, pool, field);
+        if (!lod.build(field, lodParams)) return -1;
     }
-    // build index list & compute normals
-    for (int z = 0; z < SIZE - 1; ++z) {
-        for (int x = 0; x < SIZE - 1; ++x) {
-            int i0 = z * SIZE + x;
-            int i1 = i0 + 1;
-            int i2 = i0 + SIZE;
-            int i3 = i2 + 1;
-            // two triangles: (i0,i2,i1) and (i1,i2,i3)
-            indices.push_back(i0); indices.push_back(i2); indices.push_back(i1);
-            indices.push_back(i1); indices.push_back(i2); indices.push_back(i3);
-            // calc normals for both
-            auto addNormal = [&](int a, int b, int c){
-                glm::vec3 U = positions[b] - positions[a];
-                glm::vec3 V = positions[c] - positions[a];
-                glm::vec3 N = glm::normalize(glm::cross(U, V));
-                normals[a] += N;
-                normals[b] += N;
-                normals[c] += N;
-            };
-            addNormal(i0,i2,i1);
-            addNormal(i1,i2,i3);
+    if (!cached && GPU_DISPLACEMENT) {
+        MeshCacheWriter writer;
+        writer.add(TAG_HEIGHTS, field.heights);
+        if (!writer.write(cachePath, key.value()))
+            std::fprintf(stderr, "Could not write mesh cache %s\n", cachePath.c_str());
+    } else if (!cached) {
+        std::vector<glm::vec3> positions(SIZE * SIZE);
+        std::vector<glm::vec3> normals(SIZE * SIZE);
+        buildGridPositions(field, pool, glm::value_ptr(positions[0]));
+        // normals straight from the height grid, one pass, rows in parallel
+        computeGridNormals(field, NORMALS_CENTRAL_DIFF, pool, glm::value_ptr(normals[0]));
+
+        // pack into 8-byte vertices: int16 position + octahedral normal
+        auto range = std::minmax_element(field.heights.begin(), field.heights.end());
+        AABB bounds = {{0.0f, *range.first, 0.0f},
+                       {(SIZE - 1) * SCALE, *range.second, (SIZE - 1) * SCALE}};
+        frame = makeQuantFrame(bounds);
+        packed.resize(positions.size());
+        bool quantized = encodeTerrainVertices(glm::value_ptr(positions[0]),
+                                               glm::value_ptr(normals[0]),
+                                               positions.size(), frame, packed.data());
+
+        // quadtree LOD: one index buffer per level shared by all of its patches,
+        // plus the height every point morphs to before its level drops it
+        indices.resize(lod.patchIndexCount() * lod.levels());
+        for (int level = 0; level < lod.levels(); ++level)
+            lod.buildPatchIndices(level, indices.data() + level * lod.patchIndexCount());
+        morphHeights.resize(SIZE * SIZE);
+        morphPacked.resize(SIZE * SIZE);
+        lod.buildMorphHeights(field, morphHeights.data());
+        quantized = quantized &&
+                    encodeHeights(morphHeights.data(), morphHeights.size(), frame, morphPacked.data());
+        indexData  = indices.data();
+        indexCount = indices.size();
+
+        if (quantized) {
+            MeshCacheWriter writer;
+            writer.add(TAG_HEIGHTS, field.heights);
+            writer.add(TAG_VERTICES, packed);
+            writer.add(TAG_MORPH, morphPacked);
+            writer.add(TAG_INDICES, indices);
+            writer.add(TAG_FRAME, &frame, 1, sizeof(frame));
+            if (!writer.write(cachePath, key.value()))
+                std::fprintf(stderr, "Could not write mesh cache %s\n", cachePath.c_str());
+
+            vertexData  = packed.data();
+            vertexCount = packed.size();
+            morphData   = morphPacked.data();
+            morphCount  = morphPacked.size();
+        } else {
+            // Only packed data is cached; the float vertices are rebuilt
+            // every run and drawn with the identity frame
+            std::fprintf(stderr, "Terrain does not fit its int16 frame; using float vertices\n");
+            floatVertices.resize(positions.size());
+            encodeFloatTerrainVertices(glm::value_ptr(positions[0]), glm::value_ptr(normals[0]),
+                                       positions.size(), floatVertices.data());
+            frame = QuantFrame{{0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}};
         }
     }
-    for (auto& n : normals) n = glm::normalize(n);
-
-    // upload to GPU
-    GLuint VAO, VBO[2], EBO;
+    const size_t patchIndices = lod.patchIndexCount();
+
+    // 16-bit copy of the heights with a min/max mipmap, for picking. It
+    // and the height texture keep the same headroom, so a raised bump
+    // clamps in neither or both.
+    const float EDIT_HEADROOM = 0.25f;
+    HeightfieldQuery picker;
+    picker.build(field, EDIT_HEADROOM);
+
+    // upload to GPU, straight from the cache mapping on a hit
+    GLuint VAO, VBO = 0, morphVBO = 0, EBO, heightTex = 0;
+    HeightTexture heights;
+    size_t gpuBytes;
     glGenVertexArrays(1, &VAO);
-    glGenBuffers(2, VBO);
     glGenBuffers(1, &EBO);
-
     glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3),
-                 positions.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,0,nullptr);
-    glEnableVertexAttribArray(0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[1]);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3),
-                 normals.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,0,nullptr);
-    glEnableVertexAttribArray(1);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                 indices.size()*sizeof(unsigned),
-                 indices.data(), GL_STATIC_DRAW);
-
-    // compile & link
-    GLuint vs = compileShader(GL_VERTEX_SHADER, vertSrc);
-    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragSrc);
-    GLuint prog = glCreateProgram();
-    glAttachShader(prog, vs);
-    glAttachShader(prog, fs);
-    glLinkProgram(prog);
+    if (GPU_DISPLACEMENT) {
+        // 2 bytes per grid point, and one patch of 16-bit indices for all nodes
+        heights.build(field, EDIT_HEADROOM);
+        heightTex = createHeightTexture(heights);
+        std::vector<uint16_t> sharedIndices(patchIndices);
+        lod.buildSharedPatchIndices(sharedIndices.data());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sharedIndices.size() * sizeof(uint16_t),
+                     sharedIndices.data(), GL_STATIC_DRAW);
+        gpuBytes = heights.bytes() + sharedIndices.size() * sizeof(uint16_t);
+    } else if (!floatVertices.empty()) {
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &morphVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, floatVertices.size() * sizeof(FloatTerrainVertex),
+                     floatVertices.data(), GL_STATIC_DRAW);
+        applyVertexLayout(FLOAT_TERRAIN_LAYOUT);
+        glBindBuffer(GL_ARRAY_BUFFER, morphVBO);
+        glBufferData(GL_ARRAY_BUFFER, morphHeights.size() * sizeof(float),
+                     morphHeights.data(), GL_STATIC_DRAW);
+        applyVertexLayout(FLOAT_MORPH_LAYOUT);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                     indexCount * sizeof(unsigned),
+                     indexData, GL_STATIC_DRAW);
+        gpuBytes = floatVertices.size() * sizeof(FloatTerrainVertex) +
+                   morphHeights.size() * sizeof(float) + indexCount * sizeof(unsigned);
+    } else {
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &morphVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedTerrainVertex),
+                     vertexData, GL_STATIC_DRAW);
+        applyVertexLayout(PACKED_TERRAIN_LAYOUT);
+        glBindBuffer(GL_ARRAY_BUFFER, morphVBO);
+        glBufferData(GL_ARRAY_BUFFER, morphCount * sizeof(int16_t),
+                     morphData, GL_STATIC_DRAW);
+        applyVertexLayout(LOD_MORPH_LAYOUT);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                     indexCount * sizeof(unsigned),
+                     indexData, GL_STATIC_DRAW);
+        gpuBytes = vertexCount * sizeof(PackedTerrainVertex) + morphCount * sizeof(int16_t) +
+                   indexCount * sizeof(unsigned);
+    }
+    cache.close();
+    std::printf("Terrain: %.1f KB on the GPU (%s)\n", gpuBytes / 1024.0,
+                GPU_DISPLACEMENT ? "height texture" : "vertex buffers");
+
+    if (!shaders.wait()) {
+        glfwTerminate();
+        return -1;
+    }
+    GLuint prog = shaders.program(terrainProgram);
     glUseProgram(prog);
 
     // uniforms
@@ -379,6 +606,12 @@ int main(){
     GLint projLoc       = glGetUniformLocation(prog, "projection");
     GLint lightPosLoc   = glGetUniformLocation(prog, "lightPos");
     GLint viewPosLoc    = glGetUniformLocation(prog, "viewPos");
+    GLint quantOrigLoc  = glGetUniformLocation(prog, "uQuantOrigin");
+    GLint quantScaleLoc = glGetUniformLocation(prog, "uQuantScale");
+    GLint spacingLoc    = glGetUniformLocation(prog, "uGridSpacing");
+    GLint levelLoc      = glGetUniformLocation(prog, "uLevel");
+    GLint morphLoc      = glGetUniformLocation(prog, "uMorphRange");
+    GLint patchOrigLoc  = glGetUniformLocation(prog, "uPatchOrigin");
 
     // camera setup
     glm::vec3 camPos(10,20,30), camTarget(10,0,10);
@@ -392,19 +625,90 @@ int main(){
     glUniformMatrix4fv(projLoc,  1, GL_FALSE, glm::value_ptr(proj));
     glUniform3f(lightPosLoc, 30.0f, 50.0f, 30.0f);
     glUniform3fv(viewPosLoc, 1, glm::value_ptr(camPos));
+    if (GPU_DISPLACEMENT) {
+        glUniform1i(glGetUniformLocation(prog, "uHeights"), 0);
+        glUniform2f(glGetUniformLocation(prog, "uHeightFrame"),
+                    heights.offset(), heights.step() * 65535.0f);
+        glUniform1i(glGetUniformLocation(prog, "uPatchWidth"), lod.sharedPatchWidth());
+    } else {
+        glUniform3f(quantOrigLoc,  frame.origin.x, frame.origin.y, frame.origin.z);
+        glUniform3f(quantScaleLoc, frame.scale.x,  frame.scale.y,  frame.scale.z);
+    }
+    glUniform1f(spacingLoc, field.spacing);
 
     glEnable(GL_DEPTH_TEST);
 
+    std::vector<LodPatch> patches;
+    bool wasPressed = false, wasRaising = false;
     while (!glfwWindowShouldClose(win)) {
+        // click to pick a point on the terrain; right click raises a bump there
+        bool pressed = glfwGetMouseButton(win, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        bool raising = GPU_DISPLACEMENT &&
+                       glfwGetMouseButton(win, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+        bool pick = pressed && !wasPressed, raise = raising && !wasRaising;
+        if (pick || raise) {
+            double mx, my;
+            glfwGetCursorPos(win, &mx, &my);
+            glm::vec4 viewport(0.0f, 0.0f, float(WIDTH), float(HEIGHT));
+            glm::vec2 cursor(float(mx), float(HEIGHT) - float(my));
+            glm::vec3 nearP = glm::unProject(glm::vec3(cursor, 0.0f), view, proj, viewport);
+            glm::vec3 dir   = glm::unProject(glm::vec3(cursor, 1.0f), view, proj, viewport) - nearP;
+            HeightfieldHit hit;
+            if (picker.raycast(Vec3{nearP.x, nearP.y, nearP.z}, Vec3{dir.x, dir.y, dir.z}, 1.0f, hit)) {
+                glm::vec3 p = nearP + dir * hit.t;
+                if (pick) std::printf("Picked (%.2f, %.2f, %.2f)\n", p.x, p.y, p.z);
+            }
+            if (raise && hit.x >= 0) {
+                // Only the texels of the bump go to the GPU. The LOD node
+                // bounds keep their old heights, which only shifts where
+                // the levels change.
+                const int R = 6;
+                HeightTexelRect rect = {hit.x - R, hit.z - R, hit.x + R + 1, hit.z + R + 1};
+                for (int z = std::max(rect.z0, 0); z < std::min(rect.z1, SIZE); ++z)
+                    for (int x = std::max(rect.x0, 0); x < std::min(rect.x1, SIZE); ++x) {
+                        float d = std::hypot(float(x - hit.x), float(z - hit.z)) / R;
+                        if (d >= 1.0f) continue;
+                        field.heights[(size_t)z * SIZE + x] += 0.5f * (1.0f - d * d);
+                        picker.updateHeight(field, x, z);
+                    }
+                picker.refit();
+                heights.update(field, rect);
+            }
+        }
+        wasPressed = pressed;
+        wasRaising = raising;
+        uploadHeightTexture(heightTex, heights);
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES,
-                       static_cast<GLsizei>(indices.size()),
-                       GL_UNSIGNED_INT, nullptr);
+        // triangle count follows distance to the camera, not grid size
+        lod.select(Vec3{camPos.x, camPos.y, camPos.z}, patches);
+        for (const LodPatch& p : patches) {
+            glUniform1i(levelLoc, p.level);
+            glUniform2f(morphLoc, p.morphStart, p.morphEnd);
+            glUniform2i(patchOrigLoc, p.x0, p.z0);
+            // whole patch, or just the quarters its children did not cover
+            size_t first   = GPU_DISPLACEMENT ? 0 : p.level * patchIndices;
+            size_t quarter = patchIndices / 4;
+            for (int q = 0; q < 4; ++q) {
+                if (!(p.quadrants & (1 << q))) continue;
+                size_t count = p.quadrants == 15 ? patchIndices : quarter;
+                if (GPU_DISPLACEMENT)
+                    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(count), GL_UNSIGNED_SHORT,
+                                   (void*)(q * quarter * sizeof(uint16_t)));
+                else
+                    glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(count),
+                                             GL_UNSIGNED_INT,
+                                             (void*)((first + q * quarter) * sizeof(unsigned)),
+                                             lod.patchBaseVertex(p));
+                if (p.quadrants == 15) break;
+            }
+        }
         glfwSwapBuffers(win);
         glfwPollEvents();
     }
 
+    shaders.release();
     glfwTerminate();
     return 0;
 }
@@ -414,12 +718,27 @@ int main(){
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
-#include <glm/gtc/noise.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "ChunkManager.h"
+#include "CollisionIndex.h"
+#include "FrustumCuller.h"
+#include "HeightfieldQuery.h"
+#include "MeshCache.h"
+#include "NoiseGraph.h"
+#include "ShaderManagerGL.h"
+#include "ThreadPool.h"
+#include "UploadRingGL.h"
+#include "VertexFormatGL.h"
+#include "VoxelEditor.h"
+#include "VoxelTerrain.h"
+
+#include <string>
 #include <vector>
+#include <unordered_map>
+#include <cstdio>
 #include <cstdlib>
-#include <ctime>
+#include <cstring>
 #include <thread>
 #include <chrono>
 
@@ -433,140 +752,132 @@ const float WORLD_SIZE = 7880.0f;
 // Number of voxels per side (adjust for performance)
 const int RESOLUTION = 200;
 
-// Noise parameters
+// Noise parameters; the same seed always gives the same world
+const uint32_t TERRAIN_SEED = 1337;
 const float NOISE_SCALE = 0.0015f;
 const float NOISE_AMPLITUDE = 200.0f;
 const float BASE_HEIGHT = 50.0f;
+const float WARP_STRENGTH = 0.6f;
 
 // Color thresholds
 const float GRASS_H = 80.0f;
 const float ROCK_H  = 160.0f;
 
-// Simple AABB for collisions
-struct AABB {
-    glm::vec3 min, max;
-};
-std::vector<AABB> collisionBoxes;
+// Streaming: build chunks around the camera on worker threads instead of
+// meshing the whole cube up front
+const bool   STREAM_WORLD       = true;
+const int    VIEW_RADIUS_CHUNKS = 8;
+const size_t CHUNK_CACHE_BYTES  = 64u << 20;
 
-// Mesh data
-std::vector<float> vertices;    // x,y,z, nx,ny,nz, r,g,b
-std::vector<unsigned int> indices;
+// Persistently mapped upload space: workers pack streamed chunks straight
+// into it and edits are staged through it; the GPU copies out of it
+const size_t UPLOAD_RING_BYTES  = 16u << 20;
+const float  CAMERA_SPEED       = 150.0f;   // world units per second along -z
 
-// Cube face definitions
-static const int FACE_IDX[6][4] = {
-    {0,1,2,3}, {4,5,6,7}, {1,5,6,2},
-    {0,4,7,3}, {3,2,6,7}, {0,1,5,4}
-};
-static const glm::vec3 FACE_NORMALS[6] = {
-    { 0, 0,  1}, { 0, 0, -1},
-    { 1, 0,  0}, {-1, 0,  0},
-    { 0, 1,  0}, { 0,-1,  0}
-};
-static const glm::vec3 CUBE_VERTS[8] = {
-    {-0.5f,-0.5f,-0.5f},{ 0.5f,-0.5f,-0.5f},
-    { 0.5f, 0.5f,-0.5f},{-0.5f, 0.5f,-0.5f},
-    {-0.5f,-0.5f, 0.5f},{ 0.5f,-0.5f, 0.5f},
-    { 0.5f, 0.5f, 0.5f},{-0.5f, 0.5f, 0.5f}
+// Static world edits: left click carves a crater, right click raises a
+// mound where the cursor ray hits the terrain
+const float CRATER_RADIUS = 160.0f;
+const int   MOUND_COLUMNS = 6;
+const int   MOUND_LAYERS  = 4;
+
+// Terrain mesh (x,y,z, nx,ny,nz, r,g,b per vertex), per-chunk ranges
+// and one collision box per column
+VoxelMesh terrain;
+
+// Column heights and materials the static mesh was built from; edits
+// change them and remesh the affected chunks
+VoxelColumns terrainColumns;
+
+// BVH over terrain.collisionBoxes for overlap, ray and sweep queries
+CollisionIndex terrainCollision;
+
+// Column tops with a min/max mipmap, for picking and line of sight
+HeightfieldQuery terrainHeights;
+
+// GPU buffers of one streamed chunk
+struct ChunkBuffers {
+    GLuint vao, vbo, ebo;
+    std::vector<IndexRange16> ranges;   // 16-bit index ranges with their base vertex
+    QuantFrame frame;
 };
 
-// Add one colored cube at 'center', size 's'
-void addCube(const glm::vec3& center, float s, const glm::vec3& color) {
-    glm::vec3 half = glm::vec3(s * 0.5f);
-    unsigned int baseIndex = vertices.size() / 9;
-    // Build vertices per face
-    for (int f = 0; f < 6; ++f) {
-        glm::vec3 normal = FACE_NORMALS[f];
-        int i0 = FACE_IDX[f][0], i1 = FACE_IDX[f][1],
-            i2 = FACE_IDX[f][2], i3 = FACE_IDX[f][3];
-        glm::vec3
-// continuation of main.cpp
+// Warped rolling hills, turning into ridged mountains where the
+// continent field is high. The continents are evaluated once per tile.
+typedef Shared<0, Fbm<3, SimplexNoise>> ContinentNoise;
+typedef Blend<DomainWarp<ContinentNoise, Fbm<5, GradientNoise>>,
+              Ridged<4, SimplexNoise>, ContinentNoise> TerrainShape;
+typedef ScaleBias<TerrainShape> TerrainNoise;
+
+TerrainNoise makeTerrainNoise(uint32_t seed) {
+    ContinentNoise continents(Fbm<3, SimplexNoise>(SimplexNoise(seed)));
+    TerrainShape shape(DomainWarp<ContinentNoise, Fbm<5, GradientNoise>>(
+                           continents, Fbm<5, GradientNoise>(GradientNoise(seed + 1)), WARP_STRENGTH),
+                       Ridged<4, SimplexNoise>(SimplexNoise(seed + 2)), continents);
+    return TerrainNoise(shape, NOISE_SCALE, NOISE_AMPLITUDE, BASE_HEIGHT);
+}
 
-// Push one cube into the global mesh and collision list
-void addCube(const glm::vec3& center, float s, const glm::vec3& color) {
-    glm::vec3 half = glm::vec3(s * 0.5f);
-    unsigned int startIndex = vertices.size() / 9;
-
-    // For each of the 6 faces
-    for (int f = 0; f < 6; ++f) {
-        glm::vec3 normal  = FACE_NORMALS[f];
-        int    i0 = FACE_IDX[f][0],
-               i1 = FACE_IDX[f][1],
-               i2 = FACE_IDX[f][2],
-               i3 = FACE_IDX[f][3];
-
-        // Push 4 verts: position, normal, color
-        glm::vec3 p0 = center + half * CUBE_VERTS[i0];
-        glm::vec3 p1 = center + half * CUBE_VERTS[i1];
-        glm::vec3 p2 = center + half * CUBE_VERTS[i2];
-        glm::vec3 p3 = center + half * CUBE_VERTS[i3];
-        for (auto& p : {p0, p1, p2, p3}) {
-            vertices.push_back(p.x);
-            vertices.push_back(p.y);
-            vertices.push_back(p.z);
-            vertices.push_back(normal.x);
-            vertices.push_back(normal.y);
-            vertices.push_back(normal.z);
-            vertices.push_back(color.r);
-            vertices.push_back(color.g);
-            vertices.push_back(color.b);
-        }
+const TerrainNoise terrainNoise = makeTerrainNoise(TERRAIN_SEED);
 
-        // Two triangles per face
-        indices.push_back(startIndex + 0);
-        indices.push_back(startIndex + 1);
-        indices.push_back(startIndex + 2);
-        indices.push_back(startIndex + 0);
-        indices.push_back(startIndex + 2);
-        indices.push_back(startIndex + 3);
+// Column heights for both the static and the streamed world
+void sampleTerrainHeights(const float* wx, const float* wz, int count, float* h) {
+    sampleNoise(terrainNoise, wx, wz, count, h);
+}
 
-        startIndex += 4;
+// Upload one packed voxel mesh into its own VAO. A chunk packed into the
+// upload ring is copied out of it on the GPU, with no CPU copy.
+ChunkBuffers uploadChunk(const StreamedChunk& chunk, const GLUploadRingBackend& ring) {
+    ChunkBuffers b;
+    glGenVertexArrays(1, &b.vao);
+    glGenBuffers(1, &b.vbo);
+    glGenBuffers(1, &b.ebo);
+    glBindVertexArray(b.vao);
+    const bool inRing = chunk.upload.bytes != 0;
+    glBindBuffer(GL_ARRAY_BUFFER, b.vbo);
+    glBufferData(GL_ARRAY_BUFFER, chunk.vertexBytes(),
+                 inRing ? nullptr : chunk.vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, b.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, chunk.indexBytes(),
+                 inRing ? nullptr : chunk.indices.data(), GL_STATIC_DRAW);
+    if (inRing) {
+        ring.copy(chunk.upload, 0, b.vbo, 0, chunk.vertexBytes());
+        ring.copy(chunk.upload, chunk.vertexBytes(), b.ebo, 0, chunk.indexBytes());
     }
-
-    // Add collision AABB
-    AABB box;
-    box.min = center - half;
-    box.max = center + half;
-    collisionBoxes.push_back(box);
+    applyVertexLayout(PACKED_VOXEL_LAYOUT);
+    b.ranges = chunk.ranges;
+    b.frame  = chunk.frame;
+    return b;
 }
 
-// Compile a single shader
-GLuint compileShader(GLenum type, const char* src) {
-    GLuint sh = glCreateShader(type);
-    glShaderSource(sh, 1, &src, nullptr);
-    glCompileShader(sh);
-    GLint ok = 0;
-    glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
-    if (!ok) std::exit(EXIT_FAILURE);
-    return sh;
+void freeChunk(ChunkBuffers& b) {
+    glDeleteVertexArrays(1, &b.vao);
+    glDeleteBuffers(1, &b.vbo);
+    glDeleteBuffers(1, &b.ebo);
 }
 
-// Link vertex and fragment into a program
-GLuint makeProgram(const char* vsSrc, const char* fsSrc) {
-    GLuint vs = compileShader(GL_VERTEX_SHADER,   vsSrc);
-    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fsSrc);
-    GLuint prog = glCreateProgram();
-    glAttachShader(prog, vs);
-    glAttachShader(prog, fs);
-    glLinkProgram(prog);
-    GLint ok = 0;
-    glGetProgramiv(prog, GL_LINK_STATUS, &ok);
-    if (!ok) std::exit(EXIT_FAILURE);
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-    return prog;
+void printUploadStats(const UploadRing& ring) {
+    if (!ring.valid()) return;
+    UploadRingStats st = ring.stats();
+    std::printf("Upload ring: %.1f MB in %llu slices, %.1f MB/s last frame, %llu full, "
+                "%llu stalls (%.2f ms), peak %zu KB of %zu KB\n",
+                st.bytes / 1048576.0, (unsigned long long)st.allocations, st.mbPerSecond,
+                (unsigned long long)st.failed, (unsigned long long)st.stalls, st.stallMs,
+                st.highWater / 1024, ring.capacity() / 1024);
 }
 
+// continuation of main.cpp
+
 // Simple GLSL shaders
 const char* vertexShaderSrc = R"GLSL(
 #version 330 core
-layout(location=0) in vec3 aPos;
-layout(location=1) in vec3 aNormal;
-layout(location=2) in vec3 aColor;
+layout(location=0) in vec3 aPos;          // voxel steps from uChunkOrigin
+layout(location=1) in uvec2 aFaceColor;   // face index, palette index
 uniform mat4 uMVP;
+uniform vec3 uChunkOrigin, uQuantScale;
+uniform vec3 uPalette[3];
 out vec3 vColor;
 void main() {
-    vColor = aColor;
-    gl_Position = uMVP * vec4(aPos, 1.0);
+    vColor = uPalette[aFaceColor.y];
+    gl_Position = uMVP * vec4(uChunkOrigin + aPos * uQuantScale, 1.0);
 }
 )GLSL";
 
@@ -593,6 +904,12 @@ int main() {
     // Load GL functions
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) std::exit(EXIT_FAILURE);
 
+    // Compiled and linked by the driver while the world is set up
+    GLShaderBackend shaderBackend;
+    ShaderManager shaders(shaderBackend);
+    int voxelProgram = shaders.add("terravoxel", vertexShaderSrc, fragmentShaderSrc);
+    shaders.compileAll();
+
     // Lock FPS: use swap interval 1 or 2 depending on refresh rate
     const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
     int interval = (mode->refreshRate >= 60 ? 1 : 2);
@@ -601,27 +918,211 @@ int main() {
     glEnable(GL_DEPTH_TEST);
 
     // Generate terrain
+
+    // Columns snap to whole voxels; chunks are meshed in parallel with hidden
+    // faces dropped and coplanar same-color faces merged
+    ThreadPool pool;
+    VoxelTerrainParams params;
+    params.worldSize  = WORLD_SIZE;
+    params.resolution = RESOLUTION;
+    params.grassH     = GRASS_H;
+    params.rockH      = ROCK_H;
+    params.floorY     = BASE_HEIGHT - NOISE_AMPLITUDE;  // lowest possible height
+
+    if (!shaders.wait()) {
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    GLuint shaderProg = shaders.program(voxelProgram);
+    glUseProgram(shaderProg);
+
+    // Uniform locations
+    GLint uMVPLoc         = glGetUniformLocation(shaderProg, "uMVP");
+    GLint uChunkOriginLoc = glGetUniformLocation(shaderProg, "uChunkOrigin");
+    GLint uQuantScaleLoc  = glGetUniformLocation(shaderProg, "uQuantScale");
+    GLint uPaletteLoc     = glGetUniformLocation(shaderProg, "uPalette");
+    glUniform3fv(uPaletteLoc, 3, &params.palette[0].x);
     float step = WORLD_SIZE / RESOLUTION;
-    float halfWorld = WORLD_SIZE * 0.5f;
-    srand((unsigned)time(nullptr));
-
-    for (int x = 0; x < RESOLUTION; ++x) {
-        for (int z = 0; z < RESOLUTION; ++z) {
-            float wx = -halfWorld + x * step + step * 0.5f;
-            float wz = -halfWorld + z * step + step * 0.5f;
-            float n  = glm::perlin(glm::vec2(wx, wz) * NOISE_SCALE);
-            float h  = BASE_HEIGHT + n * NOISE_AMPLITUDE;
-            glm::vec3 col;
-            if (h < GRASS_H)           col = glm::vec3(0.1f, 0.8f, 0.1f);
-            else if (h < ROCK_H)       col = glm::vec3(0.5f, 0.4f, 0.3f);
-            else                       col = glm::vec3(0.6f, 0.6f, 0.6f);
-            // center y is half the cube height
-            glm::vec3 center(wx, h * 0.5f, wz);
-            addCube(center, step, col);
+    glUniform3f(uQuantScaleLoc, step, step, step);
+
+    // Without persistent mapping both paths fall back to plain buffer uploads
+    GLUploadRingBackend ringBackend;
+    UploadRing uploadRing(ringBackend, UPLOAD_RING_BYTES);
+    if (!uploadRing.valid())
+        std::fprintf(stderr, "No persistent buffer mapping; uploading through glBufferData\n");
+
+    if (STREAM_WORLD) {
+        ChunkManagerParams streamParams;
+        streamParams.terrain      = params;
+        streamParams.viewRadius   = VIEW_RADIUS_CHUNKS;
+        streamParams.memoryBudget = CHUNK_CACHE_BYTES;
+        ChunkManager chunks(streamParams, sampleTerrainHeights, pool);
+        if (uploadRing.valid()) chunks.setUploadRing(&uploadRing);
+        std::unordered_map<ChunkKey, ChunkBuffers> gpuChunks;
+        FrustumCuller culler;
+        std::vector<AABB> chunkBoxes;
+        std::vector<int>  drawList;
+
+        double start = glfwGetTime();
+        while (!glfwWindowShouldClose(win)) {
+            glClearColor(0.53f, 0.81f, 0.92f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            // Fly over the terrain; chunks follow the eye position
+            float travel = float(glfwGetTime() - start) * CAMERA_SPEED;
+            glm::vec3 eye(0, 500, 1500 - travel);
+            chunks.update(eye.x, eye.z);
+            for (const auto& chunk : chunks.arrived())
+                gpuChunks[chunkKey(chunk->cx, chunk->cz)] = uploadChunk(*chunk, ringBackend);
+            for (ChunkKey key : chunks.evicted()) {
+                auto it = gpuChunks.find(key);
+                if (it == gpuChunks.end()) continue;
+                freeChunk(it->second);
+                gpuChunks.erase(it);
+            }
+
+            float ratio = float(WIN_W) / float(WIN_H);
+            glm::mat4 proj = glm::perspective(glm::radians(45.0f), ratio, 0.1f, 20000.0f);
+            glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0, -500, -1500),
+                                         glm::vec3(0, 1, 0));
+            glm::mat4 mvp  = proj * view;
+            glUniformMatrix4fv(uMVPLoc, 1, GL_FALSE, &mvp[0][0]);
+
+            // Only chunks inside the view frustum
+            Frustum frustum;
+            extractFrustum(&mvp[0][0], frustum);
+            chunkBoxes.clear();
+            for (ChunkKey key : chunks.visible()) chunkBoxes.push_back(chunks.find(key)->bounds);
+            culler.setBoxes(chunkBoxes.data(), (int)chunkBoxes.size());
+            drawList.clear();
+            culler.cull(frustum, drawList);
+            for (int i : drawList) {
+                const ChunkBuffers& b = gpuChunks[chunks.visible()[i]];
+                glUniform3f(uChunkOriginLoc, b.frame.origin.x, b.frame.origin.y, b.frame.origin.z);
+                glBindVertexArray(b.vao);
+                for (const IndexRange16& r : b.ranges)
+                    glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)r.indexCount, GL_UNSIGNED_SHORT,
+                                             (void*)(r.firstIndex * sizeof(uint16_t)),
+                                             (GLint)r.baseVertex);
+            }
+
+            glfwSwapBuffers(win);
+            uploadRing.endFrame();
+            glfwPollEvents();
         }
+
+        const ChunkStreamStats& st = chunks.stats();
+        std::printf("TerraVoxel streaming: %zu chunks generated, %zu evicted, %zu resident (%zu KB)\n",
+                    st.generated, st.evicted, st.resident, st.residentBytes / 1024);
+        if (st.failed)
+            std::fprintf(stderr, "TerraVoxel streaming: %zu chunks did not pack and were left empty\n",
+                         st.failed);
+        printUploadStats(uploadRing);
+        for (auto& entry : gpuChunks) freeChunk(entry.second);
+        uploadRing.unmap();
+        shaders.release();
+        glfwTerminate();
+        return EXIT_SUCCESS;
     }
 
-    // Upload mesh to GPU
+    // The static world depends only on these; a matching cache file
+    // replaces sampling, meshing and packing. Bump the version whenever
+    // sampleTerrainHeights, the column meshing, the voxel vertex packing or
+    // the 16-bit index split changes its output.
+    const uint32_t TERRAVOXEL_VERSION = 1;
+    MeshCacheKey key;
+    key.add("terravoxel").add(TERRAVOXEL_VERSION).add(TERRAIN_SEED).add(WARP_STRENGTH).add(NOISE_SCALE).add(NOISE_AMPLITUDE).add(BASE_HEIGHT)
+       .add(params.worldSize).add(params.resolution).add(params.chunkSize)
+       .add(params.floorY).add(params.voxelHeight).add(params.greedyMerge)
+       .add(params.grassH).add(params.rockH).add(params.palette, sizeof(params.palette));
+    const std::string cachePath = meshCachePath(".", "terravoxel", key.value());
+    const uint32_t TAG_VERTICES = meshCacheTag("VERT"), TAG_INDICES = meshCacheTag("IX16"),
+                   TAG_CHUNKS = meshCacheTag("CHNK"), TAG_COLLISION = meshCacheTag("COLL"),
+                   TAG_FRAME = meshCacheTag("FRAM"), TAG_STATS = meshCacheTag("STAT"),
+                   TAG_TOPS = meshCacheTag("TOPS"), TAG_MATERIALS = meshCacheTag("MATL");
+    MeshCacheFile cache;
+
+    // Pack to 8-byte vertices: int16 lattice position, face, palette index.
+    // One frame for the whole world so visible chunks go out in one multi-draw.
+    // Indices are chunk-local and 16-bit; each chunk draws with its base vertex.
+    std::vector<PackedVoxelVertex> packed;
+    std::vector<uint16_t> indices16;
+    QuantFrame worldFrame;
+    size_t vertexCount = 0, indexCount = 0, frameCount = 0, statCount = 0;
+    const PackedVoxelVertex* vertexData = nullptr;
+    const uint16_t* indexData = nullptr;
+    initVoxelColumns(params, terrainColumns);
+    bool cached = cache.open(cachePath, key.value()) &&
+                  cache.copy(TAG_CHUNKS, terrain.chunks) &&
+                  cache.copy(TAG_COLLISION, terrain.collisionBoxes) &&
+                  cache.copy(TAG_TOPS, terrainColumns.top) &&
+                  cache.copy(TAG_MATERIALS, terrainColumns.material) &&
+                  terrainColumns.top.size() == (size_t)RESOLUTION * RESOLUTION &&
+                  terrainColumns.material.size() == terrainColumns.top.size();
+    if (cached) {
+        vertexData = cache.array<PackedVoxelVertex>(TAG_VERTICES, vertexCount);
+        indexData  = cache.array<uint16_t>(TAG_INDICES, indexCount);
+        const QuantFrame* frame = cache.array<QuantFrame>(TAG_FRAME, frameCount);
+        const MeshStats*  stats = cache.array<MeshStats>(TAG_STATS, statCount);
+        cached = vertexData && indexData && frame && frameCount == 1 && stats && statCount == 1;
+        if (cached) {
+            worldFrame = *frame;
+            terrain.stats = *stats;
+        }
+    }
+    if (!cached) {
+        cache.close();
+        generateVoxelColumns(params, sampleTerrainHeights, pool, terrainColumns);
+        meshVoxelTerrain(terrainColumns, params, pool, terrain);
+        if (!packVoxelMeshWorld(terrain, worldFrame, packed)) std::exit(EXIT_FAILURE);
+        if (!localChunkIndices16(terrain, indices16)) std::exit(EXIT_FAILURE);
+
+        MeshCacheWriter writer;
+        writer.add(TAG_VERTICES, packed);
+        writer.add(TAG_INDICES, indices16);
+        writer.add(TAG_CHUNKS, terrain.chunks);
+        writer.add(TAG_COLLISION, terrain.collisionBoxes);
+        writer.add(TAG_FRAME, &worldFrame, 1, sizeof(worldFrame));
+        writer.add(TAG_STATS, &terrain.stats, 1, sizeof(terrain.stats));
+        writer.add(TAG_TOPS, terrainColumns.top);
+        writer.add(TAG_MATERIALS, terrainColumns.material);
+        if (!writer.write(cachePath, key.value()))
+            std::fprintf(stderr, "Could not write mesh cache %s\n", cachePath.c_str());
+
+        vertexData = packed.data();
+        vertexCount = packed.size();
+        indexData  = indices16.data();
+        indexCount = indices16.size();
+    }
+    std::printf("TerraVoxel mesh%s: %zu -> %zu vertices, %zu -> %zu triangles (%zu chunks)\n",
+                cached ? " (cached)" : "",
+                terrain.stats.naiveVertices, terrain.stats.vertices,
+                terrain.stats.naiveTriangles, terrain.stats.triangles,
+                terrain.chunks.size());
+
+    terrainCollision.build(terrain.collisionBoxes);
+    terrainHeights.build(terrainColumns);
+    // Keeps a CPU copy of both buffers with room for chunks that grow
+    VoxelEditor editor(terrainColumns, terrain, params, worldFrame,
+                       vertexData, vertexCount, indexData, indexCount);
+    editor.setCollision(&terrainCollision);
+    editor.setHeightQuery(&terrainHeights);
+    cache.close();
+    float groundY;
+    if (terrainHeights.heightAt(0.0f, 1500.0f, groundY))
+        std::printf("Ground under the camera: y = %.1f\n", groundY);
+    glUniform3f(uChunkOriginLoc, worldFrame.origin.x, worldFrame.origin.y, worldFrame.origin.z);
+
+    // Chunk bounds for the frustum culler
+    std::vector<AABB> chunkBounds;
+    for (const ChunkRange& chunk : terrain.chunks) chunkBounds.push_back(chunk.bounds);
+    FrustumCuller culler;
+    culler.setBoxes(chunkBounds.data(), (int)chunkBounds.size());
+    std::vector<int> visibleChunks;
+    DrawRanges drawRanges;
+
+    // Upload mesh to GPU from the editor's copy, tail room included; edits
+    // replace only the chunk ranges they touch
     GLuint vao, vbo, ebo;
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
@@ -630,31 +1131,18 @@ int main() {
 
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER,
-                 vertices.size() * sizeof(float),
-                 vertices.data(),
-                 GL_STATIC_DRAW);
+                 editor.vertices().size() * sizeof(PackedVoxelVertex),
+                 editor.vertices().data(),
+                 GL_DYNAMIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                 indices.size() * sizeof(unsigned int),
-                 indices.data(),
-                 GL_STATIC_DRAW);
-
-    // layout: 0=pos,1=normal,2=color
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float),
-                          (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float),
-                          (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    GLuint shaderProg = makeProgram(vertexShaderSrc, fragmentShaderSrc);
-    glUseProgram(shaderProg);
+                 editor.indices().size() * sizeof(uint16_t),
+                 editor.indices().data(),
+                 GL_DYNAMIC_DRAW);
 
-    // Uniform location
-    GLint uMVPLoc = glGetUniformLocation(shaderProg, "uMVP");
+    // layout: 0=lattice pos, 1=(face, palette index)
+    applyVertexLayout(PACKED_VOXEL_LAYOUT);
 
     // Main render loop
     while (!glfwWindowShouldClose(win)) {
@@ -671,13 +1159,90 @@ int main() {
         glm::mat4 mvp   = proj * view * model;
         glUniformMatrix4fv(uMVPLoc, 1, GL_FALSE, &mvp[0][0]);
 
+        // Edits are remeshed and uploaded before this frame draws
+        int button = glfwGetMouseButton(win, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS ? 0 :
+                     glfwGetMouseButton(win, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS ? 1 : -1;
+        if (button >= 0) {
+            double mx, my;
+            glfwGetCursorPos(win, &mx, &my);
+            glm::vec4 viewport(0.0f, 0.0f, float(WIN_W), float(WIN_H));
+            glm::vec2 cursor(float(mx), float(WIN_H) - float(my));
+            glm::vec3 nearP = glm::unProject(glm::vec3(cursor, 0.0f), view, proj, viewport);
+            glm::vec3 farP  = glm::unProject(glm::vec3(cursor, 1.0f), view, proj, viewport);
+            glm::vec3 dir   = farP - nearP;
+            HeightfieldHit hit;
+            if (terrainHeights.raycast(Vec3{nearP.x, nearP.y, nearP.z},
+                                       Vec3{dir.x, dir.y, dir.z}, 1.0f, hit)) {
+                glm::vec3 p = nearP + dir * hit.t;
+                if (button == 0) {
+                    editor.carveSphere(Vec3{p.x, p.y, p.z}, CRATER_RADIUS);
+                } else {
+                    size_t column = terrainColumns.index(hit.x, hit.z);
+                    int top = terrainColumns.top[column] + MOUND_LAYERS;
+                    editor.fill(VoxelEditRect{hit.x - MOUND_COLUMNS / 2, hit.z - MOUND_COLUMNS / 2,
+                                              hit.x + MOUND_COLUMNS / 2, hit.z + MOUND_COLUMNS / 2},
+                                top, terrainColumns.material[column]);
+                }
+            }
+        }
+        if (editor.dirty()) {
+            if (!editor.update(pool))
+                std::fprintf(stderr, "A terrain edit left a chunk too large to pack\n");
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+            if (editor.fullUploadNeeded()) {
+                glBufferData(GL_ARRAY_BUFFER, editor.vertices().size() * sizeof(PackedVoxelVertex),
+                             editor.vertices().data(), GL_DYNAMIC_DRAW);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, editor.indices().size() * sizeof(uint16_t),
+                             editor.indices().data(), GL_DYNAMIC_DRAW);
+                editor.clearFullUpload();
+            }
+            for (const VoxelUploadRange& u : editor.uploads()) {
+                // Staged through the ring so the draw buffers are never
+                // written while the GPU may still read them
+                const size_t vertexBytes = u.vertexCount * sizeof(PackedVoxelVertex);
+                const size_t indexBytes  = u.indexCount * sizeof(uint16_t);
+                UploadSlice slice;
+                if (uploadRing.allocate(vertexBytes + indexBytes, sizeof(PackedVoxelVertex), slice, true)) {
+                    std::memcpy(slice.data, editor.vertices().data() + u.firstVertex, vertexBytes);
+                    std::memcpy(slice.data + vertexBytes, editor.indices().data() + u.firstIndex, indexBytes);
+                    ringBackend.copy(slice, 0, vbo, u.firstVertex * sizeof(PackedVoxelVertex), vertexBytes);
+                    ringBackend.copy(slice, vertexBytes, ebo, u.firstIndex * sizeof(uint16_t), indexBytes);
+                    uploadRing.release(slice);
+                    continue;
+                }
+                glBufferSubData(GL_ARRAY_BUFFER, u.firstVertex * sizeof(PackedVoxelVertex),
+                                vertexBytes, editor.vertices().data() + u.firstVertex);
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, u.firstIndex * sizeof(uint16_t),
+                                indexBytes, editor.indices().data() + u.firstIndex);
+            }
+            for (int c : editor.remeshed()) culler.updateBox(c, terrain.chunks[c].bounds);
+        }
+
+        // Cull chunks against the frustum; each visible chunk is one range
+        // with its own base vertex
+        Frustum frustum;
+        extractFrustum(&mvp[0][0], frustum);
+        visibleChunks.clear();
+        culler.cull(frustum, visibleChunks);
+        drawRanges.clear();
+        for (int c : visibleChunks)
+            appendDrawRange(drawRanges, terrain.chunks[c].firstIndex, terrain.chunks[c].indexCount,
+                            (int)terrain.chunks[c].baseVertex, sizeof(uint16_t));
+
         glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawRanges.counts.data(), GL_UNSIGNED_SHORT,
+                                      drawRanges.offsets.data(), drawRanges.size(),
+                                      drawRanges.baseVertices.data());
 
         glfwSwapBuffers(win);
+        uploadRing.endFrame();
         glfwPollEvents();
     }
 
+    printUploadStats(uploadRing);
+    uploadRing.unmap();
+    shaders.release();
     glfwTerminate();
     return EXIT_SUCCESS;
 }